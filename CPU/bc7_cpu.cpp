@@ -0,0 +1,536 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bc7_cpu.h"
+#include "bc7_cpu_kernel.h"
+#include "cpu_features.h"
+#include "scoped_timer.h"
+
+#if defined(__BC7_CPU)
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The width and height of the tiles of 4x4 blocks that are handed out to the threads. 8x8 is the
+// same footprint as the local work size of the OpenCL version.
+#define BC7_CPU_TILE_SIZE		8
+
+// --------------------
+//
+// Enumerated Types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The tiles that belong to a thread. The thread takes its own tiles from the front, threads
+// that have run out of tiles steal from the back.
+struct bc7_cpu_tile_queue {
+
+	// Guards the tiles.
+	std::mutex m_mutex;
+
+	// The indices of the tiles that haven't been compressed yet.
+	std::deque< uint32_t > m_tiles;
+
+	// The number of tiles the thread compressed and how many of those it stole.
+	uint32_t m_num_tiles;
+	uint32_t m_num_stolen;
+
+	// The time the thread spent compressing tiles in seconds.
+	double m_busy_time;
+
+	// The number of mode evaluations the block classifier skipped in the thread's tiles.
+	uint64_t m_num_saved_evaluations;
+
+	// The number of evaluations that were pruned by the lower bound of the shape error in the
+	// thread's tiles.
+	uint64_t m_num_pruned_evaluations;
+};
+
+// The state shared between the worker threads.
+struct bc7_cpu_job {
+
+	// The compressed blocks for the entire image.
+	bc7_compressed_block* m_p_destination;
+
+	// The source image, and its pixels if they're already 32-bit RGBA so the kernel can read them
+	// straight out of it. Otherwise each tile is gathered in to 32-bit RGBA before it's compressed.
+	bc7_source const* m_p_source;
+	uint8_t const* m_p_pixels;
+
+	// The version of the kernel for the instruction set of this CPU.
+	bc7_cpu_kernel_function m_kernel;
+
+	// The encoding parameters.
+	bc7_encode_params const* m_p_params;
+
+	// The size of the image in 4x4 blocks.
+	uint32_t m_width_in_blocks;
+	uint32_t m_height_in_blocks;
+
+	// The size of the image in tiles.
+	uint32_t m_width_in_tiles;
+	uint32_t m_num_tiles;
+
+	// A queue of tiles for each thread.
+	bc7_cpu_tile_queue* m_p_queues;
+	uint32_t m_num_threads;
+
+	// The time it took to compress each tile in seconds.
+	double* m_p_tile_times;
+};
+
+// --------------------
+//
+// Global Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+// Whether the tiles, the threads and the evaluations that were skipped are printed after each call.
+static bool Report = false;
+
+// The instruction set is only printed by the first call.
+static std::once_flag Instruction_set_printed;
+
+// The version of the kernel for each instruction set.
+static bc7_cpu_kernel_function const Kernels[ CPU_INSTRUCTION_SET_COUNT ] = {
+
+	bc7_cpu_kernel_scalar,
+	bc7_cpu_kernel_sse2,
+	bc7_cpu_kernel_sse41,
+	bc7_cpu_kernel_avx2,
+	bc7_cpu_kernel_avx512
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Take the next tile from the front of a thread's own queue.
+//
+// p_queue:			(input/output) The queue of the thread.
+// p_tile_index:	(output) The index of the tile.
+//
+// returns: True if there was a tile.
+//
+static bool bc7_cpu_pop_tile(bc7_cpu_tile_queue* p_queue, uint32_t* p_tile_index)
+{
+	std::lock_guard< std::mutex > lock(p_queue->m_mutex);
+
+	if (p_queue->m_tiles.empty()) {
+
+		return false;
+	}
+
+	*p_tile_index = p_queue->m_tiles.front();
+	p_queue->m_tiles.pop_front();
+
+	return true;
+}
+
+// Steal a tile from the back of another thread's queue. The tiles at the back are the ones
+// furthest from where the owner is working.
+//
+// p_job:			(input/output) The job that is shared between the threads.
+// thread_index:	The index of the thread that is stealing.
+// p_tile_index:	(output) The index of the tile.
+//
+// returns: True if a tile was stolen, false if all the queues are empty.
+//
+static bool bc7_cpu_steal_tile(bc7_cpu_job* p_job, uint32_t thread_index, uint32_t* p_tile_index)
+{
+	for (uint32_t victim_iter = 1; victim_iter < p_job->m_num_threads; victim_iter++) {
+
+		bc7_cpu_tile_queue* p_victim = &p_job->m_p_queues[ (thread_index + victim_iter) % p_job->m_num_threads ];
+
+		std::lock_guard< std::mutex > lock(p_victim->m_mutex);
+
+		if (!p_victim->m_tiles.empty()) {
+
+			*p_tile_index = p_victim->m_tiles.back();
+			p_victim->m_tiles.pop_back();
+
+			return true;
+		}
+
+	} // end for
+
+	// Tiles are never added once the threads have started, so there's nothing left to do.
+	return false;
+}
+
+// Gather the pixels of a tile in to 32-bit RGBA and compress it, for sources the kernel can't read
+// straight out of.
+//
+// p_job:		(input/output) The job.
+// tile_x:		The horizontal index of the tile.
+// tile_y:		The vertical index of the tile.
+// p_stats:		(input/output) The counts of evaluations the kernel skipped.
+//
+static void bc7_cpu_compress_tile(bc7_cpu_job* p_job, uint32_t tile_x, uint32_t tile_y, bc7_cpu_kernel_stats* p_stats)
+{
+	// The tiles on the right and bottom edges can be smaller.
+	uint32_t const first_block_x = tile_x * BC7_CPU_TILE_SIZE;
+	uint32_t const first_block_y = tile_y * BC7_CPU_TILE_SIZE;
+	uint32_t num_blocks_x = p_job->m_width_in_blocks - first_block_x;
+	if (num_blocks_x > BC7_CPU_TILE_SIZE) {
+
+		num_blocks_x = BC7_CPU_TILE_SIZE;
+	}
+
+	uint32_t num_blocks_y = p_job->m_height_in_blocks - first_block_y;
+	if (num_blocks_y > BC7_CPU_TILE_SIZE) {
+
+		num_blocks_y = BC7_CPU_TILE_SIZE;
+	}
+
+	uint8_t pixels[ BC7_CPU_TILE_SIZE * BC7_CPU_TILE_SIZE * 64 ];
+	bc7_source_get_pixels(pixels, p_job->m_p_source, first_block_x * 4, first_block_y * 4, num_blocks_x * 4, num_blocks_y * 4);
+
+	// The tile is compressed as an image of its own and its rows of blocks are copied in to place.
+	bc7_compressed_block blocks[ BC7_CPU_TILE_SIZE * BC7_CPU_TILE_SIZE ];
+	p_job->m_kernel(blocks, pixels, num_blocks_x, num_blocks_y, 0, 0, num_blocks_x, num_blocks_y, p_job->m_p_params, p_stats);
+
+	for (uint32_t row_iter = 0; row_iter < num_blocks_y; row_iter++) {
+
+		memcpy(p_job->m_p_destination + (first_block_y + row_iter) * p_job->m_width_in_blocks + first_block_x,
+				 blocks + row_iter * num_blocks_x, num_blocks_x * sizeof(bc7_compressed_block));
+
+	} // end for
+}
+
+// The worker thread. This compresses the tiles in its own queue and then steals tiles from the
+// other threads until all of them are compressed.
+//
+// p_job:			(input/output) The job that is shared between the threads.
+// thread_index:	The index of the thread, this is also the index of its queue.
+//
+static void bc7_cpu_worker(bc7_cpu_job* p_job, uint32_t thread_index)
+{
+	bc7_cpu_tile_queue* p_queue = &p_job->m_p_queues[ thread_index ];
+
+	for (;;) {
+
+		uint32_t tile_index;
+		if (!bc7_cpu_pop_tile(p_queue, &tile_index)) {
+
+			if (!bc7_cpu_steal_tile(p_job, thread_index, &tile_index)) {
+
+				break;
+			}
+
+			p_queue->m_num_stolen++;
+		}
+
+		uint32_t const tile_x = tile_index % p_job->m_width_in_tiles;
+		uint32_t const tile_y = tile_index / p_job->m_width_in_tiles;
+
+		double const start_time = scoped_timer::get_time();
+
+		// The kernel fills its lanes with blocks from across the rows of the tile.
+		bc7_cpu_kernel_stats stats;
+		{
+			stats.m_num_saved_evaluations = 0;
+			stats.m_num_pruned_evaluations = 0;
+		}
+
+		if (p_job->m_p_pixels != NULL) {
+
+			p_job->m_kernel(p_job->m_p_destination, p_job->m_p_pixels,
+								 p_job->m_width_in_blocks, p_job->m_height_in_blocks,
+								 tile_x * BC7_CPU_TILE_SIZE, tile_y * BC7_CPU_TILE_SIZE,
+								 BC7_CPU_TILE_SIZE, BC7_CPU_TILE_SIZE, p_job->m_p_params, &stats);
+
+		} else {
+
+			bc7_cpu_compress_tile(p_job, tile_x, tile_y, &stats);
+		}
+
+		double const tile_time = scoped_timer::get_time() - start_time;
+
+		p_job->m_p_tile_times[ tile_index ] = tile_time;
+		p_queue->m_num_tiles++;
+		p_queue->m_busy_time += tile_time;
+		p_queue->m_num_saved_evaluations += stats.m_num_saved_evaluations;
+		p_queue->m_num_pruned_evaluations += stats.m_num_pruned_evaluations;
+
+	} // end for
+}
+
+// Print how long the tiles took and how the work was spread across the threads, this is
+// used to tune BC7_CPU_TILE_SIZE.
+//
+// p_job:	The job once all the threads have finished.
+//
+static void bc7_cpu_report_tile_times(bc7_cpu_job const* p_job)
+{
+	double min_time = p_job->m_p_tile_times[0];
+	double max_time = p_job->m_p_tile_times[0];
+	uint32_t slowest_tile = 0;
+	double total_time = 0.0;
+	for (uint32_t tile_iter = 0; tile_iter < p_job->m_num_tiles; tile_iter++) {
+
+		double const tile_time = p_job->m_p_tile_times[ tile_iter ];
+		if (tile_time < min_time) {
+
+			min_time = tile_time;
+		}
+
+		if (tile_time > max_time) {
+
+			max_time = tile_time;
+			slowest_tile = tile_iter;
+		}
+
+		total_time += tile_time;
+
+	} // end for
+
+	double const mean_time = total_time / p_job->m_num_tiles;
+
+	double variance = 0.0;
+	for (uint32_t tile_iter = 0; tile_iter < p_job->m_num_tiles; tile_iter++) {
+
+		double const difference = p_job->m_p_tile_times[ tile_iter ] - mean_time;
+		variance += difference * difference;
+
+	} // end for
+
+	variance /= p_job->m_num_tiles;
+
+	printf("%u tiles of %ux%u blocks : min %.3f ms, mean %.3f ms, max %.3f ms (tile %u, %u), std dev %.3f ms\n",
+			 p_job->m_num_tiles, BC7_CPU_TILE_SIZE, BC7_CPU_TILE_SIZE,
+			 min_time * 1000.0, mean_time * 1000.0, max_time * 1000.0,
+			 slowest_tile % p_job->m_width_in_tiles, slowest_tile / p_job->m_width_in_tiles,
+			 sqrt(variance) * 1000.0);
+
+	for (uint32_t thread_iter = 0; thread_iter < p_job->m_num_threads; thread_iter++) {
+
+		bc7_cpu_tile_queue const* p_queue = &p_job->m_p_queues[ thread_iter ];
+		printf("thread %u : %u tiles (%u stolen), %.3f seconds\n",
+				 thread_iter, p_queue->m_num_tiles, p_queue->m_num_stolen, p_queue->m_busy_time);
+
+	} // end for
+}
+
+// Print the instruction set the kernel is run with.
+//
+// instruction_set:	The instruction set.
+//
+static void bc7_cpu_print_instruction_set(cpu_instruction_set instruction_set)
+{
+	printf("CPU instruction set: %s\n", cpu_get_instruction_set_name(instruction_set));
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Print how the tiles were spread across the threads and how many evaluations were skipped after each
+// call, this is used to tune BC7_CPU_TILE_SIZE. It's off by default since every texture, band and mip
+// level is a call.
+//
+// report:	True to print the report.
+//
+void bc7_cpu_set_report(bool report)
+{
+	Report = report;
+}
+
+// Compress a texture to the BC7 format on the CPU straight from its source pixels. The image is
+// split in to tiles of 4x4 blocks which are spread across all the hardware threads, threads that
+// finish early steal tiles from the others.
+//
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cpu_compress_source(bc7_compressed_block* p_destination, bc7_source const* p_source,
+									  bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_cpu_compress");
+
+	size_t const width = p_source->m_width;
+	size_t const height = p_source->m_height;
+
+	if (width & 0x3) {
+
+		printf("The width of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (height & 0x3) {
+
+		printf("The height of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (!bc7_check_encode_params(p_params)) {
+
+		return false;
+	}
+
+	size_t const width_in_blocks = width / 4;
+	size_t const height_in_blocks = height / 4;
+
+	// Pick the version of the kernel for this CPU.
+	cpu_instruction_set const instruction_set = cpu_get_instruction_set();
+	std::call_once(Instruction_set_printed, bc7_cpu_print_instruction_set, instruction_set);
+
+	uint32_t const width_in_tiles = static_cast< uint32_t >((width_in_blocks + BC7_CPU_TILE_SIZE - 1) / BC7_CPU_TILE_SIZE);
+	uint32_t const height_in_tiles = static_cast< uint32_t >((height_in_blocks + BC7_CPU_TILE_SIZE - 1) / BC7_CPU_TILE_SIZE);
+	uint32_t const num_tiles = width_in_tiles * height_in_tiles;
+	if (num_tiles == 0) {
+
+		return true;
+	}
+
+	// Use all the hardware threads, there's no point in having more threads than tiles though.
+	uint32_t num_threads = std::thread::hardware_concurrency();
+	if (num_threads == 0) {
+
+		num_threads = 1;
+	}
+
+	if (num_threads > num_tiles) {
+
+		num_threads = num_tiles;
+	}
+
+	// Each thread starts with an even share of neighbouring tiles.
+	std::vector< bc7_cpu_tile_queue > queues(num_threads);
+	for (uint32_t thread_iter = 0; thread_iter < num_threads; thread_iter++) {
+
+		bc7_cpu_tile_queue* p_queue = &queues[ thread_iter ];
+		p_queue->m_num_tiles = 0;
+		p_queue->m_num_stolen = 0;
+		p_queue->m_busy_time = 0.0;
+		p_queue->m_num_saved_evaluations = 0;
+		p_queue->m_num_pruned_evaluations = 0;
+
+		uint32_t const first_tile = static_cast< uint32_t >((static_cast< uint64_t >(num_tiles) * thread_iter) / num_threads);
+		uint32_t const end_tile = static_cast< uint32_t >((static_cast< uint64_t >(num_tiles) * (thread_iter + 1)) / num_threads);
+		for (uint32_t tile_iter = first_tile; tile_iter < end_tile; tile_iter++) {
+
+			p_queue->m_tiles.push_back(tile_iter);
+
+		} // end for
+
+	} // end for
+
+	std::vector< double > tile_times(num_tiles, 0.0);
+
+	bc7_cpu_job job;
+	{
+		job.m_kernel = Kernels[ instruction_set ];
+		job.m_p_params = p_params;
+		job.m_p_destination = p_destination;
+		job.m_p_source = p_source;
+		job.m_p_pixels = bc7_source_is_rgba(p_source) ? p_source->m_p_top_row : NULL;
+		job.m_width_in_blocks = static_cast< uint32_t >(width_in_blocks);
+		job.m_height_in_blocks = static_cast< uint32_t >(height_in_blocks);
+		job.m_width_in_tiles = width_in_tiles;
+		job.m_num_tiles = num_tiles;
+		job.m_p_queues = &queues[0];
+		job.m_num_threads = num_threads;
+		job.m_p_tile_times = &tile_times[0];
+	}
+
+	// The calling thread does its share of the work too.
+	std::vector< std::thread > threads;
+	for (uint32_t thread_iter = 1; thread_iter < num_threads; thread_iter++) {
+
+		threads.push_back(std::thread(bc7_cpu_worker, &job, thread_iter));
+
+	} // end for
+
+	bc7_cpu_worker(&job, 0);
+
+	for (size_t thread_iter = 0; thread_iter < threads.size(); thread_iter++) {
+
+		threads[ thread_iter ].join();
+
+	} // end for
+
+	if (!Report) {
+
+		return true;
+	}
+
+	bc7_cpu_report_tile_times(&job);
+
+	uint64_t num_saved_evaluations = 0;
+	uint64_t num_pruned_evaluations = 0;
+	for (uint32_t thread_iter = 0; thread_iter < num_threads; thread_iter++) {
+
+		num_saved_evaluations += queues[ thread_iter ].m_num_saved_evaluations;
+		num_pruned_evaluations += queues[ thread_iter ].m_num_pruned_evaluations;
+
+	} // end for
+
+	printf("Block classifier skipped %llu mode evaluations (%.1f per block)\n",
+			 static_cast< unsigned long long >(num_saved_evaluations),
+			 static_cast< double >(num_saved_evaluations) / (width_in_blocks * height_in_blocks));
+
+	printf("Branch and bound pruned %llu evaluations (%.1f per block)\n",
+			 static_cast< unsigned long long >(num_pruned_evaluations),
+			 static_cast< double >(num_pruned_evaluations) / (width_in_blocks * height_in_blocks));
+
+	return true;
+}
+
+// Compress a texture to the BC7 format on the CPU.
+//
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cpu_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height,
+							 bc7_encode_params const* p_params)
+{
+	bc7_source source;
+	bc7_source_init_rgba(&source, p_source, width, height);
+
+	return bc7_cpu_compress_source(p_destination, &source, p_params);
+}
+
+#endif // #if defined(__BC7_CPU)
@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_H
+#define __BC7_CPU_H
+
+#include "bc7_gpu.h"
+
+#if defined(__BC7_CPU)
+
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+#include "bc7_source.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Print how the tiles were spread across the threads and how many evaluations were skipped after each
+// call, this is used to tune BC7_CPU_TILE_SIZE. It's off by default.
+//
+// report:	True to print the report.
+//
+void bc7_cpu_set_report(bool report);
+
+// Compress a texture to the BC7 format on the CPU straight from its source pixels. The image is
+// split in to tiles of 4x4 blocks which are spread across all the hardware threads, threads that
+// finish early steal tiles from the others. A source that isn't 32-bit RGBA is turned in to it a tile
+// at a time as the tiles are compressed.
+//
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cpu_compress_source(bc7_compressed_block* p_destination, bc7_source const* p_source,
+									  bc7_encode_params const* p_params);
+
+// Compress a texture to the BC7 format on the CPU.
+//
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+// 
+// returns: True if successful.
+//
+bool bc7_cpu_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height,
+							 bc7_encode_params const* p_params);
+
+#endif // #if defined(__BC7_CPU)
+
+#endif // __BC7_CPU_H
@@ -0,0 +1,739 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// The parts of the native port of OpenCL/BC7.opencl that don't depend on the instruction set: the
+// tables and the encoding of the final compressed block. The search itself is in bc7_cpu_kernel.inl.
+
+#include "bc7_cpu_kernel_internal.h"
+
+#if defined(__BC7_CPU)
+
+namespace bc7_cpu {
+
+//----------------------
+// Input
+//----------------------
+
+// Interpolation weights for different sized palettes.
+uint8_t const Palette_weights[ NUM_PALETTE_WEIGHTS ] = {
+
+	// 4 element palette
+	0, 21, 43, 64,
+
+	// 8 element palette
+	0, 9, 18, 27, 37, 46, 55, 64,
+
+	// 16 element palette
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+//----------------------
+// Constants
+//----------------------
+
+// Mode CB AB NS PB RB ISB EPB SPB IB IB2
+// ---- -- -- -- -- -- --- --- --- -- ---
+// 0    4  0  3  4  0  0   1   0   3  0
+// 1    6  0  2  6  0  0   0   1   3  0
+// 2    5  0  3  6  0  0   0   0   2  0
+// 3    7  0  2  6  0  0   1   0   2  0
+// 4    5  6  1  0  2  1   0   0   2  3
+// 5    7  8  1  0  2  0   0   0   2  2
+// 6    7  7  1  0  0  0   1   0   4  0
+// 7    5  5  2  6  0  0   1   0   2  0
+//
+// The columns are as as follows:
+//
+// CB: 	Color bits
+// AB: 	Alpha bits
+// NS: 	Number of subsets in each partition
+// PB: 	Partition bits
+// RB: 	Rotation bits
+// ISB: 	Index selection bits
+// EPB: 	Endpoint P-bits
+// SPB: 	Shared P-bits
+// IB: 	Index bits per element
+// IB2: 	Secondary index bits per element
+//
+bc7_mode const BC7_modes[ BC7_NUM_MODES ] = {
+
+	// Mode 0
+	{ 0, { 5, 5, 5, 0 }, 3, 4, 0, 0, PARITY_BIT_PER_ENDPOINT, 3, 8, 4, 0, 0, 0 },
+
+	// Mode 1
+	{ 1, { 7, 7, 7, 0 }, 2, 6, 0, 0, PARITY_BIT_SHARED, 3, 8, 4, 0, 0, 0 },
+
+	// Mode 2
+	{ 2, { 5, 5, 5, 0 }, 3, 6, 0, 0, PARITY_BIT_NONE, 2, 4, 0, 0, 0, 0 },
+
+	// Mode 3
+	{ 3, { 8, 8, 8, 0 }, 2, 6, 0, 0, PARITY_BIT_PER_ENDPOINT, 2, 4, 0, 0, 0, 0 },
+
+	// Mode 4
+	{ 4, { 5, 5, 5, 6 }, 1, 0, 2, 1, PARITY_BIT_NONE, 2, 4, 0, 3, 8, 4 },
+
+	// Mode 5
+	{ 5, { 7, 7, 7, 8 }, 1, 0, 2, 0, PARITY_BIT_NONE, 2, 4, 0, 2, 4, 0 },
+
+	// Mode 6
+	{ 6, { 8, 8, 8, 8 }, 1, 0, 0, 0, PARITY_BIT_PER_ENDPOINT, 4, 16, 12, 0, 0, 0 },
+
+	// Mode 7
+	{ 7, { 6, 6, 6, 6 }, 2, 6, 0, 0, PARITY_BIT_PER_ENDPOINT, 2, 4, 0, 0, 0, 0 }
+};
+
+// The order the modes are searched in. The shapes of a mode are skipped when they can't beat the
+// best error of the modes before it, so the single subset modes go first since they only have one
+// shape and are often close to the best. The 3 subset modes are the least likely to win so they
+// go last.
+uint8_t const Mode_search_order[ BC7_NUM_MODES ] = { 5, 6, 4, 1, 3, 7, 0, 2 };
+
+// This table determines how pixels are partitioned up in the subsets.
+//
+uint8_t const Partition_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ NUM_PIXELS_PER_BLOCK ] =
+{
+	{   // 1 Region case has no subsets (all 0)
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+	},
+
+	{   // BC6H/BC7 Partition Set for 2 Subsets
+    	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1 }, // Shape 0
+    	{ 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1 }, // Shape 1
+    	{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1 }, // Shape 2
+    	{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 1, 1, 1 }, // Shape 3
+    	{ 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1 }, // Shape 4
+    	{ 0, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 }, // Shape 5
+    	{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 }, // Shape 6
+    	{ 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 1 }, // Shape 7
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1 }, // Shape 8
+    	{ 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, // Shape 9
+    	{ 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1 }, // Shape 10
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 1 }, // Shape 11
+    	{ 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, // Shape 12
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1 }, // Shape 13
+    	{ 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, // Shape 14
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 }, // Shape 15
+    	{ 0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1, 0, 1, 1, 1, 1 }, // Shape 16
+    	{ 0, 1, 1, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 }, // Shape 17
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1, 0 }, // Shape 18
+    	{ 0, 1, 1, 1, 0, 0, 1, 1, 0, 0, 0, 1, 0, 0, 0, 0 }, // Shape 19
+    	{ 0, 0, 1, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 }, // Shape 20
+    	{ 0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0 }, // Shape 21
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 0, 0 }, // Shape 22
+    	{ 0, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0, 1 }, // Shape 23
+    	{ 0, 0, 1, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0 }, // Shape 24
+    	{ 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1, 0, 0 }, // Shape 25
+    	{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0 }, // Shape 26
+    	{ 0, 0, 1, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0, 0 }, // Shape 27
+    	{ 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0 }, // Shape 28
+    	{ 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0 }, // Shape 29
+    	{ 0, 1, 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 1, 0 }, // Shape 30
+    	{ 0, 0, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0, 0 }, // Shape 31
+	
+     	// BC7 Partition Set for 2 Subsets (second-half)
+     	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1 }, // Shape 32
+     	{ 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1 }, // Shape 33
+     	{ 0, 1, 0, 1, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 1, 0 }, // Shape 34
+     	{ 0, 0, 1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 0, 0 }, // Shape 35
+     	{ 0, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0 }, // Shape 36
+     	{ 0, 1, 0, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 1, 0 }, // Shape 37
+     	{ 0, 1, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 1, 0, 0, 1 }, // Shape 38
+     	{ 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1 }, // Shape 39
+     	{ 0, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 0 }, // Shape 40
+     	{ 0, 0, 0, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 0, 0, 0 }, // Shape 41
+     	{ 0, 0, 1, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 1, 0, 0 }, // Shape 42
+     	{ 0, 0, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 0, 0 }, // Shape 43
+     	{ 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0 }, // Shape 44
+     	{ 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1 }, // Shape 45
+     	{ 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1 }, // Shape 46
+     	{ 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0 }, // Shape 47
+     	{ 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0 }, // Shape 48
+     	{ 0, 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0 }, // Shape 49
+     	{ 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 0 }, // Shape 50
+     	{ 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 0, 0 }, // Shape 51
+     	{ 0, 1, 1, 0, 1, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 1 }, // Shape 52
+     	{ 0, 0, 1, 1, 0, 1, 1, 0, 1, 1, 0, 0, 1, 0, 0, 1 }, // Shape 53
+     	{ 0, 1, 1, 0, 0, 0, 1, 1, 1, 0, 0, 1, 1, 1, 0, 0 }, // Shape 54
+     	{ 0, 0, 1, 1, 1, 0, 0, 1, 1, 1, 0, 0, 0, 1, 1, 0 }, // Shape 55
+     	{ 0, 1, 1, 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1 }, // Shape 56
+     	{ 0, 1, 1, 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0, 0, 1 }, // Shape 57
+     	{ 0, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 1 }, // Shape 58
+     	{ 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 1, 0, 0, 1, 1, 1 }, // Shape 59
+     	{ 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1 }, // Shape 60
+     	{ 0, 0, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0 }, // Shape 61
+     	{ 0, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0 }, // Shape 62
+    	{ 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1, 0, 1, 1, 1 }  // Shape 63
+	},
+
+	{   // BC7 Partition Set for 3 Subsets
+    	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 }, // Shape 0
+    	{ 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 }, // Shape 1
+    	{ 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 }, // Shape 2
+    	{ 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 }, // Shape 3
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 }, // Shape 4
+    	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 }, // Shape 5
+    	{ 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, // Shape 6
+    	{ 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 }, // Shape 7
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 }, // Shape 8
+    	{ 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 }, // Shape 9
+    	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 }, // Shape 10
+    	{ 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 }, // Shape 11
+    	{ 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 }, // Shape 12
+    	{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 }, // Shape 13
+    	{ 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, // Shape 14
+    	{ 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 }, // Shape 15
+    	{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 }, // Shape 16
+    	{ 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 }, // Shape 17
+    	{ 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 }, // Shape 18
+    	{ 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 }, // Shape 19
+    	{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 }, // Shape 20
+    	{ 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 }, // Shape 21
+    	{ 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 }, // Shape 22
+    	{ 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 }, // Shape 23
+    	{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 }, // Shape 24
+    	{ 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 }, // Shape 25
+    	{ 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 }, // Shape 26
+    	{ 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 }, // Shape 27
+    	{ 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 }, // Shape 28
+    	{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 }, // Shape 29
+    	{ 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 }, // Shape 30
+    	{ 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 }, // Shape 31
+    	{ 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, // Shape 32
+    	{ 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 }, // Shape 33
+    	{ 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 }, // Shape 34
+    	{ 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 }, // Shape 35
+    	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 }, // Shape 36
+    	{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 }, // Shape 37
+    	{ 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 }, // Shape 38
+    	{ 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 }, // Shape 39
+    	{ 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 }, // Shape 40
+    	{ 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 }, // Shape 41
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 }, // Shape 42
+    	{ 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 }, // Shape 43
+    	{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 }, // Shape 44
+    	{ 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 }, // Shape 45
+    	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 }, // Shape 46
+    	{ 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 }, // Shape 47
+    	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 }, // Shape 48
+    	{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 }, // Shape 49
+    	{ 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 }, // Shape 50
+    	{ 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 }, // Shape 51
+    	{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 }, // Shape 52
+    	{ 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 }, // Shape 53
+    	{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 }, // Shape 54
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 }, // Shape 55
+    	{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 }, // Shape 56
+    	{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 }, // Shape 57
+    	{ 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 }, // Shape 58
+    	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 }, // Shape 59
+    	{ 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 }, // Shape 60
+    	{ 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 }, // Shape 61
+    	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 }, // Shape 62
+    	{ 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 }  // Shape 63
+	}
+};
+
+// The 7-bit mode 5 color endpoints that reproduce each 8-bit value exactly when they are
+// interpolated with the weight of BC7_SOLID_COLOR_INDEX (21). These were found by unquantizing
+// and interpolating every pair of endpoints the same way bc7_assign_pixels() does. The alpha
+// endpoints of mode 5 are 8 bits so every solid color can be encoded with no error.
+uint8_t const Solid_color_endpoints[256][2] =
+{
+	{   0,   0 }, {   0,   1 }, {   1,   1 }, {   1,   2 }, {   2,   2 }, {   2,   3 }, {   3,   3 }, {   3,   4 }, // 0 - 7
+	{   4,   4 }, {   4,   5 }, {   5,   5 }, {   5,   6 }, {   6,   6 }, {   6,   7 }, {   7,   7 }, {   7,   8 }, // 8 - 15
+	{   8,   8 }, {   8,   9 }, {   9,   9 }, {   9,  10 }, {  10,  10 }, {  10,  11 }, {  11,  11 }, {  11,  12 }, // 16 - 23
+	{  12,  12 }, {  12,  13 }, {  13,  13 }, {  13,  14 }, {  14,  14 }, {  14,  15 }, {  15,  15 }, {  15,  16 }, // 24 - 31
+	{  16,  16 }, {  16,  17 }, {  17,  17 }, {  17,  18 }, {  18,  18 }, {  18,  19 }, {  19,  19 }, {  19,  20 }, // 32 - 39
+	{  20,  20 }, {  20,  21 }, {  21,  21 }, {  21,  22 }, {  22,  22 }, {  22,  23 }, {  23,  23 }, {  23,  24 }, // 40 - 47
+	{  24,  24 }, {  24,  25 }, {  25,  25 }, {  25,  26 }, {  26,  26 }, {  26,  27 }, {  27,  27 }, {  27,  28 }, // 48 - 55
+	{  28,  28 }, {  28,  29 }, {  29,  29 }, {  29,  30 }, {  30,  30 }, {  30,  31 }, {  31,  31 }, {  31,  32 }, // 56 - 63
+	{  32,  32 }, {  32,  33 }, {  33,  33 }, {  33,  34 }, {  34,  34 }, {  34,  35 }, {  35,  35 }, {  35,  36 }, // 64 - 71
+	{  36,  36 }, {  36,  37 }, {  37,  37 }, {  37,  38 }, {  38,  38 }, {  38,  39 }, {  39,  39 }, {  39,  40 }, // 72 - 79
+	{  40,  40 }, {  40,  41 }, {  41,  41 }, {  41,  42 }, {  42,  42 }, {  42,  43 }, {  43,  43 }, {  43,  44 }, // 80 - 87
+	{  44,  44 }, {  44,  45 }, {  45,  45 }, {  45,  46 }, {  46,  46 }, {  46,  47 }, {  47,  47 }, {  47,  48 }, // 88 - 95
+	{  48,  48 }, {  48,  49 }, {  49,  49 }, {  49,  50 }, {  50,  50 }, {  50,  51 }, {  51,  51 }, {  51,  52 }, // 96 - 103
+	{  52,  52 }, {  52,  53 }, {  53,  53 }, {  53,  54 }, {  54,  54 }, {  54,  55 }, {  55,  55 }, {  55,  56 }, // 104 - 111
+	{  56,  56 }, {  56,  57 }, {  57,  57 }, {  57,  58 }, {  58,  58 }, {  58,  59 }, {  59,  59 }, {  59,  60 }, // 112 - 119
+	{  60,  60 }, {  60,  61 }, {  61,  61 }, {  61,  62 }, {  62,  62 }, {  62,  63 }, {  63,  63 }, {  63,  64 }, // 120 - 127
+	{  64,  63 }, {  64,  64 }, {  64,  65 }, {  65,  65 }, {  65,  66 }, {  66,  66 }, {  66,  67 }, {  67,  67 }, // 128 - 135
+	{  67,  68 }, {  68,  68 }, {  68,  69 }, {  69,  69 }, {  69,  70 }, {  70,  70 }, {  70,  71 }, {  71,  71 }, // 136 - 143
+	{  71,  72 }, {  72,  72 }, {  72,  73 }, {  73,  73 }, {  73,  74 }, {  74,  74 }, {  74,  75 }, {  75,  75 }, // 144 - 151
+	{  75,  76 }, {  76,  76 }, {  76,  77 }, {  77,  77 }, {  77,  78 }, {  78,  78 }, {  78,  79 }, {  79,  79 }, // 152 - 159
+	{  79,  80 }, {  80,  80 }, {  80,  81 }, {  81,  81 }, {  81,  82 }, {  82,  82 }, {  82,  83 }, {  83,  83 }, // 160 - 167
+	{  83,  84 }, {  84,  84 }, {  84,  85 }, {  85,  85 }, {  85,  86 }, {  86,  86 }, {  86,  87 }, {  87,  87 }, // 168 - 175
+	{  87,  88 }, {  88,  88 }, {  88,  89 }, {  89,  89 }, {  89,  90 }, {  90,  90 }, {  90,  91 }, {  91,  91 }, // 176 - 183
+	{  91,  92 }, {  92,  92 }, {  92,  93 }, {  93,  93 }, {  93,  94 }, {  94,  94 }, {  94,  95 }, {  95,  95 }, // 184 - 191
+	{  95,  96 }, {  96,  96 }, {  96,  97 }, {  97,  97 }, {  97,  98 }, {  98,  98 }, {  98,  99 }, {  99,  99 }, // 192 - 199
+	{  99, 100 }, { 100, 100 }, { 100, 101 }, { 101, 101 }, { 101, 102 }, { 102, 102 }, { 102, 103 }, { 103, 103 }, // 200 - 207
+	{ 103, 104 }, { 104, 104 }, { 104, 105 }, { 105, 105 }, { 105, 106 }, { 106, 106 }, { 106, 107 }, { 107, 107 }, // 208 - 215
+	{ 107, 108 }, { 108, 108 }, { 108, 109 }, { 109, 109 }, { 109, 110 }, { 110, 110 }, { 110, 111 }, { 111, 111 }, // 216 - 223
+	{ 111, 112 }, { 112, 112 }, { 112, 113 }, { 113, 113 }, { 113, 114 }, { 114, 114 }, { 114, 115 }, { 115, 115 }, // 224 - 231
+	{ 115, 116 }, { 116, 116 }, { 116, 117 }, { 117, 117 }, { 117, 118 }, { 118, 118 }, { 118, 119 }, { 119, 119 }, // 232 - 239
+	{ 119, 120 }, { 120, 120 }, { 120, 121 }, { 121, 121 }, { 121, 122 }, { 122, 122 }, { 122, 123 }, { 123, 123 }, // 240 - 247
+	{ 123, 124 }, { 124, 124 }, { 124, 125 }, { 125, 125 }, { 125, 126 }, { 126, 126 }, { 126, 127 }, { 127, 127 }  // 248 - 255
+};
+
+// The pixels in each subset of each shape as a bit mask (bit N is pixel N), this is the same as
+// Partition_table but it lets the pixels of a subset be found without going through all of them.
+//
+uint16_t const Subset_masks[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ BC7_MAX_SUBSETS ] =
+{
+	{   // 1 subset
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }
+	},
+	{   // 2 subsets
+		{ 0x3333, 0xcccc, 0x0000 }, { 0x7777, 0x8888, 0x0000 }, { 0x1111, 0xeeee, 0x0000 }, { 0x1337, 0xecc8, 0x0000 },
+		{ 0x377f, 0xc880, 0x0000 }, { 0x0113, 0xfeec, 0x0000 }, { 0x0137, 0xfec8, 0x0000 }, { 0x137f, 0xec80, 0x0000 },
+		{ 0x37ff, 0xc800, 0x0000 }, { 0x0013, 0xffec, 0x0000 }, { 0x017f, 0xfe80, 0x0000 }, { 0x17ff, 0xe800, 0x0000 },
+		{ 0x0017, 0xffe8, 0x0000 }, { 0x00ff, 0xff00, 0x0000 }, { 0x000f, 0xfff0, 0x0000 }, { 0x0fff, 0xf000, 0x0000 },
+		{ 0x08ef, 0xf710, 0x0000 }, { 0xff71, 0x008e, 0x0000 }, { 0x8eff, 0x7100, 0x0000 }, { 0xf731, 0x08ce, 0x0000 },
+		{ 0xff73, 0x008c, 0x0000 }, { 0x8cef, 0x7310, 0x0000 }, { 0xceff, 0x3100, 0x0000 }, { 0x7331, 0x8cce, 0x0000 },
+		{ 0xf773, 0x088c, 0x0000 }, { 0xceef, 0x3110, 0x0000 }, { 0x9999, 0x6666, 0x0000 }, { 0xc993, 0x366c, 0x0000 },
+		{ 0xe817, 0x17e8, 0x0000 }, { 0xf00f, 0x0ff0, 0x0000 }, { 0x8e71, 0x718e, 0x0000 }, { 0xc663, 0x399c, 0x0000 },
+		{ 0x5555, 0xaaaa, 0x0000 }, { 0x0f0f, 0xf0f0, 0x0000 }, { 0xa5a5, 0x5a5a, 0x0000 }, { 0xcc33, 0x33cc, 0x0000 },
+		{ 0xc3c3, 0x3c3c, 0x0000 }, { 0xaa55, 0x55aa, 0x0000 }, { 0x6969, 0x9696, 0x0000 }, { 0x5aa5, 0xa55a, 0x0000 },
+		{ 0x8c31, 0x73ce, 0x0000 }, { 0xec37, 0x13c8, 0x0000 }, { 0xcdb3, 0x324c, 0x0000 }, { 0xc423, 0x3bdc, 0x0000 },
+		{ 0x9669, 0x6996, 0x0000 }, { 0x3cc3, 0xc33c, 0x0000 }, { 0x6699, 0x9966, 0x0000 }, { 0xf99f, 0x0660, 0x0000 },
+		{ 0xfd8d, 0x0272, 0x0000 }, { 0xfb1b, 0x04e4, 0x0000 }, { 0xb1bf, 0x4e40, 0x0000 }, { 0xd8df, 0x2720, 0x0000 },
+		{ 0x36c9, 0xc936, 0x0000 }, { 0x6c93, 0x936c, 0x0000 }, { 0xc639, 0x39c6, 0x0000 }, { 0x9c63, 0x639c, 0x0000 },
+		{ 0x6cc9, 0x9336, 0x0000 }, { 0x6339, 0x9cc6, 0x0000 }, { 0x7e81, 0x817e, 0x0000 }, { 0x18e7, 0xe718, 0x0000 },
+		{ 0x330f, 0xccf0, 0x0000 }, { 0xf033, 0x0fcc, 0x0000 }, { 0x88bb, 0x7744, 0x0000 }, { 0x11dd, 0xee22, 0x0000 }
+	},
+	{   // 3 subsets
+		{ 0x0133, 0x08cc, 0xf600 }, { 0x0037, 0x8cc8, 0x7300 }, { 0x006f, 0xcc80, 0x3310 }, { 0x1331, 0xec00, 0x00ce },
+		{ 0x00ff, 0x3300, 0xcc00 }, { 0x3333, 0x00cc, 0xcc00 }, { 0x0033, 0xff00, 0x00cc }, { 0x0033, 0xcccc, 0x3300 },
+		{ 0x00ff, 0x0f00, 0xf000 }, { 0x000f, 0x0ff0, 0xf000 }, { 0x000f, 0x00f0, 0xff00 }, { 0x3333, 0x4444, 0x8888 },
+		{ 0x1111, 0x6666, 0x8888 }, { 0x1111, 0x2222, 0xcccc }, { 0x0013, 0x136c, 0xec80 }, { 0x8c63, 0x008c, 0x7310 },
+		{ 0x0137, 0x36c8, 0xc800 }, { 0xc631, 0x08ce, 0x3100 }, { 0x000f, 0x3330, 0xccc0 }, { 0x0333, 0xf000, 0x0ccc },
+		{ 0x1111, 0x00ee, 0xee00 }, { 0x0077, 0x8888, 0x7700 }, { 0x113f, 0x22c0, 0xcc00 }, { 0x88cf, 0x4430, 0x3300 },
+		{ 0xf311, 0x0c22, 0x00cc }, { 0x0033, 0x0344, 0xfc88 }, { 0x9009, 0x6996, 0x0660 }, { 0x009f, 0x9960, 0x6600 },
+		{ 0x3443, 0x0330, 0xc88c }, { 0x0699, 0x0066, 0xf900 }, { 0x3113, 0xc22c, 0x0cc0 }, { 0x00ef, 0x8c00, 0x7310 },
+		{ 0x007f, 0x1300, 0xec80 }, { 0x3331, 0xc400, 0x08ce }, { 0x1333, 0x004c, 0xec80 }, { 0x9999, 0x2222, 0x4444 },
+		{ 0xf00f, 0x00f0, 0x0f00 }, { 0x9249, 0x2492, 0x4924 }, { 0x9429, 0x2942, 0x4294 }, { 0x30c3, 0xc30c, 0x0c30 },
+		{ 0x3c03, 0xc03c, 0x03c0 }, { 0x0055, 0x00aa, 0xff00 }, { 0x00ff, 0xaa00, 0x5500 }, { 0x0303, 0x3030, 0xcccc },
+		{ 0x3333, 0xc0c0, 0x0c0c }, { 0x0909, 0x9090, 0x6666 }, { 0x5005, 0xa00a, 0x0ff0 }, { 0x000f, 0xaaa0, 0x5550 },
+		{ 0x0555, 0x0aaa, 0xf000 }, { 0x1111, 0xe0e0, 0x0e0e }, { 0x0707, 0x7070, 0x8888 }, { 0x000f, 0x6660, 0x9990 },
+		{ 0x1111, 0x0ee0, 0xe00e }, { 0x7007, 0x0770, 0x8888 }, { 0x0999, 0x0666, 0xf000 }, { 0x00ff, 0x6600, 0x9900 },
+		{ 0x0099, 0x0066, 0xff00 }, { 0x3333, 0x0cc0, 0xc00c }, { 0x3003, 0x0330, 0xcccc }, { 0x0fff, 0x6000, 0x9000 },
+		{ 0x7777, 0x8080, 0x0808 }, { 0x0101, 0x1010, 0xeeee }, { 0x0005, 0x000a, 0xfff0 }, { 0x8421, 0x08ce, 0x7310 }
+	}
+};
+
+// The channels that are multiplied for each product in the moments, for RGB and RGBA.
+//
+uint8_t const Moment_products[2][ BC7_NUM_MOMENT_PRODUCTS_RGBA ][2] =
+{
+	{ { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } },
+	{ { 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 1 }, { 1, 2 }, { 1, 3 }, { 2, 2 }, { 2, 3 }, { 3, 3 } }
+};
+
+// This table determines which palette indices are anchor indices.
+//
+uint8_t const Anchor_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ BC7_MAX_SUBSETS ] =
+{
+    {   // No fix-ups for 1st subset for BC6H or BC7
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0},
+        { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0}
+    },
+
+    {   // BC6H/BC7 Partition Set Fixups for 2 Subsets
+        { 0,15, 0}, { 0,15, 0}, { 0,15, 0}, { 0,15, 0},
+        { 0,15, 0}, { 0,15, 0}, { 0,15, 0}, { 0,15, 0},
+        { 0,15, 0}, { 0,15, 0}, { 0,15, 0}, { 0,15, 0},
+        { 0,15, 0}, { 0,15, 0}, { 0,15, 0}, { 0,15, 0},
+        { 0,15, 0}, { 0, 2, 0}, { 0, 8, 0}, { 0, 2, 0},
+        { 0, 2, 0}, { 0, 8, 0}, { 0, 8, 0}, { 0,15, 0},
+        { 0, 2, 0}, { 0, 8, 0}, { 0, 2, 0}, { 0, 2, 0},
+        { 0, 8, 0}, { 0, 8, 0}, { 0, 2, 0}, { 0, 2, 0},
+
+        // BC7 Partition Set Fixups for 2 Subsets (second-half)
+        { 0,15, 0}, { 0,15, 0}, { 0, 6, 0}, { 0, 8, 0},
+        { 0, 2, 0}, { 0, 8, 0}, { 0,15, 0}, { 0,15, 0},
+        { 0, 2, 0}, { 0, 8, 0}, { 0, 2, 0}, { 0, 2, 0},
+        { 0, 2, 0}, { 0,15, 0}, { 0,15, 0}, { 0, 6, 0},
+        { 0, 6, 0}, { 0, 2, 0}, { 0, 6, 0}, { 0, 8, 0},
+        { 0,15, 0}, { 0,15, 0}, { 0, 2, 0}, { 0, 2, 0},
+        { 0,15, 0}, { 0,15, 0}, { 0,15, 0}, { 0,15, 0},
+        { 0,15, 0}, { 0, 2, 0}, { 0, 2, 0}, { 0,15, 0}
+    },
+
+    {   // BC7 Partition Set Fixups for 3 Subsets
+        { 0, 3,15}, { 0, 3, 8}, { 0,15, 8}, { 0,15, 3},
+        { 0, 8,15}, { 0, 3,15}, { 0,15, 3}, { 0,15, 8},
+        { 0, 8,15}, { 0, 8,15}, { 0, 6,15}, { 0, 6,15},
+        { 0, 6,15}, { 0, 5,15}, { 0, 3,15}, { 0, 3, 8},
+        { 0, 3,15}, { 0, 3, 8}, { 0, 8,15}, { 0,15, 3},
+        { 0, 3,15}, { 0, 3, 8}, { 0, 6,15}, { 0,10, 8},
+        { 0, 5, 3}, { 0, 8,15}, { 0, 8, 6}, { 0, 6,10},
+        { 0, 8,15}, { 0, 5,15}, { 0,15,10}, { 0,15, 8},
+        { 0, 8,15}, { 0,15, 3}, { 0, 3,15}, { 0, 5,10},
+        { 0, 6,10}, { 0,10, 8}, { 0, 8, 9}, { 0,15,10},
+        { 0,15, 6}, { 0, 3,15}, { 0,15, 8}, { 0, 5,15},
+        { 0,15, 3}, { 0,15, 6}, { 0,15, 6}, { 0,15, 8},
+        { 0, 3,15}, { 0,15, 3}, { 0, 5,15}, { 0, 5,15},
+        { 0, 5,15}, { 0, 8,15}, { 0, 5,15}, { 0,10,15},
+        { 0, 5,15}, { 0,10,15}, { 0, 8,15}, { 0,13,15},
+        { 0,15, 3}, { 0,12,15}, { 0, 3,15}, { 0, 3, 8}
+    }
+};
+
+//----------------------
+// Output
+//----------------------
+
+// The compressed and encoded block of pixels.
+struct bc7_encoded_block {
+
+	// 128 bits
+	uint32_t m_bits[4];
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Store a value with the given number of bits.
+//
+// p_bits:					(output) The buffer to store to.
+// p_start_bit_index:	(input/output) The current bit index to start storing data.
+// signed_num_bits:		The number of bits.
+// value:					The value to store.
+//
+static void bc7_set_bits(uint32_t* p_bits, uint32_t* p_start_bit_index, int signed_num_bits, uint32_t value)
+{
+	if (signed_num_bits <= 0) {
+
+		return;
+	}
+
+	uint32_t const num_bits = (uint32_t)signed_num_bits;
+	uint32_t const start_bit_index = *p_start_bit_index;
+	uint32_t const slot_index = start_bit_index >> 5;
+	uint32_t const slot_index_end = (start_bit_index + num_bits - 1) >> 5;
+	uint32_t const slot_bit_index = start_bit_index & 31;
+
+	if (slot_index != slot_index_end) {
+
+		// The value will span an integer boundary.
+		uint32_t slot_value_1 = p_bits[ slot_index ];
+		uint32_t slot_value_2 = p_bits[ slot_index_end ];
+
+		// Clear out the current bits.
+		uint32_t const num_bits_1 = 32 - slot_bit_index;
+		uint32_t const num_bits_2 = num_bits - num_bits_1;
+		uint32_t const mask_1 = (1 << num_bits_1) - 1;
+		uint32_t const mask_2 = (1 << num_bits_2) - 1;
+		slot_value_1 &= ~(mask_1 << slot_bit_index);
+		slot_value_2 &= ~mask_2;
+
+		// Set the new values.
+		slot_value_1 |= value << slot_bit_index;
+		slot_value_2 |= value >> num_bits_1;
+
+		// Store them.
+		p_bits[ slot_index ] = slot_value_1;
+		p_bits[ slot_index_end ] = slot_value_2;
+
+	} else {
+
+		uint32_t slot_value = p_bits[ slot_index ];
+
+		// Clear out the current bits.
+		uint32_t const mask = (1 << num_bits) - 1;
+		slot_value &= ~(mask << slot_bit_index);
+
+		// Set the new value.
+		slot_value |= value << slot_bit_index;
+
+		// Store it.
+		p_bits[ slot_index ] = slot_value;
+	}
+
+	*p_start_bit_index = start_bit_index + num_bits;
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Encode the compressed block.
+//
+// p_out_encoded_block:	(output) The encoded block.
+// p_compressed_block:	The compressed block to encode.
+// p_mode:					The mode used to compress the pixels.
+//
+void bc7_encode_compressed_block(bc7_compressed_block* p_out_encoded_block,
+											bc7_unencoded_block const* p_compressed_block,
+											bc7_mode const* p_mode)
+{
+	bc7_encoded_block encoded_block = { 0 };
+
+	uint32_t bit_index = 0;
+
+	// Mode. There are N zeroes followed by a 1, where N is the mode index.
+	bc7_set_bits(encoded_block.m_bits, &bit_index, p_mode->m_mode_index, 0);	
+	bc7_set_bits(encoded_block.m_bits, &bit_index, 1, 1);
+
+	// Shape index.
+	bc7_set_bits(encoded_block.m_bits, &bit_index, p_mode->m_num_shape_bits, p_compressed_block->m_shape);
+
+	// Rotation.
+	bc7_set_bits(encoded_block.m_bits, &bit_index, p_mode->m_num_rotation_bits, p_compressed_block->m_rotation);
+
+	// Index selection.
+	bc7_set_bits(encoded_block.m_bits, &bit_index, p_mode->m_num_isb_bits, p_compressed_block->m_index_selection_bit);
+
+	// Get the number of channels for this mode.
+	uint32_t const num_channels = (p_mode->m_mode_index < 4) ? 3 : 4;
+
+	// Color.
+   for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+      for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+         uint32_t channel_precision = p_mode->m_endpoint_precision[ channel ];
+         uint32_t channel_value_0 = p_compressed_block->m_quantized_endpoints.m_endpoints[ subset_iter ][ channel ];
+         uint32_t channel_value_1 = p_compressed_block->m_quantized_endpoints.m_endpoints[ subset_iter ][ channel + 4 ];
+
+         if (p_mode->m_parity_bit_type != PARITY_BIT_NONE) {
+
+            channel_precision--;
+            channel_value_0 >>= 1;
+            channel_value_1 >>= 1;
+         }
+
+         bc7_set_bits(encoded_block.m_bits, &bit_index, 
+                      channel_precision,
+                      channel_value_0);
+
+         bc7_set_bits(encoded_block.m_bits, &bit_index, 
+                      channel_precision,
+                      channel_value_1);
+
+      } // end for
+
+   } // end for
+
+   // Parity bits.
+   if (p_mode->m_parity_bit_type != PARITY_BIT_NONE) {
+
+      uint32_t num_parity_bits;
+      if (p_mode->m_parity_bit_type == PARITY_BIT_SHARED) {
+
+         // The endpoints within a subset share a parity bit.
+         num_parity_bits = p_mode->m_num_subsets;
+
+      } else {
+
+         // Each endpoint has its own parity bit.
+         num_parity_bits = 2 * p_mode->m_num_subsets;
+      }
+
+      for (uint32_t parity_iter = 0; parity_iter < num_parity_bits; parity_iter++) {
+
+         uint32_t const parity_bit = p_compressed_block->m_quantized_endpoints.m_parity_bits[ parity_iter ];
+         bc7_set_bits(encoded_block.m_bits, &bit_index, 1, parity_bit);
+
+      } // end for
+   }
+
+	// Primary indices.
+	uint8_t const* p_palette_indices_1 = p_compressed_block->m_index_selection_bit ? p_compressed_block->m_palette_indices_2 : p_compressed_block->m_palette_indices_1;
+	{
+		// Get all the anchor indices.
+		uint32_t anchor_indices[ BC7_MAX_SUBSETS ];
+		for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+		 	anchor_indices[ subset_iter ] = bc7_get_anchor_index(p_compressed_block->m_shape, subset_iter, p_mode);
+
+		} // end for
+
+		// Encode all the indices.
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			uint32_t index_precision = p_mode->m_num_index_bits_1;
+
+			// See if this pixel is an anchor.			
+			for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+				
+				if (pixel_iter == anchor_indices[ subset_iter ]) {
+
+					// The anchor index is written with one less bit because the leading bit is
+					// assumed to be zero.
+					index_precision--;
+					break;
+				}
+
+			} // end for
+
+			bc7_set_bits(encoded_block.m_bits, &bit_index, index_precision, 
+							 p_palette_indices_1[ pixel_iter ]);
+
+		} // end for
+	}
+
+	// Secondary indices.
+	if (p_mode->m_num_index_bits_2 > 0) {
+
+		uint8_t const* p_palette_indices_2 = p_compressed_block->m_index_selection_bit ? p_compressed_block->m_palette_indices_1 : p_compressed_block->m_palette_indices_2;
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			// The first index is always the anchor index.
+			uint32_t const index_precision = (pixel_iter == 0) ? (p_mode->m_num_index_bits_2 - 1) : p_mode->m_num_index_bits_2;
+
+			bc7_set_bits(encoded_block.m_bits, &bit_index, index_precision,
+				 			 p_palette_indices_2[ pixel_iter ]);
+
+		} // end for
+	}
+
+	// Store the result. The bits are stored little endian like the GPU versions.
+	for (uint32_t slot_iter = 0; slot_iter < 4; slot_iter++) {
+
+		uint32_t const slot_value = encoded_block.m_bits[ slot_iter ];
+
+		p_out_encoded_block->m_data[ 4 * slot_iter + 0 ] = (uint8_t)(slot_value);
+		p_out_encoded_block->m_data[ 4 * slot_iter + 1 ] = (uint8_t)(slot_value >> 8);
+		p_out_encoded_block->m_data[ 4 * slot_iter + 2 ] = (uint8_t)(slot_value >> 16);
+		p_out_encoded_block->m_data[ 4 * slot_iter + 3 ] = (uint8_t)(slot_value >> 24);
+
+	} // end for
+}
+
+// Encode a solid color block with mode 5 using Solid_color_endpoints, there is no error.
+//
+// p_out_encoded_block:	(output) The encoded block.
+// color:					The color of the block (RGBA).
+//
+void bc7_encode_solid_color(bc7_compressed_block* p_out_encoded_block, uint8_t const color[4])
+{
+	bc7_unencoded_block compressed_block;
+	{
+		compressed_block.m_error = 0;
+		compressed_block.m_rotation = 0;
+		compressed_block.m_index_selection_bit = 0;
+		compressed_block.m_shape = 0;
+	}
+
+	// The color endpoints come from the table, the alpha endpoints are the alpha.
+	for (uint32_t channel = 0; channel < 3; channel++) {
+
+		compressed_block.m_quantized_endpoints.m_endpoints[0][ channel ] = Solid_color_endpoints[ color[ channel ] ][0];
+		compressed_block.m_quantized_endpoints.m_endpoints[0][ channel + 4 ] = Solid_color_endpoints[ color[ channel ] ][1];
+
+	} // end for
+
+	compressed_block.m_quantized_endpoints.m_endpoints[0][3] = color[3];
+	compressed_block.m_quantized_endpoints.m_endpoints[0][7] = color[3];
+
+	for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		compressed_block.m_palette_indices_1[ pixel_iter ] = BC7_SOLID_COLOR_INDEX;
+		compressed_block.m_palette_indices_2[ pixel_iter ] = 0;
+
+	} // end for
+
+	bc7_encode_compressed_block(p_out_encoded_block, &compressed_block, &BC7_modes[ BC7_SOLID_COLOR_MODE ]);
+}
+
+} // namespace bc7_cpu
+
+#endif // #if defined(__BC7_CPU)
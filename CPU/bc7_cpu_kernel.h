@@ -0,0 +1,131 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_KERNEL_H
+#define __BC7_CPU_KERNEL_H
+
+#include "bc7_gpu.h"
+
+#if defined(__BC7_CPU)
+
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The counts of the work the kernel skipped.
+struct bc7_cpu_kernel_stats {
+
+	// The number of mode evaluations the block classifier skipped.
+	uint32_t m_num_saved_evaluations;
+
+	// The number of evaluations that were skipped because the lower bound of the error of the
+	// shape was no better than the best error so far.
+	uint32_t m_num_pruned_evaluations;
+};
+
+// The signature shared by the versions of the kernel.
+typedef void (*bc7_cpu_kernel_function)(bc7_compressed_block* p_encoded_blocks,
+													 uint8_t const* p_source_pixels,
+													 uint32_t width_in_blocks, uint32_t height_in_blocks,
+													 uint32_t pixel_block_x, uint32_t pixel_block_y,
+													 uint32_t num_blocks_x, uint32_t num_blocks_y,
+													 bc7_encode_params const* p_params,
+													 bc7_cpu_kernel_stats* p_stats);
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Compress a rectangle of 4x4 blocks in the image. These are native versions of the OpenCL
+// kernel where the block indices take the place of the global work item ids. The SIMD versions
+// compress a block in each lane so they work on 4 (SSE2, SSE4.1), 8 (AVX2) or 16 (AVX-512) blocks
+// of the rectangle at once. Each block is classified first (opaque, grayscale) so the modes and
+// rotations that can't win are skipped. They all give the same results, SSE2 and SSE4.1 don't
+// have a fused multiply-add so it's done in double precision and rounded to float only once.
+//
+// p_encoded_blocks:	(output) The compressed blocks for the entire image.
+// p_source_pixels:	The source image data. This must be 32-bit RGBA.
+// width_in_blocks:	The width of the image in 4x4 blocks.
+// height_in_blocks:	The height of the image in 4x4 blocks.
+// pixel_block_x:		The horizontal index of the top left block to compress.
+// pixel_block_y:		The vertical index of the top left block to compress.
+// num_blocks_x:		The width of the rectangle in blocks. This is clamped to the edge of the image.
+// num_blocks_y:		The height of the rectangle in blocks. This is clamped to the edge of the image.
+// p_params:			The encoding parameters.
+// p_stats:				(input/output) The counts of the work that was skipped are added to this.
+//
+void bc7_cpu_kernel_scalar(bc7_compressed_block* p_encoded_blocks,
+									uint8_t const* p_source_pixels,
+									uint32_t width_in_blocks, uint32_t height_in_blocks,
+									uint32_t pixel_block_x, uint32_t pixel_block_y,
+									uint32_t num_blocks_x, uint32_t num_blocks_y,
+									bc7_encode_params const* p_params,
+									bc7_cpu_kernel_stats* p_stats);
+
+void bc7_cpu_kernel_sse2(bc7_compressed_block* p_encoded_blocks,
+								 uint8_t const* p_source_pixels,
+								 uint32_t width_in_blocks, uint32_t height_in_blocks,
+								 uint32_t pixel_block_x, uint32_t pixel_block_y,
+								 uint32_t num_blocks_x, uint32_t num_blocks_y,
+								 bc7_encode_params const* p_params,
+								 bc7_cpu_kernel_stats* p_stats);
+
+void bc7_cpu_kernel_sse41(bc7_compressed_block* p_encoded_blocks,
+								  uint8_t const* p_source_pixels,
+								  uint32_t width_in_blocks, uint32_t height_in_blocks,
+								  uint32_t pixel_block_x, uint32_t pixel_block_y,
+								  uint32_t num_blocks_x, uint32_t num_blocks_y,
+								  bc7_encode_params const* p_params,
+								  bc7_cpu_kernel_stats* p_stats);
+
+void bc7_cpu_kernel_avx2(bc7_compressed_block* p_encoded_blocks,
+								 uint8_t const* p_source_pixels,
+								 uint32_t width_in_blocks, uint32_t height_in_blocks,
+								 uint32_t pixel_block_x, uint32_t pixel_block_y,
+								 uint32_t num_blocks_x, uint32_t num_blocks_y,
+								 bc7_encode_params const* p_params,
+								 bc7_cpu_kernel_stats* p_stats);
+
+void bc7_cpu_kernel_avx512(bc7_compressed_block* p_encoded_blocks,
+									uint8_t const* p_source_pixels,
+									uint32_t width_in_blocks, uint32_t height_in_blocks,
+									uint32_t pixel_block_x, uint32_t pixel_block_y,
+									uint32_t num_blocks_x, uint32_t num_blocks_y,
+									bc7_encode_params const* p_params,
+									bc7_cpu_kernel_stats* p_stats);
+
+#endif // #if defined(__BC7_CPU)
+
+#endif // __BC7_CPU_KERNEL_H
@@ -0,0 +1,2205 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// The CPU version of the OpenCL kernel written so each lane of a SIMD register works on a different
+// 4x4 block, the same way each work item on the GPU does. This file is included inside of a
+// namespace after one of the bc7_cpu_lanes_*.h headers which supply lane_float, lane_uint,
+// lane_mask and Num_lanes.
+//
+// All the blocks go through the same modes, rotations, index selection bits and shapes so the
+// loops are shared by the lanes. Where the OpenCL version would branch on a value that depends on
+// the pixels (like stopping Gradient Descent early) the lanes use a mask instead. The operations
+// are kept the same as the OpenCL version so the compressed blocks are too.
+
+//----------------------
+// Types.
+//----------------------
+
+typedef lane_float lane_float2x4[8];
+typedef lane_uint lane_uint2x4[8];
+
+// A pixel for each of the blocks, one channel per element.
+typedef lane_uint lane_pixel[4];
+typedef lane_float lane_pixel_float[4];
+
+// This stores the quantized endpoints and parity bits (if there are any).
+struct bc7_lane_quantized_endpoints {
+
+   // The quantized endpoints.
+   // Note: If a mode has parity bits, this still stores the least significant bit.
+   lane_uint2x4 m_endpoints[ BC7_MAX_SUBSETS ];
+
+   // The parity bits (depending on the mode).
+   lane_uint m_parity_bits[ 2 * BC7_MAX_SUBSETS ];
+};
+
+// The representation of the compressed blocks of pixels before they are encoded.
+struct bc7_lane_compressed_block {
+
+	// The total error for the block.
+	lane_uint m_error;
+
+	// The endpoints of the line that the palette is generated from for each subset.
+	bc7_lane_quantized_endpoints m_quantized_endpoints;
+
+	// The indices into the palette for each pixel.
+	lane_uint m_palette_indices_1[ NUM_PIXELS_PER_BLOCK ];
+	lane_uint m_palette_indices_2[ NUM_PIXELS_PER_BLOCK ];
+
+	// This tells which color channel was swapped with the alpha channel (if any).
+	lane_uint m_rotation;
+
+	// This tells whether the index selection bit was set.
+	lane_uint m_index_selection_bit;
+
+	// This tells which shape was used.
+	lane_uint m_shape;
+};
+
+//----------------------
+// Functions
+//----------------------
+
+// Calculate the dot product.
+//
+inline lane_float dot_float3(lane_float const a[3], lane_float const b[3])
+{
+	lane_float result = a[0] * b[0];
+	result = lane_fma(a[1], b[1], result);
+	result = lane_fma(a[2], b[2], result);
+
+	return result;
+}
+
+// Calculate the dot product.
+//
+inline lane_float dot_float4(lane_float const a[4], lane_float const b[4])
+{
+	lane_float result = a[0] * b[0];
+	result = lane_fma(a[1], b[1], result);
+	result = lane_fma(a[2], b[2], result);
+	result = lane_fma(a[3], b[3], result);
+
+	return result;
+}
+
+// Normalize the vector.
+//
+// inverse_length:	(output) 1 / length or 0 if the vector is the zero vector.
+// v:						(input/output) The vector to normalize.
+// num_channels:		The number of channels in the vector (3 or 4).
+//
+inline void normalize_float(lane_float& inverse_length, lane_float v[4], uint32_t num_channels)
+{
+	lane_float const length_squared = (num_channels == 3) ? dot_float3(v, v) : dot_float4(v, v);
+	lane_mask const is_zero = length_squared < FLT_EPSILON;
+
+	// The zero lanes are replaced below so it doesn't matter that they divide by zero.
+	lane_float const lane_inverse_length = 1.0f / lane_sqrt(length_squared);
+
+	inverse_length = lane_select(is_zero, 0.0f, lane_inverse_length);
+	for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+		v[ channel ] = lane_select(is_zero, 0.0f, v[ channel ] * lane_inverse_length);
+	}
+}
+
+// Clamp a given value to the range [min, max].
+//
+// value: 			(input/output) The value to clamp.
+// min_value:		The minimum of the range.
+// max_value:		The maximum of the range.
+//
+inline void clamp_float2x4(lane_float2x4 value, float min_value, float max_value)
+{
+	for (uint32_t i = 0; i < 8; i++) {
+
+		value[i] = lane_clamp(value[i], min_value, max_value);
+	}
+}
+
+// Copy a float2x4.
+//
+// copy: (output) The copy.
+// a:		The value to copy.
+//
+inline void copy_float2x4(lane_float2x4 copy, lane_float2x4 const a)
+{
+	for (uint32_t i = 0; i < 8; i++) {
+
+		copy[i] = a[i];
+	}
+}
+
+// Calculate the length of the float2x4
+//
+// length_0:	(output) The length of the first float4.
+// length_1:	(output) The length of the second float4.
+// a:				The float2x4 to calculate the length for.
+//
+inline void length_float2x4(lane_float& length_0, lane_float& length_1, lane_float2x4 const a)
+{
+	lane_float squared_length_0 = a[0] * a[0] + a[1] * a[1] +
+											a[2] * a[2] + a[3] * a[3];
+
+	lane_float squared_length_1 = a[4] * a[4] + a[5] * a[5] +
+											a[6] * a[6] + a[7] * a[7];
+
+	length_0 = lane_sqrt(squared_length_0);
+	length_1 = lane_sqrt(squared_length_1);
+}
+
+// Swap a color channel with the alpha channel because some modes have better precision
+// in the alpha channel and it may reduce the error.
+//
+// pixels:		(input/output) The pixels.
+// rotation:	This determines which channel is swapped with the alpha channel.
+//
+static void bc7_swap_channels(lane_pixel pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t rotation)
+{
+	if (rotation == 0) {
+
+		// Don't swap.
+		return;
+	}
+
+	// Rotation 1 swaps red, 2 swaps green and 3 swaps blue with alpha.
+	uint32_t const channel = rotation - 1;
+	for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		lane_uint const temp = pixels[ pixel_iter ][ channel ];
+		pixels[ pixel_iter ][ channel ] = pixels[ pixel_iter ][3];
+		pixels[ pixel_iter ][3] = temp;
+
+	} // end for
+}
+
+// Calculate the parity bits from the least significant bits of the channels
+// of the endpoints.
+//
+// p_quantized_endpoints:  (input/output) The quantized endpoints.
+// p_mode:                 The current mode.
+//
+static void bc7_calculate_parity_bits(bc7_lane_quantized_endpoints* p_quantized_endpoints,
+                                      bc7_mode const* p_mode)
+{
+   if (p_mode->m_parity_bit_type == PARITY_BIT_NONE) {
+
+      return;
+   }
+
+   // Get the number of channels for this mode.
+   uint32_t const num_channels = (p_mode->m_mode_index < 4) ? 3 : 4;
+
+   // Count how many least significant bits are set. A parity bit
+   // will be set if there are a majority of least significant bits set.
+   lane_uint lsb_count[ 2 * BC7_MAX_SUBSETS ];
+   for (uint32_t parity_iter = 0; parity_iter < 2 * BC7_MAX_SUBSETS; parity_iter++) {
+
+      lsb_count[ parity_iter ] = 0;
+   }
+
+   for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+      for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+         lane_uint const channel_value_0 = p_quantized_endpoints->m_endpoints[ subset_iter ][ channel ];
+         lane_uint const channel_value_1 = p_quantized_endpoints->m_endpoints[ subset_iter ][ channel + 4 ];
+
+         if (p_mode->m_parity_bit_type == PARITY_BIT_SHARED) {
+
+            // The endpoints within a subset share the parity bit.
+            lsb_count[ subset_iter ] += channel_value_0 & 0x1;
+            lsb_count[ subset_iter ] += channel_value_1 & 0x1;
+
+         } else {
+
+            // Each endpoint has it's own parity bit.
+            uint32_t const index = 2 * subset_iter;
+            lsb_count[ index ] += channel_value_0 & 0x1;
+            lsb_count[ index + 1 ] += channel_value_1 & 0x1;
+         }
+
+      } // end for
+
+   } // end for
+
+   // Find the parity bits.
+   uint32_t num_parity_bits;
+   uint32_t halfway;
+   if (p_mode->m_parity_bit_type == PARITY_BIT_SHARED) {
+
+      num_parity_bits = p_mode->m_num_subsets;
+      halfway = num_channels;
+
+   } else {
+
+      num_parity_bits = 2 * p_mode->m_num_subsets;
+      halfway = num_channels >> 1;
+   }
+
+   for (uint32_t parity_iter = 0; parity_iter < num_parity_bits; parity_iter++) {
+
+      // See if the least significant bit was set the majority of the time.
+      lane_mask const parity_bit = lsb_count[ parity_iter ] > halfway;
+      p_quantized_endpoints->m_parity_bits[ parity_iter ] = lane_select(parity_bit, lane_uint(1), lane_uint(0));
+
+   } // end for
+}
+
+// Quantize the endpoints to the desired precision.
+//
+// p_quantized_endpoints:  (output) The quantized endpoints.
+// endpoints_f:            The endpoints to quantize.
+// p_mode:                 The current mode.
+//
+static void bc7_quantize_endpoints(bc7_lane_quantized_endpoints* p_quantized_endpoints,
+                                   lane_float2x4 const endpoints_f[ BC7_MAX_SUBSETS ],
+                                   bc7_mode const* p_mode)
+{
+   // This will scale the channels of the endpoints so they have the correct precision
+   // before the parity bit is found (if there is one for this mode).
+   float precision_factor[4];
+   for (uint32_t channel = 0; channel < 4; channel++) {
+
+     precision_factor[ channel ] = ((1 << p_mode->m_endpoint_precision[ channel ]) - 1) / 255.0f;
+   }
+
+   // Quantize all the endpoints.
+   for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+      for (uint32_t channel = 0; channel < 4; channel++) {
+
+         p_quantized_endpoints->m_endpoints[ subset_iter ][ channel ] =
+            lane_convert_uint_rte(endpoints_f[ subset_iter ][ channel ] * precision_factor[ channel ]) & 0xff;
+
+         p_quantized_endpoints->m_endpoints[ subset_iter ][ channel + 4 ] =
+            lane_convert_uint_rte(endpoints_f[ subset_iter ][ channel + 4 ] * precision_factor[ channel ]) & 0xff;
+
+      } // end for
+
+   } // end for
+
+   // Calculate the parity bits if this mode has them.
+   bc7_calculate_parity_bits(p_quantized_endpoints, p_mode);
+}
+
+// Unquantize the endpoints.
+//
+// endpoints:              (output) The unquantized endpoints.
+// p_quantized_endpoints:  The quantized endpoints.
+// p_mode:                 The current mode.
+//
+static void bc7_unquantize_endpoints(lane_uint2x4 endpoints[ BC7_MAX_SUBSETS ],
+                                     bc7_lane_quantized_endpoints const* p_quantized_endpoints,
+                                     bc7_mode const* p_mode)
+{
+   // First apply the parity bits (if there are any).
+   for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+      switch (p_mode->m_parity_bit_type) {
+
+         case PARITY_BIT_SHARED:
+         {
+            // The endpoints share a parity bit within a subset.
+            lane_uint const parity_bit = p_quantized_endpoints->m_parity_bits[ subset_iter ];
+
+            // Overwrite the least significant bits with the parity bit.
+            for (uint32_t channel = 0; channel < 8; channel++) {
+
+               endpoints[ subset_iter ][ channel ] = (p_quantized_endpoints->m_endpoints[ subset_iter ][ channel ] & 0xfe) | parity_bit;
+            }
+
+            break;
+         }
+
+         case PARITY_BIT_PER_ENDPOINT:
+         {
+            // Each endpoint has a parity bit for its channels.
+            lane_uint const parity_bit_0 = p_quantized_endpoints->m_parity_bits[ 2 * subset_iter ];
+            lane_uint const parity_bit_1 = p_quantized_endpoints->m_parity_bits[ 2 * subset_iter + 1 ];
+
+            // Overwrite the least significant bits with the parity bit.
+            for (uint32_t channel = 0; channel < 4; channel++) {
+
+               endpoints[ subset_iter ][ channel ] = (p_quantized_endpoints->m_endpoints[ subset_iter ][ channel ] & 0xfe) | parity_bit_0;
+               endpoints[ subset_iter ][ channel + 4 ] = (p_quantized_endpoints->m_endpoints[ subset_iter ][ channel + 4 ] & 0xfe) | parity_bit_1;
+            }
+
+            break;
+         }
+
+         default:
+         {
+            for (uint32_t channel = 0; channel < 8; channel++) {
+
+               endpoints[ subset_iter ][ channel ] = p_quantized_endpoints->m_endpoints[ subset_iter ][ channel ];
+            }
+
+            break;
+         }
+
+      } // end switch
+
+   } // end for
+
+   // Now expand the bits.
+   for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+      for (uint32_t channel = 0; channel < 4; channel++) {
+
+         uint32_t const precision = p_mode->m_endpoint_precision[ channel ];
+
+         endpoints[ subset_iter ][ channel ] = endpoints[ subset_iter ][ channel ] << (8 - precision);
+         endpoints[ subset_iter ][ channel + 4 ] = endpoints[ subset_iter ][ channel + 4 ] << (8 - precision);
+
+         // Propagate the high bits in to the low bits.
+         endpoints[ subset_iter ][ channel ] |= endpoints[ subset_iter ][ channel ] >> precision;
+         endpoints[ subset_iter ][ channel + 4 ] |= endpoints[ subset_iter ][ channel + 4 ] >> precision;
+
+         endpoints[ subset_iter ][ channel ] &= 0xff;
+         endpoints[ subset_iter ][ channel + 4 ] &= 0xff;
+
+      } // end for
+
+      if (p_mode->m_endpoint_precision[3] == 0) {
+
+         // There is no alpha channel, set it to fully opaque.
+         endpoints[ subset_iter ][3] = 255;
+         endpoints[ subset_iter ][7] = 255;
+      }
+
+   } // end for
+}
+
+// Compare the pixels to the palette generated by the endpoints and calculate a total error and
+// its gradient in the same pass. The palette indices only change where a pixel crosses over to
+// another palette entry so they are held constant, which leaves the derivative of each squared
+// difference with respect to the endpoints.
+//
+// error_gradient:	(output) The gradient of the error. The first float4 is the gradient of
+//							the first endpoint and the second float4 is the gradient of
+//							the second endpoint.
+// endpoints:			The endpoints in color space.
+// pixels:				The pixels from the image.
+// num_pixels:			Number of pixels.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size_1 and Palette_size_2.
+// p_mode:				The current mode.
+//
+// returns: The total error.
+//
+static lane_float bc7_calculate_error_gradient(lane_float2x4 error_gradient, lane_float2x4 const endpoints,
+															  lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t num_pixels,
+															  uint32_t swap_palette_index_precision,
+															  bc7_mode const* p_mode)
+{
+	// Figure out the palette sizes.
+	uint32_t palette_size_1 = p_mode->m_palette_size_1;
+	uint32_t palette_size_2 = p_mode->m_palette_size_2;
+
+	if (swap_palette_index_precision == 1) {
+
+		palette_size_1 = p_mode->m_palette_size_2;
+		palette_size_2 = p_mode->m_palette_size_1;
+	}
+
+	lane_float total_error = 0.0f;
+
+	for (uint32_t axis_iter = 0; axis_iter < 8; axis_iter++) {
+
+		error_gradient[ axis_iter ] = 0.0f;
+	}
+
+	// Modes 6 and 7 have one palette for color and alpha, the other modes
+	// only use the color channels for this palette.
+	uint32_t const num_channels = (p_mode->m_mode_index < 6) ? 3 : 4;
+
+	// Calculate the direction of the color.
+	lane_float line_direction[4];
+	for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+		line_direction[ channel ] = endpoints[ channel + 4 ] - endpoints[ channel ];
+	}
+
+	lane_float inverse_line_length;
+	normalize_float(inverse_line_length, line_direction, num_channels);
+
+	// Calculate the step between weights.
+	float const weight_step_1 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_1 - 1.0f);
+
+	// Calculate the error for color.
+	for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		lane_float const* pixel = pixels[ pixel_iter ];
+
+		// Project the pixel onto the line defined by the endpoints.
+		lane_float offset[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			offset[ channel ] = pixel[ channel ] - endpoints[ channel ];
+		}
+
+		lane_float t = ((num_channels == 3) ? dot_float3(offset, line_direction) : dot_float4(offset, line_direction)) * inverse_line_length;
+		t = lane_clamp(t, 0.0f, 1.0f);
+
+		// Get the index of the closest palette color.
+		lane_float const color_index = lane_rint(t * (palette_size_1 - 1.0f));
+
+		// Get the weights.
+		lane_float const weight1 = lane_rint(color_index * weight_step_1);
+		lane_float const weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+		// Generate the color by interpolating between the endpoints.
+		lane_float palette_color[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			palette_color[ channel ] = (endpoints[ channel ] * weight0 + endpoints[ channel + 4 ] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+		}
+
+		// Calculate the error which is the sum of squared differences.
+		lane_float difference[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			difference[ channel ] = pixel[ channel ] - palette_color[ channel ];
+		}
+
+		lane_float const error = (num_channels == 3) ? dot_float3(difference, difference) : dot_float4(difference, difference);
+
+		// Accumulate the error.
+		total_error += error;
+
+		// Each endpoint moves the palette color by its weight over the maximum weight.
+		lane_float const gradient_scale_0 = weight0 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+		lane_float const gradient_scale_1 = weight1 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			error_gradient[ channel ] += difference[ channel ] * gradient_scale_0;
+			error_gradient[ channel + 4 ] += difference[ channel ] * gradient_scale_1;
+		}
+
+	} // end for
+
+	if ((p_mode->m_mode_index == 4) || (p_mode->m_mode_index == 5)) {
+
+		// There are separate color and alpha palettes for modes 4, 5.
+
+		// Get the length and inverse length of the alpha channel.
+		lane_float const alpha_length = endpoints[7] - endpoints[3];
+		lane_float const inverse_alpha_length = lane_select(alpha_length > 0.0f, 1.0f / alpha_length, 0.0f);
+
+		// Calculate the step between weights.
+		float const weight_step_2 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_2 - 1.0f);
+
+		// Calculate the error for alpha.
+		for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+			// Get the alpha of the pixel.
+			lane_float const pixel_alpha = pixels[ pixel_iter ][3];
+
+			// Get the alpha offset from the first endpoint.
+			lane_float const alpha_offset = pixel_alpha - endpoints[3];
+
+			// Parameterize the alpha value.
+			lane_float const t = lane_clamp(alpha_offset * inverse_alpha_length, 0.0f, 1.0f);
+
+			// Get the index of the closest palette alpha.
+			lane_float const alpha_index = lane_rint(t * (palette_size_2 - 1.0f));
+
+			// Get the weights.
+			lane_float const weight1 = lane_rint(weight_step_2 * alpha_index);
+			lane_float const weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+			// Generate the alpha value by interpolating between the endpoints.
+			lane_float const palette_alpha = (endpoints[3] * weight0 + endpoints[7] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+			// Calculate the error.
+			lane_float const difference = pixel_alpha - palette_alpha;
+			lane_float const error = difference * difference;
+
+			// Accumulate the error.
+			total_error += error;
+
+			error_gradient[3] += difference * (weight0 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT));
+			error_gradient[7] += difference * (weight1 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT));
+
+		} // end for
+	}
+
+	return total_error;
+}
+
+// This performs Gradient Descent to find the best fit line segment to the block of pixels.
+// The initial condition affects the result, it can find a local minimum error without finding
+// the global minimum error. Each lane stops when it would have stopped in the OpenCL version, the
+// loop keeps going while any of the lanes are still improving.
+//
+// endpoints:				(output) The endpoints for the best fit line segment.
+// in_endpoints:			The initial endpoints.
+// pixels:					The pixels from the image.
+// num_pixels:				Number of pixels.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
+// p_mode:					The current mode.
+// p_params:				The encoding parameters.
+//
+static void bc7_gradient_descent(lane_float2x4 endpoints, lane_float2x4 const in_endpoints,
+											lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t num_pixels,
+											uint32_t swap_palette_index_precision,
+											bc7_mode const* p_mode,
+											bc7_encode_params const* p_params)
+{
+	float const epsilon = 128.0f * FLT_EPSILON;
+
+	// Initialize the endpoints that will be adjusted.
+	copy_float2x4(endpoints, in_endpoints);
+
+	// Get the gradient of the error function, after this it comes along with the error of each step.
+	lane_float2x4 error_gradient;
+	bc7_calculate_error_gradient(error_gradient, endpoints, pixels, num_pixels, swap_palette_index_precision, p_mode);
+
+	// Each refinement pass starts where the last one stopped with half the step size, all of the
+	// lanes take part in each pass again.
+	lane_float last_error = FLT_MAX;
+	float adjustment_factor = p_params->m_adjustment_factor;
+	for (uint32_t pass_iter = 0; pass_iter < p_params->m_num_refinement_passes; pass_iter++) {
+
+		// Iteratively find the minimum error.
+		lane_mask active = lane_true();
+		for (uint32_t num_iterations = 0; num_iterations < p_params->m_max_iterations; num_iterations++) {
+
+			// If the gradient is near zero we are at a local minimum.
+			lane_float error_gradient_magnitude_0;
+			lane_float error_gradient_magnitude_1;
+			length_float2x4(error_gradient_magnitude_0, error_gradient_magnitude_1, error_gradient);
+
+			active = active & !((error_gradient_magnitude_0 < epsilon) & (error_gradient_magnitude_1 < epsilon));
+			if (lane_any(active) == false) {
+
+				break;
+			}
+
+			// Adjust the endpoints in the direction opposite of the error gradient to reduce the error.
+			lane_float2x4 possible_endpoints;
+			for (uint32_t axis_iter = 0; axis_iter < 8; axis_iter++) {
+
+				possible_endpoints[ axis_iter ] = endpoints[ axis_iter ] - adjustment_factor * error_gradient[ axis_iter ];
+			}
+
+			// Clamp the endpoints to the bounds of the color space.
+			clamp_float2x4(possible_endpoints, 0.0f, 255.0f);
+
+			// Calculate the new error, the lanes that didn't improve are finished.
+			lane_float2x4 possible_error_gradient;
+			lane_float const error = bc7_calculate_error_gradient(possible_error_gradient, possible_endpoints, pixels, num_pixels,
+																					swap_palette_index_precision, p_mode);
+			active = active & (error < last_error);
+			if (lane_any(active) == false) {
+
+				break;
+			}
+
+			for (uint32_t axis_iter = 0; axis_iter < 8; axis_iter++) {
+
+				endpoints[ axis_iter ] = lane_select(active, possible_endpoints[ axis_iter ], endpoints[ axis_iter ]);
+				error_gradient[ axis_iter ] = lane_select(active, possible_error_gradient[ axis_iter ], error_gradient[ axis_iter ]);
+			}
+
+			last_error = lane_select(active, error, last_error);
+
+		} // end for
+
+		adjustment_factor *= 0.5f;
+
+	} // end for
+
+	// Clamp the endpoints to the bounds of the color space.
+	clamp_float2x4(endpoints, 0.0f, 255.0f);
+}
+
+// Solve the least squares normal equations for the endpoints of some channels. Each palette color
+// is a0 * e0 + a1 * e1 where a1 is the weight of its index over the maximum weight and a0 is
+// 1 - a1, so minimizing the squared difference to the pixels is a 2x2 linear system that is the
+// same for each channel except for the right hand side.
+//
+// endpoints:			(input/output) The endpoints, lanes that can't be solved keep theirs.
+// sum_a0_a0:			The sum of a0 * a0 over the pixels.
+// sum_a0_a1:			The sum of a0 * a1 over the pixels.
+// sum_a1_a1:			The sum of a1 * a1 over the pixels.
+// sum_a0_pixel:		The sum of a0 times each channel of the pixels.
+// sum_a1_pixel:		The sum of a1 times each channel of the pixels.
+// first_channel:		The first channel to solve.
+// num_channels:		The number of channels to solve.
+//
+static void bc7_solve_least_squares(lane_float2x4 endpoints,
+												lane_float const& sum_a0_a0, lane_float const& sum_a0_a1, lane_float const& sum_a1_a1,
+												lane_float const sum_a0_pixel[4], lane_float const sum_a1_pixel[4],
+												uint32_t first_channel, uint32_t num_channels)
+{
+	lane_float const determinant = sum_a0_a0 * sum_a1_a1 - sum_a0_a1 * sum_a0_a1;
+	lane_mask const is_solvable = determinant > BC7_LEAST_SQUARES_MIN_DETERMINANT;
+	lane_float const inverse_determinant = lane_select(is_solvable, 1.0f / determinant, 0.0f);
+
+	for (uint32_t channel = first_channel; channel < first_channel + num_channels; channel++) {
+
+		lane_float const endpoint_0 = (sum_a1_a1 * sum_a0_pixel[ channel ] - sum_a0_a1 * sum_a1_pixel[ channel ]) * inverse_determinant;
+		lane_float const endpoint_1 = (sum_a0_a0 * sum_a1_pixel[ channel ] - sum_a0_a1 * sum_a0_pixel[ channel ]) * inverse_determinant;
+
+		endpoints[ channel ] = lane_select(is_solvable, lane_clamp(endpoint_0, 0.0f, 255.0f), endpoints[ channel ]);
+		endpoints[ channel + 4 ] = lane_select(is_solvable, lane_clamp(endpoint_1, 0.0f, 255.0f), endpoints[ channel + 4 ]);
+	}
+}
+
+// Assign the pixels to the palette generated by the endpoints the same way the error is
+// calculated, then solve for the endpoints that fit those palette indices with the least error.
+//
+// fitted_endpoints:	(output) The endpoints that fit the palette indices best.
+// endpoints:			The endpoints in color space.
+// pixels:				The pixels from the image.
+// num_pixels:			Number of pixels.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size_1 and Palette_size_2.
+// p_mode:				The current mode.
+//
+// returns: The total error of endpoints.
+//
+static lane_float bc7_fit_endpoints(lane_float2x4 fitted_endpoints, lane_float2x4 const endpoints,
+												lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t num_pixels,
+												uint32_t swap_palette_index_precision,
+												bc7_mode const* p_mode)
+{
+	// Figure out the palette sizes.
+	uint32_t palette_size_1 = p_mode->m_palette_size_1;
+	uint32_t palette_size_2 = p_mode->m_palette_size_2;
+
+	if (swap_palette_index_precision == 1) {
+
+		palette_size_1 = p_mode->m_palette_size_2;
+		palette_size_2 = p_mode->m_palette_size_1;
+	}
+
+	lane_float total_error = 0.0f;
+
+	copy_float2x4(fitted_endpoints, endpoints);
+
+	// Modes 6 and 7 have one palette for color and alpha, the other modes
+	// only use the color channels for this palette.
+	uint32_t const num_channels = (p_mode->m_mode_index < 6) ? 3 : 4;
+
+	// Calculate the direction of the color.
+	lane_float line_direction[4];
+	for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+		line_direction[ channel ] = endpoints[ channel + 4 ] - endpoints[ channel ];
+	}
+
+	lane_float inverse_line_length;
+	normalize_float(inverse_line_length, line_direction, num_channels);
+
+	// Calculate the step between weights.
+	float const weight_step_1 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_1 - 1.0f);
+
+	// The sums for the normal equations.
+	lane_float sum_a0_a0 = 0.0f;
+	lane_float sum_a0_a1 = 0.0f;
+	lane_float sum_a1_a1 = 0.0f;
+	lane_float sum_a0_pixel[4];
+	lane_float sum_a1_pixel[4];
+	for (uint32_t channel = 0; channel < 4; channel++) {
+
+		sum_a0_pixel[ channel ] = 0.0f;
+		sum_a1_pixel[ channel ] = 0.0f;
+	}
+
+	// Calculate the error for color.
+	for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		lane_float const* pixel = pixels[ pixel_iter ];
+
+		// Project the pixel onto the line defined by the endpoints.
+		lane_float offset[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			offset[ channel ] = pixel[ channel ] - endpoints[ channel ];
+		}
+
+		lane_float t = ((num_channels == 3) ? dot_float3(offset, line_direction) : dot_float4(offset, line_direction)) * inverse_line_length;
+		t = lane_clamp(t, 0.0f, 1.0f);
+
+		// Get the index of the closest palette color.
+		lane_float const color_index = lane_rint(t * (palette_size_1 - 1.0f));
+
+		// Get the weights.
+		lane_float const weight1 = lane_rint(color_index * weight_step_1);
+		lane_float const weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+		// Generate the color by interpolating between the endpoints.
+		lane_float palette_color[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			palette_color[ channel ] = (endpoints[ channel ] * weight0 + endpoints[ channel + 4 ] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+		}
+
+		// Calculate the error which is the sum of squared differences.
+		lane_float difference[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			difference[ channel ] = pixel[ channel ] - palette_color[ channel ];
+		}
+
+		lane_float const error = (num_channels == 3) ? dot_float3(difference, difference) : dot_float4(difference, difference);
+
+		// Accumulate the error.
+		total_error += error;
+
+		// Accumulate the sums with this palette index.
+		lane_float const a0 = weight0 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+		lane_float const a1 = weight1 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+		sum_a0_a0 += a0 * a0;
+		sum_a0_a1 += a0 * a1;
+		sum_a1_a1 += a1 * a1;
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			sum_a0_pixel[ channel ] += a0 * pixel[ channel ];
+			sum_a1_pixel[ channel ] += a1 * pixel[ channel ];
+		}
+
+	} // end for
+
+	bc7_solve_least_squares(fitted_endpoints, sum_a0_a0, sum_a0_a1, sum_a1_a1, sum_a0_pixel, sum_a1_pixel, 0, num_channels);
+
+	if ((p_mode->m_mode_index == 4) || (p_mode->m_mode_index == 5)) {
+
+		// There are separate color and alpha palettes for modes 4, 5.
+
+		// Get the length and inverse length of the alpha channel.
+		lane_float const alpha_length = endpoints[7] - endpoints[3];
+		lane_float const inverse_alpha_length = lane_select(alpha_length > 0.0f, 1.0f / alpha_length, 0.0f);
+
+		// Calculate the step between weights.
+		float const weight_step_2 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_2 - 1.0f);
+
+		lane_float sum_alpha_a0_a0 = 0.0f;
+		lane_float sum_alpha_a0_a1 = 0.0f;
+		lane_float sum_alpha_a1_a1 = 0.0f;
+
+		// Calculate the error for alpha.
+		for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+			// Get the alpha of the pixel.
+			lane_float const pixel_alpha = pixels[ pixel_iter ][3];
+
+			// Get the alpha offset from the first endpoint.
+			lane_float const alpha_offset = pixel_alpha - endpoints[3];
+
+			// Parameterize the alpha value.
+			lane_float const t = lane_clamp(alpha_offset * inverse_alpha_length, 0.0f, 1.0f);
+
+			// Get the index of the closest palette alpha.
+			lane_float const alpha_index = lane_rint(t * (palette_size_2 - 1.0f));
+
+			// Get the weights.
+			lane_float const weight1 = lane_rint(weight_step_2 * alpha_index);
+			lane_float const weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+			// Generate the alpha value by interpolating between the endpoints.
+			lane_float const palette_alpha = (endpoints[3] * weight0 + endpoints[7] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+			// Calculate the error.
+			lane_float const difference = pixel_alpha - palette_alpha;
+			lane_float const error = difference * difference;
+
+			// Accumulate the error.
+			total_error += error;
+
+			// Accumulate the sums with this palette index.
+			lane_float const a0 = weight0 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+			lane_float const a1 = weight1 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+			sum_alpha_a0_a0 += a0 * a0;
+			sum_alpha_a0_a1 += a0 * a1;
+			sum_alpha_a1_a1 += a1 * a1;
+			sum_a0_pixel[3] += a0 * pixel_alpha;
+			sum_a1_pixel[3] += a1 * pixel_alpha;
+
+		} // end for
+
+		bc7_solve_least_squares(fitted_endpoints, sum_alpha_a0_a0, sum_alpha_a0_a1, sum_alpha_a1_a1, sum_a0_pixel, sum_a1_pixel, 3, 1);
+	}
+
+	return total_error;
+}
+
+// This alternates assigning the pixels to palette indices with solving for the endpoints that fit
+// those indices best until the error stops going down. Each fit is exact for its palette indices
+// so this usually settles in a couple of iterations. Each lane stops when it would have stopped
+// in the OpenCL version.
+//
+// endpoints:				(output) The endpoints for the best fit line segment.
+// in_endpoints:			The initial endpoints.
+// pixels:					The pixels from the image.
+// num_pixels:				Number of pixels.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
+// p_mode:					The current mode.
+// p_params:				The encoding parameters.
+//
+static void bc7_least_squares(lane_float2x4 endpoints, lane_float2x4 const in_endpoints,
+										lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t num_pixels,
+										uint32_t swap_palette_index_precision,
+										bc7_mode const* p_mode,
+										bc7_encode_params const* p_params)
+{
+	copy_float2x4(endpoints, in_endpoints);
+
+	// Fit the initial endpoints, after this each fit comes along with the error of the last one.
+	lane_float2x4 fitted_endpoints;
+	lane_float last_error = bc7_fit_endpoints(fitted_endpoints, endpoints, pixels, num_pixels,
+															swap_palette_index_precision, p_mode);
+
+	lane_mask active = lane_true();
+	for (uint32_t num_iterations = 0; num_iterations < p_params->m_max_iterations; num_iterations++) {
+
+		// Calculate the error of the fitted endpoints, the lanes that didn't improve are finished.
+		lane_float2x4 next_fitted_endpoints;
+		lane_float const error = bc7_fit_endpoints(next_fitted_endpoints, fitted_endpoints, pixels, num_pixels,
+																 swap_palette_index_precision, p_mode);
+		active = active & (error < last_error);
+		if (lane_any(active) == false) {
+
+			break;
+		}
+
+		for (uint32_t axis_iter = 0; axis_iter < 8; axis_iter++) {
+
+			endpoints[ axis_iter ] = lane_select(active, fitted_endpoints[ axis_iter ], endpoints[ axis_iter ]);
+			fitted_endpoints[ axis_iter ] = lane_select(active, next_fitted_endpoints[ axis_iter ], fitted_endpoints[ axis_iter ]);
+		}
+
+		last_error = lane_select(active, error, last_error);
+
+	} // end for
+}
+
+// Swap the quantized endpoints.
+//
+// p_quantized_endpoints:  (input/output) The quantized endpoints to swap.
+// subset_index:           The index of the subset of the particular endpoints to swap.
+// swap_mode:              Which channels to swap.
+// swap:						 The lanes to swap.
+// p_mode:                 The current mode.
+//
+static void bc7_swap_quantized_endpoints(bc7_lane_quantized_endpoints* p_quantized_endpoints,
+                                         uint32_t subset_index, uint32_t swap_mode,
+                                         lane_mask const& swap,
+                                         bc7_mode const* p_mode)
+{
+   uint32_t const first_channel = (swap_mode & BC7_SWAP_RGB) ? 0 : 3;
+   uint32_t const end_channel = (swap_mode & BC7_SWAP_ALPHA) ? 4 : 3;
+
+   for (uint32_t channel = first_channel; channel < end_channel; channel++) {
+
+      lane_uint const value_0 = p_quantized_endpoints->m_endpoints[ subset_index ][ channel ];
+      lane_uint const value_1 = p_quantized_endpoints->m_endpoints[ subset_index ][ channel + 4 ];
+
+      p_quantized_endpoints->m_endpoints[ subset_index ][ channel ] = lane_select(swap, value_1, value_0);
+      p_quantized_endpoints->m_endpoints[ subset_index ][ channel + 4 ] = lane_select(swap, value_0, value_1);
+
+   } // end for
+
+   if (p_mode->m_parity_bit_type == PARITY_BIT_PER_ENDPOINT) {
+
+      // Re-calculate the parity bits since the endpoints were swapped. The parity bits only depend
+      // on the endpoints so this doesn't change the lanes that weren't swapped.
+      bc7_calculate_parity_bits(p_quantized_endpoints, p_mode);
+   }
+}
+
+// Work out the colors of a palette once for all the pixels of a subset. The error of a color is
+// |pixel|^2 + |color|^2 - 2 * (pixel . color), so with -2 * color and |color|^2 in the table each
+// pixel only needs a dot product per color. The values are all integers well under 2^24 so the
+// floats are exact and the errors are the same as working them out from the interpolated colors.
+//
+// palette_table:		(output) -2 * color for each channel followed by |color|^2 for each color.
+// endpoints:			The unquantized endpoints of the subset.
+// first_channel:		The first channel of the palette, 3 for a separate alpha palette.
+// num_channels:		The number of channels in the palette.
+// palette_size:		The number of colors in the palette.
+// palette_start:		The index of the first weight of the palette in Palette_weights.
+//
+static void bc7_get_palette_table(lane_float palette_table[ MAX_PALETTE_SIZE ][5],
+											 lane_uint const endpoints[8],
+											 uint32_t first_channel, uint32_t num_channels,
+											 uint32_t palette_size, uint32_t palette_start)
+{
+	for (uint32_t color_iter = 0; color_iter < palette_size; color_iter++) {
+
+		uint32_t const weight1 = Palette_weights[ palette_start + color_iter ];
+		uint32_t const weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+		lane_float squared_length = 0.0f;
+		for (uint32_t channel_iter = 0; channel_iter < num_channels; channel_iter++) {
+
+			uint32_t const channel = first_channel + channel_iter;
+
+			// Generate the color by interpolating between the endpoints.
+			lane_float const palette_color = lane_convert_float((endpoints[ channel ] * weight0 + endpoints[ channel + 4 ] * weight1 +
+																				  BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+			palette_table[ color_iter ][ channel_iter ] = -2.0f * palette_color;
+			squared_length += palette_color * palette_color;
+		}
+
+		palette_table[ color_iter ][4] = squared_length;
+
+	} // end for
+}
+
+// Find the closest color in the palette to a pixel, the first one if some are just as close.
+//
+// p_error:				(output) The error of the closest color.
+// palette_table:		The palette from bc7_get_palette_table().
+// pixel:				The pixel.
+// first_channel:		The first channel of the palette.
+// num_channels:		The number of channels in the palette.
+// palette_size:		The number of colors in the palette.
+//
+// returns: The index of the closest color.
+//
+static lane_uint bc7_find_palette_index(lane_uint* p_error,
+													 lane_float const palette_table[ MAX_PALETTE_SIZE ][5],
+													 lane_uint const pixel[4],
+													 uint32_t first_channel, uint32_t num_channels,
+													 uint32_t palette_size)
+{
+	lane_float pixel_float[4];
+	lane_float pixel_squared_length = 0.0f;
+	for (uint32_t channel_iter = 0; channel_iter < num_channels; channel_iter++) {
+
+		pixel_float[ channel_iter ] = lane_convert_float(pixel[ first_channel + channel_iter ]);
+		pixel_squared_length += pixel_float[ channel_iter ] * pixel_float[ channel_iter ];
+	}
+
+	// Go through the palette, this leaves |pixel|^2 out of the errors until the end.
+	lane_float best_error = FLT_MAX;
+	lane_uint best_color_index = 0;
+	for (uint32_t color_iter = 0; color_iter < palette_size; color_iter++) {
+
+		lane_float error = palette_table[ color_iter ][4];
+		for (uint32_t channel_iter = 0; channel_iter < num_channels; channel_iter++) {
+
+			error += pixel_float[ channel_iter ] * palette_table[ color_iter ][ channel_iter ];
+		}
+
+		lane_mask const is_better = error < best_error;
+		best_error = lane_select(is_better, error, best_error);
+		best_color_index = lane_select(is_better, lane_uint(color_iter), best_color_index);
+
+	} // end for
+
+	*p_error = lane_convert_uint_rte(best_error + pixel_squared_length);
+	return best_color_index;
+}
+
+// Assign each pixel to a palette color and get the error for the entire block.
+//
+// p_quantized_endpoints:  (input/output) The quantized endpoints.
+// assigned_pixels_1:      (output) An index into the first palette for each pixel.
+// assigned_pixels_2:      (output) An index into the second palette for each pixel.
+// pixels:                 The pixels from the image.
+// swap_palette_index_precision: If this is 1 then swap Palette_size and Palette_size_2.
+// shape_index:            The current shape index.
+// p_mode:                 The current mode.
+//
+// returns: The error for the entire block.
+//
+static lane_uint bc7_assign_pixels(bc7_lane_quantized_endpoints* p_quantized_endpoints,
+											  lane_uint assigned_pixels_1[ NUM_PIXELS_PER_BLOCK ],
+											  lane_uint assigned_pixels_2[ NUM_PIXELS_PER_BLOCK ],
+											  lane_pixel const pixels[ NUM_PIXELS_PER_BLOCK ],
+											  uint32_t swap_palette_index_precision,
+											  uint32_t shape_index,
+											  bc7_mode const* p_mode)
+{
+   // Unquantize the endpoints so we can assign palette indices.
+   lane_uint2x4 endpoints[ BC7_MAX_SUBSETS ];
+   bc7_unquantize_endpoints(endpoints, p_quantized_endpoints, p_mode);
+
+	// Figure out the palette sizes.
+	uint32_t palette_size_1 = p_mode->m_palette_size_1;
+	uint32_t palette_size_2 = p_mode->m_palette_size_2;
+
+	// Figure out the starting weight indices of the palettes.
+	uint32_t palette_start_1 = p_mode->m_palette_start_1;
+	uint32_t palette_start_2 = p_mode->m_palette_start_2;
+
+	if (swap_palette_index_precision == 1) {
+
+		palette_size_1 = p_mode->m_palette_size_2;
+		palette_size_2 = p_mode->m_palette_size_1;
+
+		palette_start_1 = p_mode->m_palette_start_2;
+		palette_start_2 = p_mode->m_palette_start_1;
+	}
+
+	// If there is a separate alpha palette the first palette is just for color.
+	uint32_t const num_channels = (palette_size_2 == 0) ? 4 : 3;
+
+	lane_uint total_error = 0;
+
+	// Go through the subsets and pick the best color in the palette for each of their pixels.
+	for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+		lane_float palette_table[ MAX_PALETTE_SIZE ][5];
+		bc7_get_palette_table(palette_table, endpoints[ subset_iter ], 0, num_channels, palette_size_1, palette_start_1);
+
+		uint32_t const subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			if ((subset_mask & (1 << pixel_iter)) == 0) {
+
+				continue;
+			}
+
+			lane_uint best_error;
+			lane_uint const best_color_index = bc7_find_palette_index(&best_error, palette_table, pixels[ pixel_iter ],
+																						 0, num_channels, palette_size_1);
+
+			// Store the index for this pixel.
+			assigned_pixels_1[ pixel_iter ] = best_color_index;
+			assigned_pixels_2[ pixel_iter ] = best_color_index;
+
+			// Accumulate the error.
+			total_error += best_error;
+
+		} // end for
+
+	} // end for
+
+	// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
+	// high bit set. This saves one bit per block in the final output.
+   uint32_t const swap_mode_1 = (palette_size_2 == 0) ? (BC7_SWAP_RGB | BC7_SWAP_ALPHA) : BC7_SWAP_RGB;
+   uint32_t const high_bit_mask_1 = palette_size_1 >> 1;
+   for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+      uint32_t const anchor_index_1 = bc7_get_anchor_index(shape_index, subset_iter, p_mode);
+
+      // Is the high bit of the anchor index set?
+      lane_mask const swap = (assigned_pixels_1[ anchor_index_1 ] & high_bit_mask_1) != 0;
+      if (lane_any(swap) == false) {
+
+         continue;
+      }
+
+      // Swap endpoints.
+      bc7_swap_quantized_endpoints(p_quantized_endpoints, subset_iter, swap_mode_1, swap, p_mode);
+
+      // Swap indices.
+      for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+         if (bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode) == subset_iter) {
+
+            assigned_pixels_1[ pixel_iter ] = lane_select(swap, (palette_size_1 - 1) - assigned_pixels_1[ pixel_iter ], assigned_pixels_1[ pixel_iter ]);
+         }
+
+      } // end for
+
+   } // end for
+
+	if (palette_size_2 == 0) {
+
+		// There are no separate color and alpha palettes.
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			assigned_pixels_2[ pixel_iter ] = assigned_pixels_1[ pixel_iter ];
+		}
+
+		return total_error;
+	}
+
+	// Go through the subsets and pick the best alpha in the palette for each of their pixels.
+	for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+		lane_float palette_table[ MAX_PALETTE_SIZE ][5];
+		bc7_get_palette_table(palette_table, endpoints[ subset_iter ], 3, 1, palette_size_2, palette_start_2);
+
+		uint32_t const subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			if ((subset_mask & (1 << pixel_iter)) == 0) {
+
+				continue;
+			}
+
+			lane_uint best_error;
+			assigned_pixels_2[ pixel_iter ] = bc7_find_palette_index(&best_error, palette_table, pixels[ pixel_iter ],
+																						3, 1, palette_size_2);
+
+			// Accumulate the error.
+			total_error += best_error;
+
+		} // end for
+
+	} // end for
+
+	// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
+	// high bit set. This saves one bit per block in the final output.
+   uint32_t const high_bit_mask_2 = palette_size_2 >> 1;
+   uint32_t const anchor_index_2 = 0;
+   for (uint32_t subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+      // Is the high bit of the anchor index set?
+      lane_mask const swap = (assigned_pixels_2[ anchor_index_2 ] & high_bit_mask_2) != 0;
+      if (lane_any(swap) == false) {
+
+         continue;
+      }
+
+      // Swap endpoints (alpha channel only).
+      bc7_swap_quantized_endpoints(p_quantized_endpoints, subset_iter, BC7_SWAP_ALPHA, swap, p_mode);
+
+      // Swap indices.
+      for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+         if (bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode) == subset_iter) {
+
+            assigned_pixels_2[ pixel_iter ] = lane_select(swap, (palette_size_2 - 1) - assigned_pixels_2[ pixel_iter ], assigned_pixels_2[ pixel_iter ]);
+         }
+
+      } // end for
+
+   } // end for
+
+	return total_error;
+}
+
+// Move the initial endpoints on to the principal axis of the pixels, the line through the center of
+// mass with the most variance along it. The axis is found with power iteration on the covariance
+// matrix and the endpoints are the extents of the pixels projected on to it. The diagonal of the
+// bounding box is only a good fit when all the channels go up together. Lanes where the pixels are
+// all about the same keep the bounding box.
+//
+// endpoints:		(input/output) The bounding box of the pixels, it is replaced with the principal
+//						axis endpoints.
+// pixels:			The list of pixels.
+// num_pixels:		The number of pixels in the list.
+// num_channels:	3 for RGB and 4 for RGBA.
+//
+static void bc7_fit_principal_axis(lane_float2x4 endpoints,
+											  lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t num_pixels,
+											  uint32_t num_channels)
+{
+	float const inv_num_pixels = 1.0f / num_pixels;
+
+	// Calculate the center of mass.
+	lane_float center_of_mass[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	{
+		for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+			for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+				center_of_mass[ channel ] += pixels[ pixel_iter ][ channel ];
+			}
+
+		} // end for
+
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			center_of_mass[ channel ] *= inv_num_pixels;
+		}
+	}
+
+	// Calculate the covariance matrix, it isn't divided by the number of pixels since only the
+	// direction of the axis matters.
+	lane_float covariance[4][4];
+	for (uint32_t row = 0; row < num_channels; row++) {
+
+		for (uint32_t column = row; column < num_channels; column++) {
+
+			covariance[ row ][ column ] = 0.0f;
+		}
+	}
+
+	for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		lane_float difference[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			difference[ channel ] = pixels[ pixel_iter ][ channel ] - center_of_mass[ channel ];
+		}
+
+		for (uint32_t row = 0; row < num_channels; row++) {
+
+			for (uint32_t column = row; column < num_channels; column++) {
+
+				covariance[ row ][ column ] += difference[ row ] * difference[ column ];
+			}
+		}
+
+	} // end for
+
+	for (uint32_t row = 1; row < num_channels; row++) {
+
+		for (uint32_t column = 0; column < row; column++) {
+
+			covariance[ row ][ column ] = covariance[ column ][ row ];
+		}
+	}
+
+	// Start with the column of the channel with the most variance, unlike the diagonal of the
+	// bounding box it can't be perpendicular to the principal axis.
+	lane_float axis[4];
+	{
+		lane_float max_variance = covariance[0][0];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			axis[ channel ] = covariance[ channel ][0];
+		}
+
+		for (uint32_t column = 1; column < num_channels; column++) {
+
+			lane_mask const is_larger = covariance[ column ][ column ] > max_variance;
+			max_variance = lane_select(is_larger, covariance[ column ][ column ], max_variance);
+
+			for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+				axis[ channel ] = lane_select(is_larger, covariance[ channel ][ column ], axis[ channel ]);
+			}
+		}
+	}
+
+	// Power iteration, each multiply turns the axis towards the eigenvector with the largest
+	// eigenvalue.
+	lane_float inverse_axis_length;
+	normalize_float(inverse_axis_length, axis, num_channels);
+	for (uint32_t iteration = 0; iteration < BC7_PRINCIPAL_AXIS_ITERATIONS; iteration++) {
+
+		lane_float next_axis[4];
+		for (uint32_t row = 0; row < num_channels; row++) {
+
+			next_axis[ row ] = (num_channels == 3) ? dot_float3(covariance[ row ], axis) : dot_float4(covariance[ row ], axis);
+		}
+
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			axis[ channel ] = next_axis[ channel ];
+		}
+
+		normalize_float(inverse_axis_length, axis, num_channels);
+
+	} // end for
+
+	// Find the extents of the pixels along the axis.
+	lane_float min_t = FLT_MAX;
+	lane_float max_t = -FLT_MAX;
+	for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		lane_float offset[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			offset[ channel ] = pixels[ pixel_iter ][ channel ] - center_of_mass[ channel ];
+		}
+
+		lane_float const t = (num_channels == 3) ? dot_float3(offset, axis) : dot_float4(offset, axis);
+		min_t = lane_min(min_t, t);
+		max_t = lane_max(max_t, t);
+
+	} // end for
+
+	// A zero length axis means the pixels are all about the same.
+	lane_mask const has_axis = inverse_axis_length > 0.0f;
+	for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+		lane_float const endpoint_0 = lane_clamp(center_of_mass[ channel ] + axis[ channel ] * min_t, 0.0f, 255.0f);
+		lane_float const endpoint_1 = lane_clamp(center_of_mass[ channel ] + axis[ channel ] * max_t, 0.0f, 255.0f);
+
+		endpoints[ channel ] = lane_select(has_axis, endpoint_0, endpoints[ channel ]);
+		endpoints[ channel + 4 ] = lane_select(has_axis, endpoint_1, endpoints[ channel + 4 ]);
+	}
+}
+
+// Attempt to find the best endpoints for a set of pixels.
+//
+// endpoints:        (output) The endpoints and pixels assigned to palette indices.
+// pixels:				The list of pixels.
+// num_pixels:			The number of pixels in the list.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
+// endpoint_optimizer:	How the endpoints are refined (Gradient Descent or least squares).
+// p_mode:				The current mode.
+// p_params:			The encoding parameters.
+//
+static void bc7_find_endpoints(lane_float2x4 endpoints,
+										 lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ], uint32_t num_pixels,
+										 uint32_t swap_palette_index_precision,
+										 uint32_t endpoint_optimizer,
+										 bc7_mode const* p_mode,
+										 bc7_encode_params const* p_params)
+{
+	// Calculate the bounding box in color space of the pixels.
+	lane_float2x4 initial_endpoints;
+	{
+		for (uint32_t channel = 0; channel < 4; channel++) {
+
+			initial_endpoints[ channel ] = FLT_MAX;
+			initial_endpoints[ channel + 4 ] = -FLT_MAX;
+		}
+
+		for (uint32_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+			for (uint32_t channel = 0; channel < 4; channel++) {
+
+				initial_endpoints[ channel ] = lane_min(initial_endpoints[ channel ], pixels[ pixel_iter ][ channel ]);
+				initial_endpoints[ channel + 4 ] = lane_max(initial_endpoints[ channel + 4 ], pixels[ pixel_iter ][ channel ]);
+			}
+
+		} // end for
+	}
+
+	// Modes 6 and 7 have one palette for color and alpha, modes 4 and 5 keep the bounding box for
+	// their alpha palette.
+	bc7_fit_principal_axis(initial_endpoints, pixels, num_pixels, (p_mode->m_mode_index < 6) ? 3 : 4);
+
+	// Find a local minimum in error.
+	if (endpoint_optimizer == BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES) {
+
+		bc7_least_squares(endpoints, initial_endpoints, pixels, num_pixels,
+								swap_palette_index_precision, p_mode, p_params);
+
+	} else {
+
+		bc7_gradient_descent(endpoints, initial_endpoints, pixels, num_pixels,
+									swap_palette_index_precision, p_mode, p_params);
+	}
+}
+
+// Estimate the least error a subset can be compressed with from its moments. The squared distance
+// of the pixels to a line through their center of mass is smallest along the principal axis, where
+// it is the trace of the scatter matrix minus its largest eigenvalue. The palette and quantization
+// only add to that so it is (about, since the eigenvalue is only estimated) a lower bound on
+// the error.
+//
+// The lower bound is a strict version of the same thing. The largest eigenvalue can't be more than
+// what it would be if the other eigenvalues were all the same, which only needs the trace and the
+// sum of the squares of the scatter matrix. The palette colors are rounded so they can be up to
+// half a step off the line in each channel, the bound takes that distance off each pixel.
+//
+// p_lower_bound:	(output) The least error the subset can have with any endpoints.
+// moments:			The sums of the channels followed by the sums of the products of the channels
+//						(see Moment_products) over the pixels in the subset.
+// num_pixels:		The number of pixels in the subset.
+// num_channels:	3 for RGB and 4 for RGBA.
+// estimate:		False if only the lower bound is needed.
+//
+// returns: The estimated error, 0 if it wasn't estimated.
+//
+static lane_float bc7_estimate_subset_error(lane_float* p_lower_bound,
+														  lane_float const moments[ BC7_MAX_MOMENTS ], uint32_t num_pixels,
+														  uint32_t num_channels, bool estimate)
+{
+	if (num_pixels == 0) {
+
+		*p_lower_bound = 0.0f;
+		return 0.0f;
+	}
+
+	float const inv_num_pixels = 1.0f / num_pixels;
+
+	// Calculate the scatter matrix, the sum of the squared differences from the center of mass.
+	lane_float scatter[4][4];
+	lane_float trace = 0.0f;
+	lane_float sum_squares = 0.0f;
+	uint32_t const num_products = (num_channels == 3) ? BC7_NUM_MOMENT_PRODUCTS_RGB : BC7_NUM_MOMENT_PRODUCTS_RGBA;
+	for (uint32_t product_iter = 0; product_iter < num_products; product_iter++) {
+
+		uint32_t const row = Moment_products[ num_channels - 3 ][ product_iter ][0];
+		uint32_t const column = Moment_products[ num_channels - 3 ][ product_iter ][1];
+
+		lane_float const value = moments[ num_channels + product_iter ] - moments[ row ] * moments[ column ] * inv_num_pixels;
+		scatter[ row ][ column ] = value;
+		scatter[ column ][ row ] = value;
+
+		if (row == column) {
+
+			trace += value;
+			sum_squares += value * value;
+
+		} else {
+
+			sum_squares += 2.0f * value * value;
+		}
+
+	} // end for
+
+	// The largest eigenvalue is at most (trace + sqrt((n - 1) * (n * sum_squares - trace^2))) / n for
+	// an n x n matrix, which is exact when the pixels are on a line. The rounding of the palette
+	// colors takes up to 0.5 * sqrt(num_channels) off the distance of each pixel to the line, so at
+	// most 0.5 * sqrt(num_channels * num_pixels) off the distance of the whole subset.
+	{
+		float const n = static_cast< float >(num_channels);
+		lane_float const spread = lane_max((n - 1.0f) * (n * sum_squares - trace * trace), 0.0f);
+		lane_float const max_eigenvalue = lane_min((trace + lane_sqrt(spread)) * (1.0f / n), trace);
+		lane_float const line_error = lane_max(trace - max_eigenvalue, 0.0f);
+
+		lane_float const distance = lane_max(lane_sqrt(line_error) - 0.5f * lane_sqrt(lane_float(n * num_pixels)), 0.0f);
+		*p_lower_bound = distance * distance;
+	}
+
+	if (!estimate) {
+
+		return 0.0f;
+	}
+
+	// The largest eigenvalue is the variance along the principal axis. The Rayleigh quotient of
+	// one power iteration from the column of the channel with the most variance is close enough to
+	// rank the shapes. The scatter can't get big enough to overflow without normalizing. The alpha
+	// row of the axis isn't set or read with 3 channels.
+	lane_float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	{
+		lane_float max_variance = scatter[0][0];
+		lane_float column[4];
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			column[ channel ] = scatter[ channel ][0];
+		}
+
+		for (uint32_t column_iter = 1; column_iter < num_channels; column_iter++) {
+
+			lane_mask const is_larger = scatter[ column_iter ][ column_iter ] > max_variance;
+			max_variance = lane_select(is_larger, scatter[ column_iter ][ column_iter ], max_variance);
+
+			for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+				column[ channel ] = lane_select(is_larger, scatter[ channel ][ column_iter ], column[ channel ]);
+			}
+		}
+
+		for (uint32_t row = 0; row < num_channels; row++) {
+
+			axis[ row ] = (num_channels == 3) ? dot_float3(scatter[ row ], column) : dot_float4(scatter[ row ], column);
+		}
+	}
+
+	lane_float scatter_axis[4];
+	for (uint32_t row = 0; row < num_channels; row++) {
+
+		scatter_axis[ row ] = (num_channels == 3) ? dot_float3(scatter[ row ], axis) : dot_float4(scatter[ row ], axis);
+	}
+
+	lane_float const axis_scatter_axis = (num_channels == 3) ? dot_float3(axis, scatter_axis) : dot_float4(axis, scatter_axis);
+	lane_float const axis_axis = (num_channels == 3) ? dot_float3(axis, axis) : dot_float4(axis, axis);
+
+	// A zero length axis means the pixels are all about the same, those lanes are replaced so it
+	// doesn't matter that they divide by zero.
+	lane_mask const has_axis = axis_axis > 0.0f;
+	lane_float const eigenvalue = axis_scatter_axis / axis_axis;
+
+	return lane_select(has_axis, lane_max(trace - eigenvalue, 0.0f), 0.0f);
+}
+
+// Estimate the error of each shape of a mode from the moments of the pixels, so they don't need to
+// be gathered for each shape. The moments of each subset are summed from its mask except for the
+// last one which is what is left of the block.
+//
+// estimates:		(output) The estimated error of each shape (see bc7_estimate_subset_error()), this
+//						can be NULL when only the lower bounds are needed.
+// lower_bounds:	(output) The least error each shape can have.
+// pixels:			The block of pixels.
+// p_mode:			The current mode.
+//
+static void bc7_estimate_shape_errors(lane_float* estimates, lane_float lower_bounds[ BC7_MAX_SHAPES ],
+												  lane_pixel_float const pixels[ NUM_PIXELS_PER_BLOCK ],
+												  bc7_mode const* p_mode)
+{
+	uint32_t const num_shapes = 1 << p_mode->m_num_shape_bits;
+
+	// Modes 0 to 3 only have color and modes 4 and 5 have separate alpha indices, so only the color
+	// of the pixels has to be on a line.
+	uint32_t const num_channels = (p_mode->m_mode_index < 6) ? 3 : 4;
+	uint32_t const num_moments = num_channels + ((num_channels == 3) ? BC7_NUM_MOMENT_PRODUCTS_RGB : BC7_NUM_MOMENT_PRODUCTS_RGBA);
+	uint32_t const num_subsets = p_mode->m_num_subsets;
+
+	// Calculate the moments of each pixel and of the whole block.
+	lane_float pixel_moments[ NUM_PIXELS_PER_BLOCK ][ BC7_MAX_MOMENTS ];
+	lane_float block_moments[ BC7_MAX_MOMENTS ];
+	for (uint32_t moment_iter = 0; moment_iter < num_moments; moment_iter++) {
+
+		block_moments[ moment_iter ] = 0.0f;
+	}
+
+	for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		for (uint32_t channel = 0; channel < num_channels; channel++) {
+
+			pixel_moments[ pixel_iter ][ channel ] = pixels[ pixel_iter ][ channel ];
+		}
+
+		for (uint32_t moment_iter = num_channels; moment_iter < num_moments; moment_iter++) {
+
+			uint8_t const* p_product = Moment_products[ num_channels - 3 ][ moment_iter - num_channels ];
+			pixel_moments[ pixel_iter ][ moment_iter ] = pixels[ pixel_iter ][ p_product[0] ] * pixels[ pixel_iter ][ p_product[1] ];
+		}
+
+		for (uint32_t moment_iter = 0; moment_iter < num_moments; moment_iter++) {
+
+			block_moments[ moment_iter ] += pixel_moments[ pixel_iter ][ moment_iter ];
+		}
+
+	} // end for
+
+	for (uint32_t shape_index = 0; shape_index < num_shapes; shape_index++) {
+
+		lane_float remaining_moments[ BC7_MAX_MOMENTS ];
+		for (uint32_t moment_iter = 0; moment_iter < num_moments; moment_iter++) {
+
+			remaining_moments[ moment_iter ] = block_moments[ moment_iter ];
+		}
+
+		uint32_t num_remaining_pixels = NUM_PIXELS_PER_BLOCK;
+		lane_float estimate = 0.0f;
+		lane_float lower_bound = 0.0f;
+		for (uint32_t subset_iter = 0; subset_iter < num_subsets - 1; subset_iter++) {
+
+			uint32_t const subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+
+			lane_float subset_moments[ BC7_MAX_MOMENTS ];
+			for (uint32_t moment_iter = 0; moment_iter < num_moments; moment_iter++) {
+
+				subset_moments[ moment_iter ] = 0.0f;
+			}
+
+			uint32_t num_subset_pixels = 0;
+			for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+				if ((subset_mask & (1 << pixel_iter)) == 0) {
+
+					continue;
+				}
+
+				for (uint32_t moment_iter = 0; moment_iter < num_moments; moment_iter++) {
+
+					subset_moments[ moment_iter ] += pixel_moments[ pixel_iter ][ moment_iter ];
+				}
+
+				num_subset_pixels++;
+
+			} // end for
+
+			for (uint32_t moment_iter = 0; moment_iter < num_moments; moment_iter++) {
+
+				remaining_moments[ moment_iter ] -= subset_moments[ moment_iter ];
+			}
+
+			num_remaining_pixels -= num_subset_pixels;
+
+			lane_float subset_lower_bound;
+			estimate += bc7_estimate_subset_error(&subset_lower_bound, subset_moments, num_subset_pixels, num_channels, estimates != NULL);
+			lower_bound += subset_lower_bound;
+
+		} // end for
+
+		lane_float subset_lower_bound;
+		estimate += bc7_estimate_subset_error(&subset_lower_bound, remaining_moments, num_remaining_pixels, num_channels, estimates != NULL);
+		lower_bound += subset_lower_bound;
+
+		if (estimates != NULL) {
+
+			estimates[ shape_index ] = estimate;
+		}
+
+		lower_bounds[ shape_index ] = lower_bound;
+
+	} // end for
+}
+
+// Get the best shapes to refine, the shapes with the lowest estimated error. Each lane gets a bit
+// per shape so all the lanes go through the shapes in index order, the OpenCL and CUDA versions
+// refine their best shapes in the same order so a tie goes to the same shape.
+//
+// best_shapes:	(output) A bit for each lane that has the shape as one of its best shapes.
+// estimates:		The estimated error of each shape from bc7_estimate_shape_errors().
+// p_mode:			The current mode.
+// p_params:		The encoding parameters.
+//
+static void bc7_get_best_shapes(uint32_t best_shapes[ BC7_MAX_SHAPES ],
+										  lane_float const estimates[ BC7_MAX_SHAPES ],
+										  bc7_mode const* p_mode,
+										  bc7_encode_params const* p_params)
+{
+	uint32_t const num_shapes = 1 << p_mode->m_num_shape_bits;
+	if (num_shapes == 1) {
+
+		best_shapes[0] = lane_bits(lane_true());
+		return;
+	}
+
+	// Use a fraction of the number of shapes for the best shapes.
+	uint32_t const max_best_shapes = (p_params->m_max_best_shapes < (num_shapes >> 2)) ? p_params->m_max_best_shapes : (num_shapes >> 2);
+
+	float lane_estimates[ BC7_MAX_SHAPES ][ Num_lanes ];
+	for (uint32_t shape_index = 0; shape_index < num_shapes; shape_index++) {
+
+		lane_store(lane_estimates[ shape_index ], estimates[ shape_index ]);
+		best_shapes[ shape_index ] = 0;
+
+	} // end for
+
+	// Pick the shapes with the lowest estimated error for each lane.
+	for (uint32_t lane_iter = 0; lane_iter < Num_lanes; lane_iter++) {
+
+		uint32_t num_best_shapes = 0;
+		uint32_t best_shape_indices[ BC7_MAX_BEST_SHAPES ];
+		float best_estimates[ BC7_MAX_BEST_SHAPES ];
+		for (uint32_t shape_index = 0; shape_index < num_shapes; shape_index++) {
+
+			float const estimate = lane_estimates[ shape_index ][ lane_iter ];
+
+			// Find where this shape goes.
+			uint32_t best_shape_iter;
+			for (best_shape_iter = 0; best_shape_iter < num_best_shapes; best_shape_iter++) {
+
+				if (estimate < best_estimates[ best_shape_iter ]) {
+
+					break;
+				}
+
+			} // end for
+
+			if (best_shape_iter == max_best_shapes) {
+
+				continue;
+			}
+
+			// Shift the slots down.
+			if (num_best_shapes < max_best_shapes) {
+
+				num_best_shapes++;
+			}
+
+			for (uint32_t shift_iter = (num_best_shapes - 1); shift_iter > best_shape_iter; shift_iter--) {
+
+				best_shape_indices[ shift_iter ] = best_shape_indices[ shift_iter - 1 ];
+				best_estimates[ shift_iter ] = best_estimates[ shift_iter - 1 ];
+			}
+
+			best_shape_indices[ best_shape_iter ] = shape_index;
+			best_estimates[ best_shape_iter ] = estimate;
+
+		} // end for
+
+		for (uint32_t best_shape_iter = 0; best_shape_iter < num_best_shapes; best_shape_iter++) {
+
+			best_shapes[ best_shape_indices[ best_shape_iter ] ] |= 1 << lane_iter;
+		}
+
+	} // end for
+}
+
+// Copy one lane of the compressed blocks in to a compressed block that can be encoded.
+//
+// p_compressed_block:	(output) The compressed block.
+// p_lane_block:			The compressed blocks for all the lanes.
+// lane_index:				The lane to copy.
+//
+static void bc7_extract_lane(bc7_unencoded_block* p_compressed_block,
+									  bc7_lane_compressed_block const* p_lane_block, uint32_t lane_index)
+{
+	uint32_t values[ Num_lanes ];
+
+	for (uint32_t subset_iter = 0; subset_iter < BC7_MAX_SUBSETS; subset_iter++) {
+
+		for (uint32_t channel = 0; channel < 8; channel++) {
+
+			lane_store(values, p_lane_block->m_quantized_endpoints.m_endpoints[ subset_iter ][ channel ]);
+			p_compressed_block->m_quantized_endpoints.m_endpoints[ subset_iter ][ channel ] = values[ lane_index ];
+		}
+
+	} // end for
+
+	for (uint32_t parity_iter = 0; parity_iter < 2 * BC7_MAX_SUBSETS; parity_iter++) {
+
+		lane_store(values, p_lane_block->m_quantized_endpoints.m_parity_bits[ parity_iter ]);
+		p_compressed_block->m_quantized_endpoints.m_parity_bits[ parity_iter ] = values[ lane_index ];
+	}
+
+	for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		lane_store(values, p_lane_block->m_palette_indices_1[ pixel_iter ]);
+		p_compressed_block->m_palette_indices_1[ pixel_iter ] = static_cast< uint8_t >(values[ lane_index ]);
+
+		lane_store(values, p_lane_block->m_palette_indices_2[ pixel_iter ]);
+		p_compressed_block->m_palette_indices_2[ pixel_iter ] = static_cast< uint8_t >(values[ lane_index ]);
+
+	} // end for
+
+	lane_store(values, p_lane_block->m_error);
+	p_compressed_block->m_error = values[ lane_index ];
+
+	lane_store(values, p_lane_block->m_rotation);
+	p_compressed_block->m_rotation = static_cast< uint8_t >(values[ lane_index ]);
+
+	lane_store(values, p_lane_block->m_index_selection_bit);
+	p_compressed_block->m_index_selection_bit = static_cast< uint8_t >(values[ lane_index ]);
+
+	lane_store(values, p_lane_block->m_shape);
+	p_compressed_block->m_shape = static_cast< uint8_t >(values[ lane_index ]);
+}
+
+// Find out whether the blocks are opaque, grayscale or a solid color so the mode search can
+// skip the modes and rotations that can't win.
+//
+// pixels:	The blocks of pixels.
+//
+// returns: A combination of BC7_BLOCK_OPAQUE, BC7_BLOCK_GRAYSCALE and BC7_BLOCK_SOLID for each lane.
+//
+static lane_uint bc7_classify_blocks(lane_pixel const pixels[ NUM_PIXELS_PER_BLOCK ])
+{
+	lane_mask is_opaque = lane_true();
+	lane_mask is_grayscale = lane_true();
+	lane_mask is_solid = lane_true();
+	for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		is_opaque = is_opaque & (pixels[ pixel_iter ][3] == lane_uint(255));
+		is_grayscale = is_grayscale & (pixels[ pixel_iter ][0] == pixels[ pixel_iter ][1]) & (pixels[ pixel_iter ][1] == pixels[ pixel_iter ][2]);
+
+		for (uint32_t channel = 0; channel < 4; channel++) {
+
+			is_solid = is_solid & (pixels[ pixel_iter ][ channel ] == pixels[0][ channel ]);
+		}
+
+	} // end for
+
+	return lane_select(is_opaque, lane_uint(BC7_BLOCK_OPAQUE), lane_uint(0)) |
+			 lane_select(is_grayscale, lane_uint(BC7_BLOCK_GRAYSCALE), lane_uint(0)) |
+			 lane_select(is_solid, lane_uint(BC7_BLOCK_SOLID), lane_uint(0));
+}
+
+// Compress and encode the blocks of pixels for the given mode.
+//
+// p_encoded_blocks:	(output) A compressed and encoded block for each lane if the error is better.
+// pixels:				The blocks of pixels to compress.
+// block_indices: 	The global index of the block of pixels in each lane.
+// num_blocks:			The number of lanes that have a block, the rest are ignored.
+// p_mode:				The current mode.
+// num_lane_rotations:	The number of channel rotations to try in each lane, the lanes can't
+//								pick the rotations past this.
+// num_rotations:		The number of channel rotations to go through, the most of any lane.
+// input_error:		The current best error.
+// p_params:			The encoding parameters.
+// p_num_pruned_evaluations:	(input/output) The number of evaluations that were skipped because
+//										the lower bound of the shape was no better than the best error so far.
+//
+// returns: The new error (or the same error if there was no improvement).
+//
+static lane_uint bc7_compress(bc7_compressed_block* p_encoded_blocks,
+										lane_pixel pixels[ NUM_PIXELS_PER_BLOCK ],
+										uint32_t const block_indices[ Num_lanes ], uint32_t num_blocks,
+										bc7_mode const* p_mode,
+										lane_uint const& num_lane_rotations, uint32_t num_rotations,
+										lane_uint const& input_error,
+										bc7_encode_params const* p_params,
+										uint32_t* p_num_pruned_evaluations)
+{
+	// The best compressed blocks.
+	bc7_lane_compressed_block compressed_block;
+	{
+		compressed_block.m_error = UINT_MAX;
+		compressed_block.m_rotation = 0;
+		compressed_block.m_index_selection_bit = 0;
+		compressed_block.m_shape = 0;
+
+		// The lanes where no shape beats the input error never store their indices.
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			compressed_block.m_palette_indices_1[ pixel_iter ] = 0;
+			compressed_block.m_palette_indices_2[ pixel_iter ] = 0;
+
+		} // end for
+	}
+
+	uint32_t const num_shapes = 1 << p_mode->m_num_shape_bits;
+	uint32_t const num_isb_states = 1 << p_mode->m_num_isb_bits;
+	uint32_t const num_subsets = p_mode->m_num_subsets;
+
+	// Every lane uses every shape when the shapes aren't culled, otherwise the best shapes are
+	// picked with the first rotation (which doesn't swap any channels).
+	bool const cull_shapes = (p_params->m_max_best_shapes > 0);
+	uint32_t best_shapes[ BC7_MAX_SHAPES ];
+	for (uint32_t shape_index = 0; shape_index < num_shapes; shape_index++) {
+
+		best_shapes[ shape_index ] = lane_bits(lane_true());
+	}
+
+	// The endpoint optimizers that are tried for each shape.
+	uint32_t const first_optimizer = (p_params->m_endpoint_optimizer == BC7_ENDPOINT_OPTIMIZER_BOTH) ?
+												static_cast< uint32_t >(BC7_ENDPOINT_OPTIMIZER_GRADIENT_DESCENT) : p_params->m_endpoint_optimizer;
+	uint32_t const last_optimizer = (p_params->m_endpoint_optimizer == BC7_ENDPOINT_OPTIMIZER_BOTH) ?
+											  static_cast< uint32_t >(BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES) : p_params->m_endpoint_optimizer;
+
+	// The lanes that have a block, the counts leave out the lanes that repeat the last block.
+	uint32_t const block_lanes = (num_blocks < 32) ? ((1u << num_blocks) - 1) : 0xffffffff;
+	lane_uint const error_threshold = lane_uint(p_params->m_error_threshold);
+
+	// Iterate through the channel rotations.
+	for (uint32_t rotation_iter = 0; rotation_iter < num_rotations; rotation_iter++) {
+
+		// The lanes that try this rotation, the ones that have reached the error threshold stop
+		// searching.
+		lane_uint const rotation_best_error = lane_select(compressed_block.m_error < input_error, compressed_block.m_error, input_error);
+		lane_mask const is_rotation_tried = (lane_uint(rotation_iter) < num_lane_rotations) & (error_threshold < rotation_best_error);
+
+		if (lane_any(is_rotation_tried) == false) {
+
+			break;
+		}
+
+		// Potentially swap a color channel with the alpha channel to improve precision.
+		bc7_swap_channels(pixels, rotation_iter);
+
+		// Gradient Descent works on floating point pixels.
+		lane_pixel_float pixels_float[ NUM_PIXELS_PER_BLOCK ];
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			for (uint32_t channel = 0; channel < 4; channel++) {
+
+				pixels_float[ pixel_iter ][ channel ] = lane_convert_float(pixels[ pixel_iter ][ channel ]);
+			}
+
+		} // end for
+
+		// The lower bounds depend on which channel is in the alpha channel.
+		bool const pick_best_shapes = cull_shapes && (rotation_iter == 0);
+		lane_float shape_estimates[ BC7_MAX_SHAPES ];
+		lane_float shape_lower_bounds[ BC7_MAX_SHAPES ];
+		bc7_estimate_shape_errors(pick_best_shapes ? shape_estimates : NULL, shape_lower_bounds, pixels_float, p_mode);
+
+		if (pick_best_shapes) {
+
+			bc7_get_best_shapes(best_shapes, shape_estimates, p_mode, p_params);
+		}
+
+		lane_uint lane_lower_bounds[ BC7_MAX_SHAPES ];
+		for (uint32_t shape_index = 0; shape_index < num_shapes; shape_index++) {
+
+			lane_lower_bounds[ shape_index ] = lane_convert_uint_rte(shape_lower_bounds[ shape_index ]);
+		}
+
+		// Iterate through the states of the index selection bit.
+		for (uint32_t isb_iter = 0; isb_iter < num_isb_states; isb_iter++) {
+
+			// Iterate through the shapes.
+			for (uint32_t shape_index = 0; shape_index < num_shapes; shape_index++) {
+
+				// Skip the shape if it isn't one of the best shapes for any of the lanes.
+				if (best_shapes[ shape_index ] == 0) {
+
+					continue;
+				}
+
+				lane_mask const is_best_shape = lane_mask_from_bits(best_shapes[ shape_index ]);
+
+				// Branch and bound, a shape can't win in the lanes where its lower bound isn't less
+				// than the best error of this mode or the modes before it. The errors are integers
+				// so rounding the bound to the nearest one is still a bound.
+				lane_uint const best_error = lane_select(compressed_block.m_error < input_error, compressed_block.m_error, input_error);
+				lane_mask const is_candidate = is_rotation_tried & is_best_shape & (error_threshold < best_error);
+				lane_mask const is_pruned = is_candidate & !(lane_lower_bounds[ shape_index ] < best_error);
+
+				uint32_t const pruned_lanes = lane_bits(is_pruned) & block_lanes;
+				for (uint32_t lane_iter = 0; lane_iter < num_blocks; lane_iter++) {
+
+					*p_num_pruned_evaluations += (pruned_lanes >> lane_iter) & 1;
+				}
+
+				if (lane_any(is_candidate & !is_pruned) == false) {
+
+					continue;
+				}
+
+				// Both optimizers refine the shape when both are asked for, the endpoints that
+				// compress it with the lower error are kept.
+				for (uint32_t optimizer_iter = first_optimizer; optimizer_iter <= last_optimizer; optimizer_iter++) {
+
+					// Iterate through the subsets in the shape.
+					lane_float2x4 gd_subset_results[ BC7_MAX_SUBSETS ];
+					for (uint32_t subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
+
+						// Get the subset of pixels.
+						uint32_t const subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+						lane_pixel_float subset_pixels[ NUM_PIXELS_PER_BLOCK ];
+						uint32_t num_subset_pixels = 0;
+						for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+							if ((subset_mask & (1 << pixel_iter)) != 0) {
+
+								for (uint32_t channel = 0; channel < 4; channel++) {
+
+									subset_pixels[ num_subset_pixels ][ channel ] = pixels_float[ pixel_iter ][ channel ];
+								}
+
+								num_subset_pixels++;
+							}
+
+						} // end for
+
+						// Find the endpoints.
+						bc7_find_endpoints(gd_subset_results[ subset_iter ],
+												 subset_pixels, num_subset_pixels,
+												 isb_iter, optimizer_iter, p_mode, p_params);
+
+					} // end for
+
+					// Quantize the endpoints to the final precision including the parity bits.
+					bc7_lane_quantized_endpoints quantized_endpoints;
+					bc7_quantize_endpoints(&quantized_endpoints, gd_subset_results, p_mode);
+
+					// Assign palette indices to each pixel and calculate the error.
+					lane_uint palette_indices_1[ NUM_PIXELS_PER_BLOCK ];
+					lane_uint palette_indices_2[ NUM_PIXELS_PER_BLOCK ];
+					lane_uint const shape_error = bc7_assign_pixels(&quantized_endpoints,
+																					palette_indices_1, palette_indices_2,
+																					pixels, isb_iter, shape_index, p_mode);
+
+					// Save the results for the lanes where the error is better.
+					lane_mask const is_better = (shape_error < compressed_block.m_error) & is_candidate & !is_pruned;
+
+					if (lane_any(is_better) == false) {
+
+						continue;
+					}
+
+					compressed_block.m_rotation = lane_select(is_better, lane_uint(rotation_iter), compressed_block.m_rotation);
+					compressed_block.m_index_selection_bit = lane_select(is_better, lane_uint(isb_iter), compressed_block.m_index_selection_bit);
+					compressed_block.m_shape = lane_select(is_better, lane_uint(shape_index), compressed_block.m_shape);
+					compressed_block.m_error = lane_select(is_better, shape_error, compressed_block.m_error);
+
+					for (uint32_t subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
+
+						for (uint32_t channel = 0; channel < 8; channel++) {
+
+							compressed_block.m_quantized_endpoints.m_endpoints[ subset_iter ][ channel ] =
+								lane_select(is_better, quantized_endpoints.m_endpoints[ subset_iter ][ channel ],
+												compressed_block.m_quantized_endpoints.m_endpoints[ subset_iter ][ channel ]);
+						}
+
+					} // end for
+
+					for (uint32_t parity_iter = 0; parity_iter < 2 * num_subsets; parity_iter++) {
+
+						compressed_block.m_quantized_endpoints.m_parity_bits[ parity_iter ] =
+							lane_select(is_better, quantized_endpoints.m_parity_bits[ parity_iter ],
+											compressed_block.m_quantized_endpoints.m_parity_bits[ parity_iter ]);
+					}
+
+					// Copy the palette indices over.
+					for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+						compressed_block.m_palette_indices_1[ pixel_iter ] = lane_select(is_better, palette_indices_1[ pixel_iter ], compressed_block.m_palette_indices_1[ pixel_iter ]);
+						compressed_block.m_palette_indices_2[ pixel_iter ] = lane_select(is_better, palette_indices_2[ pixel_iter ], compressed_block.m_palette_indices_2[ pixel_iter ]);
+
+					} // end for
+
+				} // end for
+
+			} // end for
+
+		} // end for
+
+		// Swap the channels back.
+		bc7_swap_channels(pixels, rotation_iter);
+
+	} // end for
+
+	// Write out the new best compressed blocks.
+	lane_mask const is_better = compressed_block.m_error < input_error;
+	uint32_t const better_lanes = lane_bits(is_better);
+	for (uint32_t lane_iter = 0; lane_iter < num_blocks; lane_iter++) {
+
+		if ((better_lanes & (1 << lane_iter)) == 0) {
+
+			continue;
+		}
+
+		bc7_unencoded_block lane_block;
+		bc7_extract_lane(&lane_block, &compressed_block, lane_iter);
+
+		bc7_encode_compressed_block(&p_encoded_blocks[ block_indices[ lane_iter ] ], &lane_block, p_mode);
+
+	} // end for
+
+	return lane_select(is_better, compressed_block.m_error, input_error);
+}
+
+// Compress a rectangle of blocks in the image, Num_lanes blocks at a time. The blocks are handed
+// to the lanes in row order so a rectangle narrower than the number of lanes still fills them.
+//
+// p_encoded_blocks:	(output) The compressed and encoded blocks for the entire image.
+// p_source_pixels:  The image pixels (32 bit RGBA).
+// width_in_blocks:  The width of the image in 4x4 blocks.
+// height_in_blocks: The height of the image in 4x4 blocks.
+// pixel_block_x:		The horizontal index of the top left block to compress.
+// pixel_block_y:		The vertical index of the top left block to compress.
+// num_blocks_x:		The width of the rectangle in blocks.
+// num_blocks_y:		The height of the rectangle in blocks.
+// p_params:			The encoding parameters.
+// p_stats:				(input/output) The counts of the work that was skipped are added to this.
+//
+static void bc7_lane_kernel(bc7_compressed_block* p_encoded_blocks,
+									 uint8_t const* p_source_pixels,
+									 uint32_t width_in_blocks, uint32_t height_in_blocks,
+									 uint32_t pixel_block_x, uint32_t pixel_block_y,
+									 uint32_t num_blocks_x, uint32_t num_blocks_y,
+									 bc7_encode_params const* p_params,
+									 bc7_cpu_kernel_stats* p_stats)
+{
+	if ((pixel_block_y >= height_in_blocks)
+	||  (pixel_block_x >= width_in_blocks)) {
+
+		return;
+	}
+
+	if (num_blocks_x > width_in_blocks - pixel_block_x) {
+
+		num_blocks_x = width_in_blocks - pixel_block_x;
+	}
+
+	if (num_blocks_y > height_in_blocks - pixel_block_y) {
+
+		num_blocks_y = height_in_blocks - pixel_block_y;
+	}
+
+	uint32_t const num_blocks = num_blocks_x * num_blocks_y;
+	uint32_t const source_width = 4 * width_in_blocks;
+	uint32_t num_saved_evaluations = 0;
+	uint32_t num_pruned_evaluations = 0;
+	for (uint32_t block_iter = 0; block_iter < num_blocks; block_iter += Num_lanes) {
+
+		uint32_t const num_lane_blocks = ((num_blocks - block_iter) < Num_lanes) ? (num_blocks - block_iter) : Num_lanes;
+
+		// Load the pixels for the blocks. The lanes without a block repeat the last block so the lanes
+		// do the same amount of work, their results are thrown away.
+		uint32_t block_indices[ Num_lanes ];
+		uint32_t channel_values[ NUM_PIXELS_PER_BLOCK ][4][ Num_lanes ];
+		for (uint32_t lane_iter = 0; lane_iter < Num_lanes; lane_iter++) {
+
+			uint32_t const rectangle_index = block_iter + ((lane_iter < num_lane_blocks) ? lane_iter : (num_lane_blocks - 1));
+			uint32_t const lane_block_x = pixel_block_x + (rectangle_index % num_blocks_x);
+			uint32_t const lane_block_y = pixel_block_y + (rectangle_index / num_blocks_x);
+			block_indices[ lane_iter ] = lane_block_y * width_in_blocks + lane_block_x;
+
+			uint8_t const* p_block_pixels = p_source_pixels + 4 * (4 * lane_block_y * source_width + 4 * lane_block_x);
+			for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+				uint8_t const* p_pixel = p_block_pixels + 4 * ((pixel_iter >> 2) * source_width + (pixel_iter & 0x3));
+				for (uint32_t channel = 0; channel < 4; channel++) {
+
+					channel_values[ pixel_iter ][ channel ][ lane_iter ] = p_pixel[ channel ];
+				}
+
+			} // end for
+
+		} // end for
+
+		lane_pixel pixels[ NUM_PIXELS_PER_BLOCK ];
+		for (uint32_t pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+			for (uint32_t channel = 0; channel < 4; channel++) {
+
+				pixels[ pixel_iter ][ channel ] = lane_load(channel_values[ pixel_iter ][ channel ]);
+			}
+
+		} // end for
+
+		uint32_t block_flags[ Num_lanes ];
+		lane_store(block_flags, bc7_classify_blocks(pixels));
+
+		// Solid color blocks are encoded straight away, an error of 0 keeps the search from
+		// replacing them if the other lanes need it. They're encoded in mode 5 so if it isn't
+		// enabled they go through the search like any other block.
+		bool const is_solid_color_mode_enabled = ((p_params->m_mode_mask & (1 << BC7_SOLID_COLOR_MODE)) != 0);
+		uint32_t solid_errors[ Num_lanes ];
+		for (uint32_t lane_iter = 0; lane_iter < Num_lanes; lane_iter++) {
+
+			solid_errors[ lane_iter ] = UINT_MAX;
+			if (!is_solid_color_mode_enabled) {
+
+				block_flags[ lane_iter ] &= ~BC7_BLOCK_SOLID;
+			}
+
+			if ((block_flags[ lane_iter ] & BC7_BLOCK_SOLID) == 0) {
+
+				continue;
+			}
+
+			solid_errors[ lane_iter ] = 0;
+			if (lane_iter < num_lane_blocks) {
+
+				uint8_t const color[4] = {
+
+					static_cast< uint8_t >(channel_values[0][0][ lane_iter ]),
+					static_cast< uint8_t >(channel_values[0][1][ lane_iter ]),
+					static_cast< uint8_t >(channel_values[0][2][ lane_iter ]),
+					static_cast< uint8_t >(channel_values[0][3][ lane_iter ])
+				};
+
+				bc7_encode_solid_color(&p_encoded_blocks[ block_indices[ lane_iter ] ], color);
+			}
+
+		} // end for
+
+		// Go through the modes that can win and find the one with the least error for
+		// each block of 4x4 pixels. A mode is only skipped if it can't win in any of the lanes
+		// or they have all reached the error threshold.
+		lane_uint error = lane_load(solid_errors);
+		for (uint32_t mode_order_iter = 0; mode_order_iter < BC7_NUM_MODES; mode_order_iter++) {
+
+			uint32_t const mode_iter = Mode_search_order[ mode_order_iter ];
+
+			// Modes that aren't enabled don't count as skipped by the classifier.
+			if ((p_params->m_mode_mask & (1 << mode_iter)) == 0) {
+
+				continue;
+			}
+
+			bc7_mode const* p_mode = &BC7_modes[ mode_iter ];
+			uint32_t const num_mode_evaluations = bc7_get_num_evaluations(1 << p_mode->m_num_rotation_bits, p_mode, p_params);
+
+			uint32_t lane_errors[ Num_lanes ];
+			lane_store(lane_errors, error);
+
+			uint32_t lane_rotations[ Num_lanes ];
+			uint32_t num_rotations = 0;
+			for (uint32_t lane_iter = 0; lane_iter < Num_lanes; lane_iter++) {
+
+				lane_rotations[ lane_iter ] = bc7_get_num_rotations(block_flags[ lane_iter ], p_mode);
+				if (lane_iter < num_lane_blocks) {
+
+					num_saved_evaluations += num_mode_evaluations - bc7_get_num_evaluations(lane_rotations[ lane_iter ], p_mode, p_params);
+				}
+
+				// The blocks that have reached the error threshold don't try the rest of the modes.
+				if (lane_errors[ lane_iter ] <= p_params->m_error_threshold) {
+
+					lane_rotations[ lane_iter ] = 0;
+				}
+
+				if (lane_rotations[ lane_iter ] > num_rotations) {
+
+					num_rotations = lane_rotations[ lane_iter ];
+				}
+
+			} // end for
+
+			if (num_rotations == 0) {
+
+				continue;
+			}
+
+			error = bc7_compress(p_encoded_blocks, pixels, block_indices, num_lane_blocks, p_mode,
+										lane_load(lane_rotations), num_rotations, error, p_params, &num_pruned_evaluations);
+
+		} // end for
+
+	} // end for
+
+	p_stats->m_num_saved_evaluations += num_saved_evaluations;
+	p_stats->m_num_pruned_evaluations += num_pruned_evaluations;
+}
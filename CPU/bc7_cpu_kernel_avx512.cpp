@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// The AVX-512 version of the CPU kernel, it compresses 16 blocks at once.
+// With Visual Studio this file is built with /arch:AVX512, see the project settings. Multiplies and
+// adds aren't fused unless the OpenCL kernel does it so the versions match.
+
+#if defined(__GNUC__)
+	#pragma GCC target("avx512f,fma")
+	#pragma GCC optimize("fp-contract=off")
+
+	// GCC warns about the undefined pass-through operand (_mm512_undefined_ps()) in the unmasked
+	// AVX-512 intrinsics like _mm512_min_ps(), it's "used uninitialized" or "may be used
+	// uninitialized" depending on the version and how far it's inlined.
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif // #if defined(__GNUC__)
+
+#include <float.h>
+#include <limits.h>
+
+#include "bc7_cpu_kernel.h"
+#include "bc7_cpu_kernel_internal.h"
+#include "bc7_cpu_lanes_avx512.h"
+
+#if defined(__BC7_CPU)
+
+namespace bc7_cpu {
+namespace avx512 {
+
+#include "bc7_cpu_kernel.inl"
+
+} // namespace avx512
+} // namespace bc7_cpu
+
+// Compress a rectangle of 4x4 blocks in the image.
+//
+// p_encoded_blocks:	(output) The compressed blocks for the entire image.
+// p_source_pixels:	The source image data. This must be 32-bit RGBA.
+// width_in_blocks:	The width of the image in 4x4 blocks.
+// height_in_blocks:	The height of the image in 4x4 blocks.
+// pixel_block_x:		The horizontal index of the top left block to compress.
+// pixel_block_y:		The vertical index of the top left block to compress.
+// num_blocks_x:		The width of the rectangle in blocks.
+// num_blocks_y:		The height of the rectangle in blocks.
+// p_params:			The encoding parameters.
+// p_stats:				(input/output) The counts of the work that was skipped are added to this.
+//
+void bc7_cpu_kernel_avx512(bc7_compressed_block* p_encoded_blocks,
+							uint8_t const* p_source_pixels,
+							uint32_t width_in_blocks, uint32_t height_in_blocks,
+							uint32_t pixel_block_x, uint32_t pixel_block_y,
+							uint32_t num_blocks_x, uint32_t num_blocks_y,
+							bc7_encode_params const* p_params,
+							bc7_cpu_kernel_stats* p_stats)
+{
+	bc7_cpu::avx512::bc7_lane_kernel(p_encoded_blocks, p_source_pixels,
+												width_in_blocks, height_in_blocks,
+												pixel_block_x, pixel_block_y, num_blocks_x, num_blocks_y, p_params, p_stats);
+}
+
+#endif // #if defined(__BC7_CPU)
@@ -0,0 +1,351 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_KERNEL_INTERNAL_H
+#define __BC7_CPU_KERNEL_INTERNAL_H
+
+#include "bc7_gpu.h"
+
+#if defined(__BC7_CPU)
+
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+
+// These are the parts of the CPU kernel that are shared by the versions for each instruction set.
+// The names match the OpenCL kernel, they live in the bc7_cpu namespace so they don't collide with
+// the ones in bc7_decompress.cpp.
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// 4x4 block of pixels
+#define NUM_PIXELS_PER_BLOCK 16
+
+// Maximum size of a palette.
+#define MAX_PALETTE_SIZE 16
+
+// Total number of weights for the palettes.
+#define NUM_PALETTE_WEIGHTS (4 + 8 + 16)
+
+// Interpolation constants.
+#define BC7_INTERPOLATION_MAX_WEIGHT			64
+#define BC7_INTERPOLATION_INV_MAX_WEIGHT		0.015625f
+#define BC7_INTERPOLATION_MAX_WEIGHT_SHIFT	6
+#define BC7_INTERPOLATION_ROUND					32
+
+// The smallest determinant of the least squares normal equations that is solved. Below it all of
+// the pixels are about the same palette index and any endpoints on a line through them fit.
+#define BC7_LEAST_SQUARES_MIN_DETERMINANT		1e-4f
+
+// The number of power iterations used to find the principal axis of the pixels.
+#define BC7_PRINCIPAL_AXIS_ITERATIONS			4
+
+// The number of products of pairs of channels in the moments of a set of pixels, and the most
+// moments there are (the sums of the channels and their products).
+#define BC7_NUM_MOMENT_PRODUCTS_RGB				6
+#define BC7_NUM_MOMENT_PRODUCTS_RGBA			10
+#define BC7_MAX_MOMENTS							(4 + BC7_NUM_MOMENT_PRODUCTS_RGBA)
+
+// Maximum number of subsets for a mode.
+#define BC7_MAX_SUBSETS 3
+
+// Maximum number of ways to partition up the 16 pixels.
+#define BC7_MAX_SHAPES 64
+
+// The most best shapes (arrangements of partitioning up the pixels) that can be refined further
+// instead of using all the shapes.
+#define BC7_MAX_BEST_SHAPES BC7_ENCODE_MAX_BEST_SHAPES
+
+// Number of modes that BC7 has.
+#define BC7_NUM_MODES 8
+
+// Flags for swapping quantized endpoints.
+#define BC7_SWAP_RGB    0x1
+#define BC7_SWAP_ALPHA  0x2
+
+// Flags from the block classifier.
+#define BC7_BLOCK_OPAQUE      0x1
+#define BC7_BLOCK_GRAYSCALE   0x2
+#define BC7_BLOCK_SOLID       0x4
+
+// The mode and the palette index that solid color blocks are encoded with.
+#define BC7_SOLID_COLOR_MODE  5
+#define BC7_SOLID_COLOR_INDEX 1
+
+namespace bc7_cpu {
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+// The type of parity used for a mode. If a mode has a parity bit then the least
+// significant bit of the color channels uses the parity bit.
+enum bc7_parity_bit_type {
+
+	PARITY_BIT_NONE = 0,
+	PARITY_BIT_SHARED,
+	PARITY_BIT_PER_ENDPOINT
+};
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+typedef uint32_t uint2x4[8];
+
+// This stores the quantized endpoints and parity bits (if there are any).
+struct bc7_quantized_endpoints {
+
+   // The quantized endpoints.
+   // Note: If a mode has parity bits, this still stores the least significant bit.
+   uint2x4 m_endpoints[ BC7_MAX_SUBSETS ];
+
+   // The parity bits (depending on the mode).
+   uint32_t m_parity_bits[ 2 * BC7_MAX_SUBSETS ];
+};
+
+// This describes a BC7 mode.
+struct bc7_mode {
+
+	// The mode's index.
+	uint32_t m_mode_index;
+
+	// The full precision (including the parity bit) for each channel of the endpoints.
+	uint32_t m_endpoint_precision[4];
+
+	// Number of subsets.
+	uint32_t m_num_subsets;
+
+	// Number of bits for the ways to partition up the 16 pixels 
+	// among the subsets.
+	uint32_t m_num_shape_bits;
+
+	// Number of bits for the color channel swaps with the alpha channel.
+	uint32_t m_num_rotation_bits;
+
+	// Number of bits for the index selection bit.
+	uint32_t m_num_isb_bits;
+
+	// The type of parity used for this mode.
+	bc7_parity_bit_type m_parity_bit_type;
+
+	// Number of bits for the color palette indices.
+	uint32_t m_num_index_bits_1;
+
+	// The size of the color palette (1 << m_num_index_bits).
+	uint32_t m_palette_size_1;
+
+	// The starting index into the Palette_weights for this palette.
+	uint32_t m_palette_start_1;
+
+	// Number of bits for the alpha palette indices.
+	uint32_t m_num_index_bits_2;
+
+	// The size of the alpha palette (1 << m_num_index_bits2);
+	uint32_t m_palette_size_2;
+
+	// The starting index into the Palette_weights for this palette.
+	uint32_t m_palette_start_2;
+};
+
+// The representation of the compressed block of pixels before it is encoded.
+// Note: This is called bc7_compressed_block in the OpenCL version.
+struct bc7_unencoded_block {
+
+	// The total error for the block.
+	uint32_t m_error;
+
+	// The endpoints of the line that the palette is generated from for each subset.	
+	bc7_quantized_endpoints m_quantized_endpoints;
+
+	// The indices into the palette for each pixel.
+	uint8_t m_palette_indices_1[ NUM_PIXELS_PER_BLOCK ];
+	uint8_t m_palette_indices_2[ NUM_PIXELS_PER_BLOCK ]; 
+
+	// This tells which color channel was swapped with the alpha channel (if any).
+	uint8_t m_rotation;
+
+	// This tells whether the index selection bit was set.
+	uint8_t m_index_selection_bit;
+
+	// This tells which shape was used.
+	uint8_t m_shape;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+// Interpolation weights for different sized palettes.
+extern uint8_t const Palette_weights[ NUM_PALETTE_WEIGHTS ];
+
+// The description of each mode.
+extern bc7_mode const BC7_modes[ BC7_NUM_MODES ];
+
+// The order the modes are searched in, the ones most likely to give a low error first.
+extern uint8_t const Mode_search_order[ BC7_NUM_MODES ];
+
+// This table determines how pixels are partitioned up in the subsets.
+extern uint8_t const Partition_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ NUM_PIXELS_PER_BLOCK ];
+
+// The pixels in each subset of each shape as a bit mask (bit N is pixel N).
+extern uint16_t const Subset_masks[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ BC7_MAX_SUBSETS ];
+
+// The channels that are multiplied for each product in the moments, for RGB and RGBA.
+extern uint8_t const Moment_products[2][ BC7_NUM_MOMENT_PRODUCTS_RGBA ][2];
+
+// The mode 5 color endpoints that reproduce each 8-bit value exactly with BC7_SOLID_COLOR_INDEX.
+extern uint8_t const Solid_color_endpoints[256][2];
+
+// This table determines which palette indices are anchor indices.
+extern uint8_t const Anchor_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ BC7_MAX_SUBSETS ];
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+// These are static so every kernel file gets its own copy built for its instruction set. If they were
+// only inline, the linker could keep the copy from the AVX-512 file for all of them.
+
+// Get the subset index for the given pixel.
+//
+// shape_index:		The shape index.
+// pixel_index:		The pixel index within the block.
+// p_mode:			The current mode.
+//
+// returns: The subset index.
+//
+static inline uint32_t bc7_get_subset_for_pixel(uint32_t shape_index, uint32_t pixel_index,
+																bc7_mode const* p_mode)
+{
+	return Partition_table[ p_mode->m_num_subsets - 1 ][ shape_index ][ pixel_index ];
+}
+
+// Get the pixels in a subset.
+//
+// shape_index:		The shape index.
+// subset_index:		The subset index.
+// p_mode:			The current mode.
+//
+// returns: A bit for each pixel in the subset (bit N is pixel N).
+//
+static inline uint32_t bc7_get_subset_mask(uint32_t shape_index, uint32_t subset_index,
+														 bc7_mode const* p_mode)
+{
+	return Subset_masks[ p_mode->m_num_subsets - 1 ][ shape_index ][ subset_index ];
+}
+
+// Get the index within the block of 16 pixels that is called the anchor index for a given setup.
+// The anchor index is assumed to not have the high bit set which saves one bit. If the high bit is
+// set, the endpoints and indices are swapped so it is not set.
+//
+// shape_index:		The shape index.
+// subset_index:		The subset index.
+// p_mode:			The current mode.
+//
+// returns: The anchor index.
+//
+static inline uint32_t bc7_get_anchor_index(uint32_t shape_index, uint32_t subset_index,
+														  bc7_mode const* p_mode)
+{
+	return Anchor_table[ p_mode->m_num_subsets - 1 ][ shape_index ][ subset_index ];
+}
+
+// Get the number of channel rotations to try for a mode given the class of the block.
+// Solid color blocks skip the search since bc7_encode_solid_color() has no error. Modes 0 to 3
+// always decode to an alpha of 255 so they are skipped for blocks that aren't opaque. Moving a
+// color channel in to the alpha channel doesn't help when the color channels are all the same so
+// modes 4 and 5 only try no rotation for grayscale blocks. Opaque blocks still try them since it
+// gives a color channel its own indices.
+//
+// block_flags:	The flags from the block classifier.
+// p_mode:			The current mode.
+//
+// returns: The number of rotations, 0 if the mode should be skipped.
+//
+static inline uint32_t bc7_get_num_rotations(uint32_t block_flags, bc7_mode const* p_mode)
+{
+	if ((block_flags & BC7_BLOCK_SOLID) != 0) {
+
+		return 0;
+	}
+
+	if ((p_mode->m_endpoint_precision[3] == 0)
+	&&  ((block_flags & BC7_BLOCK_OPAQUE) == 0)) {
+
+		return 0;
+	}
+
+	if ((block_flags & BC7_BLOCK_GRAYSCALE) != 0) {
+
+		return 1;
+	}
+
+	return 1 << p_mode->m_num_rotation_bits;
+}
+
+// Get the number of rotation, index selection bit and shape combinations that a mode
+// compresses a block with.
+//
+// num_rotations:	The number of rotations that are tried.
+// p_mode:			The current mode.
+// p_params:		The encoding parameters.
+//
+// returns: The number of evaluations.
+//
+static inline uint32_t bc7_get_num_evaluations(uint32_t num_rotations, bc7_mode const* p_mode,
+															  bc7_encode_params const* p_params)
+{
+	uint32_t num_shapes = 1 << p_mode->m_num_shape_bits;
+	if ((p_params->m_max_best_shapes > 0)
+	&&  (num_shapes > 1)) {
+
+		num_shapes = (p_params->m_max_best_shapes < (num_shapes >> 2)) ? p_params->m_max_best_shapes : (num_shapes >> 2);
+	}
+
+	return num_rotations * (1 << p_mode->m_num_isb_bits) * num_shapes;
+}
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Encode the compressed block.
+//
+// p_out_encoded_block:	(output) The encoded block.
+// p_compressed_block:	The compressed block to encode.
+// p_mode:					The mode used to compress the pixels.
+//
+void bc7_encode_compressed_block(bc7_compressed_block* p_out_encoded_block,
+											bc7_unencoded_block const* p_compressed_block,
+											bc7_mode const* p_mode);
+
+// Encode a solid color block with mode 5 using Solid_color_endpoints, there is no error.
+//
+// p_out_encoded_block:	(output) The encoded block.
+// color:					The color of the block (RGBA).
+//
+void bc7_encode_solid_color(bc7_compressed_block* p_out_encoded_block, uint8_t const color[4]);
+
+} // namespace bc7_cpu
+
+#endif // #if defined(__BC7_CPU)
+
+#endif // __BC7_CPU_KERNEL_INTERNAL_H
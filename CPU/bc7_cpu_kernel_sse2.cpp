@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// The SSE2 version of the CPU kernel, it compresses 4 blocks at once.
+
+// Multiplies and adds aren't fused unless the OpenCL kernel does it so the versions match.
+#if defined(__GNUC__)
+	#pragma GCC target("sse2")
+	#pragma GCC optimize("fp-contract=off")
+#endif // #if defined(__GNUC__)
+
+#include <float.h>
+#include <limits.h>
+
+#include "bc7_cpu_kernel.h"
+#include "bc7_cpu_kernel_internal.h"
+#include "bc7_cpu_lanes_sse2.h"
+
+#if defined(__BC7_CPU)
+
+namespace bc7_cpu {
+namespace sse2 {
+
+#include "bc7_cpu_kernel.inl"
+
+} // namespace sse2
+} // namespace bc7_cpu
+
+// Compress a rectangle of 4x4 blocks in the image.
+//
+// p_encoded_blocks:	(output) The compressed blocks for the entire image.
+// p_source_pixels:	The source image data. This must be 32-bit RGBA.
+// width_in_blocks:	The width of the image in 4x4 blocks.
+// height_in_blocks:	The height of the image in 4x4 blocks.
+// pixel_block_x:		The horizontal index of the top left block to compress.
+// pixel_block_y:		The vertical index of the top left block to compress.
+// num_blocks_x:		The width of the rectangle in blocks.
+// num_blocks_y:		The height of the rectangle in blocks.
+// p_params:			The encoding parameters.
+// p_stats:				(input/output) The counts of the work that was skipped are added to this.
+//
+void bc7_cpu_kernel_sse2(bc7_compressed_block* p_encoded_blocks,
+							uint8_t const* p_source_pixels,
+							uint32_t width_in_blocks, uint32_t height_in_blocks,
+							uint32_t pixel_block_x, uint32_t pixel_block_y,
+							uint32_t num_blocks_x, uint32_t num_blocks_y,
+							bc7_encode_params const* p_params,
+							bc7_cpu_kernel_stats* p_stats)
+{
+	bc7_cpu::sse2::bc7_lane_kernel(p_encoded_blocks, p_source_pixels,
+												width_in_blocks, height_in_blocks,
+												pixel_block_x, pixel_block_y, num_blocks_x, num_blocks_y, p_params, p_stats);
+}
+
+#endif // #if defined(__BC7_CPU)
@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_LANES_AVX2_H
+#define __BC7_CPU_LANES_AVX2_H
+
+#include <stdint.h>
+
+#include <immintrin.h>
+
+// The lane types for the AVX2 version of the CPU kernel. Each lane of a register holds the value
+// for a different 4x4 block so 8 blocks are compressed at once. These have the same interface as
+// bc7_cpu_lanes_scalar.h.
+
+namespace bc7_cpu {
+namespace avx2 {
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// 8 floats.
+struct lane_float {
+
+	lane_float() {}
+	lane_float(float value) : m_value(_mm256_set1_ps(value)) {}
+	explicit lane_float(__m256 value) : m_value(value) {}
+
+	__m256 m_value;
+};
+
+// 8 unsigned integers.
+struct lane_uint {
+
+	lane_uint() {}
+	lane_uint(uint32_t value) : m_value(_mm256_set1_epi32(static_cast< int >(value))) {}
+	explicit lane_uint(__m256i value) : m_value(value) {}
+
+	__m256i m_value;
+};
+
+// 8 masks, each lane is either all ones or all zeros.
+struct lane_mask {
+
+	lane_mask() {}
+	explicit lane_mask(__m256i value) : m_value(value) {}
+
+	__m256i m_value;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+// The number of blocks that are compressed at once.
+uint32_t const Num_lanes = 8;
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+inline lane_float operator+(lane_float const& a, lane_float const& b) { return lane_float(_mm256_add_ps(a.m_value, b.m_value)); }
+inline lane_float operator-(lane_float const& a, lane_float const& b) { return lane_float(_mm256_sub_ps(a.m_value, b.m_value)); }
+inline lane_float operator*(lane_float const& a, lane_float const& b) { return lane_float(_mm256_mul_ps(a.m_value, b.m_value)); }
+inline lane_float operator/(lane_float const& a, lane_float const& b) { return lane_float(_mm256_div_ps(a.m_value, b.m_value)); }
+inline lane_float& operator+=(lane_float& a, lane_float const& b) { a = a + b; return a; }
+inline lane_float& operator-=(lane_float& a, lane_float const& b) { a = a - b; return a; }
+inline lane_float& operator*=(lane_float& a, lane_float const& b) { a = a * b; return a; }
+
+inline lane_mask operator<(lane_float const& a, lane_float const& b) { return lane_mask(_mm256_castps_si256(_mm256_cmp_ps(a.m_value, b.m_value, _CMP_LT_OQ))); }
+inline lane_mask operator>(lane_float const& a, lane_float const& b) { return lane_mask(_mm256_castps_si256(_mm256_cmp_ps(a.m_value, b.m_value, _CMP_GT_OQ))); }
+inline lane_mask operator>=(lane_float const& a, lane_float const& b) { return lane_mask(_mm256_castps_si256(_mm256_cmp_ps(a.m_value, b.m_value, _CMP_GE_OQ))); }
+
+inline lane_float lane_fma(lane_float const& a, lane_float const& b, lane_float const& c) { return lane_float(_mm256_fmadd_ps(a.m_value, b.m_value, c.m_value)); }
+
+inline lane_float lane_min(lane_float const& a, lane_float const& b) { return lane_float(_mm256_min_ps(a.m_value, b.m_value)); }
+inline lane_float lane_max(lane_float const& a, lane_float const& b) { return lane_float(_mm256_max_ps(a.m_value, b.m_value)); }
+inline lane_float lane_clamp(lane_float const& a, lane_float const& min_value, lane_float const& max_value) { return lane_min(lane_max(a, min_value), max_value); }
+inline lane_float lane_sqrt(lane_float const& a) { return lane_float(_mm256_sqrt_ps(a.m_value)); }
+
+// Round to the nearest integer, ties go to even.
+inline lane_float lane_rint(lane_float const& a) { return lane_float(_mm256_round_ps(a.m_value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+inline lane_uint lane_convert_uint_rte(lane_float const& a) { return lane_uint(_mm256_cvttps_epi32(lane_rint(a).m_value)); }
+inline lane_float lane_convert_float(lane_uint const& a) { return lane_float(_mm256_cvtepi32_ps(a.m_value)); }
+
+inline lane_uint operator+(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm256_add_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator-(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm256_sub_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator*(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm256_mullo_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator&(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm256_and_si256(a.m_value, b.m_value)); }
+inline lane_uint operator|(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm256_or_si256(a.m_value, b.m_value)); }
+inline lane_uint operator<<(lane_uint const& a, uint32_t count) { return lane_uint(_mm256_sll_epi32(a.m_value, _mm_cvtsi32_si128(static_cast< int >(count)))); }
+inline lane_uint operator>>(lane_uint const& a, uint32_t count) { return lane_uint(_mm256_srl_epi32(a.m_value, _mm_cvtsi32_si128(static_cast< int >(count)))); }
+inline lane_uint& operator+=(lane_uint& a, lane_uint const& b) { a = a + b; return a; }
+inline lane_uint& operator&=(lane_uint& a, lane_uint const& b) { a = a & b; return a; }
+inline lane_uint& operator|=(lane_uint& a, lane_uint const& b) { a = a | b; return a; }
+
+// The comparisons are unsigned.
+inline lane_mask operator<(lane_uint const& a, lane_uint const& b)
+{
+	__m256i const sign = _mm256_set1_epi32(static_cast< int >(0x80000000));
+	return lane_mask(_mm256_cmpgt_epi32(_mm256_xor_si256(b.m_value, sign), _mm256_xor_si256(a.m_value, sign)));
+}
+
+inline lane_mask operator>(lane_uint const& a, lane_uint const& b) { return b < a; }
+inline lane_mask operator==(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm256_cmpeq_epi32(a.m_value, b.m_value)); }
+inline lane_mask operator!=(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm256_xor_si256(_mm256_cmpeq_epi32(a.m_value, b.m_value), _mm256_set1_epi32(-1))); }
+
+inline lane_mask operator&(lane_mask const& a, lane_mask const& b) { return lane_mask(_mm256_and_si256(a.m_value, b.m_value)); }
+inline lane_mask operator|(lane_mask const& a, lane_mask const& b) { return lane_mask(_mm256_or_si256(a.m_value, b.m_value)); }
+inline lane_mask operator!(lane_mask const& a) { return lane_mask(_mm256_xor_si256(a.m_value, _mm256_set1_epi32(-1))); }
+
+inline lane_float lane_select(lane_mask const& mask, lane_float const& a, lane_float const& b) { return lane_float(_mm256_blendv_ps(b.m_value, a.m_value, _mm256_castsi256_ps(mask.m_value))); }
+inline lane_uint lane_select(lane_mask const& mask, lane_uint const& a, lane_uint const& b) { return lane_uint(_mm256_blendv_epi8(b.m_value, a.m_value, mask.m_value)); }
+
+inline lane_mask lane_true() { return lane_mask(_mm256_set1_epi32(-1)); }
+inline bool lane_any(lane_mask const& mask) { return _mm256_movemask_ps(_mm256_castsi256_ps(mask.m_value)) != 0; }
+inline uint32_t lane_bits(lane_mask const& mask) { return static_cast< uint32_t >(_mm256_movemask_ps(_mm256_castsi256_ps(mask.m_value))); }
+
+inline lane_mask lane_mask_from_bits(uint32_t bits)
+{
+	__m256i const lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	return lane_mask(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast< int >(bits)), lane_bit), lane_bit));
+}
+
+inline lane_uint lane_load(uint32_t const* p_values) { return lane_uint(_mm256_loadu_si256(reinterpret_cast< __m256i const* >(p_values))); }
+inline void lane_store(uint32_t* p_values, lane_uint const& a) { _mm256_storeu_si256(reinterpret_cast< __m256i* >(p_values), a.m_value); }
+inline void lane_store(float* p_values, lane_float const& a) { _mm256_storeu_ps(p_values, a.m_value); }
+
+} // namespace avx2
+} // namespace bc7_cpu
+
+#endif // __BC7_CPU_LANES_AVX2_H
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_LANES_AVX512_H
+#define __BC7_CPU_LANES_AVX512_H
+
+#include <stdint.h>
+
+#include <immintrin.h>
+
+// The lane types for the AVX-512 version of the CPU kernel. Each lane of a register holds the value
+// for a different 4x4 block so 16 blocks are compressed at once. These have the same interface as
+// bc7_cpu_lanes_scalar.h.
+
+namespace bc7_cpu {
+namespace avx512 {
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// 16 floats.
+struct lane_float {
+
+	lane_float() {}
+	lane_float(float value) : m_value(_mm512_set1_ps(value)) {}
+	explicit lane_float(__m512 value) : m_value(value) {}
+
+	__m512 m_value;
+};
+
+// 16 unsigned integers.
+struct lane_uint {
+
+	lane_uint() {}
+	lane_uint(uint32_t value) : m_value(_mm512_set1_epi32(static_cast< int >(value))) {}
+	explicit lane_uint(__m512i value) : m_value(value) {}
+
+	__m512i m_value;
+};
+
+// 16 masks, AVX-512 has mask registers so there is a bit per lane.
+struct lane_mask {
+
+	lane_mask() {}
+	explicit lane_mask(__mmask16 value) : m_value(value) {}
+
+	__mmask16 m_value;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+// The number of blocks that are compressed at once.
+uint32_t const Num_lanes = 16;
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+inline lane_float operator+(lane_float const& a, lane_float const& b) { return lane_float(_mm512_add_ps(a.m_value, b.m_value)); }
+inline lane_float operator-(lane_float const& a, lane_float const& b) { return lane_float(_mm512_sub_ps(a.m_value, b.m_value)); }
+inline lane_float operator*(lane_float const& a, lane_float const& b) { return lane_float(_mm512_mul_ps(a.m_value, b.m_value)); }
+inline lane_float operator/(lane_float const& a, lane_float const& b) { return lane_float(_mm512_div_ps(a.m_value, b.m_value)); }
+inline lane_float& operator+=(lane_float& a, lane_float const& b) { a = a + b; return a; }
+inline lane_float& operator-=(lane_float& a, lane_float const& b) { a = a - b; return a; }
+inline lane_float& operator*=(lane_float& a, lane_float const& b) { a = a * b; return a; }
+
+inline lane_mask operator<(lane_float const& a, lane_float const& b) { return lane_mask(_mm512_cmp_ps_mask(a.m_value, b.m_value, _CMP_LT_OQ)); }
+inline lane_mask operator>(lane_float const& a, lane_float const& b) { return lane_mask(_mm512_cmp_ps_mask(a.m_value, b.m_value, _CMP_GT_OQ)); }
+inline lane_mask operator>=(lane_float const& a, lane_float const& b) { return lane_mask(_mm512_cmp_ps_mask(a.m_value, b.m_value, _CMP_GE_OQ)); }
+
+inline lane_float lane_fma(lane_float const& a, lane_float const& b, lane_float const& c) { return lane_float(_mm512_fmadd_ps(a.m_value, b.m_value, c.m_value)); }
+
+inline lane_float lane_min(lane_float const& a, lane_float const& b) { return lane_float(_mm512_min_ps(a.m_value, b.m_value)); }
+inline lane_float lane_max(lane_float const& a, lane_float const& b) { return lane_float(_mm512_max_ps(a.m_value, b.m_value)); }
+inline lane_float lane_clamp(lane_float const& a, lane_float const& min_value, lane_float const& max_value) { return lane_min(lane_max(a, min_value), max_value); }
+inline lane_float lane_sqrt(lane_float const& a) { return lane_float(_mm512_sqrt_ps(a.m_value)); }
+
+// Round to the nearest integer, ties go to even.
+inline lane_float lane_rint(lane_float const& a) { return lane_float(_mm512_roundscale_ps(a.m_value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+inline lane_uint lane_convert_uint_rte(lane_float const& a) { return lane_uint(_mm512_cvttps_epi32(lane_rint(a).m_value)); }
+inline lane_float lane_convert_float(lane_uint const& a) { return lane_float(_mm512_cvtepi32_ps(a.m_value)); }
+
+inline lane_uint operator+(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm512_add_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator-(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm512_sub_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator*(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm512_mullo_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator&(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm512_and_si512(a.m_value, b.m_value)); }
+inline lane_uint operator|(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm512_or_si512(a.m_value, b.m_value)); }
+inline lane_uint operator<<(lane_uint const& a, uint32_t count) { return lane_uint(_mm512_sll_epi32(a.m_value, _mm_cvtsi32_si128(static_cast< int >(count)))); }
+inline lane_uint operator>>(lane_uint const& a, uint32_t count) { return lane_uint(_mm512_srl_epi32(a.m_value, _mm_cvtsi32_si128(static_cast< int >(count)))); }
+inline lane_uint& operator+=(lane_uint& a, lane_uint const& b) { a = a + b; return a; }
+inline lane_uint& operator&=(lane_uint& a, lane_uint const& b) { a = a & b; return a; }
+inline lane_uint& operator|=(lane_uint& a, lane_uint const& b) { a = a | b; return a; }
+
+// The comparisons are unsigned.
+inline lane_mask operator<(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm512_cmplt_epu32_mask(a.m_value, b.m_value)); }
+inline lane_mask operator>(lane_uint const& a, lane_uint const& b) { return b < a; }
+inline lane_mask operator==(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm512_cmpeq_epi32_mask(a.m_value, b.m_value)); }
+inline lane_mask operator!=(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm512_cmpneq_epi32_mask(a.m_value, b.m_value)); }
+
+inline lane_mask operator&(lane_mask const& a, lane_mask const& b) { return lane_mask(static_cast< __mmask16 >(a.m_value & b.m_value)); }
+inline lane_mask operator|(lane_mask const& a, lane_mask const& b) { return lane_mask(static_cast< __mmask16 >(a.m_value | b.m_value)); }
+inline lane_mask operator!(lane_mask const& a) { return lane_mask(static_cast< __mmask16 >(~a.m_value)); }
+
+inline lane_float lane_select(lane_mask const& mask, lane_float const& a, lane_float const& b) { return lane_float(_mm512_mask_blend_ps(mask.m_value, b.m_value, a.m_value)); }
+inline lane_uint lane_select(lane_mask const& mask, lane_uint const& a, lane_uint const& b) { return lane_uint(_mm512_mask_blend_epi32(mask.m_value, b.m_value, a.m_value)); }
+
+inline lane_mask lane_true() { return lane_mask(static_cast< __mmask16 >(0xffff)); }
+inline bool lane_any(lane_mask const& mask) { return mask.m_value != 0; }
+inline uint32_t lane_bits(lane_mask const& mask) { return mask.m_value; }
+inline lane_mask lane_mask_from_bits(uint32_t bits) { return lane_mask(static_cast< __mmask16 >(bits)); }
+
+inline lane_uint lane_load(uint32_t const* p_values) { return lane_uint(_mm512_loadu_si512(p_values)); }
+inline void lane_store(uint32_t* p_values, lane_uint const& a) { _mm512_storeu_si512(p_values, a.m_value); }
+inline void lane_store(float* p_values, lane_float const& a) { _mm512_storeu_ps(p_values, a.m_value); }
+
+} // namespace avx512
+} // namespace bc7_cpu
+
+#endif // __BC7_CPU_LANES_AVX512_H
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_LANES_SCALAR_H
+#define __BC7_CPU_LANES_SCALAR_H
+
+#include <math.h>
+#include <stdint.h>
+
+// The lane types for the portable version of the CPU kernel. There is a single lane so these are
+// just the plain types, bc7_cpu_kernel.inl is written against the functions below so the same code
+// is used for every instruction set.
+
+namespace bc7_cpu {
+namespace scalar {
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+typedef float lane_float;
+typedef uint32_t lane_uint;
+typedef bool lane_mask;
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+// The number of blocks that are compressed at once.
+uint32_t const Num_lanes = 1;
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+inline lane_float lane_fma(lane_float a, lane_float b, lane_float c) { return fmaf(a, b, c); }
+inline lane_float lane_min(lane_float a, lane_float b) { return fminf(a, b); }
+inline lane_float lane_max(lane_float a, lane_float b) { return fmaxf(a, b); }
+inline lane_float lane_clamp(lane_float a, lane_float min_value, lane_float max_value) { return fminf(fmaxf(a, min_value), max_value); }
+inline lane_float lane_sqrt(lane_float a) { return sqrtf(a); }
+
+// Round to the nearest integer, ties go to even. This assumes the default rounding mode.
+inline lane_float lane_rint(lane_float a) { return rintf(a); }
+inline lane_uint lane_convert_uint_rte(lane_float a) { return static_cast< lane_uint >(nearbyintf(a)); }
+inline lane_float lane_convert_float(lane_uint a) { return static_cast< lane_float >(a); }
+
+inline lane_float lane_select(lane_mask mask, lane_float a, lane_float b) { return mask ? a : b; }
+inline lane_uint lane_select(lane_mask mask, lane_uint a, lane_uint b) { return mask ? a : b; }
+
+inline lane_mask lane_true() { return true; }
+inline bool lane_any(lane_mask mask) { return mask; }
+inline uint32_t lane_bits(lane_mask mask) { return mask ? 1 : 0; }
+inline lane_mask lane_mask_from_bits(uint32_t bits) { return (bits & 0x1) != 0; }
+
+inline lane_uint lane_load(uint32_t const* p_values) { return *p_values; }
+inline void lane_store(uint32_t* p_values, lane_uint a) { *p_values = a; }
+inline void lane_store(float* p_values, lane_float a) { *p_values = a; }
+
+} // namespace scalar
+} // namespace bc7_cpu
+
+#endif // __BC7_CPU_LANES_SCALAR_H
@@ -0,0 +1,205 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_CPU_LANES_SSE41_H
+#define __BC7_CPU_LANES_SSE41_H
+
+#include <stdint.h>
+
+#include <smmintrin.h>
+
+// The lane types for the SSE4.1 version of the CPU kernel. Each lane of a register holds the value
+// for a different 4x4 block so 4 blocks are compressed at once. These have the same interface as
+// bc7_cpu_lanes_scalar.h.
+
+namespace bc7_cpu {
+namespace sse41 {
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// 4 floats.
+struct lane_float {
+
+	lane_float() {}
+	lane_float(float value) : m_value(_mm_set1_ps(value)) {}
+	explicit lane_float(__m128 value) : m_value(value) {}
+
+	__m128 m_value;
+};
+
+// 4 unsigned integers.
+struct lane_uint {
+
+	lane_uint() {}
+	lane_uint(uint32_t value) : m_value(_mm_set1_epi32(static_cast< int >(value))) {}
+	explicit lane_uint(__m128i value) : m_value(value) {}
+
+	__m128i m_value;
+};
+
+// 4 masks, each lane is either all ones or all zeros.
+struct lane_mask {
+
+	lane_mask() {}
+	explicit lane_mask(__m128i value) : m_value(value) {}
+
+	__m128i m_value;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+// The number of blocks that are compressed at once.
+uint32_t const Num_lanes = 4;
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+inline lane_float operator+(lane_float const& a, lane_float const& b) { return lane_float(_mm_add_ps(a.m_value, b.m_value)); }
+inline lane_float operator-(lane_float const& a, lane_float const& b) { return lane_float(_mm_sub_ps(a.m_value, b.m_value)); }
+inline lane_float operator*(lane_float const& a, lane_float const& b) { return lane_float(_mm_mul_ps(a.m_value, b.m_value)); }
+inline lane_float operator/(lane_float const& a, lane_float const& b) { return lane_float(_mm_div_ps(a.m_value, b.m_value)); }
+inline lane_float& operator+=(lane_float& a, lane_float const& b) { a = a + b; return a; }
+inline lane_float& operator-=(lane_float& a, lane_float const& b) { a = a - b; return a; }
+inline lane_float& operator*=(lane_float& a, lane_float const& b) { a = a * b; return a; }
+
+inline lane_mask operator<(lane_float const& a, lane_float const& b) { return lane_mask(_mm_castps_si128(_mm_cmplt_ps(a.m_value, b.m_value))); }
+inline lane_mask operator>(lane_float const& a, lane_float const& b) { return lane_mask(_mm_castps_si128(_mm_cmpgt_ps(a.m_value, b.m_value))); }
+inline lane_mask operator>=(lane_float const& a, lane_float const& b) { return lane_mask(_mm_castps_si128(_mm_cmpge_ps(a.m_value, b.m_value))); }
+
+// Round a double precision sum of a product and a float to float the way a fused multiply-add
+// does. The product of two floats is exact in double precision, so the sum only rounds to the
+// wrong float when it lands exactly halfway between two floats without being exact. Then it's
+// moved one bit toward the exact sum first, the way musl's fmaf() does it. This assumes round to
+// nearest.
+//
+// sum:		The product plus c, rounded to double.
+// product:	The product.
+// c:			The float that was added.
+//
+// returns: The sum rounded to float.
+//
+inline __m128 lane_round_fma(__m128d sum, __m128d product, __m128d c)
+{
+	// Halfway means the 29 bits below the float mantissa are a one followed by zeros.
+	__m128i const low_bits = _mm_and_si128(_mm_castpd_si128(sum), _mm_set1_epi64x(0x1fffffff));
+	__m128d const is_halfway = _mm_castsi128_pd(_mm_cmpeq_epi64(low_bits, _mm_set1_epi64x(0x10000000)));
+
+	__m128d const is_exact = _mm_and_pd(_mm_cmpeq_pd(_mm_sub_pd(sum, product), c), _mm_cmpeq_pd(_mm_sub_pd(sum, c), product));
+	__m128d const is_adjusted = _mm_andnot_pd(is_exact, is_halfway);
+	if (_mm_movemask_pd(is_adjusted) == 0) {
+
+		return _mm_cvtpd_ps(sum);
+	}
+
+	// The rounding error of the sum, taking the larger of the two terms first.
+	__m128d const zero = _mm_setzero_pd();
+	__m128d const is_negative = _mm_cmplt_pd(sum, zero);
+	__m128d const is_c_larger = _mm_xor_pd(is_negative, _mm_cmpgt_pd(c, product));
+	__m128d const c_error = _mm_add_pd(_mm_sub_pd(c, sum), product);
+	__m128d const product_error = _mm_add_pd(_mm_sub_pd(product, sum), c);
+	__m128d const error = _mm_blendv_pd(product_error, c_error, is_c_larger);
+
+	// The magnitude goes up a bit when the error has the same sign as the sum, otherwise down.
+	__m128i const is_down = _mm_castpd_si128(_mm_xor_pd(is_negative, _mm_cmplt_pd(error, zero)));
+	__m128i const step = _mm_or_si128(_mm_srli_epi64(_mm_xor_si128(is_down, _mm_set1_epi32(-1)), 63), is_down);
+	__m128i const adjusted_bits = _mm_add_epi64(_mm_castpd_si128(sum), _mm_and_si128(step, _mm_castpd_si128(is_adjusted)));
+
+	return _mm_cvtpd_ps(_mm_castsi128_pd(adjusted_bits));
+}
+
+// There is no FMA in SSE4.1, it's done in double precision and rounded so it gives the same bits
+// as a real fused multiply-add.
+inline lane_float lane_fma(lane_float const& a, lane_float const& b, lane_float const& c)
+{
+	__m128d const c_low = _mm_cvtps_pd(c.m_value);
+	__m128d const c_high = _mm_cvtps_pd(_mm_movehl_ps(c.m_value, c.m_value));
+	__m128d const product_low = _mm_mul_pd(_mm_cvtps_pd(a.m_value), _mm_cvtps_pd(b.m_value));
+	__m128d const product_high = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(a.m_value, a.m_value)),
+														 _mm_cvtps_pd(_mm_movehl_ps(b.m_value, b.m_value)));
+	__m128d const sum_low = _mm_add_pd(product_low, c_low);
+	__m128d const sum_high = _mm_add_pd(product_high, c_high);
+
+	// Few sums are halfway between two floats and most of those are exact, so the low 32 bits of
+	// all 4 are checked at once and only the halves with a halfway sum are looked at closer.
+	__m128i const low_words = _mm_castps_si128(_mm_shuffle_ps(_mm_castpd_ps(sum_low), _mm_castpd_ps(sum_high), _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i const is_halfway = _mm_cmpeq_epi32(_mm_and_si128(low_words, _mm_set1_epi32(0x1fffffff)), _mm_set1_epi32(0x10000000));
+	if (_mm_movemask_epi8(is_halfway) == 0) {
+
+		return lane_float(_mm_movelh_ps(_mm_cvtpd_ps(sum_low), _mm_cvtpd_ps(sum_high)));
+	}
+
+	return lane_float(_mm_movelh_ps(lane_round_fma(sum_low, product_low, c_low), lane_round_fma(sum_high, product_high, c_high)));
+}
+
+inline lane_float lane_min(lane_float const& a, lane_float const& b) { return lane_float(_mm_min_ps(a.m_value, b.m_value)); }
+inline lane_float lane_max(lane_float const& a, lane_float const& b) { return lane_float(_mm_max_ps(a.m_value, b.m_value)); }
+inline lane_float lane_clamp(lane_float const& a, lane_float const& min_value, lane_float const& max_value) { return lane_min(lane_max(a, min_value), max_value); }
+inline lane_float lane_sqrt(lane_float const& a) { return lane_float(_mm_sqrt_ps(a.m_value)); }
+
+// Round to the nearest integer, ties go to even.
+inline lane_float lane_rint(lane_float const& a) { return lane_float(_mm_round_ps(a.m_value, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+inline lane_uint lane_convert_uint_rte(lane_float const& a) { return lane_uint(_mm_cvttps_epi32(lane_rint(a).m_value)); }
+inline lane_float lane_convert_float(lane_uint const& a) { return lane_float(_mm_cvtepi32_ps(a.m_value)); }
+
+inline lane_uint operator+(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm_add_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator-(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm_sub_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator*(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm_mullo_epi32(a.m_value, b.m_value)); }
+inline lane_uint operator&(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm_and_si128(a.m_value, b.m_value)); }
+inline lane_uint operator|(lane_uint const& a, lane_uint const& b) { return lane_uint(_mm_or_si128(a.m_value, b.m_value)); }
+inline lane_uint operator<<(lane_uint const& a, uint32_t count) { return lane_uint(_mm_sll_epi32(a.m_value, _mm_cvtsi32_si128(static_cast< int >(count)))); }
+inline lane_uint operator>>(lane_uint const& a, uint32_t count) { return lane_uint(_mm_srl_epi32(a.m_value, _mm_cvtsi32_si128(static_cast< int >(count)))); }
+inline lane_uint& operator+=(lane_uint& a, lane_uint const& b) { a = a + b; return a; }
+inline lane_uint& operator&=(lane_uint& a, lane_uint const& b) { a = a & b; return a; }
+inline lane_uint& operator|=(lane_uint& a, lane_uint const& b) { a = a | b; return a; }
+
+// The comparisons are unsigned.
+inline lane_mask operator<(lane_uint const& a, lane_uint const& b)
+{
+	__m128i const sign = _mm_set1_epi32(static_cast< int >(0x80000000));
+	return lane_mask(_mm_cmplt_epi32(_mm_xor_si128(a.m_value, sign), _mm_xor_si128(b.m_value, sign)));
+}
+
+inline lane_mask operator>(lane_uint const& a, lane_uint const& b) { return b < a; }
+inline lane_mask operator==(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm_cmpeq_epi32(a.m_value, b.m_value)); }
+inline lane_mask operator!=(lane_uint const& a, lane_uint const& b) { return lane_mask(_mm_xor_si128(_mm_cmpeq_epi32(a.m_value, b.m_value), _mm_set1_epi32(-1))); }
+
+inline lane_mask operator&(lane_mask const& a, lane_mask const& b) { return lane_mask(_mm_and_si128(a.m_value, b.m_value)); }
+inline lane_mask operator|(lane_mask const& a, lane_mask const& b) { return lane_mask(_mm_or_si128(a.m_value, b.m_value)); }
+inline lane_mask operator!(lane_mask const& a) { return lane_mask(_mm_xor_si128(a.m_value, _mm_set1_epi32(-1))); }
+
+inline lane_float lane_select(lane_mask const& mask, lane_float const& a, lane_float const& b) { return lane_float(_mm_blendv_ps(b.m_value, a.m_value, _mm_castsi128_ps(mask.m_value))); }
+inline lane_uint lane_select(lane_mask const& mask, lane_uint const& a, lane_uint const& b) { return lane_uint(_mm_blendv_epi8(b.m_value, a.m_value, mask.m_value)); }
+
+inline lane_mask lane_true() { return lane_mask(_mm_set1_epi32(-1)); }
+inline bool lane_any(lane_mask const& mask) { return _mm_movemask_ps(_mm_castsi128_ps(mask.m_value)) != 0; }
+inline uint32_t lane_bits(lane_mask const& mask) { return static_cast< uint32_t >(_mm_movemask_ps(_mm_castsi128_ps(mask.m_value))); }
+
+inline lane_mask lane_mask_from_bits(uint32_t bits)
+{
+	__m128i const lane_bit = _mm_setr_epi32(1, 2, 4, 8);
+	return lane_mask(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(static_cast< int >(bits)), lane_bit), lane_bit));
+}
+
+inline lane_uint lane_load(uint32_t const* p_values) { return lane_uint(_mm_loadu_si128(reinterpret_cast< __m128i const* >(p_values))); }
+inline void lane_store(uint32_t* p_values, lane_uint const& a) { _mm_storeu_si128(reinterpret_cast< __m128i* >(p_values), a.m_value); }
+inline void lane_store(float* p_values, lane_float const& a) { _mm_storeu_ps(p_values, a.m_value); }
+
+} // namespace sse41
+} // namespace bc7_cpu
+
+#endif // __BC7_CPU_LANES_SSE41_H
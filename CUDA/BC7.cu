@@ -3,11 +3,6 @@
 // All rights reserved.
 //
 
-// Define this if you want to pick the best shapes to refine.
-// In my tests, it was better to not cull shapes and use less iterations.
-// You get about the same speed and better quality.
-//#define __CULL_SHAPES
-
 // 4x4 block of pixels
 #define NUM_PIXELS_PER_BLOCK 16
 
@@ -17,33 +12,23 @@
 // Total number of weights for the palettes.
 #define NUM_PALETTE_WEIGHTS (4 + 8 + 16)
 
-// Maximum number of iterations for Gradient Descent.
-#if defined(__CULL_SHAPES)
-
-   // We need more iterations when culling shapes. This results
-   // in about the same speed as non-culling.
-   #define GD_MAX_ITERATIONS 8
-
-#else
-
-   // We don't need as many iterations when we are testing all
-   // the shapes.  This results in about the same speed as culling
-   // and better quality.
-   #define GD_MAX_ITERATIONS 4
-
-#endif // #if defined(__CULL_SHAPES)
-
-// Multiplier for adjusting the endpoints.
-#define GD_ADJUSTMENT_FACTOR 0.1f
-
 // Interpolation constants.
 #define BC7_INTERPOLATION_MAX_WEIGHT			64
 #define BC7_INTERPOLATION_INV_MAX_WEIGHT		0.015625f
 #define BC7_INTERPOLATION_MAX_WEIGHT_SHIFT	6
 #define BC7_INTERPOLATION_ROUND					32
 
-// The delta when calculating the error gradient.
-#define ERROR_GRADIENT_DELTA 1.0f 
+// The smallest determinant of the least squares normal equations that is solved. Below it all of
+// the pixels are about the same palette index and any endpoints on a line through them fit.
+#define BC7_LEAST_SQUARES_MIN_DETERMINANT		1e-4f
+
+// The number of power iterations used to find the principal axis of the pixels.
+#define BC7_PRINCIPAL_AXIS_ITERATIONS			4
+
+// The endpoint optimizers, these match bc7_endpoint_optimizer in bc7_encode_params.h.
+#define BC7_ENDPOINT_OPTIMIZER_GRADIENT_DESCENT	0
+#define BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES		1
+#define BC7_ENDPOINT_OPTIMIZER_BOTH				2
 
 // Maximum value of a float.
 #define FLT_MAX 3.402823466e+38f
@@ -60,13 +45,9 @@
 // Maximum number of ways to partition up the 16 pixels.
 #define BC7_MAX_SHAPES 64
 
-#if defined(__CULL_SHAPES)
-
-   // The number of best shapes (arrangements of partitioning up the pixels) to refine further instead
-   // of using all the shapes.
-   #define BC7_MAX_BEST_SHAPES 16
-
-#endif // #if defined(__CULL_SHAPES)
+// The most best shapes (arrangements of partitioning up the pixels) that can be refined further
+// instead of using all the shapes. This matches BC7_ENCODE_MAX_BEST_SHAPES in bc7_encode_params.h.
+#define BC7_MAX_BEST_SHAPES 16
 
 // Number of modes that BC7 has.
 #define BC7_NUM_MODES 8
@@ -75,11 +56,21 @@
 #define BC7_SWAP_RGB    0x1
 #define BC7_SWAP_ALPHA  0x2
 
+// Flags from the block classifier.
+#define BC7_BLOCK_OPAQUE      0x1
+#define BC7_BLOCK_GRAYSCALE   0x2
+#define BC7_BLOCK_SOLID       0x4
+
+// The mode and the palette index that solid color blocks are encoded with.
+#define BC7_SOLID_COLOR_MODE  5
+#define BC7_SOLID_COLOR_INDEX 1
+
 //----------------------
 // Types.
 //----------------------
 
 typedef unsigned char uchar;
+typedef unsigned short ushort;
 typedef unsigned int uint;
 typedef uint uint2x4[2][4];
 typedef float float2x4[2][4];
@@ -105,6 +96,32 @@ struct bc7_quantized_endpoints {
    uint m_parity_bits[ 2 * BC7_MAX_SUBSETS ];
 };
 
+// The parameters that trade speed for quality, this matches bc7_encode_params in bc7_encode_params.h.
+struct bc7_encode_params {
+
+	// A bit for each mode that is tried (bit N is mode N).
+	uint m_mode_mask;
+
+	// The number of shapes with the lowest estimated error that are refined, 0 refines all of the shapes.
+	uint m_max_best_shapes;
+
+	// How the endpoints are refined (BC7_ENDPOINT_OPTIMIZER_*).
+	uint m_endpoint_optimizer;
+
+	// The maximum number of Gradient Descent iterations in each refinement pass, or the maximum
+	// number of least squares fits after the first one.
+	uint m_max_iterations;
+
+	// The number of Gradient Descent passes.
+	uint m_num_refinement_passes;
+
+	// The step size of the first Gradient Descent pass.
+	float m_adjustment_factor;
+
+	// The search for a block stops once its error is at or below this.
+	uint m_error_threshold;
+};
+
 // This describes a BC7 mode.
 struct bc7_mode {
 
@@ -244,6 +261,52 @@ __constant__ bc7_mode BC7_modes[ BC7_NUM_MODES ] = {
 	{ 7, { 6, 6, 6, 6 }, 2, 6, 0, 0, PARITY_BIT_PER_ENDPOINT, 2, 4, 0, 0, 0, 0 }
 };
 
+// The order the modes are searched in. The shapes of a mode are skipped when they can't beat the
+// best error of the modes before it, so the single subset modes go first since they only have one
+// shape and are often close to the best. The 3 subset modes are the least likely to win so they
+// go last.
+__constant__ uchar Mode_search_order[ BC7_NUM_MODES ] = { 5, 6, 4, 1, 3, 7, 0, 2 };
+
+// The 7-bit mode 5 color endpoints that reproduce each 8-bit value exactly when they are
+// interpolated with the weight of BC7_SOLID_COLOR_INDEX (21). These were found by unquantizing
+// and interpolating every pair of endpoints the same way bc7_assign_pixels() does. The alpha
+// endpoints of mode 5 are 8 bits so every solid color can be encoded with no error.
+__constant__ uchar Solid_color_endpoints[256][2] =
+{
+	{   0,   0 }, {   0,   1 }, {   1,   1 }, {   1,   2 }, {   2,   2 }, {   2,   3 }, {   3,   3 }, {   3,   4 }, // 0 - 7
+	{   4,   4 }, {   4,   5 }, {   5,   5 }, {   5,   6 }, {   6,   6 }, {   6,   7 }, {   7,   7 }, {   7,   8 }, // 8 - 15
+	{   8,   8 }, {   8,   9 }, {   9,   9 }, {   9,  10 }, {  10,  10 }, {  10,  11 }, {  11,  11 }, {  11,  12 }, // 16 - 23
+	{  12,  12 }, {  12,  13 }, {  13,  13 }, {  13,  14 }, {  14,  14 }, {  14,  15 }, {  15,  15 }, {  15,  16 }, // 24 - 31
+	{  16,  16 }, {  16,  17 }, {  17,  17 }, {  17,  18 }, {  18,  18 }, {  18,  19 }, {  19,  19 }, {  19,  20 }, // 32 - 39
+	{  20,  20 }, {  20,  21 }, {  21,  21 }, {  21,  22 }, {  22,  22 }, {  22,  23 }, {  23,  23 }, {  23,  24 }, // 40 - 47
+	{  24,  24 }, {  24,  25 }, {  25,  25 }, {  25,  26 }, {  26,  26 }, {  26,  27 }, {  27,  27 }, {  27,  28 }, // 48 - 55
+	{  28,  28 }, {  28,  29 }, {  29,  29 }, {  29,  30 }, {  30,  30 }, {  30,  31 }, {  31,  31 }, {  31,  32 }, // 56 - 63
+	{  32,  32 }, {  32,  33 }, {  33,  33 }, {  33,  34 }, {  34,  34 }, {  34,  35 }, {  35,  35 }, {  35,  36 }, // 64 - 71
+	{  36,  36 }, {  36,  37 }, {  37,  37 }, {  37,  38 }, {  38,  38 }, {  38,  39 }, {  39,  39 }, {  39,  40 }, // 72 - 79
+	{  40,  40 }, {  40,  41 }, {  41,  41 }, {  41,  42 }, {  42,  42 }, {  42,  43 }, {  43,  43 }, {  43,  44 }, // 80 - 87
+	{  44,  44 }, {  44,  45 }, {  45,  45 }, {  45,  46 }, {  46,  46 }, {  46,  47 }, {  47,  47 }, {  47,  48 }, // 88 - 95
+	{  48,  48 }, {  48,  49 }, {  49,  49 }, {  49,  50 }, {  50,  50 }, {  50,  51 }, {  51,  51 }, {  51,  52 }, // 96 - 103
+	{  52,  52 }, {  52,  53 }, {  53,  53 }, {  53,  54 }, {  54,  54 }, {  54,  55 }, {  55,  55 }, {  55,  56 }, // 104 - 111
+	{  56,  56 }, {  56,  57 }, {  57,  57 }, {  57,  58 }, {  58,  58 }, {  58,  59 }, {  59,  59 }, {  59,  60 }, // 112 - 119
+	{  60,  60 }, {  60,  61 }, {  61,  61 }, {  61,  62 }, {  62,  62 }, {  62,  63 }, {  63,  63 }, {  63,  64 }, // 120 - 127
+	{  64,  63 }, {  64,  64 }, {  64,  65 }, {  65,  65 }, {  65,  66 }, {  66,  66 }, {  66,  67 }, {  67,  67 }, // 128 - 135
+	{  67,  68 }, {  68,  68 }, {  68,  69 }, {  69,  69 }, {  69,  70 }, {  70,  70 }, {  70,  71 }, {  71,  71 }, // 136 - 143
+	{  71,  72 }, {  72,  72 }, {  72,  73 }, {  73,  73 }, {  73,  74 }, {  74,  74 }, {  74,  75 }, {  75,  75 }, // 144 - 151
+	{  75,  76 }, {  76,  76 }, {  76,  77 }, {  77,  77 }, {  77,  78 }, {  78,  78 }, {  78,  79 }, {  79,  79 }, // 152 - 159
+	{  79,  80 }, {  80,  80 }, {  80,  81 }, {  81,  81 }, {  81,  82 }, {  82,  82 }, {  82,  83 }, {  83,  83 }, // 160 - 167
+	{  83,  84 }, {  84,  84 }, {  84,  85 }, {  85,  85 }, {  85,  86 }, {  86,  86 }, {  86,  87 }, {  87,  87 }, // 168 - 175
+	{  87,  88 }, {  88,  88 }, {  88,  89 }, {  89,  89 }, {  89,  90 }, {  90,  90 }, {  90,  91 }, {  91,  91 }, // 176 - 183
+	{  91,  92 }, {  92,  92 }, {  92,  93 }, {  93,  93 }, {  93,  94 }, {  94,  94 }, {  94,  95 }, {  95,  95 }, // 184 - 191
+	{  95,  96 }, {  96,  96 }, {  96,  97 }, {  97,  97 }, {  97,  98 }, {  98,  98 }, {  98,  99 }, {  99,  99 }, // 192 - 199
+	{  99, 100 }, { 100, 100 }, { 100, 101 }, { 101, 101 }, { 101, 102 }, { 102, 102 }, { 102, 103 }, { 103, 103 }, // 200 - 207
+	{ 103, 104 }, { 104, 104 }, { 104, 105 }, { 105, 105 }, { 105, 106 }, { 106, 106 }, { 106, 107 }, { 107, 107 }, // 208 - 215
+	{ 107, 108 }, { 108, 108 }, { 108, 109 }, { 109, 109 }, { 109, 110 }, { 110, 110 }, { 110, 111 }, { 111, 111 }, // 216 - 223
+	{ 111, 112 }, { 112, 112 }, { 112, 113 }, { 113, 113 }, { 113, 114 }, { 114, 114 }, { 114, 115 }, { 115, 115 }, // 224 - 231
+	{ 115, 116 }, { 116, 116 }, { 116, 117 }, { 117, 117 }, { 117, 118 }, { 118, 118 }, { 118, 119 }, { 119, 119 }, // 232 - 239
+	{ 119, 120 }, { 120, 120 }, { 120, 121 }, { 121, 121 }, { 121, 122 }, { 122, 122 }, { 122, 123 }, { 123, 123 }, // 240 - 247
+	{ 123, 124 }, { 124, 124 }, { 124, 125 }, { 125, 125 }, { 125, 126 }, { 126, 126 }, { 126, 127 }, { 127, 127 }  // 248 - 255
+};
+
 // This table determines how pixels are partitioned up in the subsets.
 //
 __constant__ uchar Partition_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ NUM_PIXELS_PER_BLOCK ] =
@@ -452,6 +515,67 @@ __constant__ uchar Partition_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ NUM_PIX
 	}
 };
 
+// The pixels in each subset of each shape as a bit mask (bit N is pixel N), this is the same as
+// Partition_table but it lets the pixels of a subset be found without going through all of them.
+//
+__constant__ ushort Subset_masks[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ BC7_MAX_SUBSETS ] =
+{
+	{   // 1 subset
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 },
+		{ 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }, { 0xffff, 0x0000, 0x0000 }
+	},
+	{   // 2 subsets
+		{ 0x3333, 0xcccc, 0x0000 }, { 0x7777, 0x8888, 0x0000 }, { 0x1111, 0xeeee, 0x0000 }, { 0x1337, 0xecc8, 0x0000 },
+		{ 0x377f, 0xc880, 0x0000 }, { 0x0113, 0xfeec, 0x0000 }, { 0x0137, 0xfec8, 0x0000 }, { 0x137f, 0xec80, 0x0000 },
+		{ 0x37ff, 0xc800, 0x0000 }, { 0x0013, 0xffec, 0x0000 }, { 0x017f, 0xfe80, 0x0000 }, { 0x17ff, 0xe800, 0x0000 },
+		{ 0x0017, 0xffe8, 0x0000 }, { 0x00ff, 0xff00, 0x0000 }, { 0x000f, 0xfff0, 0x0000 }, { 0x0fff, 0xf000, 0x0000 },
+		{ 0x08ef, 0xf710, 0x0000 }, { 0xff71, 0x008e, 0x0000 }, { 0x8eff, 0x7100, 0x0000 }, { 0xf731, 0x08ce, 0x0000 },
+		{ 0xff73, 0x008c, 0x0000 }, { 0x8cef, 0x7310, 0x0000 }, { 0xceff, 0x3100, 0x0000 }, { 0x7331, 0x8cce, 0x0000 },
+		{ 0xf773, 0x088c, 0x0000 }, { 0xceef, 0x3110, 0x0000 }, { 0x9999, 0x6666, 0x0000 }, { 0xc993, 0x366c, 0x0000 },
+		{ 0xe817, 0x17e8, 0x0000 }, { 0xf00f, 0x0ff0, 0x0000 }, { 0x8e71, 0x718e, 0x0000 }, { 0xc663, 0x399c, 0x0000 },
+		{ 0x5555, 0xaaaa, 0x0000 }, { 0x0f0f, 0xf0f0, 0x0000 }, { 0xa5a5, 0x5a5a, 0x0000 }, { 0xcc33, 0x33cc, 0x0000 },
+		{ 0xc3c3, 0x3c3c, 0x0000 }, { 0xaa55, 0x55aa, 0x0000 }, { 0x6969, 0x9696, 0x0000 }, { 0x5aa5, 0xa55a, 0x0000 },
+		{ 0x8c31, 0x73ce, 0x0000 }, { 0xec37, 0x13c8, 0x0000 }, { 0xcdb3, 0x324c, 0x0000 }, { 0xc423, 0x3bdc, 0x0000 },
+		{ 0x9669, 0x6996, 0x0000 }, { 0x3cc3, 0xc33c, 0x0000 }, { 0x6699, 0x9966, 0x0000 }, { 0xf99f, 0x0660, 0x0000 },
+		{ 0xfd8d, 0x0272, 0x0000 }, { 0xfb1b, 0x04e4, 0x0000 }, { 0xb1bf, 0x4e40, 0x0000 }, { 0xd8df, 0x2720, 0x0000 },
+		{ 0x36c9, 0xc936, 0x0000 }, { 0x6c93, 0x936c, 0x0000 }, { 0xc639, 0x39c6, 0x0000 }, { 0x9c63, 0x639c, 0x0000 },
+		{ 0x6cc9, 0x9336, 0x0000 }, { 0x6339, 0x9cc6, 0x0000 }, { 0x7e81, 0x817e, 0x0000 }, { 0x18e7, 0xe718, 0x0000 },
+		{ 0x330f, 0xccf0, 0x0000 }, { 0xf033, 0x0fcc, 0x0000 }, { 0x88bb, 0x7744, 0x0000 }, { 0x11dd, 0xee22, 0x0000 }
+	},
+	{   // 3 subsets
+		{ 0x0133, 0x08cc, 0xf600 }, { 0x0037, 0x8cc8, 0x7300 }, { 0x006f, 0xcc80, 0x3310 }, { 0x1331, 0xec00, 0x00ce },
+		{ 0x00ff, 0x3300, 0xcc00 }, { 0x3333, 0x00cc, 0xcc00 }, { 0x0033, 0xff00, 0x00cc }, { 0x0033, 0xcccc, 0x3300 },
+		{ 0x00ff, 0x0f00, 0xf000 }, { 0x000f, 0x0ff0, 0xf000 }, { 0x000f, 0x00f0, 0xff00 }, { 0x3333, 0x4444, 0x8888 },
+		{ 0x1111, 0x6666, 0x8888 }, { 0x1111, 0x2222, 0xcccc }, { 0x0013, 0x136c, 0xec80 }, { 0x8c63, 0x008c, 0x7310 },
+		{ 0x0137, 0x36c8, 0xc800 }, { 0xc631, 0x08ce, 0x3100 }, { 0x000f, 0x3330, 0xccc0 }, { 0x0333, 0xf000, 0x0ccc },
+		{ 0x1111, 0x00ee, 0xee00 }, { 0x0077, 0x8888, 0x7700 }, { 0x113f, 0x22c0, 0xcc00 }, { 0x88cf, 0x4430, 0x3300 },
+		{ 0xf311, 0x0c22, 0x00cc }, { 0x0033, 0x0344, 0xfc88 }, { 0x9009, 0x6996, 0x0660 }, { 0x009f, 0x9960, 0x6600 },
+		{ 0x3443, 0x0330, 0xc88c }, { 0x0699, 0x0066, 0xf900 }, { 0x3113, 0xc22c, 0x0cc0 }, { 0x00ef, 0x8c00, 0x7310 },
+		{ 0x007f, 0x1300, 0xec80 }, { 0x3331, 0xc400, 0x08ce }, { 0x1333, 0x004c, 0xec80 }, { 0x9999, 0x2222, 0x4444 },
+		{ 0xf00f, 0x00f0, 0x0f00 }, { 0x9249, 0x2492, 0x4924 }, { 0x9429, 0x2942, 0x4294 }, { 0x30c3, 0xc30c, 0x0c30 },
+		{ 0x3c03, 0xc03c, 0x03c0 }, { 0x0055, 0x00aa, 0xff00 }, { 0x00ff, 0xaa00, 0x5500 }, { 0x0303, 0x3030, 0xcccc },
+		{ 0x3333, 0xc0c0, 0x0c0c }, { 0x0909, 0x9090, 0x6666 }, { 0x5005, 0xa00a, 0x0ff0 }, { 0x000f, 0xaaa0, 0x5550 },
+		{ 0x0555, 0x0aaa, 0xf000 }, { 0x1111, 0xe0e0, 0x0e0e }, { 0x0707, 0x7070, 0x8888 }, { 0x000f, 0x6660, 0x9990 },
+		{ 0x1111, 0x0ee0, 0xe00e }, { 0x7007, 0x0770, 0x8888 }, { 0x0999, 0x0666, 0xf000 }, { 0x00ff, 0x6600, 0x9900 },
+		{ 0x0099, 0x0066, 0xff00 }, { 0x3333, 0x0cc0, 0xc00c }, { 0x3003, 0x0330, 0xcccc }, { 0x0fff, 0x6000, 0x9000 },
+		{ 0x7777, 0x8080, 0x0808 }, { 0x0101, 0x1010, 0xeeee }, { 0x0005, 0x000a, 0xfff0 }, { 0x8421, 0x08ce, 0x7310 }
+	}
+};
+
 // This table determines which palette indices are anchor indices.
 //
 __constant__ uchar Anchor_table[ BC7_MAX_SUBSETS ][ BC7_MAX_SHAPES ][ BC7_MAX_SUBSETS ] =
@@ -527,6 +651,20 @@ struct bc7_encoded_block {
 	uint m_bits[4];
 };
 
+//----------------------
+// Shape selection
+//----------------------
+
+// The sums of the channels and of the products of pairs of channels over a set of pixels.
+struct bc7_moments {
+
+	// The sums of the channels.
+	float m_sum[4];
+
+	// The sums of the products of the channels, only the upper triangle is used.
+	float m_sum_products[4][4];
+};
+
 //----------------------
 // Globals
 //----------------------
@@ -644,35 +782,6 @@ float4 subtract_float4(float4 a, float4 b)
 	return result;
 }
 
-// Subtract two vectors.
-//
-__device__
-uint3 subtract_uint3(uint3 a, uint3 b)
-{
-	uint3 result;
-
-	result.x = a.x - b.x;
-	result.y = a.y - b.y;
-	result.z = a.z - b.z;
-
-	return result;
-}
-
-// Subtract two vectors.
-//
-__device__
-uint4 subtract_uint4(uint4 a, uint4 b)
-{
-	uint4 result;
-
-	result.x = a.x - b.x;
-	result.y = a.y - b.y;
-	result.z = a.z - b.z;
-	result.w = a.w - b.w;
-
-	return result;
-}
-
 // Calculate the dot product.
 //
 __device__
@@ -843,30 +952,6 @@ void copy_uint2x4(uint2x4 copy, const uint2x4 a)
 	copy[1][3] = a[1][3];	
 }
 
-// Calculate the squared length.
-//
-// a: The vector.
-//
-// returns: The squared length of a.
-//
-__device__
-uint squared_length_uint3(uint3 a)
-{
-	return a.x * a.x + a.y * a.y + a.z * a.z;
-}
-
-// Calculate the squared length.
-//
-// a: The vector.
-//
-// returns: The squared length of a.
-//
-__device__
-uint squared_length_uint4(uint4 a)
-{
-	return a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w;
-}
-
 // Get the subset index for the given pixel.
 //
 // shape_index:		The shape index.
@@ -882,6 +967,21 @@ uint bc7_get_subset_for_pixel(uint shape_index, uint pixel_index,
 	return Partition_table[ p_mode->m_num_subsets - 1 ][ shape_index ][ pixel_index ];
 }
 
+// Get the pixels in a subset.
+//
+// shape_index:		The shape index.
+// subset_index:		The subset index.
+// p_mode:				The current mode.
+//
+// returns: A bit for each pixel in the subset (bit N is pixel N).
+//
+__device__
+uint bc7_get_subset_mask(uint shape_index, uint subset_index,
+								 bc7_mode const* p_mode)
+{
+	return Subset_masks[ p_mode->m_num_subsets - 1 ][ shape_index ][ subset_index ];
+}
+
 // Get the index within the block of 16 pixels that is called the anchor index for a given setup. The anchor index 
 // is assumed to not have the high bit set which saves one bit. If the high bit is set, the 
 // endpoints and indices are swapped so it is not set.
@@ -1197,22 +1297,27 @@ void bc7_unquantize_endpoints(uint2x4 endpoints[ BC7_MAX_SUBSETS ],
    } // end for
 }
 
-// Compare the pixels to the palette generated by the endpoints
-// and calculate a total error.
+// Compare the pixels to the palette generated by the endpoints and calculate a total error and
+// its gradient in the same pass. The palette indices only change where a pixel crosses over to
+// another palette entry so they are held constant, which leaves the derivative of each squared
+// difference with respect to the endpoints.
 //
-// endpoints:	The endpoints in color space.
-// pixels:		The pixels from the image.
-// num_pixels:	Number of pixels.
+// error_gradient:	(output) The gradient of the error. The first float4 is the gradient of
+//							the first endpoint and the second float4 is the gradient of
+//							the second endpoint.
+// endpoints:			The endpoints in color space.
+// pixels:				The pixels from the image.
+// num_pixels:			Number of pixels.
 // swap_palette_index_precision:	If this is 1 then swap Palette_size_1 and Palette_size_2.
-// p_mode:		The current mode.
+// p_mode:				The current mode.
 //
 // returns: The total error.
 //
 __device__
-float bc7_calculate_total_error(float2x4 const endpoints, 
-										  pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
-										  uint swap_palette_index_precision,
-										  bc7_mode const* p_mode)
+float bc7_calculate_error_gradient(float2x4 error_gradient, float2x4 const endpoints, 
+											  pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
+											  uint swap_palette_index_precision,
+											  bc7_mode const* p_mode)
 {
 	// Figure out the palette sizes.
 	uint palette_size_1 = p_mode->m_palette_size_1;
@@ -1226,6 +1331,8 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 	
 	float total_error = 0.0f;
 
+	set_float2x4(error_gradient, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+
 	if (p_mode->m_mode_index < 4) {
 
 		// There is just one palette for color for modes 0, 1, 2, 3.
@@ -1268,13 +1375,13 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Get the index of the closest palette color.			
 			uint color_index = __float2uint_rn(t * (palette_size_1 - 1.0f));
 
+			// Get the weights.
+			float weight1 = rintf(color_index * weight_step_1);
+			float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
 			// Generate the color by interpolating between the endpoints.
 			float3 palette_color;
 			{
-				// Get the weights.
-				float weight1 = rintf(color_index * weight_step_1);
-				float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
-
 				palette_color.x = (endpoints[0][0] * weight0 + endpoints[1][0] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 				palette_color.y = (endpoints[0][1] * weight0 + endpoints[1][1] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 				palette_color.z = (endpoints[0][2] * weight0 + endpoints[1][2] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
@@ -1287,6 +1394,17 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Accumulate the error.
 			total_error += error;
 
+			// Each endpoint moves the palette color by its weight over the maximum weight.
+			float gradient_scale_0 = weight0 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+			float gradient_scale_1 = weight1 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+
+			error_gradient[0][0] += difference.x * gradient_scale_0;
+			error_gradient[0][1] += difference.y * gradient_scale_0;
+			error_gradient[0][2] += difference.z * gradient_scale_0;
+			error_gradient[1][0] += difference.x * gradient_scale_1;
+			error_gradient[1][1] += difference.y * gradient_scale_1;
+			error_gradient[1][2] += difference.z * gradient_scale_1;
+
 		} // end for
 
 	} else if (p_mode->m_mode_index < 6) {
@@ -1331,13 +1449,13 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Get the index of the closest palette color.			
 			uint color_index = __float2uint_rn(t * (palette_size_1 - 1.0f));
 
+			// Get the weights.
+			float weight1 = rintf(weight_step_1 * color_index);
+			float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
 			// Generate the color by interpolating between the endpoints.
 			float3 palette_color;
 			{
-				// Get the weights.
-				float weight1 = rintf(weight_step_1 * color_index);
-				float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
-
 				palette_color.x = (endpoints[0][0] * weight0 + endpoints[1][0] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 				palette_color.y = (endpoints[0][1] * weight0 + endpoints[1][1] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 				palette_color.z = (endpoints[0][2] * weight0 + endpoints[1][2] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
@@ -1350,6 +1468,17 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Accumulate the error.
 			total_error += error;
 
+			// Each endpoint moves the palette color by its weight over the maximum weight.
+			float gradient_scale_0 = weight0 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+			float gradient_scale_1 = weight1 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+
+			error_gradient[0][0] += difference.x * gradient_scale_0;
+			error_gradient[0][1] += difference.y * gradient_scale_0;
+			error_gradient[0][2] += difference.z * gradient_scale_0;
+			error_gradient[1][0] += difference.x * gradient_scale_1;
+			error_gradient[1][1] += difference.y * gradient_scale_1;
+			error_gradient[1][2] += difference.z * gradient_scale_1;
+
 		} // end for
 
 		// Get the length and inverse length of the alpha channel.
@@ -1364,7 +1493,6 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 		float weight_step_2 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_2 - 1.0f);
 
 		// Calculate the error for alpha.
-		float total_error = 0.0f;
 		for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
 
 			// Get the alpha of the pixel.
@@ -1379,13 +1507,13 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Get the index of the closest palette alpha.
 			uint alpha_index = __float2uint_rn(t * (palette_size_2 - 1.0f));
 
+			// Get the weights.
+			float weight1 = rintf(weight_step_2 * alpha_index);
+			float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
 			// Generate the alpha value by interpolating between the endpoints.
 			float palette_alpha;
 			{
-				// Get the weights.
-				float weight1 = rintf(weight_step_2 * alpha_index);
-				float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
-
 				palette_alpha = (endpoints[0][3] * weight0 + endpoints[1][3] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 			}
 
@@ -1396,6 +1524,9 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Accumulate the error.
 			total_error += error;
 
+			error_gradient[0][3] += difference * (weight0 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT));
+			error_gradient[1][3] += difference * (weight1 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT));
+
 		} // end for
 
 	} else {
@@ -1446,13 +1577,13 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Get the index of the closest palette color.			
 			uint color_index = __float2uint_rn(t * (palette_size_1 - 1.0f));
 
+			// Get the weights.
+			float weight1 = rintf(weight_step_1 * color_index);
+			float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
 			// Generate the color by interpolating between the endpoints.
 			float4 palette_color;
 			{
-				// Get the weights.
-				float weight1 = rintf(weight_step_1 * color_index);
-				float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
-
 				palette_color.x = (endpoints[0][0] * weight0 + endpoints[1][0] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 				palette_color.y = (endpoints[0][1] * weight0 + endpoints[1][1] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
 				palette_color.z = (endpoints[0][2] * weight0 + endpoints[1][2] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
@@ -1466,88 +1597,23 @@ float bc7_calculate_total_error(float2x4 const endpoints,
 			// Accumulate the error.
 			total_error += error;
 
-		} // end for			
-	}
-
-	return total_error;
-}
-
-// Calculate a partial derivative of the error.
-//
-// endpoints:			The endpoints in color space.
-// pixels:				The pixels from the image.
-// num_pixels:			Number of pixels.
-// endpoint_index:	Index of the endpoint.
-// axis_index:			Which axis to compute the partial derivative for.
-// swap_palette_index_precision:	If this is 1 then swap Palette_size_1 and Palette_size_2.
-// p_mode:				The current mode.
-//
-// returns: The partial derivative of the error.
-//
-__device__
-float bc7_calculate_error_partial_derivative(float2x4 const endpoints, 
-															pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
-															uint endpoint_index, uint axis_index,
-															uint swap_palette_index_precision,
-															bc7_mode const* p_mode)
-{
-	// Calculate the "left" endpoint.
-	float2x4 left_endpoints;
-	copy_float2x4(left_endpoints, endpoints);
-	{
-		left_endpoints[ endpoint_index ][ axis_index ] -= ERROR_GRADIENT_DELTA;
-
-		// Clamp the endpoints to the bounds of the color space.
-		left_endpoints[ endpoint_index ][ axis_index ] = clamp_float(left_endpoints[ endpoint_index ][ axis_index ], 0.0f, 255.0f);
-	}
+			// Each endpoint moves the palette color by its weight over the maximum weight.
+			float gradient_scale_0 = weight0 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
+			float gradient_scale_1 = weight1 * (-2.0f * BC7_INTERPOLATION_INV_MAX_WEIGHT);
 
-	// Calculate the "right" endpoint.
-	float2x4 right_endpoints;
-	copy_float2x4(right_endpoints, endpoints);
-	{
-		right_endpoints[ endpoint_index ][ axis_index ] += ERROR_GRADIENT_DELTA;
+			error_gradient[0][0] += difference.x * gradient_scale_0;
+			error_gradient[0][1] += difference.y * gradient_scale_0;
+			error_gradient[0][2] += difference.z * gradient_scale_0;
+			error_gradient[0][3] += difference.w * gradient_scale_0;
+			error_gradient[1][0] += difference.x * gradient_scale_1;
+			error_gradient[1][1] += difference.y * gradient_scale_1;
+			error_gradient[1][2] += difference.z * gradient_scale_1;
+			error_gradient[1][3] += difference.w * gradient_scale_1;
 
-		// Clamp the endpoints to the bounds of the color space.
-		right_endpoints[ endpoint_index ][ axis_index ] = clamp_float(right_endpoints[ endpoint_index ][ axis_index ], 0.0f, 255.0f);
+		} // end for			
 	}
 
-	// Get the error for the two points.
-	float left_error = bc7_calculate_total_error(left_endpoints, pixels, num_pixels, swap_palette_index_precision, p_mode);
-	float right_error = bc7_calculate_total_error(right_endpoints, pixels, num_pixels, swap_palette_index_precision, p_mode);
-
-	// Approximate the partial derivative with the central difference.
-	return 0.5f * (right_error - left_error) / ERROR_GRADIENT_DELTA;
-}
-
-// Calculate the gradient of the error between the pixels and the palette
-// generated from the endpoints.
-//
-// error_gradient:	(output) The gradient of the error.
-// endpoints:			The endpoints in color space.
-// pixels:				The pixels from the image.
-// num_pixels:			Number of pixels.
-// swap_palette_index_precision:	If this is 1 then swap Palette_size_1 and Palette_size_2.
-// p_mode:				The current mode.
-//
-// returns: The gradient of the error. The first float4 is the gradient of
-//			   the first endpoint and the second float4 is the gradient of
-//				the second endpoint.
-//
-__device__
-void bc7_calculate_error_gradient(float2x4 error_gradient, float2x4 const endpoints, 
-											 pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
-											 uint swap_palette_index_precision,
-											 bc7_mode const* p_mode)
-{	
-	error_gradient[0][0] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 0, 0, swap_palette_index_precision, p_mode);
-	error_gradient[0][1] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 0, 1, swap_palette_index_precision, p_mode);
-	error_gradient[0][2] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 0, 2, swap_palette_index_precision, p_mode);
-	error_gradient[0][3] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 0, 3, swap_palette_index_precision, p_mode);
-
-	error_gradient[1][0] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 1, 0, swap_palette_index_precision, p_mode);
-	error_gradient[1][1] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 1, 1, swap_palette_index_precision, p_mode);
-	error_gradient[1][2] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 1, 2, swap_palette_index_precision, p_mode);
-	error_gradient[1][3] = bc7_calculate_error_partial_derivative(endpoints, pixels, num_pixels, 1, 3, swap_palette_index_precision, p_mode);
+	return total_error;
 }
 
 // This performs Gradient Descent to find the best fit line segment to the block of pixels.
@@ -1560,63 +1626,76 @@ void bc7_calculate_error_gradient(float2x4 error_gradient, float2x4 const endpoi
 // num_pixels:				Number of pixels.
 // swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
 // p_mode:					The current mode.
+// p_params:				The encoding parameters.
 //
 __device__
 void bc7_gradient_descent(float2x4 endpoints, float2x4 const in_endpoints, 
 								  pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
 								  uint swap_palette_index_precision,
-								  bc7_mode const* p_mode)
+								  bc7_mode const* p_mode,
+								  bc7_encode_params const* p_params)
 {
 	float epsilon = 128.0f * FLT_EPSILON;
 
 	// Initialize the endpoints that will be adjusted.
 	copy_float2x4(endpoints, in_endpoints);
 
-	// Iteratively find the minimum error.
-	float last_error = FLT_MAX;
-	uint num_iterations;
-	for (num_iterations = 0; num_iterations < GD_MAX_ITERATIONS; num_iterations++) {
+	// Get the gradient of the error function, after this it comes along with the error of each step.
+	float2x4 error_gradient;
+	bc7_calculate_error_gradient(error_gradient, endpoints, pixels, num_pixels, swap_palette_index_precision, p_mode);
 
-		// Get the gradient of the error function.
-		float2x4 error_gradient;
-		bc7_calculate_error_gradient(error_gradient, endpoints, pixels, num_pixels, swap_palette_index_precision, p_mode);
+	// Each refinement pass starts where the last one stopped with half the step size.
+	float last_error = FLT_MAX;
+	float adjustment_factor = p_params->m_adjustment_factor;
+	for (uint pass_iter = 0; pass_iter < p_params->m_num_refinement_passes; pass_iter++) {
 
-		// If the gradient is near zero we are at a local minimum.
-		float2 error_gradient_magnitude = length_float2x4(error_gradient);
-		if ((error_gradient_magnitude.x < epsilon) 
-		&&  (error_gradient_magnitude.y < epsilon)) {
+		// Iteratively find the minimum error.
+		uint num_iterations;
+		for (num_iterations = 0; num_iterations < p_params->m_max_iterations; num_iterations++) {
 
-			// Increment for stats.
-			num_iterations++;
-			break;
-		}
+			// If the gradient is near zero we are at a local minimum.
+			float2 error_gradient_magnitude = length_float2x4(error_gradient);
+			if ((error_gradient_magnitude.x < epsilon) 
+			&&  (error_gradient_magnitude.y < epsilon)) {
 
-		// Adjust the endpoints in the direction opposite of the error gradient to reduce the error.
-		float2x4 possible_endpoints;
-		possible_endpoints[0][0] = endpoints[0][0] - GD_ADJUSTMENT_FACTOR * error_gradient[0][0];
-		possible_endpoints[0][1] = endpoints[0][1] - GD_ADJUSTMENT_FACTOR * error_gradient[0][1];
-		possible_endpoints[0][2] = endpoints[0][2] - GD_ADJUSTMENT_FACTOR * error_gradient[0][2];
-		possible_endpoints[0][3] = endpoints[0][3] - GD_ADJUSTMENT_FACTOR * error_gradient[0][3];		
-		possible_endpoints[1][0] = endpoints[1][0] - GD_ADJUSTMENT_FACTOR * error_gradient[1][0];
-		possible_endpoints[1][1] = endpoints[1][1] - GD_ADJUSTMENT_FACTOR * error_gradient[1][1];
-		possible_endpoints[1][2] = endpoints[1][2] - GD_ADJUSTMENT_FACTOR * error_gradient[1][2];
-		possible_endpoints[1][3] = endpoints[1][3] - GD_ADJUSTMENT_FACTOR * error_gradient[1][3];
+				// Increment for stats.
+				num_iterations++;
+				break;
+			}
 
-		// Clamp the endpoints to the bounds of the color space.
-		clamp_float2x4(possible_endpoints, 0.0f, 255.0f);
+			// Adjust the endpoints in the direction opposite of the error gradient to reduce the error.
+			float2x4 possible_endpoints;
+			possible_endpoints[0][0] = endpoints[0][0] - adjustment_factor * error_gradient[0][0];
+			possible_endpoints[0][1] = endpoints[0][1] - adjustment_factor * error_gradient[0][1];
+			possible_endpoints[0][2] = endpoints[0][2] - adjustment_factor * error_gradient[0][2];
+			possible_endpoints[0][3] = endpoints[0][3] - adjustment_factor * error_gradient[0][3];		
+			possible_endpoints[1][0] = endpoints[1][0] - adjustment_factor * error_gradient[1][0];
+			possible_endpoints[1][1] = endpoints[1][1] - adjustment_factor * error_gradient[1][1];
+			possible_endpoints[1][2] = endpoints[1][2] - adjustment_factor * error_gradient[1][2];
+			possible_endpoints[1][3] = endpoints[1][3] - adjustment_factor * error_gradient[1][3];
+
+			// Clamp the endpoints to the bounds of the color space.
+			clamp_float2x4(possible_endpoints, 0.0f, 255.0f);
+
+			// Calculate the new error.
+			float2x4 possible_error_gradient;
+			float error = bc7_calculate_error_gradient(possible_error_gradient, possible_endpoints, pixels, num_pixels,
+																	swap_palette_index_precision, p_mode);
+			if (error >= last_error) { 
+
+				// No improvement.
+				// Increment for stats.
+				num_iterations++;
+				break;
+			}
 
-		// Calculate the new error.
-		float error = bc7_calculate_total_error(possible_endpoints, pixels, num_pixels, swap_palette_index_precision, p_mode);
-		if (error >= last_error) { 
+			copy_float2x4(endpoints, possible_endpoints);
+			copy_float2x4(error_gradient, possible_error_gradient);
+			last_error = error;
 
-			// No improvement.
-			// Increment for stats.
-			num_iterations++;
-			break;
-		}
+		} // end for
 
-		copy_float2x4(endpoints, possible_endpoints);
-		last_error = error;
+		adjustment_factor *= 0.5f;
 
 	} // end for
 
@@ -1624,153 +1703,469 @@ void bc7_gradient_descent(float2x4 endpoints, float2x4 const in_endpoints,
 	clamp_float2x4(endpoints, 0.0f, 255.0f);
 }
 
-// Swap the quantized endpoints.
-//
-// p_quantized_endpoints:  (input/output) The quantized endpoints to swap.
-// subset_index:           The index of the subset of the particular endpoints to swap.
-// swap_mode:              Which channels to swap.
-// p_mode:                 The current mode.
+// Solve the least squares normal equations for the endpoints of some channels. Each palette color
+// is a0 * e0 + a1 * e1 where a1 is the weight of its index over the maximum weight and a0 is
+// 1 - a1, so minimizing the squared difference to the pixels is a 2x2 linear system that is the
+// same for each channel except for the right hand side.
+//
+// endpoints:			(input/output) The endpoints, they are kept if all of the pixels are about
+//							the same palette index.
+// sum_a0_a0:			The sum of a0 * a0 over the pixels.
+// sum_a0_a1:			The sum of a0 * a1 over the pixels.
+// sum_a1_a1:			The sum of a1 * a1 over the pixels.
+// sum_a0_pixel:		The sum of a0 times each channel of the pixels.
+// sum_a1_pixel:		The sum of a1 times each channel of the pixels.
+// first_channel:		The first channel to solve.
+// num_channels:		The number of channels to solve.
 //
 __device__
-void bc7_swap_quantized_endpoints(bc7_quantized_endpoints* p_quantized_endpoints, 
-                                  uint subset_index, uint swap_mode,
-                                  bc7_mode const* p_mode)
+void bc7_solve_least_squares(float2x4 endpoints,
+									  float sum_a0_a0, float sum_a0_a1, float sum_a1_a1,
+									  float const sum_a0_pixel[4], float const sum_a1_pixel[4],
+									  uint first_channel, uint num_channels)
 {
-   if (swap_mode & BC7_SWAP_RGB) {
-
-      uint3 temp;
-      temp.x = p_quantized_endpoints->m_endpoints[ subset_index ][0][0];
-      temp.y = p_quantized_endpoints->m_endpoints[ subset_index ][0][1];
-      temp.z = p_quantized_endpoints->m_endpoints[ subset_index ][0][2];
-
-      p_quantized_endpoints->m_endpoints[ subset_index ][0][0] = p_quantized_endpoints->m_endpoints[ subset_index ][1][0];
-      p_quantized_endpoints->m_endpoints[ subset_index ][0][1] = p_quantized_endpoints->m_endpoints[ subset_index ][1][1];
-      p_quantized_endpoints->m_endpoints[ subset_index ][0][2] = p_quantized_endpoints->m_endpoints[ subset_index ][1][2];
+	float determinant = sum_a0_a0 * sum_a1_a1 - sum_a0_a1 * sum_a0_a1;
+	if (determinant <= BC7_LEAST_SQUARES_MIN_DETERMINANT) {
 
-      p_quantized_endpoints->m_endpoints[ subset_index ][1][0] = temp.x;
-      p_quantized_endpoints->m_endpoints[ subset_index ][1][1] = temp.y;
-      p_quantized_endpoints->m_endpoints[ subset_index ][1][2] = temp.z;      
-   }
+		return;
+	}
 
-   if (swap_mode & BC7_SWAP_ALPHA) {
+	float inverse_determinant = 1.0f / determinant;
 
-      uint temp = p_quantized_endpoints->m_endpoints[ subset_index ][0][3];
-      p_quantized_endpoints->m_endpoints[ subset_index ][0][3] = p_quantized_endpoints->m_endpoints[ subset_index ][1][3];
-      p_quantized_endpoints->m_endpoints[ subset_index ][1][3] = temp;
-   }
+	for (uint channel = first_channel; channel < first_channel + num_channels; channel++) {
 
-   if (p_mode->m_parity_bit_type == PARITY_BIT_PER_ENDPOINT) {
+		float endpoint_0 = (sum_a1_a1 * sum_a0_pixel[ channel ] - sum_a0_a1 * sum_a1_pixel[ channel ]) * inverse_determinant;
+		float endpoint_1 = (sum_a0_a0 * sum_a1_pixel[ channel ] - sum_a0_a1 * sum_a0_pixel[ channel ]) * inverse_determinant;
 
-      // Re-calculate the parity bits since the endpoints were swapped.
-      bc7_calculate_parity_bits(p_quantized_endpoints, p_mode);
-   }
+		endpoints[0][ channel ] = clamp_float(endpoint_0, 0.0f, 255.0f);
+		endpoints[1][ channel ] = clamp_float(endpoint_1, 0.0f, 255.0f);
+	}
 }
 
-// Assign each pixel to a palette color and get the error for the entire block.
+// Assign the pixels to the palette generated by the endpoints the same way the error is
+// calculated, then solve for the endpoints that fit those palette indices with the least error.
 //
-// p_quantized_endpoints:  (input/output) The quantized endpoints.
-// assigned_pixels_1:      (output) An index into the first palette for each pixel.
-// assigned_pixels_2:      (output) An index into the second palette for each pixel.
-// pixels:					   The pixels from the image.
-// swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
-// shape_index:			   The current shape index.
-// p_mode:					   The current mode.
+// fitted_endpoints:	(output) The endpoints that fit the palette indices best.
+// endpoints:			The endpoints in color space.
+// pixels:				The pixels from the image.
+// num_pixels:			Number of pixels.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size_1 and Palette_size_2.
+// p_mode:				The current mode.
 //
-// returns: The error for the entire block.
+// returns: The total error of endpoints.
 //
 __device__
-uint bc7_assign_pixels(bc7_quantized_endpoints* p_quantized_endpoints,
-                       uchar assigned_pixels_1[ NUM_PIXELS_PER_BLOCK ],
-							  uchar assigned_pixels_2[ NUM_PIXELS_PER_BLOCK ],							  
-							  pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ],
-							  uint swap_palette_index_precision,
-							  uint shape_index,
-							  bc7_mode const* p_mode)
+float bc7_fit_endpoints(float2x4 fitted_endpoints, float2x4 const endpoints,
+								pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
+								uint swap_palette_index_precision,
+								bc7_mode const* p_mode)
 {
-	// Unquantize the endpoints so we can assign palette indices.
-	uint2x4 endpoints[ BC7_MAX_SUBSETS ];
-	bc7_unquantize_endpoints(endpoints, p_quantized_endpoints, p_mode);
-
 	// Figure out the palette sizes.
 	uint palette_size_1 = p_mode->m_palette_size_1;
 	uint palette_size_2 = p_mode->m_palette_size_2;
 
-	// Figure out the starting weight indices of the palettes.
-	uint palette_start_1 = p_mode->m_palette_start_1;
-	uint palette_start_2 = p_mode->m_palette_start_2;
-
 	if (swap_palette_index_precision == 1) {
 
 		palette_size_1 = p_mode->m_palette_size_2;
 		palette_size_2 = p_mode->m_palette_size_1;
-
-		palette_start_1 = p_mode->m_palette_start_2;
-		palette_start_2 = p_mode->m_palette_start_1;
 	}
-	
-	uint total_error = 0;
-	if (palette_size_2 == 0) {
 
-		// There are no separate color and alpha palettes.		
+	float total_error = 0.0f;
 
-		// Go through the pixels and pick the best color in the palette.				
-		for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+	copy_float2x4(fitted_endpoints, endpoints);
 
-			uint4 pixel;
-			{
-				pixel.x = pixels[ pixel_iter ].x;
-				pixel.y = pixels[ pixel_iter ].y;
-				pixel.z = pixels[ pixel_iter ].z;
-				pixel.w = pixels[ pixel_iter ].w;
-			}
+	// Modes 6 and 7 have one palette for color and alpha, the other modes
+	// only use the color channels for this palette.
+	uint num_channels = (p_mode->m_mode_index < 6) ? 3 : 4;
 
-         // Get the subset for this pixel.
-         uint subset_index = bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode);
+	// Calculate the direction of the color.
+	float line_direction[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float line_length_squared = 0.0f;
+	for (uint channel = 0; channel < num_channels; channel++) {
 
-			// Go through the palette.
-			uint best_error = UINT_MAX;
-			uint best_color_index = UINT_MAX;			
-			for (uint color_iter = 0; color_iter < palette_size_1; color_iter++) {
+		line_direction[ channel ] = endpoints[1][ channel ] - endpoints[0][ channel ];
+		line_length_squared += line_direction[ channel ] * line_direction[ channel ];
+	}
 
-				// Generate the color by interpolating between the endpoints.
-				uint4 palette_color;
-				{
-					uint weight1 = Palette_weights[ palette_start_1 + color_iter ];					
-					uint weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+	float inverse_line_length = 0.0f;
+	if (line_length_squared >= FLT_EPSILON) {
 
-					palette_color.x = (endpoints[ subset_index ][0][0] * weight0 + endpoints[ subset_index ][1][0] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
-					palette_color.y = (endpoints[ subset_index ][0][1] * weight0 + endpoints[ subset_index ][1][1] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
-					palette_color.z = (endpoints[ subset_index ][0][2] * weight0 + endpoints[ subset_index ][1][2] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
-					palette_color.w = (endpoints[ subset_index ][0][3] * weight0 + endpoints[ subset_index ][1][3] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
-				}
+		inverse_line_length = rsqrtf(line_length_squared);
+	}
 
-				// Calculate the error which is the sum of squared differences.
-				uint4 difference = subtract_uint4(pixel, palette_color);
-				uint error = squared_length_uint4(difference);
+	for (uint channel = 0; channel < num_channels; channel++) {
 
-				if (error < best_error) {
+		line_direction[ channel ] *= inverse_line_length;
+	}
 
-					best_error = error;
-					best_color_index = color_iter;
-				}
+	// Calculate the step between weights.
+	float weight_step_1 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_1 - 1.0f);
 
-			} // end for
+	// The sums for the normal equations.
+	float sum_a0_a0 = 0.0f;
+	float sum_a0_a1 = 0.0f;
+	float sum_a1_a1 = 0.0f;
+	float sum_a0_pixel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float sum_a1_pixel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
 
-			// Store the index for this pixel.
-			assigned_pixels_1[ pixel_iter ] = best_color_index;
-			assigned_pixels_2[ pixel_iter ] = best_color_index;
+	// Calculate the error for color.
+	for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
 
-			// Accumulate the error.
-			total_error += best_error;			
+		float pixel[4];
+		{
+			pixel[0] = pixels[ pixel_iter ].x;
+			pixel[1] = pixels[ pixel_iter ].y;
+			pixel[2] = pixels[ pixel_iter ].z;
+			pixel[3] = pixels[ pixel_iter ].w;
+		}
 
-		} // end for
+		// Project the pixel onto the line defined by the endpoints.
+		float t = 0.0f;
+		for (uint channel = 0; channel < num_channels; channel++) {
 
-		// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
-		// high bit set. This saves one bit per block in the final output.
-		uint const high_bit_mask = palette_size_1 >> 1;
-      for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+			t += (pixel[ channel ] - endpoints[0][ channel ]) * line_direction[ channel ];
+		}
 
-   		uint const anchor_index = bc7_get_anchor_index(shape_index, subset_iter, p_mode);
+		t = clamp_float(t * inverse_line_length, 0.0f, 1.0f);
+
+		// Get the index of the closest palette color.
+		uint color_index = __float2uint_rn(t * (palette_size_1 - 1.0f));
+
+		// Get the weights.
+		float weight1 = rintf(color_index * weight_step_1);
+		float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+		float a0 = weight0 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+		float a1 = weight1 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+		sum_a0_a0 += a0 * a0;
+		sum_a0_a1 += a0 * a1;
+		sum_a1_a1 += a1 * a1;
+
+		float error = 0.0f;
+		for (uint channel = 0; channel < num_channels; channel++) {
+
+			// Generate the color by interpolating between the endpoints, the error is the sum of
+			// squared differences.
+			float palette_color = (endpoints[0][ channel ] * weight0 + endpoints[1][ channel ] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+			float difference = pixel[ channel ] - palette_color;
+			error += difference * difference;
+
+			// Accumulate the sums with this palette index.
+			sum_a0_pixel[ channel ] += a0 * pixel[ channel ];
+			sum_a1_pixel[ channel ] += a1 * pixel[ channel ];
+		}
+
+		// Accumulate the error.
+		total_error += error;
+
+	} // end for
+
+	bc7_solve_least_squares(fitted_endpoints, sum_a0_a0, sum_a0_a1, sum_a1_a1, sum_a0_pixel, sum_a1_pixel, 0, num_channels);
+
+	if ((p_mode->m_mode_index == 4) || (p_mode->m_mode_index == 5)) {
+
+		// There are separate color and alpha palettes for modes 4, 5.
+
+		// Get the length and inverse length of the alpha channel.
+		float alpha_length = endpoints[1][3] - endpoints[0][3];
+		float inverse_alpha_length = 0.0f;
+		if (alpha_length > 0.0f) {
+
+			inverse_alpha_length = 1.0f / alpha_length;
+		}
+
+		// Calculate the step between weights.
+		float weight_step_2 = BC7_INTERPOLATION_MAX_WEIGHT / (palette_size_2 - 1.0f);
+
+		float sum_alpha_a0_a0 = 0.0f;
+		float sum_alpha_a0_a1 = 0.0f;
+		float sum_alpha_a1_a1 = 0.0f;
+
+		// Calculate the error for alpha.
+		for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+			// Get the alpha of the pixel.
+			float pixel_alpha = pixels[ pixel_iter ].w;
+
+			// Parameterize the alpha value.
+			float t = clamp_float((pixel_alpha - endpoints[0][3]) * inverse_alpha_length, 0.0f, 1.0f);
+
+			// Get the index of the closest palette alpha.
+			uint alpha_index = __float2uint_rn(t * (palette_size_2 - 1.0f));
+
+			// Get the weights.
+			float weight1 = rintf(weight_step_2 * alpha_index);
+			float weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+			// Generate the alpha value by interpolating between the endpoints.
+			float palette_alpha = (endpoints[0][3] * weight0 + endpoints[1][3] * weight1) * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+			// Calculate the error.
+			float difference = pixel_alpha - palette_alpha;
+			total_error += difference * difference;
+
+			// Accumulate the sums with this palette index.
+			float a0 = weight0 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+			float a1 = weight1 * BC7_INTERPOLATION_INV_MAX_WEIGHT;
+
+			sum_alpha_a0_a0 += a0 * a0;
+			sum_alpha_a0_a1 += a0 * a1;
+			sum_alpha_a1_a1 += a1 * a1;
+			sum_a0_pixel[3] += a0 * pixel_alpha;
+			sum_a1_pixel[3] += a1 * pixel_alpha;
+
+		} // end for
+
+		bc7_solve_least_squares(fitted_endpoints, sum_alpha_a0_a0, sum_alpha_a0_a1, sum_alpha_a1_a1, sum_a0_pixel, sum_a1_pixel, 3, 1);
+	}
+
+	return total_error;
+}
+
+// This alternates assigning the pixels to palette indices with solving for the endpoints that fit
+// those indices best until the error stops going down. Each fit is exact for its palette indices
+// so this usually settles in a couple of iterations.
+//
+// endpoints:				(output) The endpoints for the best fit line segment.
+// in_endpoints:			The initial endpoints.
+// pixels:					The pixels from the image.
+// num_pixels:				Number of pixels.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
+// p_mode:					The current mode.
+// p_params:				The encoding parameters.
+//
+__device__
+void bc7_least_squares(float2x4 endpoints, float2x4 const in_endpoints,
+							  pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
+							  uint swap_palette_index_precision,
+							  bc7_mode const* p_mode,
+							  bc7_encode_params const* p_params)
+{
+	copy_float2x4(endpoints, in_endpoints);
+
+	// Fit the initial endpoints, after this each fit comes along with the error of the last one.
+	float2x4 fitted_endpoints;
+	float last_error = bc7_fit_endpoints(fitted_endpoints, endpoints, pixels, num_pixels,
+													 swap_palette_index_precision, p_mode);
+
+	for (uint num_iterations = 0; num_iterations < p_params->m_max_iterations; num_iterations++) {
+
+		// Calculate the error of the fitted endpoints.
+		float2x4 next_fitted_endpoints;
+		float error = bc7_fit_endpoints(next_fitted_endpoints, fitted_endpoints, pixels, num_pixels,
+												  swap_palette_index_precision, p_mode);
+		if (error >= last_error) {
+
+			// No improvement.
+			break;
+		}
+
+		copy_float2x4(endpoints, fitted_endpoints);
+		copy_float2x4(fitted_endpoints, next_fitted_endpoints);
+		last_error = error;
+
+	} // end for
+}
+
+// Swap the quantized endpoints.
+//
+// p_quantized_endpoints:  (input/output) The quantized endpoints to swap.
+// subset_index:           The index of the subset of the particular endpoints to swap.
+// swap_mode:              Which channels to swap.
+// p_mode:                 The current mode.
+//
+__device__
+void bc7_swap_quantized_endpoints(bc7_quantized_endpoints* p_quantized_endpoints, 
+                                  uint subset_index, uint swap_mode,
+                                  bc7_mode const* p_mode)
+{
+   if (swap_mode & BC7_SWAP_RGB) {
+
+      uint3 temp;
+      temp.x = p_quantized_endpoints->m_endpoints[ subset_index ][0][0];
+      temp.y = p_quantized_endpoints->m_endpoints[ subset_index ][0][1];
+      temp.z = p_quantized_endpoints->m_endpoints[ subset_index ][0][2];
+
+      p_quantized_endpoints->m_endpoints[ subset_index ][0][0] = p_quantized_endpoints->m_endpoints[ subset_index ][1][0];
+      p_quantized_endpoints->m_endpoints[ subset_index ][0][1] = p_quantized_endpoints->m_endpoints[ subset_index ][1][1];
+      p_quantized_endpoints->m_endpoints[ subset_index ][0][2] = p_quantized_endpoints->m_endpoints[ subset_index ][1][2];
+
+      p_quantized_endpoints->m_endpoints[ subset_index ][1][0] = temp.x;
+      p_quantized_endpoints->m_endpoints[ subset_index ][1][1] = temp.y;
+      p_quantized_endpoints->m_endpoints[ subset_index ][1][2] = temp.z;      
+   }
+
+   if (swap_mode & BC7_SWAP_ALPHA) {
+
+      uint temp = p_quantized_endpoints->m_endpoints[ subset_index ][0][3];
+      p_quantized_endpoints->m_endpoints[ subset_index ][0][3] = p_quantized_endpoints->m_endpoints[ subset_index ][1][3];
+      p_quantized_endpoints->m_endpoints[ subset_index ][1][3] = temp;
+   }
+
+   if (p_mode->m_parity_bit_type == PARITY_BIT_PER_ENDPOINT) {
+
+      // Re-calculate the parity bits since the endpoints were swapped.
+      bc7_calculate_parity_bits(p_quantized_endpoints, p_mode);
+   }
+}
+
+// Work out the colors of a palette once for all the pixels of a subset. The error of a color is
+// |pixel|^2 + |color|^2 - 2 * (pixel . color), so with -2 * color and |color|^2 in the table each
+// pixel only needs a dot product per color. The values are all integers well under 2^24 so the
+// floats are exact and the errors are the same as working them out from the interpolated colors.
+//
+// palette_colors:	(output) -2 * each color in the palette.
+// squared_lengths:	(output) |color|^2 for each color in the palette.
+// endpoints:			The unquantized endpoints of the subset.
+// channel_mask:		1 for the channels in the palette and 0 for the rest.
+// palette_size:		The number of colors in the palette.
+// palette_start:		The index of the first weight of the palette in Palette_weights.
+//
+__device__
+void bc7_get_palette_table(float4 palette_colors[ MAX_PALETTE_SIZE ], float squared_lengths[ MAX_PALETTE_SIZE ],
+									uint const endpoints[2][4], float4 channel_mask,
+									uint palette_size, uint palette_start)
+{
+	for (uint color_iter = 0; color_iter < palette_size; color_iter++) {
+
+		// Generate the color by interpolating between the endpoints.
+		float4 color;
+		{
+			uint weight1 = Palette_weights[ palette_start + color_iter ];
+			uint weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+
+			color.x = ((endpoints[0][0] * weight0 + endpoints[1][0] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT) * channel_mask.x;
+			color.y = ((endpoints[0][1] * weight0 + endpoints[1][1] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT) * channel_mask.y;
+			color.z = ((endpoints[0][2] * weight0 + endpoints[1][2] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT) * channel_mask.z;
+			color.w = ((endpoints[0][3] * weight0 + endpoints[1][3] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT) * channel_mask.w;
+		}
+
+		palette_colors[ color_iter ] = make_float4(-2.0f * color.x, -2.0f * color.y, -2.0f * color.z, -2.0f * color.w);
+		squared_lengths[ color_iter ] = dot_float4(color, color);
+
+	} // end for
+}
+
+// Find the closest color in the palette to a pixel, the first one if some are just as close.
+//
+// p_error:				(output) The error of the closest color.
+// palette_colors:	The palette from bc7_get_palette_table().
+// squared_lengths:	The squared lengths from bc7_get_palette_table().
+// pixel:				The pixel with the channels that aren't in the palette set to 0.
+// palette_size:		The number of colors in the palette.
+//
+// returns: The index of the closest color.
+//
+__device__
+uint bc7_find_palette_index(uint* p_error,
+									 float4 const palette_colors[ MAX_PALETTE_SIZE ], float const squared_lengths[ MAX_PALETTE_SIZE ],
+									 float4 pixel, uint palette_size)
+{
+	// Go through the palette, this leaves |pixel|^2 out of the errors until the end.
+	float best_error = FLT_MAX;
+	uint best_color_index = 0;
+	for (uint color_iter = 0; color_iter < palette_size; color_iter++) {
+
+		float error = squared_lengths[ color_iter ] + dot_float4(pixel, palette_colors[ color_iter ]);
+		if (error < best_error) {
+
+			best_error = error;
+			best_color_index = color_iter;
+		}
+
+	} // end for
+
+	*p_error = __float2uint_rn(best_error + dot_float4(pixel, pixel));
+	return best_color_index;
+}
+
+// Assign each pixel to a palette color and get the error for the entire block.
+//
+// p_quantized_endpoints:  (input/output) The quantized endpoints.
+// assigned_pixels_1:      (output) An index into the first palette for each pixel.
+// assigned_pixels_2:      (output) An index into the second palette for each pixel.
+// pixels:					   The pixels from the image.
+// swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
+// shape_index:			   The current shape index.
+// p_mode:					   The current mode.
+//
+// returns: The error for the entire block.
+//
+__device__
+uint bc7_assign_pixels(bc7_quantized_endpoints* p_quantized_endpoints,
+                       uchar assigned_pixels_1[ NUM_PIXELS_PER_BLOCK ],
+							  uchar assigned_pixels_2[ NUM_PIXELS_PER_BLOCK ],							  
+							  pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ],
+							  uint swap_palette_index_precision,
+							  uint shape_index,
+							  bc7_mode const* p_mode)
+{
+	// Unquantize the endpoints so we can assign palette indices.
+	uint2x4 endpoints[ BC7_MAX_SUBSETS ];
+	bc7_unquantize_endpoints(endpoints, p_quantized_endpoints, p_mode);
+
+	// Figure out the palette sizes.
+	uint palette_size_1 = p_mode->m_palette_size_1;
+	uint palette_size_2 = p_mode->m_palette_size_2;
+
+	// Figure out the starting weight indices of the palettes.
+	uint palette_start_1 = p_mode->m_palette_start_1;
+	uint palette_start_2 = p_mode->m_palette_start_2;
+
+	if (swap_palette_index_precision == 1) {
+
+		palette_size_1 = p_mode->m_palette_size_2;
+		palette_size_2 = p_mode->m_palette_size_1;
+
+		palette_start_1 = p_mode->m_palette_start_2;
+		palette_start_2 = p_mode->m_palette_start_1;
+	}
+	
+	uint total_error = 0;
+	if (palette_size_2 == 0) {
+
+		// There are no separate color and alpha palettes.		
+
+		// Go through the subsets and pick the best color in the palette for each of their pixels.
+		for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+			float4 palette_colors[ MAX_PALETTE_SIZE ];
+			float squared_lengths[ MAX_PALETTE_SIZE ];
+			bc7_get_palette_table(palette_colors, squared_lengths, endpoints[ subset_iter ], make_float4(1.0f, 1.0f, 1.0f, 1.0f),
+										 palette_size_1, palette_start_1);
+
+			uint subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+			for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+				if ((subset_mask & (1 << pixel_iter)) == 0) {
+
+					continue;
+				}
+
+				pixel_type const pixel = pixels[ pixel_iter ];
+
+				uint best_error;
+				uint best_color_index = bc7_find_palette_index(&best_error, palette_colors, squared_lengths,
+																			  make_float4(pixel.x, pixel.y, pixel.z, pixel.w), palette_size_1);
+
+				// Store the index for this pixel.
+				assigned_pixels_1[ pixel_iter ] = best_color_index;
+				assigned_pixels_2[ pixel_iter ] = best_color_index;
+
+				// Accumulate the error.
+				total_error += best_error;
+
+			} // end for
+
+		} // end for
+
+		// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
+		// high bit set. This saves one bit per block in the final output.
+		uint const high_bit_mask = palette_size_1 >> 1;
+      for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
+
+   		uint const anchor_index = bc7_get_anchor_index(shape_index, subset_iter, p_mode);
 
    		// Is the high bit of the anchor index set?
    		if ((assigned_pixels_1[ anchor_index ] & high_bit_mask) == 0) {
@@ -1798,53 +2193,35 @@ uint bc7_assign_pixels(bc7_quantized_endpoints* p_quantized_endpoints,
 
 		// There are separate color and alpha palettes.		
 
-		// Go through the pixels and pick the best color in the palette.
-		uint pixel_iter;
-		for (pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
-			
-			uint3 pixel;
-			{
-				pixel.x = pixels[ pixel_iter ].x;
-				pixel.y = pixels[ pixel_iter ].y;
-				pixel.z = pixels[ pixel_iter ].z;
-			}
+		// Go through the subsets and pick the best color in the palette for each of their pixels.
+		for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
 
-         uint subset_index = bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode);
+			float4 const color_mask = make_float4(1.0f, 1.0f, 1.0f, 0.0f);
 
-			// Go through the palette.
-			uint best_error = UINT_MAX;
-			uint best_color_index = UINT_MAX;			
-			for (uint color_iter = 0; color_iter < palette_size_1; color_iter++) {
+			float4 palette_colors[ MAX_PALETTE_SIZE ];
+			float squared_lengths[ MAX_PALETTE_SIZE ];
+			bc7_get_palette_table(palette_colors, squared_lengths, endpoints[ subset_iter ], color_mask,
+										 palette_size_1, palette_start_1);
 
-				// Generate the color by interpolating between the endpoints.
-				uint3 palette_color;
-				{
-					uint weight1 = Palette_weights[ palette_start_1 + color_iter ];					
-					uint weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+			uint subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+			for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
 
-					palette_color.x = (endpoints[ subset_index ][0][0] * weight0 + endpoints[ subset_index ][1][0] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
-					palette_color.y = (endpoints[ subset_index ][0][1] * weight0 + endpoints[ subset_index ][1][1] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
-					palette_color.z = (endpoints[ subset_index ][0][2] * weight0 + endpoints[ subset_index ][1][2] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
+				if ((subset_mask & (1 << pixel_iter)) == 0) {
+
+					continue;
 				}
 
-				// Calculate the error which is the sum of squared differences.
-				uint3 difference = subtract_uint3(pixel, palette_color);
-				uint error = squared_length_uint3(difference);
+				pixel_type const pixel = pixels[ pixel_iter ];
 
-				if (error < best_error) {
+				uint best_error;
+				assigned_pixels_1[ pixel_iter ] = bc7_find_palette_index(&best_error, palette_colors, squared_lengths,
+																							make_float4(pixel.x, pixel.y, pixel.z, 0.0f), palette_size_1);
 
-					best_error = error;
-					best_color_index = color_iter;
-				}
+				// Accumulate the error.
+				total_error += best_error;
 
 			} // end for
 
-			// Store the index for this pixel.
-			assigned_pixels_1[ pixel_iter ] = best_color_index;
-
-			// Accumulate the error.
-			total_error += best_error;
-
 		} // end for
 
 		// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
@@ -1875,76 +2252,218 @@ uint bc7_assign_pixels(bc7_quantized_endpoints* p_quantized_endpoints,
 
       } // end for
 
-		// Go through the pixels and pick the best alpha in the palette.
-		for (pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+		// Go through the subsets and pick the best alpha in the palette for each of their pixels.
+		for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
 
-			uint pixel_alpha = pixels[ pixel_iter ].w;
+			float4 const alpha_mask = make_float4(0.0f, 0.0f, 0.0f, 1.0f);
 
-         uint subset_index = bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode);
+			float4 palette_alphas[ MAX_PALETTE_SIZE ];
+			float squared_lengths[ MAX_PALETTE_SIZE ];
+			bc7_get_palette_table(palette_alphas, squared_lengths, endpoints[ subset_iter ], alpha_mask,
+										 palette_size_2, palette_start_2);
 
-			// Go through the palette.
-			uint best_error = UINT_MAX;
-			uint best_alpha_index = UINT_MAX;			
-			for (uint alpha_iter = 0; alpha_iter < palette_size_2; alpha_iter++) {
+			uint subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+			for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
 
-				// Generate the alpha value by interpolating between the endpoints.
-				uint palette_alpha;
-				{
-					uint weight1 = Palette_weights[ palette_start_2 + alpha_iter ];					
-					uint weight0 = BC7_INTERPOLATION_MAX_WEIGHT - weight1;
+				if ((subset_mask & (1 << pixel_iter)) == 0) {
 
-					palette_alpha = (endpoints[ subset_index ][0][3] * weight0 + endpoints[ subset_index ][1][3] * weight1 + BC7_INTERPOLATION_ROUND) >> BC7_INTERPOLATION_MAX_WEIGHT_SHIFT;
+					continue;
 				}
 
-				// Calculate the error.
-				uint difference = pixel_alpha - palette_alpha;
-				uint error = difference * difference;
+				pixel_type const pixel = pixels[ pixel_iter ];
 
-				if (error < best_error) {
+				uint best_error;
+				assigned_pixels_2[ pixel_iter ] = bc7_find_palette_index(&best_error, palette_alphas, squared_lengths,
+																							make_float4(0.0f, 0.0f, 0.0f, pixel.w), palette_size_2);
 
-					best_error = error;
-					best_alpha_index = alpha_iter;
-				}
+				// Accumulate the error.
+				total_error += best_error;
 
 			} // end for
 
-			// Store the index for this pixel.
-			assigned_pixels_2[ pixel_iter ] = best_alpha_index;
+		} // end for
+
+		// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
+		// high bit set. This saves one bit per block in the final output.
+		uint const high_bit_mask_2 = palette_size_2 >> 1;
+      uint const anchor_index_2 = 0;
+      for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {   		
+
+   		// Is the high bit of the anchor index set?
+   		if ((assigned_pixels_2[ anchor_index_2 ] & high_bit_mask_2) == 0) {
+
+            continue;
+         }
+
+			// Swap endpoints (alpha channel only).
+         bc7_swap_quantized_endpoints(p_quantized_endpoints, subset_iter, BC7_SWAP_ALPHA, p_mode);
+
+			// Swap indices.
+			for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+            if (bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode) == subset_iter) {
+
+				  assigned_pixels_2[ pixel_iter ] = palette_size_2 - 1 - assigned_pixels_2[ pixel_iter ];
+            }
+
+			} // end for
+
+      } // end for
+	}
+
+	return total_error;
+}
+
+// Move the initial endpoints on to the principal axis of the pixels, the line through the center of
+// mass with the most variance along it. The axis is found with power iteration on the covariance
+// matrix and the endpoints are the extents of the pixels projected on to it. The diagonal of the
+// bounding box is only a good fit when all the channels go up together. If the pixels are all
+// about the same the bounding box is kept.
+//
+// endpoints:		(input/output) The bounding box of the pixels, it is replaced with the principal
+//						axis endpoints.
+// pixels:			The list of pixels.
+// num_pixels:		The number of pixels in the list.
+// num_channels:	3 for RGB and 4 for RGBA.
+//
+__device__
+void bc7_fit_principal_axis(float2x4 endpoints,
+									 pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
+									 uint num_channels)
+{
+	// Calculate the center of mass.
+	float center_of_mass[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		center_of_mass[0] += pixels[ pixel_iter ].x;
+		center_of_mass[1] += pixels[ pixel_iter ].y;
+		center_of_mass[2] += pixels[ pixel_iter ].z;
+		center_of_mass[3] += pixels[ pixel_iter ].w;
+
+	} // end for
+
+	float inv_num_pixels = 1.0f / num_pixels;
+	for (uint channel = 0; channel < 4; channel++) {
+
+		center_of_mass[ channel ] *= inv_num_pixels;
+	}
+
+	// Calculate the covariance matrix, it isn't divided by the number of pixels since only the
+	// direction of the axis matters.
+	float covariance[4][4];
+	for (uint row = 0; row < 4; row++) {
+
+		for (uint column = 0; column < 4; column++) {
+
+			covariance[ row ][ column ] = 0.0f;
+		}
+	}
+
+	for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		float difference[4];
+		{
+			difference[0] = pixels[ pixel_iter ].x - center_of_mass[0];
+			difference[1] = pixels[ pixel_iter ].y - center_of_mass[1];
+			difference[2] = pixels[ pixel_iter ].z - center_of_mass[2];
+			difference[3] = pixels[ pixel_iter ].w - center_of_mass[3];
+		}
+
+		for (uint row = 0; row < num_channels; row++) {
+
+			for (uint column = 0; column < num_channels; column++) {
+
+				covariance[ row ][ column ] += difference[ row ] * difference[ column ];
+			}
+		}
+
+	} // end for
+
+	// Start with the column of the channel with the most variance, unlike the diagonal of the
+	// bounding box it can't be perpendicular to the principal axis.
+	uint max_variance_channel = 0;
+	for (uint channel = 1; channel < num_channels; channel++) {
+
+		if (covariance[ channel ][ channel ] > covariance[ max_variance_channel ][ max_variance_channel ]) {
+
+			max_variance_channel = channel;
+		}
+	}
+
+	float axis[4];
+	for (uint channel = 0; channel < 4; channel++) {
+
+		axis[ channel ] = covariance[ channel ][ max_variance_channel ];
+	}
+
+	// Power iteration, each multiply turns the axis towards the eigenvector with the largest
+	// eigenvalue. The axis is normalized before each multiply and after the last one.
+	float inverse_axis_length = 0.0f;
+	for (uint iteration = 0; iteration <= BC7_PRINCIPAL_AXIS_ITERATIONS; iteration++) {
+
+		float length_squared = 0.0f;
+		for (uint channel = 0; channel < num_channels; channel++) {
+
+			length_squared += axis[ channel ] * axis[ channel ];
+		}
+
+		if (length_squared < FLT_EPSILON) {
+
+			// The pixels are all about the same.
+			return;
+		}
+
+		inverse_axis_length = rsqrtf(length_squared);
+		for (uint channel = 0; channel < num_channels; channel++) {
+
+			axis[ channel ] *= inverse_axis_length;
+		}
+
+		if (iteration == BC7_PRINCIPAL_AXIS_ITERATIONS) {
+
+			break;
+		}
+
+		float next_axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (uint row = 0; row < num_channels; row++) {
+
+			for (uint column = 0; column < num_channels; column++) {
+
+				next_axis[ row ] += covariance[ row ][ column ] * axis[ column ];
+			}
+		}
 
-			// Accumulate the error.
-			total_error += best_error;
+		for (uint channel = 0; channel < 4; channel++) {
 
-		} // end for
+			axis[ channel ] = next_axis[ channel ];
+		}
 
-		// Swap endpoints and palette indices as needed to ensure anchor indices don't have their
-		// high bit set. This saves one bit per block in the final output.
-		uint const high_bit_mask_2 = palette_size_2 >> 1;
-      uint const anchor_index_2 = 0;
-      for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {   		
+	} // end for
 
-   		// Is the high bit of the anchor index set?
-   		if ((assigned_pixels_2[ anchor_index_2 ] & high_bit_mask_2) == 0) {
+	// Find the extents of the pixels along the axis.
+	float min_t = FLT_MAX;
+	float max_t = -FLT_MAX;
+	for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
 
-            continue;
-         }
+		float t = (pixels[ pixel_iter ].x - center_of_mass[0]) * axis[0] +
+					 (pixels[ pixel_iter ].y - center_of_mass[1]) * axis[1] +
+					 (pixels[ pixel_iter ].z - center_of_mass[2]) * axis[2];
 
-			// Swap endpoints (alpha channel only).
-         bc7_swap_quantized_endpoints(p_quantized_endpoints, subset_iter, BC7_SWAP_ALPHA, p_mode);
+		if (num_channels == 4) {
 
-			// Swap indices.
-			for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+			t += (pixels[ pixel_iter ].w - center_of_mass[3]) * axis[3];
+		}
 
-            if (bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode) == subset_iter) {
+		min_t = fminf(min_t, t);
+		max_t = fmaxf(max_t, t);
 
-				  assigned_pixels_2[ pixel_iter ] = palette_size_2 - 1 - assigned_pixels_2[ pixel_iter ];
-            }
+	} // end for
 
-			} // end for
+	for (uint channel = 0; channel < num_channels; channel++) {
 
-      } // end for
+		endpoints[0][ channel ] = clamp_float(center_of_mass[ channel ] + axis[ channel ] * min_t, 0.0f, 255.0f);
+		endpoints[1][ channel ] = clamp_float(center_of_mass[ channel ] + axis[ channel ] * max_t, 0.0f, 255.0f);
 	}
-
-	return total_error;
 }
 
 // Attempt to find the best endpoints for a set of pixels.
@@ -1953,13 +2472,17 @@ uint bc7_assign_pixels(bc7_quantized_endpoints* p_quantized_endpoints,
 // pixels:				The list of pixels.
 // num_pixels:			The number of pixels in the list.
 // swap_palette_index_precision:	If this is 1 then swap Palette_size and Palette_size_2.
+// endpoint_optimizer:	How the endpoints are refined (Gradient Descent or least squares).
 // p_mode:				The current mode.
+// p_params:			The encoding parameters.
 //
 __device__
 void bc7_find_endpoints(float2x4 endpoints,
 								pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels,
 								uint swap_palette_index_precision,
-								bc7_mode const* p_mode)
+								uint endpoint_optimizer,
+								bc7_mode const* p_mode,
+								bc7_encode_params const* p_params)
 {
 	// Calculate the bounding box in color space of the pixels.
 	float2x4 initial_endpoints;
@@ -1987,447 +2510,309 @@ void bc7_find_endpoints(float2x4 endpoints,
 						 pixels_max.x, pixels_max.y, pixels_max.z, pixels_max.w);
 	}
 
+	// Modes 6 and 7 have one palette for color and alpha, modes 4 and 5 keep the bounding box for
+	// their alpha palette.
+	bc7_fit_principal_axis(initial_endpoints, pixels, num_pixels, (p_mode->m_mode_index < 6) ? 3 : 4);
+
 	// Find a local minimum in error.		
-	bc7_gradient_descent(endpoints, initial_endpoints, pixels, num_pixels,
-                        swap_palette_index_precision, p_mode);
-}
+	if (endpoint_optimizer == BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES) {
 
-#if defined(__CULL_SHAPES)
+		bc7_least_squares(endpoints, initial_endpoints, pixels, num_pixels,
+								swap_palette_index_precision, p_mode, p_params);
 
-// Calculate how much the distribution of a set of pixels is like a line.
-//
-// pixels:		The list of pixels.
-// num_pixels:	The number of pixels in the list.
+	} else {
+
+		bc7_gradient_descent(endpoints, initial_endpoints, pixels, num_pixels,
+									swap_palette_index_precision, p_mode, p_params);
+	}
+}
+
+// Clear the moments.
 //
-// returns: A value in the range [0, 1] where 0 means the set of pixels are
-//				like a sphere and 1 means they make up a line.
+// p_moments:	(output) The moments.
 //
 __device__
-float bc7_calculate_linearity_rgb(pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels)
+void bc7_clear_moments(bc7_moments* p_moments)
 {
-	// Measure the linearity by calculating the eccentricity of the point cloud. The eccentricity
-	// value is in the range [0, 1] with 0 being a circle and 1 being a line. I could only
-	// find a 2d formula for this:
-	//
-	// eccentricity = sqrt((U20 - U02)^2 + 4 * U11^2)) / (U20 + U02)
-	//
-	// Where U20, U02, and U11 are central moments of different orders:
-	//
-	// Upq = 1/N * sum{ (X - Xc)^p * (Y - Yc)^q }
-	//
-	// Where (Xc, Yc) is the average position of the points (center of mass).
-	//
-	// Since we are only comparing linearities, we don't have to do the square root:
-	//
-	// linearity = eccentricity^2 = ((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-	//
-	// This is derived from calculating the eigenvalues of the covariance matrix. Three dimensions (RGB)
-	// would require finding the roots of a qubic equation and 4 dimensions (RGBA) would require 
-	// finding the roots of a quartic equation which are giant messes. So just calculate linearity
-	// in 2d for the different combinations of planes and average them.
-
-	float inv_num_pixels = 1.0f / num_pixels;
-
-	// Calculate the center of mass.
-	float3 center_of_mass = { 0.0f, 0.0f, 0.0f };
-	{
-		for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
-
-			float3 pixel;
-			{
-				pixel.x = pixels[ pixel_iter ].x;
-				pixel.y = pixels[ pixel_iter ].y;
-				pixel.z = pixels[ pixel_iter ].z;				
-			}
-
-			center_of_mass.x += pixel.x;
-			center_of_mass.y += pixel.y;
-			center_of_mass.z += pixel.z;
-
-		} // end for
-
-		center_of_mass.x *= inv_num_pixels;
-		center_of_mass.y *= inv_num_pixels;
-		center_of_mass.z *= inv_num_pixels;
-	}
-
-	// Calculate U20, U02, U11:
-	float3 u20_and_u02 = { 0.0f, 0.0f, 0.0f };
-	float3 u11 = { 0.0f, 0.0f, 0.0f };
-	for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
-
-		float3 pixel;
-		{
-			pixel.x = pixels[ pixel_iter ].x;
-			pixel.y = pixels[ pixel_iter ].y;
-			pixel.z = pixels[ pixel_iter ].z;
-		}
-
-		float3 difference;
-		difference.x = pixel.x - center_of_mass.x;
-		difference.y = pixel.y - center_of_mass.y;
-		difference.z = pixel.z - center_of_mass.z;
-
-		float3 squared_difference;
-		squared_difference.x = difference.x * difference.x;
-		squared_difference.y = difference.y * difference.y;
-		squared_difference.z = difference.z * difference.z;
-
-		// U20: (X - Xc)^2 * (Y - Yc)^0
-		// U02: (X - Xc)^0 * (Y - Yc)^2
-		u20_and_u02.x += squared_difference.x;
-		u20_and_u02.y += squared_difference.y;
-		u20_and_u02.z += squared_difference.z;
+	for (uint row = 0; row < 4; row++) {
 
-		// U11: (X - Xc)^1 * (Y - Yc)^1
-		u11.x += difference.x * difference.y;
-		u11.y += difference.x * difference.z;
-		u11.z += difference.y * difference.z;
+		p_moments->m_sum[ row ] = 0.0f;
 
-	} // end for
-
-	// Upq = 1/N * sum{ (X - Xc)^p * (Y - Yc)^q }
-	u20_and_u02.x *= inv_num_pixels;
-	u20_and_u02.y *= inv_num_pixels;
-	u20_and_u02.z *= inv_num_pixels;
-
-	u11.x *= inv_num_pixels;
-	u11.y *= inv_num_pixels;
-	u11.z *= inv_num_pixels;
-
-	// Calculate (4 * U11^2).
-	u11.x *= 4.0f * u11.x;
-	u11.y *= 4.0f * u11.y;
-	u11.z *= 4.0f * u11.z;
-
-	// RG plane.
-	float rg_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.x;
-		float u02 = u20_and_u02.y;
-
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11.x;
-		float denom = u20_plus_u02 * u20_plus_u02;
-
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+		for (uint column = 0; column < 4; column++) {
 
-			rg_linearity = numer / denom;
+			p_moments->m_sum_products[ row ][ column ] = 0.0f;
 		}
 	}
+}
 
-	// RB plane.
-	float rb_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.x;
-		float u02 = u20_and_u02.z;
+// Add the moments of a set of pixels.
+//
+// p_moments:		(input/output) The moments to add to.
+// pixels:			The block of pixels.
+// pixel_mask:		A bit for each pixel to add (bit N is pixel N).
+// num_channels:	3 for RGB and 4 for RGBA.
+//
+// returns: The number of pixels that were added.
+//
+__device__
+uint bc7_add_moments(bc7_moments* p_moments,
+							pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint pixel_mask,
+							uint num_channels)
+{
+	uint num_pixels = 0;
+	for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
 
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11.y;
-		float denom = u20_plus_u02 * u20_plus_u02;
+		if ((pixel_mask & (1 << pixel_iter)) == 0) {
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+			continue;
+		}
 
-			rb_linearity = numer / denom;
+		float pixel[4];
+		{
+			pixel[0] = pixels[ pixel_iter ].x;
+			pixel[1] = pixels[ pixel_iter ].y;
+			pixel[2] = pixels[ pixel_iter ].z;
+			pixel[3] = pixels[ pixel_iter ].w;
 		}
-	}
 
-	// GB plane.
-	float gb_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.y;
-		float u02 = u20_and_u02.z;
+		for (uint row = 0; row < num_channels; row++) {
 
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11.z;
-		float denom = u20_plus_u02 * u20_plus_u02;
+			p_moments->m_sum[ row ] += pixel[ row ];
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+			for (uint column = row; column < num_channels; column++) {
 
-			gb_linearity = numer / denom;
+				p_moments->m_sum_products[ row ][ column ] += pixel[ row ] * pixel[ column ];
+			}
 		}
-	}
 
-	// Get the average linearity.
-	float linearity = (rg_linearity + rb_linearity + gb_linearity) * 0.33333333333333f;
+		num_pixels++;
+
+	} // end for
 
-	return linearity;
+	return num_pixels;
 }
 
-// Calculate how much the distribution of a set of pixels is like a line.
+// Estimate the least error a subset can be compressed with from its moments. The squared distance
+// of the pixels to a line through their center of mass is smallest along the principal axis, where
+// it is the trace of the scatter matrix minus its largest eigenvalue. The palette and quantization
+// only add to that so it is (about, since the eigenvalue is only estimated) a lower bound on
+// the error.
+//
+// The lower bound is a strict version of the same thing. The largest eigenvalue can't be more than
+// what it would be if the other eigenvalues were all the same, which only needs the trace and the
+// sum of the squares of the scatter matrix. The palette colors are rounded so they can be up to
+// half a step off the line in each channel, the bound takes that distance off each pixel.
 //
-// pixels:		The list of pixels.
-// num_pixels:	The number of pixels in the list.
+// p_lower_bound:	(output) The least error the subset can have with any endpoints.
+// p_moments:		The moments of the subset.
+// num_pixels:		The number of pixels in the subset.
+// num_channels:	3 for RGB and 4 for RGBA.
+// estimate:		False if only the lower bound is needed.
 //
-// returns: A value in the range [0, 1] where 0 means the set of pixels are
-//				like a sphere and 1 means they make up a line.
+// returns: The estimated error, 0 if it wasn't estimated.
 //
 __device__
-float bc7_calculate_linearity_rgba(pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ], uint num_pixels)
+float bc7_estimate_subset_error(float* p_lower_bound,
+										  bc7_moments const* p_moments, uint num_pixels,
+										  uint num_channels, bool estimate)
 {
-	// Measure the linearity by calculating the eccentricity of the point cloud. The eccentricity
-	// value is in the range [0, 1] with 0 being a circle and 1 being a line. I could only
-	// find a 2d formula for this:
-	//
-	// eccentricity = sqrt((U20 - U02)^2 + 4 * U11^2)) / (U20 + U02)
-	//
-	// Where U20, U02, and U11 are central moments of different orders:
-	//
-	// Upq = 1/N * sum{ (X - Xc)^p * (Y - Yc)^q }
-	//
-	// Where (Xc, Yc) is the average position of the points (center of mass).
-	//
-	// Since we are only comparing linearities, we don't have to do the square root:
-	//
-	// linearity = eccentricity^2 = ((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-	//
-	// This is derived from calculating the eigenvalues of the covariance matrix. Three dimensions (RGB)
-	// would require finding the roots of a qubic equation and 4 dimensions (RGBA) would require 
-	// finding the roots of a quartic equation which are giant messes. So just calculate linearity
-	// in 2d for the different combinations of planes and average them.
+	if (num_pixels == 0) {
 
-	float inv_num_pixels = 1.0f / num_pixels;
+		*p_lower_bound = 0.0f;
+		return 0.0f;
+	}
 
-	// Calculate the center of mass.
-	float4 center_of_mass = { 0.0f, 0.0f, 0.0f, 0.0f };
-	{
-		for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+	// Calculate the scatter matrix, the sum of the squared differences from the center of mass.
+	float inv_num_pixels = 1.0f / num_pixels;
+	float scatter[4][4];
+	float trace = 0.0f;
+	for (uint row = 0; row < 4; row++) {
 
-			float4 pixel;
-			{
-				pixel.x = pixels[ pixel_iter ].x;
-				pixel.y = pixels[ pixel_iter ].y;
-				pixel.z = pixels[ pixel_iter ].z;
-				pixel.w = pixels[ pixel_iter ].w;				
-			}
+		for (uint column = row; column < 4; column++) {
 
-			center_of_mass.x += pixel.x;
-			center_of_mass.y += pixel.y;
-			center_of_mass.z += pixel.z;
-			center_of_mass.w += pixel.w;
+			float value = p_moments->m_sum_products[ row ][ column ] - 
+							  p_moments->m_sum[ row ] * p_moments->m_sum[ column ] * inv_num_pixels;
 
-		} // end for
+			scatter[ row ][ column ] = value;
+			scatter[ column ][ row ] = value;
+		}
 
-		center_of_mass.x *= inv_num_pixels;
-		center_of_mass.y *= inv_num_pixels;
-		center_of_mass.z *= inv_num_pixels;
-		center_of_mass.w *= inv_num_pixels;
+		trace += scatter[ row ][ row ];
 	}
 
-	// Calculate U20, U02, U11:
-	float4 u20_and_u02 = { 0.0f, 0.0f, 0.0f, 0.0f };
-	float u11[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
-	for (uint pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+	// The largest eigenvalue is at most (trace + sqrt((n - 1) * (n * sum_squares - trace^2))) / n for
+	// an n x n matrix, which is exact when the pixels are on a line. The rounding of the palette
+	// colors takes up to 0.5 * sqrt(num_channels) off the distance of each pixel to the line, so at
+	// most 0.5 * sqrt(num_channels * num_pixels) off the distance of the whole subset.
+	{
+		float sum_squares = 0.0f;
+		for (uint row = 0; row < num_channels; row++) {
 
-		float4 pixel;
-		{
-			pixel.x = pixels[ pixel_iter ].x;
-			pixel.y = pixels[ pixel_iter ].y;
-			pixel.z = pixels[ pixel_iter ].z;
-			pixel.w = pixels[ pixel_iter ].w;			
+			for (uint column = 0; column < num_channels; column++) {
+
+				sum_squares += scatter[ row ][ column ] * scatter[ row ][ column ];
+			}
 		}
 
-		float4 difference;
-		difference.x = pixel.x - center_of_mass.x;
-		difference.y = pixel.y - center_of_mass.y;
-		difference.z = pixel.z - center_of_mass.z;
-		difference.w = pixel.w - center_of_mass.w;
-
-		float4 squared_difference;
-		squared_difference.x = difference.x * difference.x;
-		squared_difference.y = difference.y * difference.y;
-		squared_difference.z = difference.z * difference.z;
-		squared_difference.w = difference.w * difference.w;
-
-		// U20: (X - Xc)^2 * (Y - Yc)^0
-		// U02: (X - Xc)^0 * (Y - Yc)^2
-		u20_and_u02.x += squared_difference.x;
-		u20_and_u02.y += squared_difference.y;
-		u20_and_u02.z += squared_difference.z;
-		u20_and_u02.w += squared_difference.w;
-
-		// U11: (X - Xc)^1 * (Y - Yc)^1
-		u11[0] += difference.x * difference.y;
-		u11[1] += difference.x * difference.z;
-		u11[2] += difference.x * difference.w;
-		u11[3] += difference.y * difference.z;
-		u11[4] += difference.y * difference.w;
-		u11[5] += difference.z * difference.w;
+		float const n = (float)num_channels;
+		float const spread = max((n - 1.0f) * (n * sum_squares - trace * trace), 0.0f);
+		float const max_eigenvalue = min((trace + sqrtf(spread)) * (1.0f / n), trace);
+		float const line_error = max(trace - max_eigenvalue, 0.0f);
 
-	} // end for
+		float const distance = max(sqrtf(line_error) - 0.5f * sqrtf(n * num_pixels), 0.0f);
+		*p_lower_bound = distance * distance;
+	}
 
-	// Upq = 1/N * sum{ (X - Xc)^p * (Y - Yc)^q }
-	u20_and_u02.x *= inv_num_pixels;	
-	u20_and_u02.y *= inv_num_pixels;
-	u20_and_u02.z *= inv_num_pixels;
-	u20_and_u02.w *= inv_num_pixels;
-
-	u11[0] *= inv_num_pixels;
-	u11[1] *= inv_num_pixels;
-	u11[2] *= inv_num_pixels;
-	u11[3] *= inv_num_pixels;
-	u11[4] *= inv_num_pixels;
-	u11[5] *= inv_num_pixels;
-
-	// Calculate (4 * U11^2).
-	u11[0] *= 4.0f * u11[0];
-	u11[1] *= 4.0f * u11[1];
-	u11[2] *= 4.0f * u11[2];
-	u11[3] *= 4.0f * u11[3];
-	u11[4] *= 4.0f * u11[4];
-	u11[5] *= 4.0f * u11[5];
-
-	// RG plane.
-	float rg_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.x;
-		float u02 = u20_and_u02.y;
+	if (!estimate) {
+
+		return 0.0f;
+	}
 
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11[0];
-		float denom = u20_plus_u02 * u20_plus_u02;
+	// The largest eigenvalue is the variance along the principal axis. The Rayleigh quotient of
+	// one power iteration from the column of the channel with the most variance is close enough to
+	// rank the shapes. The scatter can't get big enough to overflow without normalizing.
+	uint max_variance_channel = 0;
+	for (uint channel = 1; channel < num_channels; channel++) {
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+		if (scatter[ channel ][ channel ] > scatter[ max_variance_channel ][ max_variance_channel ]) {
 
-			rg_linearity = numer / denom;
+			max_variance_channel = channel;
 		}
 	}
 
-	// RB plane.
-	float rb_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.x;
-		float u02 = u20_and_u02.z;
-
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11[1];
-		float denom = u20_plus_u02 * u20_plus_u02;
+	float axis[4];
+	for (uint row = 0; row < 4; row++) {
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+		axis[ row ] = 0.0f;
+		for (uint column = 0; column < num_channels; column++) {
 
-			rb_linearity = numer / denom;
+			axis[ row ] += scatter[ row ][ column ] * scatter[ column ][ max_variance_channel ];
 		}
 	}
 
-	// RA plane.
-	float ra_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.x;
-		float u02 = u20_and_u02.w;
-
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11[2];
-		float denom = u20_plus_u02 * u20_plus_u02;
+	float axis_axis = 0.0f;
+	float axis_scatter_axis = 0.0f;
+	for (uint row = 0; row < num_channels; row++) {
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+		float scatter_axis = 0.0f;
+		for (uint column = 0; column < num_channels; column++) {
 
-			ra_linearity = numer / denom;
+			scatter_axis += scatter[ row ][ column ] * axis[ column ];
 		}
+
+		axis_axis += axis[ row ] * axis[ row ];
+		axis_scatter_axis += axis[ row ] * scatter_axis;
 	}
 
-	// GB plane.
-	float gb_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.y;
-		float u02 = u20_and_u02.z;
+	if (axis_axis <= 0.0f) {
 
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11[3];
-		float denom = u20_plus_u02 * u20_plus_u02;
+		// The pixels are all about the same.
+		return 0.0f;
+	}
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+	float eigenvalue = axis_scatter_axis / axis_axis;
 
-			gb_linearity = numer / denom;
-		}
-	}
+	return max(trace - eigenvalue, 0.0f);
+}
 
-	// GA plane.
-	float ga_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.y;
-		float u02 = u20_and_u02.w;
+// Get the moments of the whole block.
+//
+// p_moments:	(output) The moments.
+// pixels:		The block of pixels.
+// p_mode:		The current mode.
+//
+// returns: The number of channels that are used, 3 for RGB and 4 for RGBA.
+//
+__device__
+uint bc7_get_block_moments(bc7_moments* p_moments,
+									pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ],
+									bc7_mode const* p_mode)
+{
+	// Modes 0 to 3 only have color and modes 4 and 5 have separate alpha indices, so only the color
+	// of the pixels has to be on a line.
+	uint const num_channels = (p_mode->m_mode_index < 6) ? 3 : 4;
 
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11[4];
-		float denom = u20_plus_u02 * u20_plus_u02;
+	bc7_clear_moments(p_moments);
+	bc7_add_moments(p_moments, pixels, 0xffff, num_channels);
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+	return num_channels;
+}
 
-			ga_linearity = numer / denom;
-		}
-	}
+// Estimate the error of a shape from the moments of the pixels, so they don't need to be gathered.
+// The moments of each subset are added up from its mask except for the last one which is what is
+// left of the block.
+//
+// p_lower_bound:		(output) The least error the shape can have.
+// pixels:				The block of pixels.
+// p_block_moments:	The moments of the whole block from bc7_get_block_moments().
+// num_channels:		The number of channels that are used.
+// shape_index:		The shape.
+// p_mode:				The current mode.
+// estimate:			False if only the lower bound is needed.
+//
+// returns: The estimated error (see bc7_estimate_subset_error()), 0 if it wasn't estimated.
+//
+__device__
+float bc7_estimate_shape_error(float* p_lower_bound,
+										 pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ],
+										 bc7_moments const* p_block_moments, uint num_channels,
+										 uint shape_index, bc7_mode const* p_mode,
+										 bool estimate)
+{
+	bc7_moments remaining_moments = *p_block_moments;
+	uint num_remaining_pixels = NUM_PIXELS_PER_BLOCK;
+	float estimate_sum = 0.0f;
+	float lower_bound = 0.0f;
+	for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets - 1; subset_iter++) {
 
-	// BA plane.
-	float ba_linearity = 1.0f;
-	{
-		float u20 = u20_and_u02.z;
-		float u02 = u20_and_u02.w;
+		uint subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+
+		bc7_moments subset_moments;
+		bc7_clear_moments(&subset_moments);
+		uint num_subset_pixels = bc7_add_moments(&subset_moments, pixels, subset_mask, num_channels);
 
-		//	((U20 - U02)^2 + 4 * U11^2) / (U20 + U02)^2
-		float u20_minus_u02 = u20 - u02;
-		float u20_plus_u02 = u20 + u02;
-		float numer = u20_minus_u02 * u20_minus_u02 + u11[5];
-		float denom = u20_plus_u02 * u20_plus_u02;
+		for (uint row = 0; row < 4; row++) {
 
-		// If the denominator is zero that means all the points are at the center
-		// of mass in this plane so the linearity is considered 1.
-		if (denom > 0.0f) {
+			remaining_moments.m_sum[ row ] -= subset_moments.m_sum[ row ];
 
-			ba_linearity = numer / denom;
+			for (uint column = row; column < 4; column++) {
+
+				remaining_moments.m_sum_products[ row ][ column ] -= subset_moments.m_sum_products[ row ][ column ];
+			}
 		}
-	}	
 
-	// Get the average linearity.
-	float linearity = (rg_linearity + rb_linearity + ra_linearity + 
-							 gb_linearity + ga_linearity + ba_linearity) * 0.16666666666667f;
+		num_remaining_pixels -= num_subset_pixels;
+
+		float subset_lower_bound;
+		estimate_sum += bc7_estimate_subset_error(&subset_lower_bound, &subset_moments, num_subset_pixels, num_channels, estimate);
+		lower_bound += subset_lower_bound;
+
+	} // end for
+
+	float subset_lower_bound;
+	estimate_sum += bc7_estimate_subset_error(&subset_lower_bound, &remaining_moments, num_remaining_pixels, num_channels, estimate);
+	lower_bound += subset_lower_bound;
 
-	return linearity;
+	*p_lower_bound = lower_bound;
+	return estimate_sum;
 }
 
-// Get the best shapes to refine.
+// Get the best shapes to refine, the shapes with the lowest estimated error. They're returned in
+// index order like the CPU version refines them, so the lowest shape index wins when two shapes
+// compress with the same error.
 //
-// best_shape_indices: 	(output) List of the indices of the best shapes.
+// best_shape_indices: 	(output) List of the indices of the best shapes in increasing order.
 // pixels:					The block of pixels.
 // p_mode:					The current mode.
+// p_params:				The encoding parameters.
 //
 // returns: Number of best shapes.
 //
 __device__
 uint bc7_get_best_shapes(uint best_shape_indices[ BC7_MAX_BEST_SHAPES ],
 								 pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ],
-								 bc7_mode const* p_mode)
+								 bc7_mode const* p_mode,
+								 bc7_encode_params const* p_params)
 {
 	uint const num_shapes = 1 << p_mode->m_num_shape_bits;
 	if (num_shapes == 1) {
@@ -2437,50 +2822,27 @@ uint bc7_get_best_shapes(uint best_shape_indices[ BC7_MAX_BEST_SHAPES ],
 	}
 
 	// Use a fraction of the number of shapes for the best shapes.
-	const uint max_best_shapes = min(BC7_MAX_BEST_SHAPES, num_shapes >> 2);
+	const uint max_best_shapes = min(p_params->m_max_best_shapes, num_shapes >> 2);
+
+	// Calculate the moments of the whole block.
+	bc7_moments block_moments;
+	uint const num_channels = bc7_get_block_moments(&block_moments, pixels, p_mode);
 
 	// Iterate through the shapes and get the best shapes to refine by
-	// finding the shapes with the highest linearity.
+	// finding the shapes with the lowest estimated error.
 	uint num_best_shapes = 0;	
-	float best_linearities[ BC7_MAX_BEST_SHAPES ];
+	float best_estimates[ BC7_MAX_BEST_SHAPES ];
 	for (uint shape_index = 0; shape_index < num_shapes; shape_index++) {
 
-		// Calculate the average linearity of the subsets.
-		float linearity = 0.0f;
-		for (uint subset_iter = 0; subset_iter < p_mode->m_num_subsets; subset_iter++) {
-
-			// Get the subset of pixels.
-			pixel_type subset_pixels[ NUM_PIXELS_PER_BLOCK ];
-			uint num_subset_pixels = 0;
-			for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
-
-				if (bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode) == subset_iter) {
-
-					subset_pixels[ num_subset_pixels++ ] = pixels[ pixel_iter ];
-				}
-
-			} // end for
-			
-			if (p_mode->m_mode_index < 4) {
-
-				// Non-alpha modes.
-				linearity += bc7_calculate_linearity_rgb(subset_pixels, num_subset_pixels);  
-
-			} else {
-
-				// Alpha modes.
-				linearity += bc7_calculate_linearity_rgba(subset_pixels, num_subset_pixels);
-			}				
-
-		} // end for
-
-		linearity /= p_mode->m_num_subsets;
+		float lower_bound;
+		float estimate = bc7_estimate_shape_error(&lower_bound, pixels, &block_moments, num_channels,
+																shape_index, p_mode, true);
 
 		// Find where this shape goes.
 		uint best_shape_iter;
 		for (best_shape_iter = 0; best_shape_iter < num_best_shapes; best_shape_iter++) {
 
-			if (linearity <= best_linearities[ best_shape_iter ]) {
+			if (estimate >= best_estimates[ best_shape_iter ]) {
 
 				continue;
 			}
@@ -2492,11 +2854,11 @@ uint bc7_get_best_shapes(uint best_shape_indices[ BC7_MAX_BEST_SHAPES ],
 			for (uint shift_iter = (num_best_shapes - 1); shift_iter > best_shape_iter; shift_iter--) {
 
 				best_shape_indices[ shift_iter ] = best_shape_indices[ shift_iter - 1 ];
-				best_linearities[ shift_iter ] = best_linearities[ shift_iter - 1 ];
+				best_estimates[ shift_iter ] = best_estimates[ shift_iter - 1 ];
 			}
 
 			best_shape_indices[ best_shape_iter ] = shape_index;			
-			best_linearities[ best_shape_iter ] = linearity;
+			best_estimates[ best_shape_iter ] = estimate;
 
 			break;
 
@@ -2507,18 +2869,31 @@ uint bc7_get_best_shapes(uint best_shape_indices[ BC7_MAX_BEST_SHAPES ],
 		&&  (num_best_shapes < max_best_shapes)) {
 
 			best_shape_indices[ num_best_shapes ] = shape_index;			
-			best_linearities[ num_best_shapes ] = linearity;
+			best_estimates[ num_best_shapes ] = estimate;
 
 			num_best_shapes++;
 		}
 
 	} // end for
 
+	// Put the best shapes back in index order.
+	for (uint sort_iter = 1; sort_iter < num_best_shapes; sort_iter++) {
+
+		uint const shape_index = best_shape_indices[ sort_iter ];
+
+		uint shift_iter;
+		for (shift_iter = sort_iter; (shift_iter > 0) && (best_shape_indices[ shift_iter - 1 ] > shape_index); shift_iter--) {
+
+			best_shape_indices[ shift_iter ] = best_shape_indices[ shift_iter - 1 ];
+		}
+
+		best_shape_indices[ shift_iter ] = shape_index;
+
+	} // end for
+
 	return num_best_shapes;
 }
 
-#endif // #if defined(__CULL_SHAPES)
-
 // Store a value with the given number of bits.
 //
 // p_bits:					(output) The buffer to store to.
@@ -2716,13 +3091,114 @@ void bc7_encode_compressed_block(bc7_encoded_block* p_out_encoded_block,
 	*p_out_encoded_block = encoded_block;
 }
 
+// Find out whether the block is opaque, grayscale or a solid color so the mode search can
+// skip the modes and rotations that can't win.
+//
+// pixels:	The block of pixels.
+//
+// returns: A combination of BC7_BLOCK_OPAQUE, BC7_BLOCK_GRAYSCALE and BC7_BLOCK_SOLID.
+//
+__device__
+uint bc7_classify_block(pixel_type const pixels[ NUM_PIXELS_PER_BLOCK ])
+{
+	uint is_opaque = 1;
+	uint is_grayscale = 1;
+	uint is_solid = 1;
+	for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		is_opaque &= (pixels[ pixel_iter ].w == 255);
+		is_grayscale &= (pixels[ pixel_iter ].x == pixels[ pixel_iter ].y) & (pixels[ pixel_iter ].y == pixels[ pixel_iter ].z);
+		is_solid &= (pixels[ pixel_iter ].x == pixels[0].x) & (pixels[ pixel_iter ].y == pixels[0].y) &
+					 (pixels[ pixel_iter ].z == pixels[0].z) & (pixels[ pixel_iter ].w == pixels[0].w);
+
+	} // end for
+
+	return (is_opaque ? BC7_BLOCK_OPAQUE : 0) | (is_grayscale ? BC7_BLOCK_GRAYSCALE : 0) | (is_solid ? BC7_BLOCK_SOLID : 0);
+}
+
+// Encode a solid color block with mode 5 using Solid_color_endpoints, there is no error.
+//
+// p_encoded_block:	(output) The compressed and encoded block.
+// color:				The color of the block.
+//
+__device__
+void bc7_encode_solid_color(bc7_encoded_block* p_encoded_block, pixel_type const color)
+{
+	bc7_compressed_block compressed_block;
+	{
+		compressed_block.m_error = 0;
+		compressed_block.m_rotation = 0;
+		compressed_block.m_index_selection_bit = 0;
+		compressed_block.m_shape = 0;
+	}
+
+	// The color endpoints come from the table, the alpha endpoints are the alpha.
+	uint const channel_values[4] = { color.x, color.y, color.z, color.w };
+	for (uint channel = 0; channel < 3; channel++) {
+
+		compressed_block.m_quantized_endpoints.m_endpoints[0][0][ channel ] = Solid_color_endpoints[ channel_values[ channel ] ][0];
+		compressed_block.m_quantized_endpoints.m_endpoints[0][1][ channel ] = Solid_color_endpoints[ channel_values[ channel ] ][1];
+
+	} // end for
+
+	compressed_block.m_quantized_endpoints.m_endpoints[0][0][3] = channel_values[3];
+	compressed_block.m_quantized_endpoints.m_endpoints[0][1][3] = channel_values[3];
+
+	for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+
+		compressed_block.m_palette_indices_1[ pixel_iter ] = BC7_SOLID_COLOR_INDEX;
+		compressed_block.m_palette_indices_2[ pixel_iter ] = 0;
+
+	} // end for
+
+	bc7_encode_compressed_block(p_encoded_block, &compressed_block, &BC7_modes[ BC7_SOLID_COLOR_MODE ]);
+}
+
+// Get the number of channel rotations to try for a mode given the class of the block.
+// Solid color blocks skip the search since bc7_encode_solid_color() has no error. Modes 0 to 3
+// always decode to an alpha of 255 so they are skipped for blocks that aren't opaque. Moving a
+// color channel in to the alpha channel doesn't help when the color channels are all the same so
+// modes 4 and 5 only try no rotation for grayscale blocks. Opaque blocks still try them since it
+// gives a color channel its own indices.
+//
+// block_flags:	The flags from bc7_classify_block().
+// p_mode:			The current mode.
+//
+// returns: The number of rotations, 0 if the mode should be skipped.
+//
+__device__
+uint bc7_get_num_rotations(uint block_flags, bc7_mode const* p_mode)
+{
+	if ((block_flags & BC7_BLOCK_SOLID) != 0) {
+
+		return 0;
+	}
+
+	if ((p_mode->m_endpoint_precision[3] == 0)
+	&&  ((block_flags & BC7_BLOCK_OPAQUE) == 0)) {
+
+		return 0;
+	}
+
+	if ((block_flags & BC7_BLOCK_GRAYSCALE) != 0) {
+
+		return 1;
+	}
+
+	return 1 << p_mode->m_num_rotation_bits;
+}
+
 // Compress and encode the block of pixels for the given mode.
 //
 // p_encoded_blocks:	(output) A compressed and encoded block if the error is better.
 // pixels:				The block of pixels to compress.
 // block_index: 		The global index of the block of pixels to compress.
 // p_mode:				The current mode.
+// num_rotations:		The number of channel rotations to try.
 // input_error:		The current best error.
+// p_params:			The encoding parameters.
+// p_num_pruned_evaluations:	(input/output) The number of evaluations that were skipped because
+//										the lower bound of the shape was no better than the best error so far.
 //
 // returns: The new error (or the same error if there was no improvement).
 //
@@ -2731,7 +3207,10 @@ uint bc7_compress(bc7_encoded_block* p_encoded_blocks,
 					   pixel_type pixels[ NUM_PIXELS_PER_BLOCK ],
 					   uint block_index,
 					   bc7_mode const* p_mode,
-					   uint const input_error)
+					   uint const num_rotations,
+					   uint const input_error,
+					   bc7_encode_params const* p_params,
+					   uint* p_num_pruned_evaluations)
 {
 	// Initialize the error for this block.
 	bc7_compressed_block compressed_block;
@@ -2739,28 +3218,39 @@ uint bc7_compress(bc7_encoded_block* p_encoded_blocks,
 		compressed_block.m_error = UINT_MAX;
 	}
 
-#if defined(__CULL_SHAPES)
-
-	// Get the best shapes to refine.
+	// Either refine the best shapes or iterate over all the shapes.
+	bool const cull_shapes = (p_params->m_max_best_shapes > 0);
 	uint best_shape_indices[ BC7_MAX_BEST_SHAPES ];
-	uint num_shapes = bc7_get_best_shapes(best_shape_indices, pixels, p_mode);
+	uint num_shapes = 1 << p_mode->m_num_shape_bits;
+	if (cull_shapes) {
 
-#else
-
-   // We'll iterate over all the shapes.
-   uint num_shapes = 1 << p_mode->m_num_shape_bits;
+		num_shapes = bc7_get_best_shapes(best_shape_indices, pixels, p_mode, p_params);
+	}
 
-#endif // #if defined(__CULL_SHAPES)
+	// The endpoint optimizers that are tried for each shape.
+	uint const first_optimizer = (p_params->m_endpoint_optimizer == BC7_ENDPOINT_OPTIMIZER_BOTH) ?
+											BC7_ENDPOINT_OPTIMIZER_GRADIENT_DESCENT : p_params->m_endpoint_optimizer;
+	uint const last_optimizer = (p_params->m_endpoint_optimizer == BC7_ENDPOINT_OPTIMIZER_BOTH) ?
+										  BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES : p_params->m_endpoint_optimizer;
 
-	uint const num_rotations = 1 << p_mode->m_num_rotation_bits;
 	uint const num_isb_states = 1 << p_mode->m_num_isb_bits;
 	uint const num_subsets = p_mode->m_num_subsets;
 
 	// Iterate through the channel rotations.
 	for (uint rotation_iter = 0; rotation_iter < num_rotations; rotation_iter++) { 
 
+		// Stop once the block has reached the error threshold.
+		if (min(compressed_block.m_error, input_error) <= p_params->m_error_threshold) {
+
+			break;
+		}
+
 		// Potentially swap a color channel with the alpha channel to improve precision.
 		bc7_swap_channels(pixels, rotation_iter);
+
+		// The lower bounds depend on which channel is in the alpha channel.
+		bc7_moments block_moments;
+		uint const num_channels = bc7_get_block_moments(&block_moments, pixels, p_mode);
       
 		// Iterate through the states of the index selection bit.
 		for (uint isb_iter = 0; isb_iter < num_isb_states; isb_iter++) {
@@ -2768,67 +3258,85 @@ uint bc7_compress(bc7_encoded_block* p_encoded_blocks,
 			// Iterate through the shapes.
 			for (uint shape_iter = 0; shape_iter < num_shapes; shape_iter++) {
 				
-         #if defined(__CULL_SHAPES)
-			
-         	uint const shape_index = best_shape_indices[ shape_iter ];
+				uint const shape_index = cull_shapes ? best_shape_indices[ shape_iter ] : shape_iter;
+
+				// Stop once the block has reached the error threshold, the rotation loop stops too
+				// after the channels are swapped back.
+				if (min(compressed_block.m_error, input_error) <= p_params->m_error_threshold) {
+
+					break;
+				}
 
-         #else
+				// Branch and bound, the shape can't win if its lower bound isn't less than the best
+				// error of this mode or the modes before it.
+				float lower_bound;
+				bc7_estimate_shape_error(&lower_bound, pixels, &block_moments, num_channels,
+												 shape_index, p_mode, false);
 
-            uint const shape_index = shape_iter;
+				if (lower_bound >= (float)min(compressed_block.m_error, input_error)) {
 
-         #endif // #if defined(__CULL_SHAPES)
+					(*p_num_pruned_evaluations)++;
+					continue;
+				}
+
+				// Both optimizers refine the shape when both are asked for, the endpoints that
+				// compress it with the lower error are kept.
+				for (uint optimizer_iter = first_optimizer; optimizer_iter <= last_optimizer; optimizer_iter++) {
 
-				// Iterate through the subsets in the shape and run gradient descent.
-            float2x4 gd_subset_results[ BC7_MAX_SUBSETS ];
-				for (uint subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
+					// Iterate through the subsets in the shape.
+					float2x4 gd_subset_results[ BC7_MAX_SUBSETS ];
+					for (uint subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
 
-					// Get the subset of pixels.
-					pixel_type subset_pixels[ NUM_PIXELS_PER_BLOCK ];
-					uint num_subset_pixels = 0;
-					for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+						// Get the subset of pixels.
+						uint subset_mask = bc7_get_subset_mask(shape_index, subset_iter, p_mode);
+						pixel_type subset_pixels[ NUM_PIXELS_PER_BLOCK ];
+						uint num_subset_pixels = 0;
+						for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
 
-						if (bc7_get_subset_for_pixel(shape_index, pixel_iter, p_mode) == subset_iter) {
+							if ((subset_mask & (1 << pixel_iter)) != 0) {
 
-							subset_pixels[ num_subset_pixels++ ] = pixels[ pixel_iter ];
-						}
+								subset_pixels[ num_subset_pixels++ ] = pixels[ pixel_iter ];
+							}
 
-					} // end for
+						} // end for
 
-					// Find the endpoints.
-					bc7_find_endpoints(gd_subset_results[ subset_iter ],
-                                  subset_pixels, num_subset_pixels, 
-											 isb_iter, p_mode);
+						// Find the endpoints.
+						bc7_find_endpoints(gd_subset_results[ subset_iter ],
+												 subset_pixels, num_subset_pixels, 
+												 isb_iter, optimizer_iter, p_mode, p_params);
 
-				} // end for            
+					} // end for            
 
-            // Quantize the endpoints to the final precision including the parity bits.
-            bc7_quantized_endpoints quantized_endpoints;
-            bc7_quantize_endpoints(&quantized_endpoints, gd_subset_results, p_mode);
+					// Quantize the endpoints to the final precision including the parity bits.
+					bc7_quantized_endpoints quantized_endpoints;
+					bc7_quantize_endpoints(&quantized_endpoints, gd_subset_results, p_mode);
 
-             // Assign palette indices to each pixel and calculate the error.
-            uchar palette_indices_1[ NUM_PIXELS_PER_BLOCK ];
-            uchar palette_indices_2[ NUM_PIXELS_PER_BLOCK ];                     
-            uint shape_error = bc7_assign_pixels(&quantized_endpoints,
-                                                 palette_indices_1, palette_indices_2,                                                 
-                                                 pixels, isb_iter, shape_index, p_mode);  
+					// Assign palette indices to each pixel and calculate the error.
+					uchar palette_indices_1[ NUM_PIXELS_PER_BLOCK ];
+					uchar palette_indices_2[ NUM_PIXELS_PER_BLOCK ];                     
+					uint shape_error = bc7_assign_pixels(&quantized_endpoints,
+																	 palette_indices_1, palette_indices_2,                                                 
+																	 pixels, isb_iter, shape_index, p_mode);  
 
-				// Save the results if the error is better.
-				if (shape_error < compressed_block.m_error) {
+					// Save the results if the error is better.
+					if (shape_error < compressed_block.m_error) {
 										
-					compressed_block.m_rotation = rotation_iter;
-					compressed_block.m_index_selection_bit = isb_iter;
-					compressed_block.m_shape = shape_index;					
-					compressed_block.m_error = shape_error;
-               compressed_block.m_quantized_endpoints = quantized_endpoints;									
+						compressed_block.m_rotation = rotation_iter;
+						compressed_block.m_index_selection_bit = isb_iter;
+						compressed_block.m_shape = shape_index;					
+						compressed_block.m_error = shape_error;
+						compressed_block.m_quantized_endpoints = quantized_endpoints;									
 
-					// Copy the palette indices over.
-					for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
+						// Copy the palette indices over.
+						for (uint pixel_iter = 0; pixel_iter < NUM_PIXELS_PER_BLOCK; pixel_iter++) {
 
-						compressed_block.m_palette_indices_1[ pixel_iter ] = palette_indices_1[ pixel_iter ];
-						compressed_block.m_palette_indices_2[ pixel_iter ] = palette_indices_2[ pixel_iter ];
+							compressed_block.m_palette_indices_1[ pixel_iter ] = palette_indices_1[ pixel_iter ];
+							compressed_block.m_palette_indices_2[ pixel_iter ] = palette_indices_2[ pixel_iter ];
 
-					} // end for
-				}
+						} // end for
+					}
+
+				} // end for
 
 			} // end for
 
@@ -2858,11 +3366,15 @@ uint bc7_compress(bc7_encoded_block* p_encoded_blocks,
 // p_source_pixels:	The image pixels.
 // width_in_blocks:  The width of the image in 4x4 blocks.
 // height_in_blocks: The height of the image in 4x4 blocks.
+// params:				The encoding parameters.
+// p_num_pruned_evaluations:	(input/output) The number of evaluations branch and bound skipped.
 //
 extern "C" __global__ 
 void bc7_kernel(bc7_encoded_block* p_encoded_blocks,					 
 					 pixel_type const* p_source_pixels,						
-					 uint width_in_blocks, uint height_in_blocks)
+					 uint width_in_blocks, uint height_in_blocks,
+					 bc7_encode_params params,
+					 unsigned long long* p_num_pruned_evaluations)
 {
    uint const pixel_block_x = blockIdx.x * blockDim.x + threadIdx.x;
    uint const pixel_block_y = blockIdx.y * blockDim.y + threadIdx.y;
@@ -2890,10 +3402,52 @@ void bc7_kernel(bc7_encoded_block* p_encoded_blocks,
 	// Go through the modes and find the one with the least error for
 	// this block of 4x4 pixels.
    uint const pixel_block_index = pixel_block_y * width_in_blocks + pixel_block_x;   
+   uint block_flags = bc7_classify_block(pixels);
 	uint error = UINT_MAX;
-	for (uint mode_iter = 0; mode_iter < BC7_NUM_MODES; mode_iter++) {
+	uint num_pruned_evaluations = 0;
+
+	// Solid color blocks are encoded straight away. They're encoded in mode 5 so if it isn't
+	// enabled they go through the search like any other block.
+	if ((params.m_mode_mask & (1 << BC7_SOLID_COLOR_MODE)) == 0) {
+
+		block_flags &= ~BC7_BLOCK_SOLID;
+	}
+
+	if ((block_flags & BC7_BLOCK_SOLID) != 0) {
+
+		bc7_encode_solid_color(&p_encoded_blocks[ pixel_block_index ], pixels[0]);
+		error = 0;
+	}
+
+	for (uint mode_order_iter = 0; mode_order_iter < BC7_NUM_MODES; mode_order_iter++) {
+
+		uint const mode_iter = Mode_search_order[ mode_order_iter ];
+		if ((params.m_mode_mask & (1 << mode_iter)) == 0) {
+
+			continue;
+		}
+
+		// The rest of the modes are skipped once the block has reached the error threshold.
+		if (error <= params.m_error_threshold) {
+
+			break;
+		}
+
+		// Skip the modes and rotations that can't win for this class of block.
+		bc7_mode const* p_mode = &BC7_modes[ mode_iter ];
+		uint const num_rotations = bc7_get_num_rotations(block_flags, p_mode);
+		if (num_rotations == 0) {
+
+			continue;
+		}
 	
-		error = bc7_compress(p_encoded_blocks, pixels, pixel_block_index, &BC7_modes[ mode_iter ], error);
+		error = bc7_compress(p_encoded_blocks, pixels, pixel_block_index, p_mode, num_rotations, error, &params,
+									&num_pruned_evaluations);
 
 	} // end for
+
+	if (num_pruned_evaluations > 0) {
+
+		atomicAdd(p_num_pruned_evaluations, (unsigned long long)num_pruned_evaluations);
+	}
 }
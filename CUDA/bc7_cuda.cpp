@@ -5,6 +5,9 @@
 
 #include <stdio.h>
 
+#include <mutex>
+#include <vector>
+
 #include <cuda.h>
 
 #include "bc7_cuda.h"
@@ -12,7 +15,9 @@
 
 #if defined(__BC7_CUDA)
 
-#pragma comment(lib, "CUDA.lib")
+#if defined(_MSC_VER)
+	#pragma comment(lib, "CUDA.lib")
+#endif // #if defined(_MSC_VER)
 
 // --------------------
 //
@@ -20,6 +25,9 @@
 //
 // --------------------
 
+// The number of block rows of a source that isn't 32-bit RGBA that are gathered in to 32-bit RGBA and
+// uploaded at a time.
+#define BC7_CUDA_UPLOAD_BAND_ROWS	64
 
 // --------------------
 //
@@ -34,6 +42,26 @@
 //
 // --------------------
 
+// Everything that is set up once and used for each texture a context compresses.
+struct bc7_cuda_context {
+
+	CUdevice m_device;
+	CUcontext m_context;
+	CUmodule m_module;
+	CUfunction m_kernel;
+
+	// The buffers and the number of bytes they hold, they only ever grow.
+	CUdeviceptr m_source_buffer;
+	size_t m_source_buffer_size;
+	CUdeviceptr m_destination_buffer;
+	size_t m_destination_buffer_size;
+
+	// The count of evaluations branch and bound skipped.
+	CUdeviceptr m_pruned_evaluations_buffer;
+
+	// Only one thread can use the context at a time.
+	std::mutex m_mutex;
+};
 
 // --------------------
 //
@@ -55,41 +83,198 @@
 //
 // --------------------
 
-
-// --------------------
+// Make sure a device buffer is big enough, it only ever grows so a context that compresses a lot of
+// textures of about the same size only allocates it once.
 //
-// External Functions
+// p_buffer:		(input/output) The buffer, 0 if it hasn't been allocated.
+// p_size:			(input/output) The number of bytes the buffer holds.
+// size:				The number of bytes that are needed.
+// p_name:			The name of the buffer for the error message.
 //
-// --------------------
+// returns: True if successful.
+//
+static bool bc7_cuda_reserve_buffer(CUdeviceptr* p_buffer, size_t* p_size, size_t size, char const* p_name)
+{
+	if (*p_size >= size) {
+
+		return true;
+	}
 
-// Compress a texture to the BC7 format using CUDA.
+	if (*p_buffer != 0) {
+
+		cuMemFree(*p_buffer);
+		*p_buffer = 0;
+		*p_size = 0;
+	}
+
+	CUresult result = cuMemAlloc(p_buffer, size);
+	if (result != CUDA_SUCCESS) {
+
+		printf("Failed to allocate the %s buffer on the device!\n", p_name);
+
+		*p_buffer = 0;
+		return false;
+	}
+
+	*p_size = size;
+	return true;
+}
+
+// Compress a texture to the BC7 format with a context that the caller has locked and made current.
 //
+// p_context:		(input/output) The context.
 // p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
 //						correct size (source size / 4).
-// p_source:		The source image data. This must be 32-bit RGBA.
-// width:			Width of the image in pixels. Must be a multiple of 4.
-// height:			Height of the image in pixels. Must be a multiple of 4.
-// 
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
 // returns: True if successful.
 //
-bool bc7_cuda_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height)
+static bool bc7_cuda_context_compress_locked(bc7_cuda_context* p_context, bc7_compressed_block* p_destination,
+															bc7_source const* p_source, bc7_encode_params const* p_params)
 {
-	SCOPED_TIMER("bc7_cuda_compress");
+	size_t const width = p_source->m_width;
+	size_t const height = p_source->m_height;
 
-	if (width & 0x3) {
+	// The kernel takes 32-bit sizes.
+	uint32_t width_in_blocks = static_cast< uint32_t >(width / 4);
+	uint32_t height_in_blocks = static_cast< uint32_t >(height / 4);
+	if ((width_in_blocks == 0)
+	||  (height_in_blocks == 0)) {
+
+		return true;
+	}
+
+	CUresult result;
+
+	// Make sure the 32-bit source buffer in device memory is big enough.
+	size_t const source_buffer_size = 4 * width * height;
+	if (bc7_cuda_reserve_buffer(&p_context->m_source_buffer, &p_context->m_source_buffer_size,
+										 source_buffer_size, "source") == false) {
 
-		printf("The width of the image must be a multiple of 4!\n");
 		return false;
 	}
 
-	if (height & 0x3) {
+	// Copy the source data to device memory. A source that isn't 32-bit RGBA is gathered in to it a
+	// band of block rows at a time so it's never converted as a whole.
+	if (bc7_source_is_rgba(p_source)) {
 
-		printf("The height of the image must be a multiple of 4!\n");
+		result = cuMemcpyHtoD(p_context->m_source_buffer, p_source->m_p_top_row, source_buffer_size);
+
+	} else {
+
+		size_t const band_row_size = 4 * 4 * width;
+		std::vector< uint8_t > band_pixels(BC7_CUDA_UPLOAD_BAND_ROWS * band_row_size);
+
+		result = CUDA_SUCCESS;
+		for (size_t block_row = 0; (block_row < height_in_blocks) && (result == CUDA_SUCCESS); block_row += BC7_CUDA_UPLOAD_BAND_ROWS) {
+
+			size_t num_block_rows = height_in_blocks - block_row;
+			if (num_block_rows > BC7_CUDA_UPLOAD_BAND_ROWS) {
+
+				num_block_rows = BC7_CUDA_UPLOAD_BAND_ROWS;
+			}
+
+			bc7_source_get_pixels(&band_pixels[0], p_source, 0, block_row * 4, width, num_block_rows * 4);
+			result = cuMemcpyHtoD(p_context->m_source_buffer + block_row * band_row_size, &band_pixels[0],
+										 num_block_rows * band_row_size);
+
+		} // end for
+	}
+
+	if (result != CUDA_SUCCESS) {
+
+		printf("Failed to copy the source data to the device!\n");
+		return false;
+	}
+
+	// Number of 4x4 blocks of pixels.
+	size_t const num_blocks = width * height / 16;
+
+	// Make sure the destination buffer in device memory is big enough.
+	size_t const destination_buffer_size = num_blocks * sizeof(bc7_compressed_block);
+	if (bc7_cuda_reserve_buffer(&p_context->m_destination_buffer, &p_context->m_destination_buffer_size,
+										 destination_buffer_size, "destination") == false) {
+
+		return false;
+	}
+
+	// Clear the count of evaluations branch and bound skipped, the kernel adds to it.
+	unsigned long long num_pruned_evaluations = 0;
+	result = cuMemcpyHtoD(p_context->m_pruned_evaluations_buffer, &num_pruned_evaluations, sizeof(num_pruned_evaluations));
+	if (result != CUDA_SUCCESS) {
+
+		printf("Failed to clear the pruned evaluations on the device!\n");
 		return false;
 	}
 
-	size_t width_in_blocks = width / 4;
-	size_t height_in_blocks = height / 4;
+	{
+		SCOPED_TIMER("Run kernel");
+
+		// Run the kernel.
+		size_t const block_dim = 8;
+		size_t const grid_dim_x = (width_in_blocks + block_dim - 1) / block_dim;
+		size_t const grid_dim_y = (height_in_blocks + block_dim - 1) / block_dim;
+
+		// The parameters are passed by value.
+		bc7_encode_params params = *p_params;
+
+		void* args[] = {
+
+			&p_context->m_destination_buffer,
+			&p_context->m_source_buffer,
+			&width_in_blocks,
+			&height_in_blocks,
+			&params,
+			&p_context->m_pruned_evaluations_buffer
+		};
+
+		result = cuLaunchKernel(p_context->m_kernel,
+										grid_dim_x, grid_dim_y, 1,
+										block_dim, block_dim, 1,
+										0, 0, args, 0);
+		if (result != CUDA_SUCCESS) {
+
+			printf("Failed to launch the kernel!\n");
+			return false;
+		}
+
+		// Copy the results from device to host memory.
+		result = cuMemcpyDtoH(p_destination, p_context->m_destination_buffer, destination_buffer_size);
+		if (result != CUDA_SUCCESS) {
+
+			printf("Failed to copy the results from the device!\n");
+			return false;
+		}
+
+		result = cuMemcpyDtoH(&num_pruned_evaluations, p_context->m_pruned_evaluations_buffer, sizeof(num_pruned_evaluations));
+		if (result != CUDA_SUCCESS) {
+
+			printf("Failed to copy the pruned evaluations from the device!\n");
+			return false;
+		}
+	}
+
+	printf("Branch and bound pruned %llu evaluations (%.1f per block)\n",
+			 num_pruned_evaluations, static_cast< double >(num_pruned_evaluations) / num_blocks);
+
+	return true;
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Create a context that keeps the CUDA device, module, kernel and buffers between calls so they're
+// only set up once for any number of textures.
+//
+// returns: The context or NULL if it failed.
+//
+bc7_cuda_context* bc7_cuda_context_create()
+{
+	SCOPED_TIMER("bc7_cuda_context_create");
 
 	CUresult result;
 
@@ -98,133 +283,239 @@ bool bc7_cuda_compress(bc7_compressed_block* p_destination, uint8_t const* p_sou
 	if (result != CUDA_SUCCESS) {
 
 		printf("Failed to initialize CUDA!\n");
-		return false;
+		return NULL;
 	}
 
+	bc7_cuda_context* p_context = new bc7_cuda_context;
+	p_context->m_context = NULL;
+	p_context->m_module = NULL;
+	p_context->m_kernel = NULL;
+	p_context->m_source_buffer = 0;
+	p_context->m_source_buffer_size = 0;
+	p_context->m_destination_buffer = 0;
+	p_context->m_destination_buffer_size = 0;
+	p_context->m_pruned_evaluations_buffer = 0;
+
 	// Get a handle to the first device.
-	CUdevice cu_device; 
-	result = cuDeviceGet(&cu_device, 0); 
+	result = cuDeviceGet(&p_context->m_device, 0);
 	if (result != CUDA_SUCCESS) {
 
 		printf("Failed to get a CUDA device!\n");
-		return false;
+
+		bc7_cuda_context_destroy(p_context);
+		return NULL;
 	}
 
 	// Show device info.
 	{
 		// Get the name of the device.
 		char device_name[256] = {0};
-		result = cuDeviceGetName(device_name, sizeof(device_name), cu_device);
+		result = cuDeviceGetName(device_name, sizeof(device_name), p_context->m_device);
 		if (result != CUDA_SUCCESS) {
 
 			printf("Failed to get the name of the CUDA device!\n");
-			return false;
+
+			bc7_cuda_context_destroy(p_context);
+			return NULL;
 		}
 
 		printf("CUDA device: %s\n", device_name);
 	}
 
-	// Create a context.
-	CUcontext cu_context; 
-	result = cuCtxCreate(&cu_context, 0, cu_device); 
+	// Create a context, it's current on this thread until it's popped at the end.
+	result = cuCtxCreate(&p_context->m_context, 0, p_context->m_device);
 	if (result != CUDA_SUCCESS) {
 
 		printf("Failed to create a CUDA context!\n");
-		return false;
+
+		p_context->m_context = NULL;
+		bc7_cuda_context_destroy(p_context);
+		return NULL;
 	}
-	
+
 	// Load the code.
 	char const* p_module_name = "CUDA/BC7.ptx";
-	CUmodule cu_module; 
-	result = cuModuleLoad(&cu_module, p_module_name);
+	result = cuModuleLoad(&p_context->m_module, p_module_name);
 	if (result != CUDA_SUCCESS) {
 
 		printf("Failed to load the module \"%s\"!\n", p_module_name);
-		return false;
+
+		p_context->m_module = NULL;
+		cuCtxPopCurrent(NULL);
+		bc7_cuda_context_destroy(p_context);
+		return NULL;
 	}
 
-	// Allocate the 32-bit source buffer in device memory.
-	CUdeviceptr device_source_buffer; 
-	size_t const source_buffer_size = 4 * width * height;
-	result = cuMemAlloc(&device_source_buffer, source_buffer_size);
+	// Get a handle to the kernel.
+	result = cuModuleGetFunction(&p_context->m_kernel, p_context->m_module, "bc7_kernel");
 	if (result != CUDA_SUCCESS) {
 
-		printf("Failed to allocate the source buffer on the device!\n");
-		return false;
+		printf("Failed to find the kernel function!\n");
+
+		cuCtxPopCurrent(NULL);
+		bc7_cuda_context_destroy(p_context);
+		return NULL;
 	}
 
-	// Copy the source data to device memory.
-	result = cuMemcpyHtoD(device_source_buffer, p_source, source_buffer_size);
+	// Allocate the count of evaluations branch and bound skipped.
+	result = cuMemAlloc(&p_context->m_pruned_evaluations_buffer, sizeof(unsigned long long));
 	if (result != CUDA_SUCCESS) {
 
-		printf("Failed to copy the source data to the device!\n");
+		printf("Failed to allocate the pruned evaluations buffer on the device!\n");
+
+		p_context->m_pruned_evaluations_buffer = 0;
+		cuCtxPopCurrent(NULL);
+		bc7_cuda_context_destroy(p_context);
+		return NULL;
+	}
+
+	// The context is pushed on whichever thread compresses with it.
+	cuCtxPopCurrent(NULL);
+
+	return p_context;
+}
+
+// Release everything a context holds on to.
+//
+// p_context:	The context, this can be a partly created one or NULL.
+//
+void bc7_cuda_context_destroy(bc7_cuda_context* p_context)
+{
+	if (p_context == NULL) {
+
+		return;
+	}
+
+	if (p_context->m_context != NULL) {
+
+		cuCtxPushCurrent(p_context->m_context);
+
+		if (p_context->m_pruned_evaluations_buffer != 0) {
+
+			cuMemFree(p_context->m_pruned_evaluations_buffer);
+		}
+
+		if (p_context->m_destination_buffer != 0) {
+
+			cuMemFree(p_context->m_destination_buffer);
+		}
+
+		if (p_context->m_source_buffer != 0) {
+
+			cuMemFree(p_context->m_source_buffer);
+		}
+
+		if (p_context->m_module != NULL) {
+
+			cuModuleUnload(p_context->m_module);
+		}
+
+		cuCtxPopCurrent(NULL);
+		cuCtxDestroy(p_context->m_context);
+	}
+
+	delete p_context;
+}
+
+// Compress a texture to the BC7 format with a context straight from its source pixels. Several
+// threads can use the same context, their textures are compressed one at a time.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cuda_context_compress_source(bc7_cuda_context* p_context, bc7_compressed_block* p_destination,
+												  bc7_source const* p_source, bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_cuda_context_compress");
+
+	if (p_source->m_width & 0x3) {
+
+		printf("The width of the image must be a multiple of 4!\n");
 		return false;
 	}
 
-	// Number of 4x4 blocks of pixels.
-	size_t const num_blocks = width * height / 16;
+	if (p_source->m_height & 0x3) {
 
-	// Allocate the destination buffer in device memory.
-	CUdeviceptr device_destination_buffer;
-	size_t const destination_buffer_size = num_blocks * sizeof(bc7_compressed_block);
-	result = cuMemAlloc(&device_destination_buffer, destination_buffer_size);
-	if (result != CUDA_SUCCESS) {
+		printf("The height of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (!bc7_check_encode_params(p_params)) {
 
-		printf("Failed to allocate the destination buffer on the device!\n");
 		return false;
 	}
 
-	// Get a handle to the kernel.
-	CUfunction kernel; 
-	result = cuModuleGetFunction(&kernel, cu_module, "bc7_kernel");
+	// The buffers are shared so only one texture is in flight at once, and the context has to be
+	// current on the thread that uses it.
+	std::lock_guard< std::mutex > lock(p_context->m_mutex);
+
+	CUresult result = cuCtxPushCurrent(p_context->m_context);
 	if (result != CUDA_SUCCESS) {
 
-		printf("Failed to find the kernel function!\n");
+		printf("Failed to make the CUDA context current!\n");
 		return false;
 	}
 
-	{
-		SCOPED_TIMER("Run kernel");
-
-		// Run the kernel.
-		size_t const block_dim = 8;
-		size_t const grid_dim_x = (width_in_blocks + block_dim - 1) / block_dim;
-		size_t const grid_dim_y = (height_in_blocks + block_dim - 1) / block_dim;
+	bool const compressed = bc7_cuda_context_compress_locked(p_context, p_destination, p_source, p_params);
+	cuCtxPopCurrent(NULL);
 
-		void* args[] = { 
+	return compressed;
+}
 
-			&device_destination_buffer, 
-			&device_source_buffer,					
-			&width_in_blocks,
-			&height_in_blocks
-		}; 
+// Compress a texture to the BC7 format with a context.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cuda_context_compress(bc7_cuda_context* p_context, bc7_compressed_block* p_destination,
+										 uint8_t const* p_source, size_t width, size_t height,
+										 bc7_encode_params const* p_params)
+{
+	bc7_source source;
+	bc7_source_init_rgba(&source, p_source, width, height);
 
-		result = cuLaunchKernel(kernel,
-										grid_dim_x, grid_dim_y, 1,
-										block_dim, block_dim, 1,
-										0, 0, args, 0);
-		if (result != CUDA_SUCCESS) {
+	return bc7_cuda_context_compress_source(p_context, p_destination, &source, p_params);
+}
 
-			printf("Failed to launch the kernel!\n");
-			return false;
-		}				
+// Compress a texture to the BC7 format using CUDA. Everything is set up for this texture and
+// released again, use a context to compress more than one.
+//
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cuda_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height,
+							  bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_cuda_compress");
 
-		// Copy the results from device to host memory.
-		result = cuMemcpyDtoH(p_destination, device_destination_buffer, destination_buffer_size);
-		if (result != CUDA_SUCCESS) {
+	bc7_cuda_context* p_context = bc7_cuda_context_create();
+	if (p_context == NULL) {
 
-			printf("Failed to copy the results from the device!\n");
-			return false;
-		}
+		return false;
 	}
 
-	// Cleanup.
-	cuMemFree(device_destination_buffer);
-	cuMemFree(device_source_buffer);
-	cuModuleUnload(cu_module);
-	cuCtxDestroy(cu_context);
+	bool const compressed = bc7_cuda_context_compress(p_context, p_destination, p_source, width, height, p_params);
+	bc7_cuda_context_destroy(p_context);
 
-	return true;
+	return compressed;
 }
 
 #endif // #if defined(__BC7_CUDA)
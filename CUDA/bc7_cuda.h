@@ -13,6 +13,8 @@
 #if defined(__BC7_CUDA)
 
 #include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+#include "bc7_source.h"
 
 // --------------------
 //
@@ -34,6 +36,9 @@
 //
 // --------------------
 
+// The CUDA device, module, kernel and buffers that a context keeps between textures. It's only
+// defined in "bc7_cuda.cpp" so this header doesn't need the CUDA headers.
+struct bc7_cuda_context;
 
 // --------------------
 //
@@ -48,17 +53,65 @@
 //
 // --------------------
 
-// Compress a texture to the BC7 format using CUDA.
+// Create a context that keeps the CUDA device, module, kernel and buffers between calls so they're
+// only set up once for any number of textures.
+//
+// returns: The context or NULL if it failed.
+//
+bc7_cuda_context* bc7_cuda_context_create();
+
+// Release everything a context holds on to.
+//
+// p_context:	The context, this can be NULL.
+//
+void bc7_cuda_context_destroy(bc7_cuda_context* p_context);
+
+// Compress a texture to the BC7 format with a context straight from its source pixels. Several
+// threads can use the same context, their textures are compressed one at a time. The device buffers
+// only ever grow so textures of about the same size don't allocate anything. A source that isn't
+// 32-bit RGBA is turned in to it a band of block rows at a time as it's uploaded.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cuda_context_compress_source(bc7_cuda_context* p_context, bc7_compressed_block* p_destination,
+												  bc7_source const* p_source, bc7_encode_params const* p_params);
+
+// Compress a texture to the BC7 format with a context.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_cuda_context_compress(bc7_cuda_context* p_context, bc7_compressed_block* p_destination,
+										 uint8_t const* p_source, size_t width, size_t height,
+										 bc7_encode_params const* p_params);
+
+// Compress a texture to the BC7 format using CUDA. Everything is set up for this texture and
+// released again, use a context to compress more than one.
 //
 // p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
 //						correct size (source size / 4).
 // p_source:		The source image data. This must be 32-bit RGBA.
 // width:			Width of the image in pixels. Must be a multiple of 4.
 // height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
 // 
 // returns: True if successful.
 //
-bool bc7_cuda_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height);
+bool bc7_cuda_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height,
+							  bc7_encode_params const* p_params);
 
 #endif // #if defined(__BC7_CUDA)
 
@@ -4,15 +4,30 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 
-#include <cl/opencl.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+	#include <process.h>
+	#include <windows.h>
+#else
+	#include <unistd.h>
+#endif // #if defined(_WIN32)
+
+#include <CL/opencl.h>
 
 #include "bc7_opencl.h"
+#include "portable.h"
 #include "scoped_timer.h"
 
 #if defined(__BC7_OPENCL)
 
-#pragma comment(lib, "OpenCL.lib")
+#if defined(_MSC_VER)
+	#pragma comment(lib, "OpenCL.lib")
+#endif // #if defined(_MSC_VER)
 
 // --------------------
 //
@@ -20,8 +35,26 @@
 //
 // --------------------
 
-// This will write out the driver-compiled code.
-//#define __WRITE_OUT_DRIVER_COMPILED_CODE
+// This keeps the driver-compiled code next to the program so later runs don't have to build it
+// from source.
+#define __BC7_OPENCL_PROGRAM_CACHE
+
+// The start of a 64-bit FNV-1a hash.
+#define BC7_OPENCL_HASH_START				0xcbf29ce484222325ULL
+
+// Identifies a cached program binary, "BC7B", and the version of the file layout.
+#define BC7_OPENCL_BINARY_MAGIC			0x42374342
+#define BC7_OPENCL_BINARY_VERSION		1
+
+// The number of chunks of block rows that are in flight at once. Each has its own buffers and
+// command queue so the upload of one chunk and the readback of another overlap the kernel of a third.
+#define BC7_OPENCL_NUM_CHUNKS				3
+
+// The number of blocks in the first chunks, before the kernel has been timed.
+#define BC7_OPENCL_FIRST_CHUNK_BLOCKS	(16 * 1024)
+
+// The most bytes of 32-bit RGBA source pixels in a chunk.
+#define BC7_OPENCL_MAX_CHUNK_SIZE		(64 * 1024 * 1024)
 
 // --------------------
 //
@@ -36,6 +69,62 @@
 //
 // --------------------
 
+// The start of a cached program binary, it's followed by the key and then the binary.
+struct bc7_opencl_binary_header {
+
+	uint32_t m_magic;
+	uint32_t m_version;
+	uint32_t m_key_length;
+	uint32_t m_padding;
+	uint64_t m_binary_size;
+};
+
+// The buffers and command queue of a chunk of block rows.
+struct bc7_opencl_chunk {
+
+	// The buffers and the number of bytes they hold, they only ever grow.
+	cl_mem m_source_buffer;
+	size_t m_source_buffer_size;
+	cl_mem m_destination_buffer;
+	size_t m_destination_buffer_size;
+
+	cl_command_queue m_command_queue;
+
+	// The block rows of a source that isn't 32-bit RGBA are gathered in to this before they're
+	// uploaded, it stays put until the kernel of the chunk has finished with it.
+	std::vector< uint8_t > m_staging_pixels;
+
+	// The kernel of the last chunk that used the buffers and the number of block rows it had, the
+	// event is NULL if the buffers haven't been used yet.
+	cl_event m_kernel_event;
+	size_t m_num_block_rows;
+};
+
+// Everything that is set up once and used for each texture a context compresses.
+struct bc7_opencl_context {
+
+	cl_platform_id m_platform_id;
+	cl_device_id m_device_id;
+	cl_context m_context;
+	cl_program m_program;
+	cl_kernel m_kernel;
+	cl_kernel m_downsample_kernel;
+
+	// The chunks that are in flight.
+	bc7_opencl_chunk m_chunks[ BC7_OPENCL_NUM_CHUNKS ];
+
+	// The counts of mode evaluations the block classifier and branch and bound skipped.
+	cl_mem m_saved_evaluations_buffer;
+	cl_mem m_pruned_evaluations_buffer;
+
+	// The queue the mip levels are filtered on, it's separate from the chunks so the next level of
+	// a chain is filtered while this one is compressed.
+	cl_command_queue m_downsample_command_queue;
+
+	// Only one thread can compress with the context at a time, and only one can filter.
+	std::mutex m_mutex;
+	std::mutex m_downsample_mutex;
+};
 
 // --------------------
 //
@@ -50,6 +139,8 @@
 //
 // --------------------
 
+// The time in milliseconds each dispatch of the kernel should take.
+static uint32_t Dispatch_latency = BC7_OPENCL_DEFAULT_DISPATCH_LATENCY;
 
 // --------------------
 //
@@ -57,17 +148,238 @@
 //
 // --------------------
 
-// Load the program and build it.
+// Hash some bytes with 64-bit FNV-1a.
+//
+// p_data:	The bytes.
+// size:		The number of bytes.
+// hash:		The hash to continue from, BC7_OPENCL_HASH_START to start a new one.
+//
+// returns: The hash.
+//
+static uint64_t bc7_opencl_hash(void const* p_data, size_t size, uint64_t hash)
+{
+	uint8_t const* p_bytes = static_cast< uint8_t const* >(p_data);
+	for (size_t byte_iter = 0; byte_iter < size; byte_iter++) {
+
+		hash = (hash ^ p_bytes[ byte_iter ]) * 0x100000001b3ULL;
+
+	} // end for
+
+	return hash;
+}
+
+// Work out the key of the cached binary of a program and the name of the file it's kept in. The key
+// changes with the platform, the device, the driver, the build options and the source, so a binary is
+// never used with anything other than what it was built from.
+//
+// key:						(output) The key.
+// key_size:				The size of the key buffer.
+// binary_filename:		(output) The name of the binary file.
+// binary_filename_size:	The size of the binary filename buffer.
+// p_program_filename:	The filename of the program.
+// p_source:				The source of the program.
+// source_size:			The size of the source.
+// p_compile_options:	The build options.
+// platform:				The platform of the device.
+// device_id:				The device the program is built for.
+//
+static void bc7_opencl_get_program_binary_key(char* key, size_t key_size,
+															 char* binary_filename, size_t binary_filename_size,
+															 char const* p_program_filename, char const* p_source, size_t source_size,
+															 char const* p_compile_options, cl_platform_id platform, cl_device_id device_id)
+{
+	// Two drivers can have a device with the same name, the platform tells them apart.
+	char platform_vendor[256] = {0};
+	clGetPlatformInfo(platform, CL_PLATFORM_VENDOR, sizeof(platform_vendor) - 1, platform_vendor, NULL);
+
+	char platform_version[256] = {0};
+	clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(platform_version) - 1, platform_version, NULL);
+
+	char device_name[256] = {0};
+	clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(device_name) - 1, device_name, NULL);
+
+	char driver_version[256] = {0};
+	clGetDeviceInfo(device_id, CL_DRIVER_VERSION, sizeof(driver_version) - 1, driver_version, NULL);
+
+	uint64_t const source_hash = bc7_opencl_hash(p_source, source_size, BC7_OPENCL_HASH_START);
+	_snprintf_s(key, key_size, _TRUNCATE, "%s|%s|%s|%s|%s|%016llx", platform_vendor, platform_version, device_name,
+					driver_version, p_compile_options, static_cast< unsigned long long >(source_hash));
+
+	// The whole key is kept in the file too, the hash only picks the name.
+	uint64_t const key_hash = bc7_opencl_hash(key, strlen(key), BC7_OPENCL_HASH_START);
+	_snprintf_s(binary_filename, binary_filename_size, _TRUNCATE, "%s.%016llx.bin", p_program_filename,
+					static_cast< unsigned long long >(key_hash));
+}
+
+// Create a program from a cached binary and build it.
+//
+// program:				(output) The program.
+// p_binary_filename:	The name of the binary file.
+// p_key:				The key the binary has to have been saved with.
+// p_compile_options:	The build options.
+// context:				The OpenCL context.
+// device_id:			The device to build the program for.
+//
+// returns: True if successful, false if there isn't a usable binary.
+//
+static bool bc7_opencl_load_program_binary(cl_program& program, char const* p_binary_filename, char const* p_key,
+														 char const* p_compile_options, cl_context context, cl_device_id device_id)
+{
+	FILE* p_file = NULL;
+	errno_t fopen_result = fopen_s(&p_file, p_binary_filename, "rb");
+	if (fopen_result != 0) {
+
+		return false;
+	}
+
+	// Check the header and the key, a file another process is still writing or an old version is
+	// just skipped.
+	bc7_opencl_binary_header header;
+	size_t const key_length = strlen(p_key);
+	std::vector< char > file_key(key_length);
+	if ((fread(&header, sizeof(header), 1, p_file) != 1)
+	||  (header.m_magic != BC7_OPENCL_BINARY_MAGIC)
+	||  (header.m_version != BC7_OPENCL_BINARY_VERSION)
+	||  (header.m_key_length != key_length)
+	||  (header.m_binary_size == 0)
+	||  (fread(&file_key[0], key_length, 1, p_file) != 1)
+	||  (memcmp(&file_key[0], p_key, key_length) != 0)) {
+
+		fclose(p_file);
+		return false;
+	}
+
+	std::vector< uint8_t > binary(static_cast< size_t >(header.m_binary_size));
+	if (fread(&binary[0], binary.size(), 1, p_file) != 1) {
+
+		fclose(p_file);
+		return false;
+	}
+
+	fclose(p_file);
+
+	// Create the program.
+	size_t const binary_size = binary.size();
+	uint8_t const* p_binary = &binary[0];
+	cl_int binary_status;
+	cl_int result;
+	program = clCreateProgramWithBinary(context, 1, &device_id, &binary_size, &p_binary, &binary_status, &result);
+	if ((result != CL_SUCCESS)
+	||  (binary_status != CL_SUCCESS)) {
+
+		if (result == CL_SUCCESS) {
+
+			clReleaseProgram(program);
+		}
+
+		return false;
+	}
+
+	// A program from a binary still has to be built.
+	result = clBuildProgram(program, 1, &device_id, p_compile_options, NULL, NULL);
+	if (result != CL_SUCCESS) {
+
+		clReleaseProgram(program);
+		return false;
+	}
+
+	return true;
+}
+
+// Save the binary of a program that was built from source so the next run can load it.
+//
+// program:				The program.
+// p_binary_filename:	The name of the binary file.
+// p_key:				The key to save the binary with.
+//
+static void bc7_opencl_save_program_binary(cl_program program, char const* p_binary_filename, char const* p_key)
+{
+	size_t binary_size = 0;
+	cl_int result = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL);
+	if ((result != CL_SUCCESS)
+	||  (binary_size == 0)) {
+
+		return;
+	}
+
+	std::vector< uint8_t > binary(binary_size);
+	uint8_t* p_binary = &binary[0];
+	result = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(p_binary), &p_binary, NULL);
+	if (result != CL_SUCCESS) {
+
+		return;
+	}
+
+	// Write to a temporary file and rename it so other processes never see part of a binary. Each
+	// process and each save in it has its own temporary file, so processes that build the program
+	// at the same time never write in to the same one.
+	static std::atomic< uint32_t > s_num_saves(0);
+#if defined(_WIN32)
+	unsigned long const process_id = static_cast< unsigned long >(_getpid());
+#else
+	unsigned long const process_id = static_cast< unsigned long >(getpid());
+#endif // #if defined(_WIN32)
+
+	char temporary_filename[1024];
+	_snprintf_s(temporary_filename, sizeof(temporary_filename), _TRUNCATE, "%s.%lu.%u.tmp", p_binary_filename,
+					process_id, s_num_saves++);
+
+	FILE* p_file = NULL;
+	errno_t fopen_result = fopen_s(&p_file, temporary_filename, "wb");
+	if (fopen_result != 0) {
+
+		printf("Failed to open \"%s\", the program binary isn't cached!\n", temporary_filename);
+		return;
+	}
+
+	bc7_opencl_binary_header header;
+	header.m_magic = BC7_OPENCL_BINARY_MAGIC;
+	header.m_version = BC7_OPENCL_BINARY_VERSION;
+	header.m_key_length = static_cast< uint32_t >(strlen(p_key));
+	header.m_padding = 0;
+	header.m_binary_size = binary_size;
+
+	bool const written = (fwrite(&header, sizeof(header), 1, p_file) == 1)
+							&& (fwrite(p_key, header.m_key_length, 1, p_file) == 1)
+							&& (fwrite(&binary[0], binary_size, 1, p_file) == 1);
+	fclose(p_file);
+
+	if (written == false) {
+
+		printf("Failed to write \"%s\", the program binary isn't cached!\n", temporary_filename);
+		remove(temporary_filename);
+		return;
+	}
+
+	// Replace the binary in one step, a process that loads it gets either the old file or the new one.
+	// rename() only does that on POSIX, on Windows it fails if the file is already there.
+#if defined(_WIN32)
+	bool const renamed = (MoveFileExA(temporary_filename, p_binary_filename, MOVEFILE_REPLACE_EXISTING) != FALSE);
+#else
+	bool const renamed = (rename(temporary_filename, p_binary_filename) == 0);
+#endif // #if defined(_WIN32)
+
+	if (renamed == false) {
+
+		printf("Failed to rename \"%s\" to \"%s\", the program binary isn't cached!\n", temporary_filename,
+				 p_binary_filename);
+		remove(temporary_filename);
+	}
+}
+
+// Load the program and build it. The binary from an earlier build is used if there's one for this
+// device, driver, build options and source, otherwise it's built from source and the binary is saved.
 //
 // program:						(output) The program.
 // p_program_filename:		The filename of the program.
+// platform:					The platform of the device.
 // context:						The OpenCL context.
 // device_id:					The device to build the program for.
 //
 // returns: True if successful.
 //
-static bool bc7_opencl_create_and_build_program(cl_program& program, char const* p_program_filename, 
-																cl_platform_id platform, cl_context context, 
+static bool bc7_opencl_create_and_build_program(cl_program& program, char const* p_program_filename,
+																cl_platform_id platform, cl_context context,
 																cl_device_id device_id)
 {
 	SCOPED_TIMER("Create and build program");
@@ -93,30 +405,52 @@ static bool bc7_opencl_create_and_build_program(cl_program& program, char const*
 	if (fread(p_program_buffer, program_size, 1, p_file) != 1) {
 
 		printf("Failed to read \"%s\" in to memory!\n", p_program_filename);
+
+		delete [] p_program_buffer;
+		fclose(p_file);
 		return false;
 	}
 
 	fclose(p_file);
 
+	// Setup the compile options.
+	char compile_options[256] = {0};
+	strncat_s(compile_options, sizeof(compile_options), "-Werror ", _TRUNCATE);
+	strncat_s(compile_options, sizeof(compile_options), "-cl-denorms-are-zero ", _TRUNCATE);
+	strncat_s(compile_options, sizeof(compile_options), "-cl-fast-relaxed-math ", _TRUNCATE);
+
+#if defined(__BC7_OPENCL_PROGRAM_CACHE)
+	// Use the binary from an earlier build if there is one.
+	char key[1024];
+	char binary_filename[1024];
+	bc7_opencl_get_program_binary_key(key, sizeof(key), binary_filename, sizeof(binary_filename),
+												 p_program_filename, p_program_buffer, program_size, compile_options, platform,
+												 device_id);
+
+	if (bc7_opencl_load_program_binary(program, binary_filename, key, compile_options, context, device_id)) {
+
+		printf("Loaded the program binary \"%s\"\n", binary_filename);
+
+		delete [] p_program_buffer;
+		return true;
+	}
+#endif // __BC7_OPENCL_PROGRAM_CACHE
+
 	// Create the program.
 	cl_int result;
 	program = clCreateProgramWithSource(context, 1, const_cast< char const** >(&p_program_buffer), &program_size, &result);
 	if (result != CL_SUCCESS) {
 
 		printf("Failed to create the program!\n");
+
+		delete [] p_program_buffer;
 		return false;
 	}
 
 	delete [] p_program_buffer;
 
-	// Setup the compile options.
-	char compile_options[256] = {0};
-	strncat_s(compile_options, sizeof(compile_options), "-Werror ", _TRUNCATE);
-	strncat_s(compile_options, sizeof(compile_options), "-cl-denorms-are-zero ", _TRUNCATE);
-	strncat_s(compile_options, sizeof(compile_options), "-cl-fast-relaxed-math ", _TRUNCATE);
-
 	// Build the program.
-	result = clBuildProgram(program, 1, &device_id, compile_options, NULL, NULL);		
+	result = clBuildProgram(program, 1, &device_id, compile_options, NULL, NULL);
 	if (result != CL_SUCCESS) {
 
 		printf("Failed to build the program!\n");
@@ -131,235 +465,1020 @@ static bool bc7_opencl_create_and_build_program(cl_program& program, char const*
 		return false;
 	}
 
-#if defined(__WRITE_OUT_DRIVER_COMPILED_CODE)
-	// This will write out the driver-compiled code.
-	{
-		size_t compiled_size = 0;
-		result = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(compiled_size), &compiled_size, NULL);
-
-		uint8_t* p_binary = new uint8_t[ compiled_size ];
-		result = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(p_binary), &p_binary, NULL);
-
-		FILE* p_file = NULL;
-		errno_t fopen_result = fopen_s(&p_file, "bc7_driver_compiled.code", "wb");
-		if (fopen_result == 0) {
-
-			fwrite(p_binary, compiled_size, 1, p_file);
-		}
-
-		fclose(p_file);
-	}
-#endif // __WRITE_OUT_DRIVER_COMPILED_CODE
+#if defined(__BC7_OPENCL_PROGRAM_CACHE)
+	// Save the driver-compiled code for the next run.
+	bc7_opencl_save_program_binary(program, binary_filename, key);
+#endif // __BC7_OPENCL_PROGRAM_CACHE
 
 	return true;
 }
 
-// --------------------
+// Round the number of block rows in a chunk down to a whole number of work groups.
 //
-// External Functions
-//
-// --------------------
-
-// Compress a texture to the BC7 format using OpenCL.
+// num_block_rows:	The number of block rows.
+// max_chunk_rows:	The most block rows that fit in the chunk buffers.
 //
-// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
-//						correct size (source size / 4).
-// p_source:		The source image data. This must be 32-bit RGBA.
-// width:			Width of the image in pixels. Must be a multiple of 4.
-// height:			Height of the image in pixels. Must be a multiple of 4.
-// 
-// returns: True if successful.
+// returns: The number of block rows, at least 1 and at most max_chunk_rows.
 //
-bool bc7_opencl_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height)
+static size_t bc7_opencl_round_chunk_rows(size_t num_block_rows, size_t max_chunk_rows)
 {
-	SCOPED_TIMER("bc7_opencl_compress");
-
-	if (width & 0x3) {
-
-		printf("The width of the image must be a multiple of 4!\n");
-		return false;
-	}
+	if (num_block_rows > max_chunk_rows) {
 
-	if (height & 0x3) {
-
-		printf("The height of the image must be a multiple of 4!\n");
-		return false;
+		num_block_rows = max_chunk_rows;
 	}
 
-	size_t const width_in_blocks = width / 4;
-	size_t const height_in_blocks = height / 4;
+	// The work groups are 8 blocks high.
+	if (num_block_rows >= 8) {
 
-	cl_int result;
+		num_block_rows &= ~static_cast< size_t >(7);
 
-	// Get the platform id.
-	cl_uint const max_platforms = 4;
-	cl_uint num_platforms = 0;
-	cl_platform_id platform_ids[ max_platforms ];
-	result = clGetPlatformIDs(max_platforms, platform_ids, &num_platforms);
-	if (result != CL_SUCCESS) {
+	} else if (num_block_rows == 0) {
 
-		printf("Failed to get the OpenCL platforms!\n");
-		return false;
+		num_block_rows = 1;
 	}
 
-	// Search for a GPU.
-	cl_platform_id platform_id = NULL;
-	cl_device_id device_id = NULL;
-	for (uint32_t i = 0; i < num_platforms; i++) {
-
-		// Get the device ids.			
-		result = clGetDeviceIDs(platform_ids[i], CL_DEVICE_TYPE_GPU, 1, &device_id, NULL);
-		if (result == CL_SUCCESS) {
-
-			platform_id = platform_ids[i];
-			break;
-		}
-
-	} // end for
+	return num_block_rows;
+}
 
+// Wait for a kernel to finish and get the time it took on the device.
+//
+// p_kernel_time:	(output) The time in nanoseconds.
+// kernel_event:	The event of the kernel.
+//
+// returns: True if successful.
+//
+static bool bc7_opencl_get_kernel_time(cl_ulong* p_kernel_time, cl_event kernel_event)
+{
+	cl_int result = clWaitForEvents(1, &kernel_event);
 	if (result != CL_SUCCESS) {
 
-		printf("Failed to get an OpenCL GPU device!\n");
+		printf("Failed to wait for the kernel!\n");
 		return false;
 	}
 
-	// Show the device info.
-	{
-		char device_name[256] = {0};
-		clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
-		printf("OpenCL device: %s\n", device_name);
-	}
-
-	// Create a context.
-	cl_context context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &result); 
+	cl_ulong start_time = 0;
+	cl_ulong end_time = 0;
+	result  = clGetEventProfilingInfo(kernel_event, CL_PROFILING_COMMAND_START, sizeof(start_time), &start_time, NULL);
+	result |= clGetEventProfilingInfo(kernel_event, CL_PROFILING_COMMAND_END, sizeof(end_time), &end_time, NULL);
 	if (result != CL_SUCCESS) {
 
-		printf("Failed to create a CUDA context!\n");
-		return false;
-	}
-
-	// Create the program.
-	cl_program program;
-	if (bc7_opencl_create_and_build_program(program, "OpenCL/BC7.opencl", platform_id, context, device_id) == false) {
-
+		printf("Failed to get the time the kernel took!\n");
 		return false;
 	}
 
-	// Allocate the 32-bit source buffer in device memory.
-	size_t const source_buffer_size = 4 * width * height;
-	cl_mem device_source_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 
-																source_buffer_size, (void*)p_source, &result);
-	if (result != CL_SUCCESS) {
+	*p_kernel_time = (end_time > start_time) ? (end_time - start_time) : 0;
+	return true;
+}
 
-		printf("Failed to allocate the source buffer on the device!\n");
-		return false;
-	}
+// Work out how many block rows the next chunk should have so its kernel takes about the target
+// time, from the time a chunk that has finished took. Chunks shrink straight away so a slow chunk
+// can't be followed by a longer one, but they at most double each time so one chunk that is a lot
+// easier than the rest doesn't throw it off.
+//
+// chunk_rows:				The number of block rows the chunks have now.
+// timed_rows:				The number of block rows in the chunk that was timed.
+// kernel_time:			The time the kernel of that chunk took in nanoseconds.
+// target_kernel_time:	The time a kernel should take in nanoseconds.
+// max_chunk_rows:		The most block rows that fit in the chunk buffers.
+//
+// returns: The number of block rows.
+//
+static size_t bc7_opencl_get_next_chunk_rows(size_t chunk_rows, size_t timed_rows, cl_ulong kernel_time,
+															cl_ulong target_kernel_time, size_t max_chunk_rows)
+{
+	// A kernel that took no measurable time can only get bigger.
+	size_t num_block_rows = 2 * chunk_rows;
+	if (kernel_time > 0) {
 
-	// Number of 4x4 blocks of pixels.
-	size_t const num_blocks = width * height / 16;
+		double const rows_per_nanosecond = static_cast< double >(timed_rows) / kernel_time;
+		double const target_rows = rows_per_nanosecond * target_kernel_time;
 
-	// Allocate the destination buffer in device memory.	
-	size_t const destination_size = num_blocks * sizeof(bc7_compressed_block);
-	cl_mem device_destination_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-																	  destination_size, NULL, &result);
-	if (result != CL_SUCCESS) {
+		if (target_rows < num_block_rows) {
 
-		printf("Failed to allocate the destination buffer on the device!\n");
-		return false;
+			num_block_rows = static_cast< size_t >(target_rows);
+		}
 	}
 
-	// Get a handle to the kernel.
-	cl_kernel kernel = clCreateKernel(program, "bc7_kernel", &result);
-	if (result != CL_SUCCESS) {
-
-		printf("Failed to create the kernel!\n");
-		return false;
-	}
+	return bc7_opencl_round_chunk_rows(num_block_rows, max_chunk_rows);
+}
 
-	// Create the command queue.
-	cl_command_queue_properties queue_properties = 0;		
-	cl_command_queue command_queue = clCreateCommandQueue(context, device_id, queue_properties, &result);
-	if (result != CL_SUCCESS) {
+// Make sure a chunk's buffers are big enough, they only ever grow so a context that compresses a lot
+// of textures of about the same size only allocates them once.
+//
+// p_context:			(input/output) The context.
+// chunk:				(input/output) The chunk.
+// source_size:		The number of bytes of source pixels.
+// destination_size:	The number of bytes of compressed blocks.
+//
+// returns: True if successful.
+//
+static bool bc7_opencl_reserve_chunk_buffers(bc7_opencl_context* p_context, bc7_opencl_chunk& chunk,
+															size_t source_size, size_t destination_size)
+{
+	cl_int result;
+	if (chunk.m_source_buffer_size < source_size) {
 
-		printf("Failed to create the command queue!\n");
-		return false;
-	}
-	
-	{
-		SCOPED_TIMER("Run kernel");
+		if (chunk.m_source_buffer != NULL) {
 
-		// Set the kernel arguments.
-		{
-			result  = clSetKernelArg(kernel, 0, sizeof(device_destination_buffer), &device_destination_buffer);
-			if (result != CL_SUCCESS) {
+			clReleaseMemObject(chunk.m_source_buffer);
+			chunk.m_source_buffer_size = 0;
+		}
 
-				printf("Failed to set the destination kernel argument!\n");
-				return false;
-			}
+		// Allocate the 32-bit source buffer in device memory.
+		chunk.m_source_buffer = clCreateBuffer(p_context->m_context, CL_MEM_READ_ONLY, source_size, NULL, &result);
+		if (result != CL_SUCCESS) {
 
-			result = clSetKernelArg(kernel, 1, sizeof(device_source_buffer), &device_source_buffer);
-			if (result != CL_SUCCESS) {
+			printf("Failed to allocate the source buffer on the device!\n");
 
-				printf("Failed to set the source kernel argument!\n");
-				return false;
-			}
+			chunk.m_source_buffer = NULL;
+			return false;
+		}
 
-			result = clSetKernelArg(kernel, 2, sizeof(width_in_blocks), &width_in_blocks);
-			if (result != CL_SUCCESS) {
+		chunk.m_source_buffer_size = source_size;
+	}
 
-				printf("Failed to set the width in pixel blocks kernel argument!\n");
-				return false;
-			}
+	if (chunk.m_destination_buffer_size < destination_size) {
 
-			result = clSetKernelArg(kernel, 3, sizeof(height_in_blocks), &height_in_blocks);
-			if (result != CL_SUCCESS) {
+		if (chunk.m_destination_buffer != NULL) {
 
-				printf("Failed to set the height in pixel blocks kernel argument!\n");
-				return false;
-			}
+			clReleaseMemObject(chunk.m_destination_buffer);
+			chunk.m_destination_buffer_size = 0;
 		}
 
-		// Run the kernel.
-		size_t const local_work_size[] = { 8, 8 };
-		size_t const global_work_size[] = {
-
-			((width_in_blocks + local_work_size[0] - 1) / local_work_size[0]) * local_work_size[0],
-			((height_in_blocks + local_work_size[1] - 1) / local_work_size[1]) * local_work_size[1]
-		};
-
-		result = clEnqueueNDRangeKernel(command_queue,
-												  kernel,
-												  2,														  															
-												  NULL,
-												  global_work_size,
-												  local_work_size,
-												  0, NULL, NULL);
+		// Allocate the destination buffer in device memory.
+		chunk.m_destination_buffer = clCreateBuffer(p_context->m_context, CL_MEM_WRITE_ONLY, destination_size, NULL, &result);
 		if (result != CL_SUCCESS) {
 
-			printf("Failed to launch the kernel!\n");
-			return false;
-		}
-
-		// Copy the results from device to host memory.
-		result = clEnqueueReadBuffer(command_queue, device_destination_buffer, true, 
-											  0, num_blocks * sizeof(bc7_compressed_block),
-											  p_destination, 0, NULL, NULL);
-		if (result != CL_SUCCESS) {
+			printf("Failed to allocate the destination buffer on the device!\n");
 
-			printf("Failed to copy the results from the device!\n");
+			chunk.m_destination_buffer = NULL;
 			return false;
 		}
-	}
 
-	// Cleanup.
-	clReleaseCommandQueue(command_queue);
-	clReleaseKernel(kernel);
-	clReleaseMemObject(device_destination_buffer);
-	clReleaseMemObject(device_source_buffer);		
-	clReleaseProgram(program);
-	clReleaseContext(context);	
+		chunk.m_destination_buffer_size = destination_size;
+	}
 
 	return true;
 }
 
+// Wait for everything that is queued on the chunks to finish and release their kernel events. A
+// compress that fails part of the way through can still have copies in flight that read the
+// source or write the destination, they have to be done before the caller gets them back.
+//
+// p_context:	(input/output) The context.
+//
+static void bc7_opencl_finish_chunks(bc7_opencl_context* p_context)
+{
+	for (uint32_t chunk_iter = 0; chunk_iter < BC7_OPENCL_NUM_CHUNKS; chunk_iter++) {
+
+		bc7_opencl_chunk& chunk = p_context->m_chunks[ chunk_iter ];
+		if (chunk.m_command_queue != NULL) {
+
+			clFinish(chunk.m_command_queue);
+		}
+
+		if (chunk.m_kernel_event != NULL) {
+
+			clReleaseEvent(chunk.m_kernel_event);
+			chunk.m_kernel_event = NULL;
+		}
+
+	} // end for
+}
+
+// Compress a texture to the BC7 format with a context that the caller has locked. If it fails the
+// chunks can still have work in flight, the caller has to finish them with
+// bc7_opencl_finish_chunks().
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+static bool bc7_opencl_context_compress_locked(bc7_opencl_context* p_context, bc7_compressed_block* p_destination,
+															  bc7_source const* p_source, bc7_encode_params const* p_params)
+{
+	size_t const width = p_source->m_width;
+	size_t const height = p_source->m_height;
+	size_t const width_in_blocks = width / 4;
+	size_t const height_in_blocks = height / 4;
+	if ((width_in_blocks == 0)
+	||  (height_in_blocks == 0)) {
+
+		return true;
+	}
+
+	cl_int result;
+	cl_kernel const kernel = p_context->m_kernel;
+	bc7_opencl_chunk* const chunks = p_context->m_chunks;
+
+	// Number of 4x4 blocks of pixels.
+	size_t const num_blocks = width_in_blocks * height_in_blocks;
+
+	// The image is dispatched a chunk of block rows at a time. The chunk buffers are big enough for
+	// the tallest chunk and are reused, so the device memory that is used doesn't depend on the
+	// height of the image.
+	size_t const source_row_size = 4 * 4 * width;
+	size_t const destination_row_size = width_in_blocks * sizeof(bc7_compressed_block);
+
+	size_t max_chunk_rows = BC7_OPENCL_MAX_CHUNK_SIZE / source_row_size;
+	if (max_chunk_rows > height_in_blocks) {
+
+		max_chunk_rows = height_in_blocks;
+	}
+
+	if (max_chunk_rows == 0) {
+
+		max_chunk_rows = 1;
+	}
+
+	for (uint32_t chunk_iter = 0; chunk_iter < BC7_OPENCL_NUM_CHUNKS; chunk_iter++) {
+
+		if (bc7_opencl_reserve_chunk_buffers(p_context, chunks[ chunk_iter ],
+														 max_chunk_rows * source_row_size,
+														 max_chunk_rows * destination_row_size) == false) {
+
+			return false;
+		}
+
+	} // end for
+
+	// Clear the count of mode evaluations the block classifier skipped and the count of evaluations
+	// branch and bound skipped, the kernel adds to them as 64-bit values made of two 32-bit halves.
+	cl_uint num_saved_evaluations[2] = { 0, 0 };
+	result = clEnqueueWriteBuffer(chunks[0].m_command_queue, p_context->m_saved_evaluations_buffer, true,
+											0, sizeof(num_saved_evaluations), num_saved_evaluations, 0, NULL, NULL);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to clear the saved evaluations on the device!\n");
+		return false;
+	}
+
+	cl_uint num_pruned_evaluations[2] = { 0, 0 };
+	result = clEnqueueWriteBuffer(chunks[0].m_command_queue, p_context->m_pruned_evaluations_buffer, true,
+											0, sizeof(num_pruned_evaluations), num_pruned_evaluations, 0, NULL, NULL);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to clear the pruned evaluations on the device!\n");
+		return false;
+	}
+
+	uint32_t num_chunks = 0;
+	cl_ulong longest_kernel_time = 0;
+	{
+		SCOPED_TIMER("Run kernel");
+
+		// Set the kernel arguments that are the same for every chunk. The kernel takes 32-bit sizes.
+		cl_uint const kernel_width_in_blocks = static_cast< cl_uint >(width_in_blocks);
+		{
+			result = clSetKernelArg(kernel, 2, sizeof(kernel_width_in_blocks), &kernel_width_in_blocks);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to set the width in pixel blocks kernel argument!\n");
+				return false;
+			}
+
+			result = clSetKernelArg(kernel, 4, sizeof(*p_params), p_params);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to set the encoding parameters kernel argument!\n");
+				return false;
+			}
+
+			result = clSetKernelArg(kernel, 5, sizeof(p_context->m_saved_evaluations_buffer), &p_context->m_saved_evaluations_buffer);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to set the saved evaluations kernel argument!\n");
+				return false;
+			}
+
+			result = clSetKernelArg(kernel, 6, sizeof(p_context->m_pruned_evaluations_buffer), &p_context->m_pruned_evaluations_buffer);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to set the pruned evaluations kernel argument!\n");
+				return false;
+			}
+		}
+
+		// The first chunks are sized before the kernel has been timed.
+		size_t chunk_rows = bc7_opencl_round_chunk_rows(BC7_OPENCL_FIRST_CHUNK_BLOCKS / width_in_blocks, max_chunk_rows);
+
+		cl_ulong const target_kernel_time = static_cast< cl_ulong >(Dispatch_latency) * 1000000;
+		cl_event previous_kernel_event = NULL;
+		size_t num_block_rows = 0;
+		for (size_t block_row = 0; block_row < height_in_blocks; block_row += num_block_rows, num_chunks++) {
+
+			bc7_opencl_chunk& chunk = chunks[ num_chunks % BC7_OPENCL_NUM_CHUNKS ];
+
+			// Wait for the kernel of the last chunk that used these buffers, the queue keeps the
+			// readback of that chunk in front of the upload of this one. The time it took per block row
+			// sizes the chunks from here on.
+			if (chunk.m_kernel_event != NULL) {
+
+				cl_ulong kernel_time = 0;
+				if (bc7_opencl_get_kernel_time(&kernel_time, chunk.m_kernel_event) == false) {
+
+					return false;
+				}
+
+				if (kernel_time > longest_kernel_time) {
+
+					longest_kernel_time = kernel_time;
+				}
+
+				chunk_rows = bc7_opencl_get_next_chunk_rows(chunk_rows, chunk.m_num_block_rows, kernel_time,
+																		  target_kernel_time, max_chunk_rows);
+
+				// With a single chunk the event is also the one the next kernel would wait for.
+				if (previous_kernel_event == chunk.m_kernel_event) {
+
+					previous_kernel_event = NULL;
+				}
+
+				clReleaseEvent(chunk.m_kernel_event);
+				chunk.m_kernel_event = NULL;
+			}
+
+			// The last chunk can be shorter.
+			num_block_rows = height_in_blocks - block_row;
+			if (num_block_rows > chunk_rows) {
+
+				num_block_rows = chunk_rows;
+			}
+
+			chunk.m_num_block_rows = num_block_rows;
+
+			// A source that is already 32-bit RGBA is uploaded straight from its pixels, otherwise the
+			// block rows of the chunk are gathered in to the staging pixels. The kernel of the last
+			// chunk that used them has finished so the upload from them has too.
+			size_t const chunk_size = num_block_rows * source_row_size;
+			uint8_t const* p_chunk_pixels;
+			if (bc7_source_is_rgba(p_source)) {
+
+				p_chunk_pixels = p_source->m_p_top_row + block_row * source_row_size;
+
+			} else {
+
+				if (chunk.m_staging_pixels.size() < chunk_size) {
+
+					chunk.m_staging_pixels.resize(chunk_size);
+				}
+
+				bc7_source_get_pixels(&chunk.m_staging_pixels[0], p_source, 0, block_row * 4, width, num_block_rows * 4);
+				p_chunk_pixels = &chunk.m_staging_pixels[0];
+			}
+
+			// Upload the chunk without waiting, the source stays put until the queues are finished.
+			result = clEnqueueWriteBuffer(chunk.m_command_queue, chunk.m_source_buffer, CL_FALSE,
+													0, chunk_size, p_chunk_pixels, 0, NULL, NULL);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to copy the source to the device!\n");
+				return false;
+			}
+
+			// The arguments are captured when the kernel is enqueued so they can change per chunk.
+			cl_uint const kernel_height_in_blocks = static_cast< cl_uint >(num_block_rows);
+			{
+				result  = clSetKernelArg(kernel, 0, sizeof(chunk.m_destination_buffer), &chunk.m_destination_buffer);
+				if (result != CL_SUCCESS) {
+
+					printf("Failed to set the destination kernel argument!\n");
+					return false;
+				}
+
+				result = clSetKernelArg(kernel, 1, sizeof(chunk.m_source_buffer), &chunk.m_source_buffer);
+				if (result != CL_SUCCESS) {
+
+					printf("Failed to set the source kernel argument!\n");
+					return false;
+				}
+
+				result = clSetKernelArg(kernel, 3, sizeof(kernel_height_in_blocks), &kernel_height_in_blocks);
+				if (result != CL_SUCCESS) {
+
+					printf("Failed to set the height in pixel blocks kernel argument!\n");
+					return false;
+				}
+			}
+
+			// Run the kernel. It waits for the kernel of the chunk before it so only one dispatch is
+			// on the device at a time and each one takes about the target latency, the copies of the
+			// other chunks still overlap it.
+			size_t const local_work_size[] = { 8, 8 };
+			size_t const global_work_size[] = {
+
+				((width_in_blocks + local_work_size[0] - 1) / local_work_size[0]) * local_work_size[0],
+				((num_block_rows + local_work_size[1] - 1) / local_work_size[1]) * local_work_size[1]
+			};
+
+			result = clEnqueueNDRangeKernel(chunk.m_command_queue,
+													  kernel,
+													  2,
+													  NULL,
+													  global_work_size,
+													  local_work_size,
+													  (previous_kernel_event != NULL) ? 1 : 0,
+													  (previous_kernel_event != NULL) ? &previous_kernel_event : NULL,
+													  &chunk.m_kernel_event);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to launch the kernel!\n");
+
+				// The event isn't set when the kernel isn't enqueued.
+				chunk.m_kernel_event = NULL;
+				return false;
+			}
+
+			// Copy the results from device to host memory without waiting.
+			result = clEnqueueReadBuffer(chunk.m_command_queue, chunk.m_destination_buffer, CL_FALSE,
+												  0, num_block_rows * destination_row_size,
+												  p_destination + block_row * width_in_blocks, 0, NULL, NULL);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to copy the results from the device!\n");
+				return false;
+			}
+
+			// Start the chunk now instead of when the queue fills up.
+			clFlush(chunk.m_command_queue);
+
+			previous_kernel_event = chunk.m_kernel_event;
+
+		} // end for
+
+		// Wait for the chunks that are still in flight.
+		for (uint32_t chunk_iter = 0; chunk_iter < BC7_OPENCL_NUM_CHUNKS; chunk_iter++) {
+
+			bc7_opencl_chunk& chunk = chunks[ chunk_iter ];
+
+			result = clFinish(chunk.m_command_queue);
+			if (result != CL_SUCCESS) {
+
+				printf("Failed to finish the command queue!\n");
+				return false;
+			}
+
+			if (chunk.m_kernel_event != NULL) {
+
+				cl_ulong kernel_time = 0;
+				if (bc7_opencl_get_kernel_time(&kernel_time, chunk.m_kernel_event) == false) {
+
+					return false;
+				}
+
+				if (kernel_time > longest_kernel_time) {
+
+					longest_kernel_time = kernel_time;
+				}
+
+				clReleaseEvent(chunk.m_kernel_event);
+				chunk.m_kernel_event = NULL;
+			}
+
+		} // end for
+
+		result = clEnqueueReadBuffer(chunks[0].m_command_queue, p_context->m_saved_evaluations_buffer, true,
+											  0, sizeof(num_saved_evaluations),
+											  num_saved_evaluations, 0, NULL, NULL);
+		if (result != CL_SUCCESS) {
+
+			printf("Failed to copy the saved evaluations from the device!\n");
+			return false;
+		}
+
+		result = clEnqueueReadBuffer(chunks[0].m_command_queue, p_context->m_pruned_evaluations_buffer, true,
+											  0, sizeof(num_pruned_evaluations),
+											  num_pruned_evaluations, 0, NULL, NULL);
+		if (result != CL_SUCCESS) {
+
+			printf("Failed to copy the pruned evaluations from the device!\n");
+			return false;
+		}
+	}
+
+	printf("Dispatched %u chunks, the longest kernel took %.1f ms (target %u ms)\n",
+			 num_chunks, longest_kernel_time / 1000000.0, Dispatch_latency);
+
+	uint64_t const total_saved_evaluations = (static_cast< uint64_t >(num_saved_evaluations[1]) << 32) | num_saved_evaluations[0];
+	printf("Block classifier skipped %llu mode evaluations (%.1f per block)\n",
+			 static_cast< unsigned long long >(total_saved_evaluations),
+			 static_cast< double >(total_saved_evaluations) / num_blocks);
+
+	uint64_t const total_pruned_evaluations = (static_cast< uint64_t >(num_pruned_evaluations[1]) << 32) | num_pruned_evaluations[0];
+	printf("Branch and bound pruned %llu evaluations (%.1f per block)\n",
+			 static_cast< unsigned long long >(total_pruned_evaluations),
+			 static_cast< double >(total_pruned_evaluations) / num_blocks);
+
+	return true;
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Set the time each dispatch of the kernel should take. The image is split in to chunks of block
+// rows that are sized from the time the kernel took on the chunks before them.
+//
+// milliseconds:	The time in milliseconds, 0 is treated as 1.
+//
+void bc7_opencl_set_dispatch_latency(uint32_t milliseconds)
+{
+	Dispatch_latency = (milliseconds > 0) ? milliseconds : 1;
+}
+
+// Create a context that keeps the OpenCL device, program, kernel, command queues and buffers
+// between calls so they're only set up once for any number of textures.
+//
+// returns: The context or NULL if it failed.
+//
+bc7_opencl_context* bc7_opencl_context_create()
+{
+	SCOPED_TIMER("bc7_opencl_context_create");
+
+	bc7_opencl_context* p_context = new bc7_opencl_context;
+	p_context->m_context = NULL;
+	p_context->m_program = NULL;
+	p_context->m_kernel = NULL;
+	p_context->m_downsample_kernel = NULL;
+	p_context->m_downsample_command_queue = NULL;
+	p_context->m_saved_evaluations_buffer = NULL;
+	p_context->m_pruned_evaluations_buffer = NULL;
+	for (uint32_t chunk_iter = 0; chunk_iter < BC7_OPENCL_NUM_CHUNKS; chunk_iter++) {
+
+		bc7_opencl_chunk& chunk = p_context->m_chunks[ chunk_iter ];
+		chunk.m_source_buffer = NULL;
+		chunk.m_source_buffer_size = 0;
+		chunk.m_destination_buffer = NULL;
+		chunk.m_destination_buffer_size = 0;
+		chunk.m_command_queue = NULL;
+		chunk.m_kernel_event = NULL;
+		chunk.m_num_block_rows = 0;
+
+	} // end for
+
+	cl_int result;
+
+	// Get the platform id.
+	cl_uint const max_platforms = 4;
+	cl_uint num_platforms = 0;
+	cl_platform_id platform_ids[ max_platforms ];
+	result = clGetPlatformIDs(max_platforms, platform_ids, &num_platforms);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to get the OpenCL platforms!\n");
+
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Search for a GPU.
+	cl_platform_id platform_id = NULL;
+	cl_device_id device_id = NULL;
+	for (uint32_t i = 0; i < num_platforms; i++) {
+
+		// Get the device ids.
+		result = clGetDeviceIDs(platform_ids[i], CL_DEVICE_TYPE_GPU, 1, &device_id, NULL);
+		if (result == CL_SUCCESS) {
+
+			platform_id = platform_ids[i];
+			break;
+		}
+
+	} // end for
+
+	// Fall back to any device, like a CPU implementation such as POCL.
+	if (result != CL_SUCCESS) {
+
+		for (uint32_t i = 0; i < num_platforms; i++) {
+
+			result = clGetDeviceIDs(platform_ids[i], CL_DEVICE_TYPE_ALL, 1, &device_id, NULL);
+			if (result == CL_SUCCESS) {
+
+				platform_id = platform_ids[i];
+				break;
+			}
+
+		} // end for
+	}
+
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to get an OpenCL device!\n");
+
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	p_context->m_platform_id = platform_id;
+	p_context->m_device_id = device_id;
+
+	// Show the device info.
+	{
+		char device_name[256] = {0};
+		clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+		printf("OpenCL device: %s\n", device_name);
+	}
+
+	// Create a context.
+	p_context->m_context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to create an OpenCL context!\n");
+
+		p_context->m_context = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Create the program.
+	if (bc7_opencl_create_and_build_program(p_context->m_program, "OpenCL/BC7.opencl", platform_id,
+														 p_context->m_context, device_id) == false) {
+
+		p_context->m_program = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Get a handle to the kernel.
+	p_context->m_kernel = clCreateKernel(p_context->m_program, "bc7_kernel", &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to create the kernel!\n");
+
+		p_context->m_kernel = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Get a handle to the kernel that filters mip levels.
+	p_context->m_downsample_kernel = clCreateKernel(p_context->m_program, "bc7_downsample_kernel", &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to create the downsample kernel!\n");
+
+		p_context->m_downsample_kernel = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Each chunk has its own in-order queue so its upload, kernel and readback run in order while the
+	// other queues overlap them. Profiling gives the time the kernel took.
+	for (uint32_t chunk_iter = 0; chunk_iter < BC7_OPENCL_NUM_CHUNKS; chunk_iter++) {
+
+		bc7_opencl_chunk& chunk = p_context->m_chunks[ chunk_iter ];
+		chunk.m_command_queue = clCreateCommandQueue(p_context->m_context, device_id, CL_QUEUE_PROFILING_ENABLE, &result);
+		if (result != CL_SUCCESS) {
+
+			printf("Failed to create the command queue!\n");
+
+			chunk.m_command_queue = NULL;
+			bc7_opencl_context_destroy(p_context);
+			return NULL;
+		}
+
+	} // end for
+
+	p_context->m_downsample_command_queue = clCreateCommandQueue(p_context->m_context, device_id, 0, &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to create the downsample command queue!\n");
+
+		p_context->m_downsample_command_queue = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Allocate the count of mode evaluations the block classifier skipped.
+	p_context->m_saved_evaluations_buffer = clCreateBuffer(p_context->m_context, CL_MEM_READ_WRITE,
+																			 2 * sizeof(cl_uint), NULL, &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to allocate the saved evaluations buffer on the device!\n");
+
+		p_context->m_saved_evaluations_buffer = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	// Allocate the count of evaluations branch and bound skipped the same way.
+	p_context->m_pruned_evaluations_buffer = clCreateBuffer(p_context->m_context, CL_MEM_READ_WRITE,
+																			  2 * sizeof(cl_uint), NULL, &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to allocate the pruned evaluations buffer on the device!\n");
+
+		p_context->m_pruned_evaluations_buffer = NULL;
+		bc7_opencl_context_destroy(p_context);
+		return NULL;
+	}
+
+	return p_context;
+}
+
+// Release everything a context holds on to.
+//
+// p_context:	The context, this can be a partly created one or NULL.
+//
+void bc7_opencl_context_destroy(bc7_opencl_context* p_context)
+{
+	if (p_context == NULL) {
+
+		return;
+	}
+
+	for (uint32_t chunk_iter = 0; chunk_iter < BC7_OPENCL_NUM_CHUNKS; chunk_iter++) {
+
+		bc7_opencl_chunk& chunk = p_context->m_chunks[ chunk_iter ];
+		if (chunk.m_command_queue != NULL) {
+
+			clFinish(chunk.m_command_queue);
+			clReleaseCommandQueue(chunk.m_command_queue);
+		}
+
+		if (chunk.m_kernel_event != NULL) {
+
+			clReleaseEvent(chunk.m_kernel_event);
+		}
+
+		if (chunk.m_destination_buffer != NULL) {
+
+			clReleaseMemObject(chunk.m_destination_buffer);
+		}
+
+		if (chunk.m_source_buffer != NULL) {
+
+			clReleaseMemObject(chunk.m_source_buffer);
+		}
+
+	} // end for
+
+	if (p_context->m_downsample_command_queue != NULL) {
+
+		clFinish(p_context->m_downsample_command_queue);
+		clReleaseCommandQueue(p_context->m_downsample_command_queue);
+	}
+
+	if (p_context->m_pruned_evaluations_buffer != NULL) {
+
+		clReleaseMemObject(p_context->m_pruned_evaluations_buffer);
+	}
+
+	if (p_context->m_saved_evaluations_buffer != NULL) {
+
+		clReleaseMemObject(p_context->m_saved_evaluations_buffer);
+	}
+
+	if (p_context->m_downsample_kernel != NULL) {
+
+		clReleaseKernel(p_context->m_downsample_kernel);
+	}
+
+	if (p_context->m_kernel != NULL) {
+
+		clReleaseKernel(p_context->m_kernel);
+	}
+
+	if (p_context->m_program != NULL) {
+
+		clReleaseProgram(p_context->m_program);
+	}
+
+	if (p_context->m_context != NULL) {
+
+		clReleaseContext(p_context->m_context);
+	}
+
+	delete p_context;
+}
+
+// Compress a texture to the BC7 format with a context straight from its source pixels. Several
+// threads can use the same context, their textures are compressed one at a time.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_context_compress_source(bc7_opencl_context* p_context, bc7_compressed_block* p_destination,
+													 bc7_source const* p_source, bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_opencl_context_compress");
+
+	if (p_source->m_width & 0x3) {
+
+		printf("The width of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (p_source->m_height & 0x3) {
+
+		printf("The height of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (!bc7_check_encode_params(p_params)) {
+
+		return false;
+	}
+
+	// The kernel arguments, queues and buffers are shared so only one texture is in flight at once.
+	std::lock_guard< std::mutex > lock(p_context->m_mutex);
+	if (!bc7_opencl_context_compress_locked(p_context, p_destination, p_source, p_params)) {
+
+		// Every error path ends up here, so nothing is left on the queues and no event is kept.
+		bc7_opencl_finish_chunks(p_context);
+		return false;
+	}
+
+	return true;
+}
+
+// Compress a texture to the BC7 format with a context.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_context_compress(bc7_opencl_context* p_context, bc7_compressed_block* p_destination,
+											uint8_t const* p_source, size_t width, size_t height,
+											bc7_encode_params const* p_params)
+{
+	bc7_source source;
+	bc7_source_init_rgba(&source, p_source, width, height);
+
+	return bc7_opencl_context_compress_source(p_context, p_destination, &source, p_params);
+}
+
+// Compress a texture to the BC7 format using OpenCL. Everything is set up for this texture and
+// released again, use a context to compress more than one.
+//
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height,
+								 bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_opencl_compress");
+
+	bc7_opencl_context* p_context = bc7_opencl_context_create();
+	if (p_context == NULL) {
+
+		return false;
+	}
+
+	bool const compressed = bc7_opencl_context_compress(p_context, p_destination, p_source, width, height, p_params);
+	bc7_opencl_context_destroy(p_context);
+
+	return compressed;
+}
+
+// Filter a level of linear RGBA float pixels to make a smaller one with a context. Several threads
+// can use the same context, their levels are filtered one at a time. Filtering has its own command
+// queue and lock so it runs alongside a texture that is being compressed with the context.
+//
+// p_context:				(input/output) The context.
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_context_downsample(bc7_opencl_context* p_context, float* p_destination,
+											  size_t destination_width, size_t destination_height,
+											  float const* p_source, size_t source_width, size_t source_height,
+											  bc7_mip_filter filter)
+{
+	SCOPED_TIMER("bc7_opencl_context_downsample");
+
+	std::lock_guard< std::mutex > lock(p_context->m_downsample_mutex);
+
+	// The levels of a chain are different sizes and are only filtered once so the buffers aren't kept.
+	cl_int result;
+	size_t const source_size = source_width * source_height * 4 * sizeof(float);
+	cl_mem source_buffer = clCreateBuffer(p_context->m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+													  source_size, const_cast< float* >(p_source), &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to allocate the mip source buffer on the device!\n");
+		return false;
+	}
+
+	size_t const destination_size = destination_width * destination_height * 4 * sizeof(float);
+	cl_mem destination_buffer = clCreateBuffer(p_context->m_context, CL_MEM_WRITE_ONLY, destination_size, NULL, &result);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to allocate the mip destination buffer on the device!\n");
+
+		clReleaseMemObject(source_buffer);
+		return false;
+	}
+
+	// Set the kernel arguments, the kernel takes 32-bit sizes.
+	cl_kernel const kernel = p_context->m_downsample_kernel;
+	cl_uint const kernel_source_width = static_cast< cl_uint >(source_width);
+	cl_uint const kernel_source_height = static_cast< cl_uint >(source_height);
+	cl_uint const kernel_destination_width = static_cast< cl_uint >(destination_width);
+	cl_uint const kernel_destination_height = static_cast< cl_uint >(destination_height);
+	cl_uint const kernel_filter = static_cast< cl_uint >(filter);
+
+	result  = clSetKernelArg(kernel, 0, sizeof(destination_buffer), &destination_buffer);
+	result |= clSetKernelArg(kernel, 1, sizeof(source_buffer), &source_buffer);
+	result |= clSetKernelArg(kernel, 2, sizeof(kernel_source_width), &kernel_source_width);
+	result |= clSetKernelArg(kernel, 3, sizeof(kernel_source_height), &kernel_source_height);
+	result |= clSetKernelArg(kernel, 4, sizeof(kernel_destination_width), &kernel_destination_width);
+	result |= clSetKernelArg(kernel, 5, sizeof(kernel_destination_height), &kernel_destination_height);
+	result |= clSetKernelArg(kernel, 6, sizeof(kernel_filter), &kernel_filter);
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to set the downsample kernel arguments!\n");
+
+		clReleaseMemObject(destination_buffer);
+		clReleaseMemObject(source_buffer);
+		return false;
+	}
+
+	// One thread per pixel in 8x8 groups, the threads past the edges return straight away.
+	size_t const local_work_size[2] = { 8, 8 };
+	size_t const global_work_size[2] = {
+		(destination_width + local_work_size[0] - 1) & ~(local_work_size[0] - 1),
+		(destination_height + local_work_size[1] - 1) & ~(local_work_size[1] - 1)
+	};
+
+	cl_command_queue const command_queue = p_context->m_downsample_command_queue;
+	result = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+	if (result == CL_SUCCESS) {
+
+		result = clEnqueueReadBuffer(command_queue, destination_buffer, true, 0, destination_size, p_destination,
+											  0, NULL, NULL);
+	}
+
+	clReleaseMemObject(destination_buffer);
+	clReleaseMemObject(source_buffer);
+
+	if (result != CL_SUCCESS) {
+
+		printf("Failed to run the downsample kernel!\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Filter a level of linear RGBA float pixels to make a smaller one using OpenCL. Everything is set
+// up for this level and released again, use a context to filter more than one.
+//
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_downsample(float* p_destination, size_t destination_width, size_t destination_height,
+									float const* p_source, size_t source_width, size_t source_height,
+									bc7_mip_filter filter)
+{
+	SCOPED_TIMER("bc7_opencl_downsample");
+
+	bc7_opencl_context* p_context = bc7_opencl_context_create();
+	if (p_context == NULL) {
+
+		return false;
+	}
+
+	bool const downsampled = bc7_opencl_context_downsample(p_context, p_destination, destination_width, destination_height,
+																			 p_source, source_width, source_height, filter);
+	bc7_opencl_context_destroy(p_context);
+
+	return downsampled;
+}
+
 #endif // #if defined(__BC7_OPENCL)
@@ -13,6 +13,9 @@
 #if defined(__BC7_OPENCL)
 
 #include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+#include "bc7_mip.h"
+#include "bc7_source.h"
 
 // --------------------
 //
@@ -20,6 +23,9 @@
 //
 // --------------------
 
+// The default time in milliseconds each dispatch of the kernel should take. It's well under the
+// 2 second "Timeout Detection and Recovery" limit of Windows.
+#define BC7_OPENCL_DEFAULT_DISPATCH_LATENCY	100
 
 // --------------------
 //
@@ -34,6 +40,9 @@
 //
 // --------------------
 
+// The OpenCL device, program, kernel, command queues and buffers that a context keeps between
+// textures. It's only defined in "bc7_opencl.cpp" so this header doesn't need the OpenCL headers.
+struct bc7_opencl_context;
 
 // --------------------
 //
@@ -48,17 +57,112 @@
 //
 // --------------------
 
-// Compress a texture to the BC7 format using OpenCL.
+// Set the time each dispatch of the kernel should take. The image is split in to chunks of block
+// rows that are sized from the time the kernel took on the chunks before them.
+//
+// milliseconds:	The time in milliseconds, 0 is treated as 1.
+//
+void bc7_opencl_set_dispatch_latency(uint32_t milliseconds);
+
+// Create a context that keeps the OpenCL device, program, kernel, command queues and buffers
+// between calls so they're only set up once for any number of textures.
+//
+// returns: The context or NULL if it failed.
+//
+bc7_opencl_context* bc7_opencl_context_create();
+
+// Release everything a context holds on to.
+//
+// p_context:	The context, this can be NULL.
+//
+void bc7_opencl_context_destroy(bc7_opencl_context* p_context);
+
+// Compress a texture to the BC7 format with a context straight from its source pixels. Several
+// threads can use the same context, their textures are compressed one at a time. The device buffers
+// only ever grow so textures of about the same size don't allocate anything. A source that isn't
+// 32-bit RGBA is turned in to it a chunk of block rows at a time as the chunks are uploaded.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_context_compress_source(bc7_opencl_context* p_context, bc7_compressed_block* p_destination,
+													 bc7_source const* p_source, bc7_encode_params const* p_params);
+
+// Compress a texture to the BC7 format with a context.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_context_compress(bc7_opencl_context* p_context, bc7_compressed_block* p_destination,
+											uint8_t const* p_source, size_t width, size_t height,
+											bc7_encode_params const* p_params);
+
+// Compress a texture to the BC7 format using OpenCL. The image is dispatched in chunks of block rows
+// so no dispatch takes much longer than the dispatch latency, several chunks are in flight at once so
+// the copies to and from the device overlap the kernel. Everything is set up for this texture and
+// released again, use a context to compress more than one.
 //
 // p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
 //						correct size (source size / 4).
 // p_source:		The source image data. This must be 32-bit RGBA.
 // width:			Width of the image in pixels. Must be a multiple of 4.
 // height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
 // 
 // returns: True if successful.
 //
-bool bc7_opencl_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height);
+bool bc7_opencl_compress(bc7_compressed_block* p_destination, uint8_t const* p_source, size_t width, size_t height,
+								 bc7_encode_params const* p_params);
+
+// Filter a level of linear RGBA float pixels to make a smaller one with a context. Several threads
+// can use the same context, their levels are filtered one at a time. Filtering has its own command
+// queue and lock so it runs alongside a texture that is being compressed with the context.
+//
+// p_context:				(input/output) The context.
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_context_downsample(bc7_opencl_context* p_context, float* p_destination,
+											  size_t destination_width, size_t destination_height,
+											  float const* p_source, size_t source_width, size_t source_height,
+											  bc7_mip_filter filter);
+
+// Filter a level of linear RGBA float pixels to make a smaller one using OpenCL, each thread of the
+// kernel makes one pixel of the smaller level. Everything is set up for this level and released
+// again, use a context to filter more than one.
+//
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_opencl_downsample(float* p_destination, size_t destination_width, size_t destination_height,
+									float const* p_source, size_t source_width, size_t source_height,
+									bc7_mip_filter filter);
 
 #endif // #if defined(__BC7_OPENCL)
 
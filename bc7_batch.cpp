@@ -0,0 +1,134 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "bc7_batch.h"
+#include "scoped_timer.h"
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// An entry in the job table, there's one for each block in the packed image.
+struct bc7_batch_block {
+
+	// The texture the block comes from.
+	size_t m_job;
+
+	// The index of the block in the texture.
+	size_t m_block;
+};
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Compress a batch of textures to the BC7 format with a single call to the compressor.
+//
+// compress:	The compressor.
+// p_context:	The encoder context, it's passed to the compressor.
+// p_jobs:		The textures.
+// num_jobs:	The number of textures.
+// p_params:	The encoding parameters, they're the same for every texture.
+//
+// returns: True if successful.
+//
+bool bc7_batch_compress(bc7_compress_function compress, bc7_encoder_context* p_context,
+								bc7_batch_job const* p_jobs, size_t num_jobs,
+								bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_batch_compress");
+
+	size_t num_blocks = 0;
+	for (size_t job_iter = 0; job_iter < num_jobs; job_iter++) {
+
+		bc7_batch_job const& job = p_jobs[ job_iter ];
+		if ((job.m_width & 0x3)
+		||  (job.m_height & 0x3)) {
+
+			printf("The width and height of texture %llu in the batch must be multiples of 4!\n",
+					 static_cast< unsigned long long >(job_iter));
+			return false;
+		}
+
+		num_blocks += (job.m_width / 4) * (job.m_height / 4);
+
+	} // end for
+
+	if (num_blocks == 0) {
+
+		return true;
+	}
+
+	size_t const packed_width_in_blocks = (num_blocks < BC7_BATCH_PACKED_WIDTH_IN_BLOCKS) ? num_blocks : BC7_BATCH_PACKED_WIDTH_IN_BLOCKS;
+	size_t const packed_height_in_blocks = (num_blocks + packed_width_in_blocks - 1) / packed_width_in_blocks;
+	size_t const num_packed_blocks = packed_width_in_blocks * packed_height_in_blocks;
+	size_t const packed_width = packed_width_in_blocks * 4;
+
+	printf("Batch: %llu textures, %llu blocks packed in to %llu x %llu\n",
+			 static_cast< unsigned long long >(num_jobs), static_cast< unsigned long long >(num_blocks),
+			 static_cast< unsigned long long >(packed_width), static_cast< unsigned long long >(packed_height_in_blocks * 4));
+
+	// The job table, the texture and block each block in the packed image comes from. The end of the
+	// last row repeats the last block so every block in the packed image is a real one.
+	std::vector< bc7_batch_block > job_table(num_packed_blocks);
+	size_t packed_iter = 0;
+	for (size_t job_iter = 0; job_iter < num_jobs; job_iter++) {
+
+		bc7_batch_job const& job = p_jobs[ job_iter ];
+		size_t const num_job_blocks = (job.m_width / 4) * (job.m_height / 4);
+		for (size_t block_iter = 0; block_iter < num_job_blocks; block_iter++, packed_iter++) {
+
+			job_table[ packed_iter ].m_job = job_iter;
+			job_table[ packed_iter ].m_block = block_iter;
+
+		} // end for
+
+	} // end for
+
+	for (; packed_iter < num_packed_blocks; packed_iter++) {
+
+		job_table[ packed_iter ] = job_table[ num_blocks - 1 ];
+
+	} // end for
+
+	std::vector< uint8_t > packed_pixels(num_packed_blocks * 64);
+	for (packed_iter = 0; packed_iter < num_packed_blocks; packed_iter++) {
+
+		bc7_batch_block const& block = job_table[ packed_iter ];
+		bc7_batch_job const& job = p_jobs[ block.m_job ];
+
+		uint8_t pixels[64];
+		bc7_get_block_pixels(pixels, job.m_p_source, job.m_width, block.m_block);
+		bc7_put_block_pixels(&packed_pixels[0], pixels, packed_width, packed_iter);
+
+	} // end for
+
+	bc7_source packed_source;
+	bc7_source_init_rgba(&packed_source, &packed_pixels[0], packed_width, packed_height_in_blocks * 4);
+
+	std::vector< bc7_compressed_block > packed_blocks(num_packed_blocks);
+	if (!compress(p_context, &packed_blocks[0], &packed_source, p_params)) {
+
+		return false;
+	}
+
+	// Scatter the compressed blocks back to the textures, the padding at the end isn't copied.
+	for (packed_iter = 0; packed_iter < num_blocks; packed_iter++) {
+
+		bc7_batch_block const& block = job_table[ packed_iter ];
+		p_jobs[ block.m_job ].m_p_destination[ block.m_block ] = packed_blocks[ packed_iter ];
+
+	} // end for
+
+	return true;
+}
@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_BATCH_H
+#define __BC7_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bc7_block_dedup.h"
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The width in blocks of the image the blocks of a batch are packed in to (1024 pixels).
+#define BC7_BATCH_PACKED_WIDTH_IN_BLOCKS	256
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// A texture in a batch.
+struct bc7_batch_job {
+
+	// The source image data. This must be 32-bit RGBA.
+	uint8_t const* m_p_source;
+
+	// Width and height of the image in pixels. Must be multiples of 4.
+	size_t m_width;
+	size_t m_height;
+
+	// The buffer to store the compressed texture. It is assumed that the buffer is the correct size
+	// (source size / 4).
+	bc7_compressed_block* m_p_destination;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Compress a batch of textures to the BC7 format with a single call to the compressor. Small
+// textures don't fill the device on their own and each call pays for the launch and the copies, so
+// the blocks of all the textures are packed in to one image BC7_BATCH_PACKED_WIDTH_IN_BLOCKS blocks
+// wide, it's compressed in one go and the compressed blocks are copied back to each texture.
+//
+// compress:	The compressor.
+// p_context:	The encoder context, it's passed to the compressor.
+// p_jobs:		The textures.
+// num_jobs:	The number of textures.
+// p_params:	The encoding parameters, they're the same for every texture.
+//
+// returns: True if successful.
+//
+bool bc7_batch_compress(bc7_compress_function compress, bc7_encoder_context* p_context,
+								bc7_batch_job const* p_jobs, size_t num_jobs,
+								bc7_encode_params const* p_params);
+
+#endif // __BC7_BATCH_H
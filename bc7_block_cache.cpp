@@ -0,0 +1,450 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <vector>
+
+#include "bc7_block_cache.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// "BC7C" at the start of the file.
+#define BC7_BLOCK_CACHE_MAGIC			0x43374342
+
+// Change this whenever the layout of the file changes, files with another version are rejected.
+// Changes to the compressed blocks are BC7_ENCODER_VERSION, it's part of every key.
+#define BC7_BLOCK_CACHE_VERSION		1
+
+// The backend that compresses the blocks that are added. The backends don't round the same way so
+// each one only finds the blocks it compressed itself.
+#if defined(__BC7_OPENCL)
+	#define BC7_BLOCK_CACHE_BACKEND	2
+#elif defined(__BC7_CUDA)
+	#define BC7_BLOCK_CACHE_BACKEND	3
+#else
+	#define BC7_BLOCK_CACHE_BACKEND	1
+#endif
+
+// The number of slots after the first one for a block that are looked at before giving up.
+#define BC7_BLOCK_CACHE_MAX_PROBES	32
+
+// The keys of slots that are empty and of slots that another thread or process is filling in.
+// Hashes that land on these are moved out of the way.
+#define BC7_BLOCK_CACHE_EMPTY_KEY	0
+#define BC7_BLOCK_CACHE_BUSY_KEY		1
+
+// The number of bytes of pixels in a block.
+#define BC7_BLOCK_CACHE_PIXEL_BYTES	64
+
+// --------------------
+//
+// Enumerated Types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The start of the file. The magic is written last so that a file with the magic has all of its
+// header.
+struct bc7_block_cache_header {
+
+	std::atomic< uint32_t > m_magic;
+	uint32_t m_version;
+	uint32_t m_num_slots;
+	uint32_t m_slot_size;
+
+	// Pads the header to 64 bytes. The slots after it are 88 bytes, they aren't padded to a multiple
+	// of 64 since that would make the file half as big again.
+	uint32_t m_padding[12];
+};
+
+// A block in the cache. The key is written last so that a slot with a key has all of its data.
+struct bc7_block_cache_slot {
+
+	std::atomic< uint64_t > m_key;
+	uint8_t m_pixels[ BC7_BLOCK_CACHE_PIXEL_BYTES ];
+	bc7_compressed_block m_block;
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Mix the bits of a 64-bit value so each bit of the input affects all the bits of the output.
+//
+// value:	The value.
+//
+// returns: The mixed value.
+//
+static uint64_t bc7_block_cache_mix(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+
+	return value;
+}
+
+// Hash some bytes, the size has to be a multiple of 4.
+//
+// hash:		The hash to continue from.
+// p_data:	The bytes.
+// size:		The number of bytes.
+//
+// returns: The new hash.
+//
+static uint64_t bc7_block_cache_hash(uint64_t hash, void const* p_data, size_t size)
+{
+	uint8_t const* p_bytes = reinterpret_cast< uint8_t const* >(p_data);
+	for (size_t byte_iter = 0; byte_iter < size; byte_iter += 4) {
+
+		uint32_t word;
+		memcpy(&word, p_bytes + byte_iter, sizeof(word));
+
+		hash = bc7_block_cache_mix(hash ^ word) + byte_iter;
+
+	} // end for
+
+	return hash;
+}
+
+// Get the slots of the cache.
+//
+// p_cache:	The cache.
+//
+// returns: The first slot.
+//
+static bc7_block_cache_slot* bc7_block_cache_get_slots(bc7_block_cache const* p_cache)
+{
+	return reinterpret_cast< bc7_block_cache_slot* >(p_cache->m_mapping.m_p_data + sizeof(bc7_block_cache_header));
+}
+
+// Get the key of a block.
+//
+// pixels:			The pixels of the block.
+// params_hash:	The hash of the encoding parameters.
+//
+// returns: The key, this is never one of the reserved keys.
+//
+static uint64_t bc7_block_cache_get_key(uint8_t const pixels[ BC7_BLOCK_CACHE_PIXEL_BYTES ], uint64_t params_hash)
+{
+	uint64_t key = bc7_block_cache_mix(bc7_block_cache_hash(params_hash, pixels, BC7_BLOCK_CACHE_PIXEL_BYTES));
+	if (key <= BC7_BLOCK_CACHE_BUSY_KEY) {
+
+		key += BC7_BLOCK_CACHE_BUSY_KEY + 1;
+	}
+
+	return key;
+}
+
+// Look for a block in the cache.
+//
+// p_cache:	The cache.
+// p_block:	(output) The compressed block if it was found.
+// pixels:	The pixels of the block.
+// key:		The key of the block.
+//
+// returns: True if the block was found.
+//
+static bool bc7_block_cache_find(bc7_block_cache const* p_cache, bc7_compressed_block* p_block,
+											uint8_t const pixels[ BC7_BLOCK_CACHE_PIXEL_BYTES ], uint64_t key)
+{
+	bc7_block_cache_slot* p_slots = bc7_block_cache_get_slots(p_cache);
+	uint32_t const slot_mask = p_cache->m_num_slots - 1;
+
+	for (uint32_t probe_iter = 0; probe_iter <= BC7_BLOCK_CACHE_MAX_PROBES; probe_iter++) {
+
+		bc7_block_cache_slot* p_slot = &p_slots[ (key + probe_iter) & slot_mask ];
+
+		// Slots are filled in order along the probe sequence, so an empty slot ends the search.
+		uint64_t const slot_key = p_slot->m_key.load(std::memory_order_acquire);
+		if (slot_key == BC7_BLOCK_CACHE_EMPTY_KEY) {
+
+			return false;
+		}
+
+		if ((slot_key == key)
+		&&  (memcmp(p_slot->m_pixels, pixels, BC7_BLOCK_CACHE_PIXEL_BYTES) == 0)) {
+
+			*p_block = p_slot->m_block;
+			return true;
+		}
+
+	} // end for
+
+	return false;
+}
+
+// Add a block to the cache.
+//
+// p_cache:	The cache.
+// block:	The compressed block.
+// pixels:	The pixels of the block.
+// key:		The key of the block.
+//
+// returns: True if the block is in the cache, false if its probe sequence was full.
+//
+static bool bc7_block_cache_add(bc7_block_cache const* p_cache, bc7_compressed_block const& block,
+										  uint8_t const pixels[ BC7_BLOCK_CACHE_PIXEL_BYTES ], uint64_t key)
+{
+	bc7_block_cache_slot* p_slots = bc7_block_cache_get_slots(p_cache);
+	uint32_t const slot_mask = p_cache->m_num_slots - 1;
+
+	for (uint32_t probe_iter = 0; probe_iter <= BC7_BLOCK_CACHE_MAX_PROBES; probe_iter++) {
+
+		bc7_block_cache_slot* p_slot = &p_slots[ (key + probe_iter) & slot_mask ];
+
+		uint64_t slot_key = BC7_BLOCK_CACHE_EMPTY_KEY;
+		if (p_slot->m_key.compare_exchange_strong(slot_key, BC7_BLOCK_CACHE_BUSY_KEY, std::memory_order_acquire)) {
+
+			// The slot is ours, the key goes in last so readers never see half a slot.
+			memcpy(p_slot->m_pixels, pixels, BC7_BLOCK_CACHE_PIXEL_BYTES);
+			p_slot->m_block = block;
+			p_slot->m_key.store(key, std::memory_order_release);
+
+			return true;
+		}
+
+		// Another process may have compressed the same block already.
+		if ((slot_key == key)
+		&&  (memcmp(p_slot->m_pixels, pixels, BC7_BLOCK_CACHE_PIXEL_BYTES) == 0)) {
+
+			return true;
+		}
+
+	} // end for
+
+	return false;
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Open a cache file, it's created if it doesn't exist yet.
+//
+// p_cache:		(output) The cache.
+// p_filename:	The name of the cache file.
+// num_slots:	The number of slots if the file is created, this is rounded up to a power of 2.
+//					The size of an existing file doesn't change.
+//
+// returns: True if successful.
+//
+bool bc7_block_cache_open(bc7_block_cache* p_cache, char const* p_filename, uint32_t num_slots)
+{
+	memset(p_cache, 0, sizeof(*p_cache));
+
+	uint32_t num_new_slots = 1;
+	while ((num_new_slots < num_slots)
+	&&     (num_new_slots < 0x80000000)) {
+
+		num_new_slots <<= 1;
+	}
+
+	// Processes that create the file at the same time are serialized, only the first one sizes it.
+	size_t const new_size = sizeof(bc7_block_cache_header) + static_cast< size_t >(num_new_slots) * sizeof(bc7_block_cache_slot);
+	if (!file_mapping_open_shared(&p_cache->m_mapping, p_filename, new_size)) {
+
+		return false;
+	}
+
+	size_t const size = p_cache->m_mapping.m_size;
+	if (size < sizeof(bc7_block_cache_header)) {
+
+		printf("'%s' isn't a block cache!\n", p_filename);
+		bc7_block_cache_close(p_cache);
+		return false;
+	}
+
+	// A new file is all zeros, the slots are already empty so only the header has to be written.
+	// Processes that create the file at the same time write the same header, the number of slots
+	// comes from the size of the file rather than the size each of them asked for.
+	bc7_block_cache_header* p_header = reinterpret_cast< bc7_block_cache_header* >(p_cache->m_mapping.m_p_data);
+	if (p_header->m_magic.load(std::memory_order_acquire) == 0) {
+
+		p_header->m_version = BC7_BLOCK_CACHE_VERSION;
+		p_header->m_num_slots = static_cast< uint32_t >((size - sizeof(bc7_block_cache_header)) / sizeof(bc7_block_cache_slot));
+		p_header->m_slot_size = sizeof(bc7_block_cache_slot);
+		p_header->m_magic.store(BC7_BLOCK_CACHE_MAGIC, std::memory_order_release);
+	}
+
+	// The rest of the header is only read once the magic is there.
+	if (p_header->m_magic.load(std::memory_order_acquire) != BC7_BLOCK_CACHE_MAGIC) {
+
+		printf("'%s' isn't a block cache!\n", p_filename);
+		bc7_block_cache_close(p_cache);
+		return false;
+	}
+
+	p_cache->m_num_slots = p_header->m_num_slots;
+
+	if ((p_header->m_slot_size != sizeof(bc7_block_cache_slot))
+	||  (p_cache->m_num_slots == 0)
+	||  ((p_cache->m_num_slots & (p_cache->m_num_slots - 1)) != 0)
+	||  (size != sizeof(bc7_block_cache_header) + static_cast< size_t >(p_cache->m_num_slots) * sizeof(bc7_block_cache_slot))) {
+
+		printf("'%s' isn't a block cache!\n", p_filename);
+		bc7_block_cache_close(p_cache);
+		return false;
+	}
+
+	if (p_header->m_version != BC7_BLOCK_CACHE_VERSION) {
+
+		printf("The block cache '%s' is from another version of the compressor, delete it to start again!\n", p_filename);
+		bc7_block_cache_close(p_cache);
+		return false;
+	}
+
+	return true;
+}
+
+// Unmap and close a cache file.
+//
+// p_cache:	(input/output) The cache.
+//
+void bc7_block_cache_close(bc7_block_cache* p_cache)
+{
+	file_mapping_close(&p_cache->m_mapping);
+}
+
+// Compress a texture to the BC7 format, only the blocks that aren't in the cache are compressed.
+// They're compressed with bc7_dedup_compress_blocks() so repeats are only compressed once and then
+// they're added to the cache.
+//
+// p_cache:			(input/output) The cache.
+// compress:		The compressor for the blocks that aren't in the cache.
+// p_context:		The encoder context, it's passed to the compressor.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_block_cache_compress(bc7_block_cache* p_cache, bc7_compress_function compress, bc7_encoder_context* p_context,
+										bc7_compressed_block* p_destination, bc7_source const* p_source,
+										bc7_encode_params const* p_params)
+{
+	size_t const width = p_source->m_width;
+	size_t const height = p_source->m_height;
+
+	if (width & 0x3) {
+
+		printf("The width of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (height & 0x3) {
+
+		printf("The height of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	size_t const width_in_blocks = width / 4;
+	size_t const height_in_blocks = height / 4;
+
+	// The version of the encoder, the backend and the parameters change the compressed blocks so
+	// they're part of every key.
+	uint32_t const encoder[2] = { BC7_ENCODER_VERSION, BC7_BLOCK_CACHE_BACKEND };
+	uint64_t const encoder_hash = bc7_block_cache_hash(BC7_BLOCK_CACHE_VERSION, encoder, sizeof(encoder));
+	uint64_t const params_hash = bc7_block_cache_hash(encoder_hash, p_params, sizeof(*p_params));
+
+	// Fill in the blocks that are in the cache and keep a list of the rest.
+	std::vector< size_t > missed_blocks;
+	std::vector< uint64_t > missed_keys;
+	for (size_t block_y = 0; block_y < height_in_blocks; block_y++) {
+
+		for (size_t block_x = 0; block_x < width_in_blocks; block_x++) {
+
+			uint8_t pixels[ BC7_BLOCK_CACHE_PIXEL_BYTES ];
+			size_t const block_index = block_y * width_in_blocks + block_x;
+			bc7_source_get_block_pixels(pixels, p_source, block_index);
+
+			uint64_t const key = bc7_block_cache_get_key(pixels, params_hash);
+			if (bc7_block_cache_find(p_cache, &p_destination[ block_index ], pixels, key)) {
+
+				p_cache->m_num_hits++;
+
+			} else {
+
+				missed_blocks.push_back(block_index);
+				missed_keys.push_back(key);
+			}
+
+		} // end for
+
+	} // end for
+
+	size_t const num_missed_blocks = missed_blocks.size();
+	p_cache->m_num_misses += num_missed_blocks;
+	if (num_missed_blocks == 0) {
+
+		return true;
+	}
+
+	std::vector< bc7_compressed_block > missed_results(num_missed_blocks);
+	if (!bc7_dedup_compress_blocks(compress, p_context, &missed_results[0], p_source,
+											 &missed_blocks[0], num_missed_blocks, p_params)) {
+
+		return false;
+	}
+
+	// Put the blocks where they belong and add them to the cache.
+	for (size_t missed_iter = 0; missed_iter < num_missed_blocks; missed_iter++) {
+
+		size_t const block_index = missed_blocks[ missed_iter ];
+		p_destination[ block_index ] = missed_results[ missed_iter ];
+
+		uint8_t pixels[ BC7_BLOCK_CACHE_PIXEL_BYTES ];
+		bc7_source_get_block_pixels(pixels, p_source, block_index);
+
+		if (bc7_block_cache_add(p_cache, missed_results[ missed_iter ], pixels, missed_keys[ missed_iter ])) {
+
+			p_cache->m_num_added++;
+
+		} else {
+
+			p_cache->m_num_dropped++;
+		}
+
+	} // end for
+
+	return true;
+}
+
+// Print the hit rate and the number of source bytes that didn't have to be compressed.
+//
+// p_cache:	The cache.
+//
+void bc7_block_cache_report(bc7_block_cache const* p_cache)
+{
+	uint64_t const num_blocks = p_cache->m_num_hits + p_cache->m_num_misses;
+
+	printf("Block cache: %llu hits, %llu misses (%.1f%% hit rate), %llu bytes saved, %llu blocks added, %llu didn't fit\n",
+			 static_cast< unsigned long long >(p_cache->m_num_hits),
+			 static_cast< unsigned long long >(p_cache->m_num_misses),
+			 (num_blocks > 0) ? (100.0 * p_cache->m_num_hits / num_blocks) : 0.0,
+			 static_cast< unsigned long long >(p_cache->m_num_hits * BC7_BLOCK_CACHE_PIXEL_BYTES),
+			 static_cast< unsigned long long >(p_cache->m_num_added),
+			 static_cast< unsigned long long >(p_cache->m_num_dropped));
+}
@@ -0,0 +1,119 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_BLOCK_CACHE_H
+#define __BC7_BLOCK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bc7_block_dedup.h"
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+#include "file_mapping.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The number of slots in a new cache file, each slot holds one block (88 bytes). Most file
+// systems only allocate the parts of the file that have been written to.
+#define BC7_BLOCK_CACHE_DEFAULT_SLOTS	(1 << 22)
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// A cache of compressed blocks in a memory-mapped file that is kept between runs. The blocks are
+// found by a hash of their 64 bytes of pixels and the encoding parameters, the pixels are stored
+// too so a hash collision can't return the wrong block. Several processes can share the file,
+// finding blocks doesn't take any locks and adding a block only claims its slot with an atomic
+// compare and swap. Blocks are never removed, once the probe sequence of a block is full it isn't
+// added.
+struct bc7_block_cache {
+
+	// The mapped file, a header followed by the slots.
+	file_mapping m_mapping;
+
+	// The number of slots, this is a power of 2.
+	uint32_t m_num_slots;
+
+	// The blocks this process found in the cache and the ones it had to compress.
+	uint64_t m_num_hits;
+	uint64_t m_num_misses;
+
+	// The blocks this process added to the cache and the ones that didn't fit.
+	uint64_t m_num_added;
+	uint64_t m_num_dropped;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Open a cache file, it's created if it doesn't exist yet.
+//
+// p_cache:		(output) The cache.
+// p_filename:	The name of the cache file.
+// num_slots:	The number of slots if the file is created, this is rounded up to a power of 2.
+//					The size of an existing file doesn't change.
+//
+// returns: True if successful.
+//
+bool bc7_block_cache_open(bc7_block_cache* p_cache, char const* p_filename, uint32_t num_slots);
+
+// Unmap and close a cache file.
+//
+// p_cache:	(input/output) The cache.
+//
+void bc7_block_cache_close(bc7_block_cache* p_cache);
+
+// Compress a texture to the BC7 format, only the blocks that aren't in the cache are compressed.
+// They're compressed with bc7_dedup_compress_blocks() so repeats are only compressed once and then
+// they're added to the cache.
+//
+// p_cache:			(input/output) The cache.
+// compress:		The compressor for the blocks that aren't in the cache.
+// p_context:		The encoder context, it's passed to the compressor.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_block_cache_compress(bc7_block_cache* p_cache, bc7_compress_function compress, bc7_encoder_context* p_context,
+										bc7_compressed_block* p_destination, bc7_source const* p_source,
+										bc7_encode_params const* p_params);
+
+// Print the hit rate and the number of source bytes that didn't have to be compressed.
+//
+// p_cache:	The cache.
+//
+void bc7_block_cache_report(bc7_block_cache const* p_cache);
+
+#endif // __BC7_BLOCK_CACHE_H
@@ -0,0 +1,351 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "bc7_block_dedup.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// Marks an empty slot in the hash table of unique blocks.
+#define BC7_DEDUP_EMPTY_SLOT	((size_t)-1)
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Hash the pixels of a block.
+//
+// pixels:	The pixels of the block.
+//
+// returns: The hash.
+//
+static uint64_t bc7_dedup_hash(uint8_t const pixels[64])
+{
+	uint64_t hash = 0;
+	for (uint32_t word_iter = 0; word_iter < 8; word_iter++) {
+
+		uint64_t word;
+		memcpy(&word, pixels + word_iter * 8, sizeof(word));
+
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+		hash ^= hash >> 29;
+
+	} // end for
+
+	return hash;
+}
+
+// Find the blocks with pixels that no block before them has.
+//
+// unique_blocks:		(output) The index in the image of the first block with each set of pixels.
+// remap:				(output) The index in unique_blocks of each block.
+// p_source:			The source image.
+// p_block_indices:	The indices of the blocks, or NULL for all the blocks of the image in order.
+// num_blocks:			The number of blocks.
+//
+static void bc7_dedup_find_unique_blocks(std::vector< size_t >& unique_blocks, std::vector< size_t >& remap,
+													  bc7_source const* p_source, size_t const* p_block_indices, size_t num_blocks)
+{
+	// An open addressing table of indices in to unique_blocks that is at most half full. Only the
+	// indices are kept, the pixels of a unique block are gathered again to compare against it.
+	size_t table_size = 1;
+	while (table_size < 2 * num_blocks) {
+
+		table_size <<= 1;
+	}
+
+	std::vector< size_t > table(table_size, BC7_DEDUP_EMPTY_SLOT);
+
+	unique_blocks.clear();
+	remap.resize(num_blocks);
+	for (size_t block_iter = 0; block_iter < num_blocks; block_iter++) {
+
+		size_t const block_index = (p_block_indices != NULL) ? p_block_indices[ block_iter ] : block_iter;
+
+		uint8_t pixels[64];
+		bc7_source_get_block_pixels(pixels, p_source, block_index);
+
+		size_t slot_index = static_cast< size_t >(bc7_dedup_hash(pixels)) & (table_size - 1);
+		for (;;) {
+
+			size_t const unique_index = table[ slot_index ];
+			if (unique_index == BC7_DEDUP_EMPTY_SLOT) {
+
+				// The first block with these pixels.
+				table[ slot_index ] = unique_blocks.size();
+				remap[ block_iter ] = unique_blocks.size();
+
+				unique_blocks.push_back(block_index);
+				break;
+			}
+
+			uint8_t unique_pixels[64];
+			bc7_source_get_block_pixels(unique_pixels, p_source, unique_blocks[ unique_index ]);
+			if (memcmp(unique_pixels, pixels, 64) == 0) {
+
+				remap[ block_iter ] = unique_index;
+				break;
+			}
+
+			slot_index = (slot_index + 1) & (table_size - 1);
+
+		} // end for
+
+	} // end for
+}
+
+// Pack the unique blocks in to an image and compress it. The blocks are turned in to 32-bit RGBA
+// as they're packed.
+//
+// compress:			The compressor.
+// p_context:			The encoder context, it's passed to the compressor.
+// packed_blocks:		(output) The compressed unique blocks.
+// p_source:			The source image.
+// unique_blocks:		The indices in the image of the unique blocks.
+// p_params:			The encoding parameters.
+//
+// returns: True if successful.
+//
+static bool bc7_dedup_compress_unique_blocks(bc7_compress_function compress, bc7_encoder_context* p_context,
+															std::vector< bc7_compressed_block >& packed_blocks,
+															bc7_source const* p_source, std::vector< size_t > const& unique_blocks,
+															bc7_encode_params const* p_params)
+{
+	// The packed image is no wider than the original so the compressor sees the same size rows,
+	// the end of the last row repeats the last block.
+	size_t const width_in_blocks = p_source->m_width / 4;
+	size_t const num_unique_blocks = unique_blocks.size();
+	size_t const packed_width_in_blocks = (num_unique_blocks < width_in_blocks) ? num_unique_blocks : width_in_blocks;
+	size_t const packed_height_in_blocks = (num_unique_blocks + packed_width_in_blocks - 1) / packed_width_in_blocks;
+	size_t const num_packed_blocks = packed_width_in_blocks * packed_height_in_blocks;
+	size_t const packed_width = packed_width_in_blocks * 4;
+
+	std::vector< uint8_t > packed_pixels(num_packed_blocks * 64);
+	for (size_t packed_iter = 0; packed_iter < num_packed_blocks; packed_iter++) {
+
+		size_t const unique_index = (packed_iter < num_unique_blocks) ? packed_iter : (num_unique_blocks - 1);
+
+		uint8_t pixels[64];
+		bc7_source_get_block_pixels(pixels, p_source, unique_blocks[ unique_index ]);
+		bc7_put_block_pixels(&packed_pixels[0], pixels, packed_width, packed_iter);
+
+	} // end for
+
+	bc7_source packed_source;
+	bc7_source_init_rgba(&packed_source, &packed_pixels[0], packed_width, packed_height_in_blocks * 4);
+
+	packed_blocks.resize(num_packed_blocks);
+	return compress(p_context, &packed_blocks[0], &packed_source, p_params);
+}
+
+// Print how many of the blocks were repeats.
+//
+// num_unique_blocks:	The number of unique blocks.
+// num_blocks:				The number of blocks.
+//
+static void bc7_dedup_report(size_t num_unique_blocks, size_t num_blocks)
+{
+	printf("Deduplication: %llu unique blocks of %llu (%.1f%% repeated)\n",
+			 static_cast< unsigned long long >(num_unique_blocks),
+			 static_cast< unsigned long long >(num_blocks),
+			 (num_blocks > 0) ? (100.0 * (num_blocks - num_unique_blocks) / num_blocks) : 0.0);
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Compress a texture to the BC7 format, blocks that have the same pixels are only compressed
+// once.
+//
+// compress:		The compressor.
+// p_context:		The encoder context, it's passed to the compressor.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_dedup_compress(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+								uint8_t const* p_source, size_t width, size_t height, bc7_encode_params const* p_params)
+{
+	bc7_source source;
+	bc7_source_init_rgba(&source, p_source, width, height);
+
+	return bc7_dedup_compress_source(compress, p_context, p_destination, &source, p_params);
+}
+
+// Compress a texture to the BC7 format straight from its source pixels, blocks that have the same
+// pixels are only compressed once.
+//
+// compress:		The compressor.
+// p_context:		The encoder context, it's passed to the compressor.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_dedup_compress_source(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+										 bc7_source const* p_source, bc7_encode_params const* p_params)
+{
+	size_t const width = p_source->m_width;
+	size_t const height = p_source->m_height;
+
+	if (width & 0x3) {
+
+		printf("The width of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	if (height & 0x3) {
+
+		printf("The height of the image must be a multiple of 4!\n");
+		return false;
+	}
+
+	size_t const num_blocks = (width / 4) * (height / 4);
+	if (num_blocks == 0) {
+
+		return true;
+	}
+
+	std::vector< size_t > unique_blocks;
+	std::vector< size_t > remap;
+	bc7_dedup_find_unique_blocks(unique_blocks, remap, p_source, NULL, num_blocks);
+	bc7_dedup_report(unique_blocks.size(), num_blocks);
+
+	// There's nothing to gain from packing the image if every block is different, the compressor
+	// turns the source in to RGBA itself as it loads the blocks.
+	if (unique_blocks.size() == num_blocks) {
+
+		return compress(p_context, p_destination, p_source, p_params);
+	}
+
+	std::vector< bc7_compressed_block > packed_blocks;
+	if (!bc7_dedup_compress_unique_blocks(compress, p_context, packed_blocks, p_source, unique_blocks, p_params)) {
+
+		return false;
+	}
+
+	for (size_t block_iter = 0; block_iter < num_blocks; block_iter++) {
+
+		p_destination[ block_iter ] = packed_blocks[ remap[ block_iter ] ];
+
+	} // end for
+
+	return true;
+}
+
+// Compress some of the blocks of a texture, blocks that have the same pixels are only compressed
+// once.
+//
+// compress:			The compressor.
+// p_context:			The encoder context, it's passed to the compressor.
+// p_destination:		(output) The compressed blocks in the same order as the block indices.
+// p_source:			The source image. The width and height must be multiples of 4.
+// p_block_indices:	The indices of the blocks to compress, counting across the rows of blocks.
+// num_blocks:			The number of blocks to compress.
+// p_params:			The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_dedup_compress_blocks(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+										 bc7_source const* p_source, size_t const* p_block_indices, size_t num_blocks,
+										 bc7_encode_params const* p_params)
+{
+	if (num_blocks == 0) {
+
+		return true;
+	}
+
+	std::vector< size_t > unique_blocks;
+	std::vector< size_t > remap;
+	bc7_dedup_find_unique_blocks(unique_blocks, remap, p_source, p_block_indices, num_blocks);
+	bc7_dedup_report(unique_blocks.size(), num_blocks);
+
+	// Every block of the image in order with no repeats is compressed straight from the source.
+	bool every_block = (unique_blocks.size() == (p_source->m_width / 4) * (p_source->m_height / 4));
+	for (size_t unique_iter = 0; every_block && (unique_iter < unique_blocks.size()); unique_iter++) {
+
+		every_block = (unique_blocks[ unique_iter ] == unique_iter);
+
+	} // end for
+
+	if (every_block && (unique_blocks.size() == num_blocks)) {
+
+		return compress(p_context, p_destination, p_source, p_params);
+	}
+
+	std::vector< bc7_compressed_block > packed_blocks;
+	if (!bc7_dedup_compress_unique_blocks(compress, p_context, packed_blocks, p_source, unique_blocks, p_params)) {
+
+		return false;
+	}
+
+	for (size_t block_iter = 0; block_iter < num_blocks; block_iter++) {
+
+		p_destination[ block_iter ] = packed_blocks[ remap[ block_iter ] ];
+
+	} // end for
+
+	return true;
+}
+
+// Copy the pixels of a block out of an image.
+//
+// pixels:			(output) The pixels of the block, a row at a time.
+// p_source:		The image data (32-bit RGBA).
+// width:			The width of the image in pixels.
+// block_index:	The index of the block, counting across the rows of blocks.
+//
+void bc7_get_block_pixels(uint8_t pixels[64], uint8_t const* p_source, size_t width, size_t block_index)
+{
+	size_t const width_in_blocks = width / 4;
+	size_t const block_x = block_index % width_in_blocks;
+	size_t const block_y = block_index / width_in_blocks;
+
+	for (uint32_t row_iter = 0; row_iter < 4; row_iter++) {
+
+		memcpy(pixels + row_iter * 16, p_source + ((block_y * 4 + row_iter) * width + block_x * 4) * 4, 16);
+
+	} // end for
+}
+
+// Copy the pixels of a block in to an image.
+//
+// p_destination:	(output) The image data (32-bit RGBA).
+// pixels:			The pixels of the block, a row at a time.
+// width:			The width of the image in pixels.
+// block_index:	The index of the block, counting across the rows of blocks.
+//
+void bc7_put_block_pixels(uint8_t* p_destination, uint8_t const pixels[64], size_t width, size_t block_index)
+{
+	size_t const width_in_blocks = width / 4;
+	size_t const block_x = block_index % width_in_blocks;
+	size_t const block_y = block_index / width_in_blocks;
+
+	for (uint32_t row_iter = 0; row_iter < 4; row_iter++) {
+
+		memcpy(p_destination + ((block_y * 4 + row_iter) * width + block_x * 4) * 4, pixels + row_iter * 16, 16);
+
+	} // end for
+}
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_BLOCK_DEDUP_H
+#define __BC7_BLOCK_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+#include "bc7_source.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The encoder the compressor uses, it's only defined in "bc7_encoder_context.cpp".
+struct bc7_encoder_context;
+
+// The signature of a compressor, bc7_encoder_context_compress_source() is one. The context is passed
+// through to it so every texture, band and level is compressed with the same device and buffers, and
+// the source is passed as it's stored so it's only turned in to 32-bit RGBA as it's loaded.
+typedef bool (*bc7_compress_function)(bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+												  bc7_source const* p_source, bc7_encode_params const* p_params);
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Compress a texture to the BC7 format, blocks that have the same pixels are only compressed
+// once. The unique blocks are packed in to a smaller image that is passed to the compressor and
+// the compressed blocks are copied to all the places they came from. Atlases and padded textures
+// have a lot of repeated blocks, if there aren't any the image is passed to the compressor as is.
+//
+// compress:		The compressor.
+// p_context:		The encoder context, it's passed to the compressor.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_dedup_compress(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+								uint8_t const* p_source, size_t width, size_t height, bc7_encode_params const* p_params);
+
+// Compress a texture to the BC7 format straight from its source pixels, blocks that have the same
+// pixels are only compressed once. The pixels are turned in to 32-bit RGBA as the blocks are
+// gathered to be hashed and packed, so a BGR or BGRA image that is stored from the bottom up, like
+// a memory-mapped TGA, doesn't have to be converted as a whole first. An image with no repeats is
+// passed to the compressor as is, whatever its format.
+//
+// compress:		The compressor.
+// p_context:		The encoder context, it's passed to the compressor.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_dedup_compress_source(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+										 bc7_source const* p_source, bc7_encode_params const* p_params);
+
+// Compress some of the blocks of a texture, blocks that have the same pixels are only compressed
+// once.
+//
+// compress:			The compressor.
+// p_context:			The encoder context, it's passed to the compressor.
+// p_destination:		(output) The compressed blocks in the same order as the block indices.
+// p_source:			The source image. The width and height must be multiples of 4.
+// p_block_indices:	The indices of the blocks to compress, counting across the rows of blocks.
+// num_blocks:			The number of blocks to compress.
+// p_params:			The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_dedup_compress_blocks(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+										 bc7_source const* p_source, size_t const* p_block_indices, size_t num_blocks,
+										 bc7_encode_params const* p_params);
+
+// Copy the pixels of a block out of an image.
+//
+// pixels:			(output) The pixels of the block, a row at a time.
+// p_source:		The image data (32-bit RGBA).
+// width:			The width of the image in pixels.
+// block_index:	The index of the block, counting across the rows of blocks.
+//
+void bc7_get_block_pixels(uint8_t pixels[64], uint8_t const* p_source, size_t width, size_t block_index);
+
+// Copy the pixels of a block in to an image.
+//
+// p_destination:	(output) The image data (32-bit RGBA).
+// pixels:			The pixels of the block, a row at a time.
+// width:			The width of the image in pixels.
+// block_index:	The index of the block, counting across the rows of blocks.
+//
+void bc7_put_block_pixels(uint8_t* p_destination, uint8_t const pixels[64], size_t width, size_t block_index);
+
+#endif // __BC7_BLOCK_DEDUP_H
@@ -8,6 +8,15 @@
 
 #include "bc7_compressed_block.h"
 #include "bc7_decompress.h"
+#include "cpu_features.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+
+	#define BC7_DECOMPRESS_X86
+
+	#include <immintrin.h>
+
+#endif // #if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
 
 // --------------------
 //
@@ -103,6 +112,19 @@ struct bc7_decompressed_block {
 	uint8_t m_pixels[4][4][4];
 };
 
+// The endpoints and weight for each channel of each pixel in a block, in the same order as the
+// channels of bc7_decompressed_block. The rotation is already applied.
+struct bc7_interpolation_inputs {
+
+	uint8_t m_endpoints_0[ 4 * BC7_NUM_PIXELS_PER_BLOCK ];
+	uint8_t m_endpoints_1[ 4 * BC7_NUM_PIXELS_PER_BLOCK ];
+	uint8_t m_weights[ 4 * BC7_NUM_PIXELS_PER_BLOCK ];
+};
+
+// Interpolates all the channels of a block, there is a version for each instruction set.
+typedef void (*bc7_interpolate_block_function)(bc7_decompressed_block& decompressed_block,
+															  bc7_interpolation_inputs const& inputs);
+
 // --------------------
 //
 // Global Variables
@@ -477,14 +499,15 @@ static bool bc7_get_bits(uint8_t& bits, size_t& bit_index,
 
 	if (num_bits > 8) {
 
-		printf("bc7_get_bits: Too many bits requested: '%u', max is 8!\n", num_bits);
+		printf("bc7_get_bits: Too many bits requested: '%u', max is 8!\n", static_cast< uint32_t >(num_bits));
 		return false;
 	}
 
 	if ((bit_index + num_bits) > (8 * buffer_size)) {
 
 		printf("bc7_get_bits: Requesting too many bits (bit index: %u, num bits: %u), "
-				 "buffer size is '%u' bytes!\n", bit_index, num_bits, buffer_size);
+				 "buffer size is '%u' bytes!\n", static_cast< uint32_t >(bit_index), static_cast< uint32_t >(num_bits),
+				 static_cast< uint32_t >(buffer_size));
 		return false;
 	}
 
@@ -531,15 +554,145 @@ static uint8_t bc7_interpolate_channel(uint8_t channel_0, uint8_t channel_1, uin
 	return channel;
 }
 
+// Interpolate all the channels of a block one at a time.
+//
+// decompressed_block:	(output) The decompressed block of pixels.
+// inputs:					The endpoints and weights for each channel.
+//
+static void bc7_interpolate_block_scalar(bc7_decompressed_block& decompressed_block,
+													  bc7_interpolation_inputs const& inputs)
+{
+	uint8_t* p_pixels = &decompressed_block.m_pixels[0][0][0];
+	for (uint32_t channel_iter = 0; channel_iter < 4 * BC7_NUM_PIXELS_PER_BLOCK; channel_iter++) {
+
+		p_pixels[ channel_iter ] = bc7_interpolate_channel(inputs.m_endpoints_0[ channel_iter ],
+																			inputs.m_endpoints_1[ channel_iter ],
+																			inputs.m_weights[ channel_iter ]);
+
+	} // end for
+}
+
+#if defined(BC7_DECOMPRESS_X86)
+
+// Interpolate all the channels of a block, 16 at a time. The channels are widened to 16 bits
+// since the products don't fit in 8 bits.
+//
+// decompressed_block:	(output) The decompressed block of pixels.
+// inputs:					The endpoints and weights for each channel.
+//
+CPU_TARGET("sse2")
+static void bc7_interpolate_block_sse2(bc7_decompressed_block& decompressed_block,
+													bc7_interpolation_inputs const& inputs)
+{
+	__m128i const zero = _mm_setzero_si128();
+	__m128i const max_weight = _mm_set1_epi16(BC7_INTERPOLATION_MAX_WEIGHT);
+	__m128i const round = _mm_set1_epi16(BC7_INTERPOLATION_ROUND);
+
+	uint8_t* p_pixels = &decompressed_block.m_pixels[0][0][0];
+	for (uint32_t channel_iter = 0; channel_iter < 4 * BC7_NUM_PIXELS_PER_BLOCK; channel_iter += 16) {
+
+		__m128i const channels_0 = _mm_loadu_si128(reinterpret_cast< __m128i const* >(&inputs.m_endpoints_0[ channel_iter ]));
+		__m128i const channels_1 = _mm_loadu_si128(reinterpret_cast< __m128i const* >(&inputs.m_endpoints_1[ channel_iter ]));
+		__m128i const weights = _mm_loadu_si128(reinterpret_cast< __m128i const* >(&inputs.m_weights[ channel_iter ]));
+
+		__m128i const weights_low = _mm_unpacklo_epi8(weights, zero);
+		__m128i const weights_high = _mm_unpackhi_epi8(weights, zero);
+
+		__m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(channels_0, zero), _mm_sub_epi16(max_weight, weights_low));
+		low = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(channels_1, zero), weights_low));
+		low = _mm_srli_epi16(_mm_add_epi16(low, round), BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+		__m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(channels_0, zero), _mm_sub_epi16(max_weight, weights_high));
+		high = _mm_add_epi16(high, _mm_mullo_epi16(_mm_unpackhi_epi8(channels_1, zero), weights_high));
+		high = _mm_srli_epi16(_mm_add_epi16(high, round), BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+		_mm_storeu_si128(reinterpret_cast< __m128i* >(&p_pixels[ channel_iter ]), _mm_packus_epi16(low, high));
+
+	} // end for
+}
+
+// Interpolate all the channels of a block, 32 at a time.
+//
+// decompressed_block:	(output) The decompressed block of pixels.
+// inputs:					The endpoints and weights for each channel.
+//
+CPU_TARGET("avx2")
+static void bc7_interpolate_block_avx2(bc7_decompressed_block& decompressed_block,
+													bc7_interpolation_inputs const& inputs)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	__m256i const max_weight = _mm256_set1_epi16(BC7_INTERPOLATION_MAX_WEIGHT);
+	__m256i const round = _mm256_set1_epi16(BC7_INTERPOLATION_ROUND);
+
+	uint8_t* p_pixels = &decompressed_block.m_pixels[0][0][0];
+	for (uint32_t channel_iter = 0; channel_iter < 4 * BC7_NUM_PIXELS_PER_BLOCK; channel_iter += 32) {
+
+		__m256i const channels_0 = _mm256_loadu_si256(reinterpret_cast< __m256i const* >(&inputs.m_endpoints_0[ channel_iter ]));
+		__m256i const channels_1 = _mm256_loadu_si256(reinterpret_cast< __m256i const* >(&inputs.m_endpoints_1[ channel_iter ]));
+		__m256i const weights = _mm256_loadu_si256(reinterpret_cast< __m256i const* >(&inputs.m_weights[ channel_iter ]));
+
+		// The unpacks and the pack work within each 128 bit half so the order is kept.
+		__m256i const weights_low = _mm256_unpacklo_epi8(weights, zero);
+		__m256i const weights_high = _mm256_unpackhi_epi8(weights, zero);
+
+		__m256i low = _mm256_mullo_epi16(_mm256_unpacklo_epi8(channels_0, zero), _mm256_sub_epi16(max_weight, weights_low));
+		low = _mm256_add_epi16(low, _mm256_mullo_epi16(_mm256_unpacklo_epi8(channels_1, zero), weights_low));
+		low = _mm256_srli_epi16(_mm256_add_epi16(low, round), BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+		__m256i high = _mm256_mullo_epi16(_mm256_unpackhi_epi8(channels_0, zero), _mm256_sub_epi16(max_weight, weights_high));
+		high = _mm256_add_epi16(high, _mm256_mullo_epi16(_mm256_unpackhi_epi8(channels_1, zero), weights_high));
+		high = _mm256_srli_epi16(_mm256_add_epi16(high, round), BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(&p_pixels[ channel_iter ]), _mm256_packus_epi16(low, high));
+
+	} // end for
+}
+
+// Interpolate all the channels of a block at once.
+//
+// decompressed_block:	(output) The decompressed block of pixels.
+// inputs:					The endpoints and weights for each channel.
+//
+CPU_TARGET("avx512f,avx512bw")
+static void bc7_interpolate_block_avx512(bc7_decompressed_block& decompressed_block,
+													  bc7_interpolation_inputs const& inputs)
+{
+	__m512i const zero = _mm512_setzero_si512();
+	__m512i const max_weight = _mm512_set1_epi16(BC7_INTERPOLATION_MAX_WEIGHT);
+	__m512i const round = _mm512_set1_epi16(BC7_INTERPOLATION_ROUND);
+
+	__m512i const channels_0 = _mm512_loadu_si512(inputs.m_endpoints_0);
+	__m512i const channels_1 = _mm512_loadu_si512(inputs.m_endpoints_1);
+	__m512i const weights = _mm512_loadu_si512(inputs.m_weights);
+
+	// The unpacks and the pack work within each 128 bit quarter so the order is kept.
+	__m512i const weights_low = _mm512_unpacklo_epi8(weights, zero);
+	__m512i const weights_high = _mm512_unpackhi_epi8(weights, zero);
+
+	__m512i low = _mm512_mullo_epi16(_mm512_unpacklo_epi8(channels_0, zero), _mm512_sub_epi16(max_weight, weights_low));
+	low = _mm512_add_epi16(low, _mm512_mullo_epi16(_mm512_unpacklo_epi8(channels_1, zero), weights_low));
+	low = _mm512_srli_epi16(_mm512_add_epi16(low, round), BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+	__m512i high = _mm512_mullo_epi16(_mm512_unpackhi_epi8(channels_0, zero), _mm512_sub_epi16(max_weight, weights_high));
+	high = _mm512_add_epi16(high, _mm512_mullo_epi16(_mm512_unpackhi_epi8(channels_1, zero), weights_high));
+	high = _mm512_srli_epi16(_mm512_add_epi16(high, round), BC7_INTERPOLATION_MAX_WEIGHT_SHIFT);
+
+	_mm512_storeu_si512(&decompressed_block.m_pixels[0][0][0], _mm512_packus_epi16(low, high));
+}
+
+#endif // #if defined(BC7_DECOMPRESS_X86)
+
 // Decompress a 4x4 block of pixels.
 //
 // decompressed_block:	(output) The decompressed block of pixels.
 // compressed_block:		The compressed block of pixels.
+// interpolate_block:	The version of the interpolation for this CPU.
 //
 // returns: True if successful.
 //
 static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block, 
-											bc7_compressed_block const& compressed_block)
+											bc7_compressed_block const& compressed_block,
+											bc7_interpolate_block_function interpolate_block)
 {
 	// Get the mode number by counting the number of cleared bits in the
 	// first byte.
@@ -569,6 +722,14 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 
 	bc7_mode const& mode = BC7_modes[ mode_index ];
 
+	// Checked so the compiler can tell that the per-subset arrays below are never overrun.
+	uint32_t const num_subsets = mode.m_num_subsets;
+	if ((num_subsets == 0) || (num_subsets > BC7_MAX_SUBSETS)) {
+
+		printf("Invalid number of subsets '%u' for mode '%u'!\n", num_subsets, mode_index);
+		return false;
+	}
+
 	// Get the shape index.
 	size_t const num_shape_bits = mode.m_num_shape_bits;
 	uint8_t shape_index;
@@ -600,7 +761,6 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 	uint32_t const num_channels = (mode_index < 4) ? 3 : 4;
 	uint8_t endpoints[ BC7_MAX_SUBSETS ][2][4];
 	{
-		uint32_t const num_subsets = mode.m_num_subsets;		
 		for (uint32_t channel = 0; channel < num_channels; channel++) {
 
 			for (uint32_t subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
@@ -638,12 +798,12 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 		if (mode.m_parity_bit_type == PARITY_BIT_SHARED) {
 
 			// The endpoints within a subset share a parity bit.
-			num_parity_bits = mode.m_num_subsets;
+			num_parity_bits = num_subsets;
 
 		} else {
 
 			// Each endpoint has its own parity bit.
-			num_parity_bits = 2 * mode.m_num_subsets;
+			num_parity_bits = 2 * num_subsets;
 		}
 
 		// Get the parity bits.
@@ -661,7 +821,7 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 		// Apply the parity bits to the colors.
 		for (uint32_t channel = 0; channel < num_channels; channel++) {
 
-			for (uint32_t subset_iter = 0; subset_iter < mode.m_num_subsets; subset_iter++) {
+			for (uint32_t subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
 
 				if (mode.m_parity_bit_type == PARITY_BIT_SHARED) {
 
@@ -687,7 +847,7 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 
 	// Unquantize the colors.
 	{
-		for (uint32_t subset_iter = 0; subset_iter < mode.m_num_subsets; subset_iter++) {
+		for (uint32_t subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
 
 			for (uint32_t channel = 0; channel < num_channels; channel++) {
 
@@ -719,9 +879,9 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 			uint32_t index_precision = mode.m_num_index_bits_1;
 
 			// See if this pixel is an anchor.
-			for (uint32_t subset_iter = 0; subset_iter < mode.m_num_subsets; subset_iter++) {
+			for (uint32_t subset_iter = 0; subset_iter < num_subsets; subset_iter++) {
 
-				if (pixel_iter == Anchor_table[ mode.m_num_subsets - 1 ][ shape_index ][ subset_iter ]) {
+				if (pixel_iter == Anchor_table[ num_subsets - 1 ][ shape_index ][ subset_iter ]) {
 
 					// The anchor has one less bit of precision.
 					index_precision--;
@@ -790,83 +950,56 @@ static bool bc7_decompress_block(bc7_decompressed_block& decompressed_block,
 		num_weights_2 = temp;
 	}
 
-	// Interpolate the colors.
-	uint32_t pixel_index = 0;
-	for (uint32_t pixel_y = 0; pixel_y < 4; pixel_y++) {
-
-		for (uint32_t pixel_x = 0; pixel_x < 4; pixel_x++) {
-
-			// Get which subset this pixel belongs to.
-			uint8_t const subset_index = Partition_table[ mode.m_num_subsets - 1 ][ shape_index ][ pixel_index ];
-			
-			// Get the indices for the weights.
-			uint8_t const weight_index_1 = p_indices_1[ pixel_index ];
-			uint8_t const weight_index_2 = p_indices_2[ pixel_index ];
-
-			// Get the weights.
-			assert(weight_index_1 < num_weights_1);
-			uint8_t const weight_1 = p_weights_1[ weight_index_1 ];
-
-			assert(weight_index_2 < num_weights_2);
-			uint8_t const weight_2 = p_weights_2[ weight_index_2 ];
-
-			// Calculate the channels.
-			uint8_t red		= bc7_interpolate_channel(endpoints[ subset_index ][0][0], endpoints[ subset_index ][1][0], weight_1);
-			uint8_t green	= bc7_interpolate_channel(endpoints[ subset_index ][0][1], endpoints[ subset_index ][1][1], weight_1);
-			uint8_t blue	= bc7_interpolate_channel(endpoints[ subset_index ][0][2], endpoints[ subset_index ][1][2], weight_1);
-			uint8_t alpha	= bc7_interpolate_channel(endpoints[ subset_index ][0][3], endpoints[ subset_index ][1][3], weight_2);
-
-			switch (rotation_index) {
-			case 0:
-				{
-					// Don't swap.
-					break;
-				}
-			case 1:
-				{
-					// Swap red and alpha.
-					uint8_t temp = red;
-					red = alpha;
-					alpha = temp;
+	if (rotation_index > 3) {
 
-					break;
-				}
-			case 2:
-				{
-					// Swap green and alpha.
-					uint8_t temp = green;
-					green = alpha;
-					alpha = temp;
+		printf("Invalid rotation '%u'!\n", rotation_index);
+		return false;
+	}
 
-					break;
-				}
-			case 3:
-				{
-					// Swap blue and alpha.
-					uint8_t temp = blue;
-					blue = alpha;
-					alpha = temp;
+	// Rotation 1 swaps red, 2 swaps green and 3 swaps blue with alpha. Figure out which
+	// channel ends up in each channel of the output.
+	uint32_t source_channels[4] = { 0, 1, 2, 3 };
+	if (rotation_index > 0) {
 
-					break;
-				}
-			default:
-				{
-					printf("Invalid rotation '%u'!\n", rotation_index);
-					return false;
-				}
-			}
+		source_channels[ rotation_index - 1 ] = 3;
+		source_channels[3] = rotation_index - 1;
+	}
+
+	// Gather the endpoints and weights for every channel of every pixel.
+	bc7_interpolation_inputs inputs;
+	for (uint32_t pixel_index = 0; pixel_index < BC7_NUM_PIXELS_PER_BLOCK; pixel_index++) {
+
+		// Get which subset this pixel belongs to.
+		uint8_t const subset_index = Partition_table[ num_subsets - 1 ][ shape_index ][ pixel_index ];
+
+		// Get the indices for the weights.
+		uint8_t const weight_index_1 = p_indices_1[ pixel_index ];
+		uint8_t const weight_index_2 = p_indices_2[ pixel_index ];
+
+		// Get the weights.
+		assert(weight_index_1 < num_weights_1);
+		uint8_t const weight_1 = p_weights_1[ weight_index_1 ];
+
+		assert(weight_index_2 < num_weights_2);
+		uint8_t const weight_2 = p_weights_2[ weight_index_2 ];
+
+		for (uint32_t channel = 0; channel < 4; channel++) {
 
-			decompressed_block.m_pixels[ pixel_y ][ pixel_x ][0] = red;
-			decompressed_block.m_pixels[ pixel_y ][ pixel_x ][1] = green;
-			decompressed_block.m_pixels[ pixel_y ][ pixel_x ][2] = blue;
-			decompressed_block.m_pixels[ pixel_y ][ pixel_x ][3] = alpha;
+			// The color channels use the first weight and alpha uses the second.
+			uint32_t const source_channel = source_channels[ channel ];
+			uint32_t const input_index = 4 * pixel_index + channel;
 
-			pixel_index++;
+			inputs.m_endpoints_0[ input_index ] = endpoints[ subset_index ][0][ source_channel ];
+			inputs.m_endpoints_1[ input_index ] = endpoints[ subset_index ][1][ source_channel ];
+			inputs.m_weights[ input_index ] = (source_channel < 3) ? weight_1 : weight_2;
 
 		} // end for
 
 	} // end for
 
+	// Interpolate the colors.
+	interpolate_block(decompressed_block, inputs);
+
 	return true;
 }
 
@@ -903,6 +1036,41 @@ bool bc7_decompress(uint8_t* p_decompressed, bc7_compressed_block const* p_compr
 	size_t const width_in_blocks = image_width / 4;
 	size_t const height_in_blocks = image_height / 4;
 
+	// Pick the version of the interpolation for this CPU.
+	bc7_interpolate_block_function interpolate_block = bc7_interpolate_block_scalar;
+
+#if defined(BC7_DECOMPRESS_X86)
+
+	switch (cpu_get_instruction_set()) {
+
+		case CPU_INSTRUCTION_SET_AVX512:
+		{
+			interpolate_block = bc7_interpolate_block_avx512;
+			break;
+		}
+
+		case CPU_INSTRUCTION_SET_AVX2:
+		{
+			interpolate_block = bc7_interpolate_block_avx2;
+			break;
+		}
+
+		case CPU_INSTRUCTION_SET_SSE41:
+		case CPU_INSTRUCTION_SET_SSE2:
+		{
+			interpolate_block = bc7_interpolate_block_sse2;
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+
+	} // end switch
+
+#endif // #if defined(BC7_DECOMPRESS_X86)
+
 	// Go through the blocks and decompress them.
 	size_t block_index = 0;
 	for (size_t block_y = 0; block_y < height_in_blocks; block_y++) {
@@ -911,7 +1079,7 @@ bool bc7_decompress(uint8_t* p_decompressed, bc7_compressed_block const* p_compr
 
 			// Decompress the block.
 			bc7_decompressed_block decompressed_block;
-			if (bc7_decompress_block(decompressed_block, p_compressed[ block_index++ ]) == false) {
+			if (bc7_decompress_block(decompressed_block, p_compressed[ block_index++ ], interpolate_block) == false) {
 
 				return false;
 			}			
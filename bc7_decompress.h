@@ -8,6 +8,9 @@
 #ifndef __BC7_DECOMPRESS_H
 #define __BC7_DECOMPRESS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "bc7_compressed_block.h"
 
 // --------------------
@@ -0,0 +1,207 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bc7_encode_params.h"
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+// The parameters for each preset. Least squares reaches a lower error in 2 fits than Gradient
+// Descent does in 4 to 16 iterations, so the presets use it, it converges in about 4 fits. From
+// there quality comes from refining more shapes, normal refines the 8 shapes with the lowest
+// estimated error and slow refines all of them. Exhaustive also runs Gradient Descent on every
+// shape and keeps whichever endpoints compress it better. Culling shapes used to be the
+// __CULL_SHAPES define. None of the presets stop early on an error threshold above 0 since that
+// trades quality for speed on every block, it's set from the command line.
+static bc7_encode_params const Presets[ BC7_ENCODE_PRESET_COUNT ] = {
+
+	// Ultrafast: Modes 1, 5 and 6, the 2 shapes with the lowest estimated error and a couple of
+	// least squares fits.
+	{ 0x62, 2, BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES, 2, 1, 0.1f, 0 },
+
+	// Fast: Skips the 3 subset modes (0 and 2) and refines the 4 shapes with the lowest estimated error.
+	{ 0xfa, 4, BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES, 2, 1, 0.1f, 0 },
+
+	// Normal: All of the modes and the 8 shapes with the lowest estimated error.
+	{ BC7_ENCODE_ALL_MODES, 8, BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES, 4, 1, 0.1f, 0 },
+
+	// Slow: Refines all of the shapes.
+	{ BC7_ENCODE_ALL_MODES, 0, BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES, 4, 1, 0.1f, 0 },
+
+	// Exhaustive: Refines all of the shapes with both optimizers and 4 Gradient Descent passes.
+	{ BC7_ENCODE_ALL_MODES, 0, BC7_ENDPOINT_OPTIMIZER_BOTH, 16, 4, 0.1f, 0 }
+};
+
+// The names of the presets.
+static char const* const Preset_names[ BC7_ENCODE_PRESET_COUNT ] = {
+
+	"ultrafast",
+	"fast",
+	"normal",
+	"slow",
+	"exhaustive"
+};
+
+// The names of the endpoint optimizers.
+static char const* const Endpoint_optimizer_names[ BC7_ENDPOINT_OPTIMIZER_COUNT ] = {
+
+	"gradient_descent",
+	"least_squares",
+	"both"
+};
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Get the parameters for a preset.
+//
+// p_params:	(output) The parameters.
+// preset:		The preset.
+//
+void bc7_get_encode_params(bc7_encode_params* p_params, bc7_encode_preset preset)
+{
+	if (preset >= BC7_ENCODE_PRESET_COUNT) {
+
+		preset = BC7_ENCODE_PRESET_NORMAL;
+	}
+
+	*p_params = Presets[ preset ];
+}
+
+// Get the name of a preset.
+//
+// preset:	The preset.
+//
+// returns: The name.
+//
+char const* bc7_get_encode_preset_name(bc7_encode_preset preset)
+{
+	if (preset >= BC7_ENCODE_PRESET_COUNT) {
+
+		return "unknown";
+	}
+
+	return Preset_names[ preset ];
+}
+
+// Find a preset by its name.
+//
+// p_preset:	(output) The preset.
+// p_name:		The name of the preset.
+//
+// returns: True if there is a preset with the name.
+//
+bool bc7_find_encode_preset(bc7_encode_preset* p_preset, char const* p_name)
+{
+	for (uint32_t preset_iter = 0; preset_iter < BC7_ENCODE_PRESET_COUNT; preset_iter++) {
+
+		if (strcmp(p_name, Preset_names[ preset_iter ]) == 0) {
+
+			*p_preset = static_cast< bc7_encode_preset >(preset_iter);
+			return true;
+		}
+
+	} // end for
+
+	return false;
+}
+
+// Get the name of an endpoint optimizer.
+//
+// endpoint_optimizer:	The endpoint optimizer.
+//
+// returns: The name.
+//
+char const* bc7_get_endpoint_optimizer_name(bc7_endpoint_optimizer endpoint_optimizer)
+{
+	if (endpoint_optimizer >= BC7_ENDPOINT_OPTIMIZER_COUNT) {
+
+		return "unknown";
+	}
+
+	return Endpoint_optimizer_names[ endpoint_optimizer ];
+}
+
+// Find an endpoint optimizer by its name.
+//
+// p_endpoint_optimizer:	(output) The endpoint optimizer.
+// p_name:						The name of the endpoint optimizer.
+//
+// returns: True if there is an endpoint optimizer with the name.
+//
+bool bc7_find_endpoint_optimizer(bc7_endpoint_optimizer* p_endpoint_optimizer, char const* p_name)
+{
+	for (uint32_t optimizer_iter = 0; optimizer_iter < BC7_ENDPOINT_OPTIMIZER_COUNT; optimizer_iter++) {
+
+		if (strcmp(p_name, Endpoint_optimizer_names[ optimizer_iter ]) == 0) {
+
+			*p_endpoint_optimizer = static_cast< bc7_endpoint_optimizer >(optimizer_iter);
+			return true;
+		}
+
+	} // end for
+
+	return false;
+}
+
+// Check that the parameters can be used, this prints what is wrong if they can't.
+//
+// p_params:	The parameters.
+//
+// returns: True if the parameters are valid.
+//
+bool bc7_check_encode_params(bc7_encode_params const* p_params)
+{
+	// Blocks with alpha can only be compressed with modes 4 to 7.
+	if ((p_params->m_mode_mask & 0xf0) == 0) {
+
+		printf("At least one of the modes 4 to 7 has to be enabled!\n");
+		return false;
+	}
+
+	if (p_params->m_max_best_shapes > BC7_ENCODE_MAX_BEST_SHAPES) {
+
+		printf("At most %u shapes can be refined when culling shapes!\n", BC7_ENCODE_MAX_BEST_SHAPES);
+		return false;
+	}
+
+	if (p_params->m_endpoint_optimizer >= BC7_ENDPOINT_OPTIMIZER_COUNT) {
+
+		printf("Unknown endpoint optimizer %u!\n", p_params->m_endpoint_optimizer);
+		return false;
+	}
+
+	if ((p_params->m_max_iterations == 0)
+	||  (p_params->m_num_refinement_passes == 0)) {
+
+		printf("There has to be at least one Gradient Descent iteration and refinement pass!\n");
+		return false;
+	}
+
+	if (!(p_params->m_adjustment_factor > 0.0f)) {
+
+		printf("The Gradient Descent adjustment factor has to be positive!\n");
+		return false;
+	}
+
+	// The search starts with an error of UINT_MAX so it would never start.
+	if (p_params->m_error_threshold == UINT_MAX) {
+
+		printf("The error threshold has to be less than %u!\n", UINT_MAX);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,165 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_ENCODE_PARAMS_H
+#define __BC7_ENCODE_PARAMS_H
+
+#include <stdint.h>
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The most shapes that can be picked for refinement when culling shapes. This is the size of
+// the best shape arrays in the kernels so it has to match BC7_MAX_BEST_SHAPES in them.
+#define BC7_ENCODE_MAX_BEST_SHAPES 16
+
+// A mask with all 8 modes enabled.
+#define BC7_ENCODE_ALL_MODES 0xff
+
+// The version of the blocks the kernels write. Bump it whenever any of the kernels compresses the
+// same pixels with the same parameters to different blocks, the block cache keys blocks on it.
+#define BC7_ENCODER_VERSION 1
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+// Named sets of encoding parameters from fastest to best quality.
+enum bc7_encode_preset {
+
+	BC7_ENCODE_PRESET_ULTRAFAST = 0,
+	BC7_ENCODE_PRESET_FAST,
+	BC7_ENCODE_PRESET_NORMAL,
+	BC7_ENCODE_PRESET_SLOW,
+	BC7_ENCODE_PRESET_EXHAUSTIVE,
+
+	BC7_ENCODE_PRESET_COUNT
+};
+
+// The ways of refining the endpoints of a subset.
+enum bc7_endpoint_optimizer {
+
+	// Step the endpoints against the gradient of the error.
+	BC7_ENDPOINT_OPTIMIZER_GRADIENT_DESCENT = 0,
+
+	// Assign the pixels to the palette and solve for the endpoints that fit those palette
+	// indices best, over and over.
+	BC7_ENDPOINT_OPTIMIZER_LEAST_SQUARES,
+
+	// Refine each shape with both and keep the endpoints that compress it with the lower error,
+	// after quantization. Each finds endpoints the other misses, it takes twice as long.
+	BC7_ENDPOINT_OPTIMIZER_BOTH,
+
+	BC7_ENDPOINT_OPTIMIZER_COUNT
+};
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The parameters that trade speed for quality. This is passed to the kernels as is so it only
+// has 32-bit members, the OpenCL and CUDA kernels have a copy of it.
+struct bc7_encode_params {
+
+	// A bit for each mode that is tried (bit N is mode N). At least one of the modes
+	// with alpha (4 to 7) has to be enabled.
+	uint32_t m_mode_mask;
+
+	// The number of shapes with the lowest estimated error that are refined, 0 refines all
+	// of the shapes. Modes use at most a quarter of their shapes.
+	uint32_t m_max_best_shapes;
+
+	// How the endpoints are refined (bc7_endpoint_optimizer).
+	uint32_t m_endpoint_optimizer;
+
+	// The maximum number of Gradient Descent iterations in each refinement pass, and the maximum
+	// number of least squares fits after the first one.
+	uint32_t m_max_iterations;
+
+	// The number of times Gradient Descent is run, each pass starts where the last one
+	// stopped with half the step size. Least squares doesn't use this.
+	uint32_t m_num_refinement_passes;
+
+	// The step size of the first Gradient Descent pass, as a multiple of the error gradient.
+	float m_adjustment_factor;
+
+	// The search for a block stops as soon as its error (the sum of the squared differences of
+	// the channels) is at or below this. 0 only stops on blocks that are compressed exactly, which
+	// doesn't change the result.
+	uint32_t m_error_threshold;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Get the parameters for a preset.
+//
+// p_params:	(output) The parameters.
+// preset:		The preset.
+//
+void bc7_get_encode_params(bc7_encode_params* p_params, bc7_encode_preset preset);
+
+// Get the name of a preset ("ultrafast", "fast", "normal", "slow" or "exhaustive").
+//
+// preset:	The preset.
+//
+// returns: The name.
+//
+char const* bc7_get_encode_preset_name(bc7_encode_preset preset);
+
+// Find a preset by its name.
+//
+// p_preset:	(output) The preset.
+// p_name:		The name of the preset.
+//
+// returns: True if there is a preset with the name.
+//
+bool bc7_find_encode_preset(bc7_encode_preset* p_preset, char const* p_name);
+
+// Get the name of an endpoint optimizer ("gradient_descent", "least_squares" or "both").
+//
+// endpoint_optimizer:	The endpoint optimizer.
+//
+// returns: The name.
+//
+char const* bc7_get_endpoint_optimizer_name(bc7_endpoint_optimizer endpoint_optimizer);
+
+// Find an endpoint optimizer by its name.
+//
+// p_endpoint_optimizer:	(output) The endpoint optimizer.
+// p_name:						The name of the endpoint optimizer.
+//
+// returns: True if there is an endpoint optimizer with the name.
+//
+bool bc7_find_endpoint_optimizer(bc7_endpoint_optimizer* p_endpoint_optimizer, char const* p_name);
+
+// Check that the parameters can be used, this prints what is wrong if they can't.
+//
+// p_params:	The parameters.
+//
+// returns: True if the parameters are valid.
+//
+bool bc7_check_encode_params(bc7_encode_params const* p_params);
+
+#endif // __BC7_ENCODE_PARAMS_H
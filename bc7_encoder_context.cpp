@@ -0,0 +1,176 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdio.h>
+
+#include "bc7_encoder_context.h"
+#include "CPU/bc7_cpu.h"
+#include "CUDA/bc7_cuda.h"
+#include "OpenCL/bc7_opencl.h"
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The context of the version that is being used, the CPU version doesn't set anything up.
+struct bc7_encoder_context {
+
+#if defined(__BC7_OPENCL)
+	bc7_opencl_context* m_p_opencl_context;
+#elif defined(__BC7_CUDA)
+	bc7_cuda_context* m_p_cuda_context;
+#endif
+};
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Create an encoder context.
+//
+// returns: The context or NULL if it failed.
+//
+bc7_encoder_context* bc7_encoder_context_create()
+{
+	bc7_encoder_context* p_context = new bc7_encoder_context;
+
+#if defined(__BC7_OPENCL)
+
+	p_context->m_p_opencl_context = bc7_opencl_context_create();
+	if (p_context->m_p_opencl_context == NULL) {
+
+		delete p_context;
+		return NULL;
+	}
+
+#elif defined(__BC7_CUDA)
+
+	p_context->m_p_cuda_context = bc7_cuda_context_create();
+	if (p_context->m_p_cuda_context == NULL) {
+
+		delete p_context;
+		return NULL;
+	}
+
+#endif
+
+	return p_context;
+}
+
+// Compress a texture to the BC7 format with an encoder context straight from its source pixels.
+// Several threads can use the same context at once.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_encoder_context_compress_source(bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+													  bc7_source const* p_source, bc7_encode_params const* p_params)
+{
+#if defined(__BC7_OPENCL)
+
+	return bc7_opencl_context_compress_source(p_context->m_p_opencl_context, p_destination, p_source, p_params);
+
+#elif defined(__BC7_CUDA)
+
+	return bc7_cuda_context_compress_source(p_context->m_p_cuda_context, p_destination, p_source, p_params);
+
+#elif defined(__BC7_CPU)
+
+	// The CPU version doesn't set anything up.
+	(void)p_context;
+
+	return bc7_cpu_compress_source(p_destination, p_source, p_params);
+
+#endif
+}
+
+// Compress a texture to the BC7 format with an encoder context.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_encoder_context_compress(bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+											 uint8_t const* p_source, size_t width, size_t height,
+											 bc7_encode_params const* p_params)
+{
+	bc7_source source;
+	bc7_source_init_rgba(&source, p_source, width, height);
+
+	return bc7_encoder_context_compress_source(p_context, p_destination, &source, p_params);
+}
+
+// Filter a level of linear RGBA float pixels to make a smaller one with an encoder context.
+//
+// p_context:				(input/output) The context.
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_encoder_context_downsample(bc7_encoder_context* p_context, float* p_destination,
+												size_t destination_width, size_t destination_height,
+												float const* p_source, size_t source_width, size_t source_height,
+												bc7_mip_filter filter)
+{
+#if defined(__BC7_OPENCL)
+
+	return bc7_opencl_context_downsample(p_context->m_p_opencl_context, p_destination, destination_width, destination_height,
+													 p_source, source_width, source_height, filter);
+
+#else
+
+	// Only the OpenCL version has a downsample kernel.
+	(void)p_context;
+
+	return bc7_mip_downsample(p_destination, destination_width, destination_height,
+									  p_source, source_width, source_height, filter);
+
+#endif
+}
+
+// Release an encoder context.
+//
+// p_context:	The context, this can be NULL.
+//
+void bc7_encoder_context_destroy(bc7_encoder_context* p_context)
+{
+	if (p_context == NULL) {
+
+		return;
+	}
+
+#if defined(__BC7_OPENCL)
+
+	bc7_opencl_context_destroy(p_context->m_p_opencl_context);
+
+#elif defined(__BC7_CUDA)
+
+	bc7_cuda_context_destroy(p_context->m_p_cuda_context);
+
+#endif
+
+	delete p_context;
+}
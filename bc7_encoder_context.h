@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_ENCODER_CONTEXT_H
+#define __BC7_ENCODER_CONTEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+#include "bc7_mip.h"
+#include "bc7_source.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// An encoder for the version picked in "bc7_gpu.h" that keeps its device, program, kernel, queues
+// and buffers between textures. Creating one is the slow part, compressing with it only does the
+// work for the texture. It's only defined in "bc7_encoder_context.cpp".
+struct bc7_encoder_context;
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Create an encoder context.
+//
+// returns: The context or NULL if it failed.
+//
+bc7_encoder_context* bc7_encoder_context_create();
+
+// Compress a texture to the BC7 format with an encoder context straight from its source pixels, this
+// is the bc7_compress_function that's passed to everything that compresses. A source that isn't
+// 32-bit RGBA is turned in to it a tile or a band of block rows at a time as it's loaded or uploaded.
+// Several threads can use the same context at once.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image. The width and height must be multiples of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_encoder_context_compress_source(bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+													  bc7_source const* p_source, bc7_encode_params const* p_params);
+
+// Compress a 32-bit RGBA texture to the BC7 format with an encoder context. Several threads can use
+// the same context at once.
+//
+// p_context:		(input/output) The context.
+// p_destination: The buffer to store the compressed texture. It is assumed that the buffer is the
+//						correct size (source size / 4).
+// p_source:		The source image data. This must be 32-bit RGBA.
+// width:			Width of the image in pixels. Must be a multiple of 4.
+// height:			Height of the image in pixels. Must be a multiple of 4.
+// p_params:		The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_encoder_context_compress(bc7_encoder_context* p_context, bc7_compressed_block* p_destination,
+											 uint8_t const* p_source, size_t width, size_t height,
+											 bc7_encode_params const* p_params);
+
+// Filter a level of linear RGBA float pixels to make a smaller one with an encoder context. The
+// OpenCL version filters on the device, the others use bc7_mip_downsample(). Several threads can use
+// the same context at once.
+//
+// p_context:				(input/output) The context.
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_encoder_context_downsample(bc7_encoder_context* p_context, float* p_destination,
+												size_t destination_width, size_t destination_height,
+												float const* p_source, size_t source_width, size_t source_height,
+												bc7_mip_filter filter);
+
+// Release an encoder context.
+//
+// p_context:	The context, this can be NULL.
+//
+void bc7_encoder_context_destroy(bc7_encoder_context* p_context);
+
+#endif // __BC7_ENCODER_CONTEXT_H
@@ -14,8 +14,11 @@
 //
 // --------------------
 
-// Define one of these.
-//#define __BC7_CUDA
-#define __BC7_OPENCL
+// Define one of these. The build can pick one instead, the CMake build does with BC7_BACKEND.
+#if !defined(__BC7_CPU) && !defined(__BC7_CUDA) && !defined(__BC7_OPENCL)
+	//#define __BC7_CPU
+	//#define __BC7_CUDA
+	#define __BC7_OPENCL
+#endif // #if !defined(__BC7_CPU) && !defined(__BC7_CUDA) && !defined(__BC7_OPENCL)
 
 #endif // __BC7_GPU_H
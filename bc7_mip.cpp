@@ -0,0 +1,547 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "bc7_mip.h"
+#include "scoped_timer.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+#define BC7_MIP_PI	3.14159265358979f
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// A source pixel that goes in to a destination pixel along one axis.
+struct bc7_mip_tap {
+
+	size_t m_index;
+	float m_weight;
+};
+
+// The source pixels that go in to each destination pixel along one axis.
+struct bc7_mip_taps {
+
+	// The first tap of each destination pixel, with one more at the end.
+	std::vector< size_t > m_first_taps;
+	std::vector< bc7_mip_tap > m_taps;
+};
+
+// A level of a chain.
+struct bc7_mip_level {
+
+	size_t m_width;
+	size_t m_height;
+
+	// The pixels in linear RGBA float for filtering the next level.
+	std::vector< float > m_linear_pixels;
+
+	// The pixels in 32-bit RGBA padded to a multiple of 4 for the compressor.
+	std::vector< uint8_t > m_pixels;
+	size_t m_padded_width;
+	size_t m_padded_height;
+};
+
+// What the thread that filters the next level works on.
+struct bc7_mip_job {
+
+	bc7_downsample_function m_downsample;
+	bc7_encoder_context* m_p_context;
+	bc7_mip_level const* m_p_source_level;
+	bc7_mip_level* m_p_level;
+	bc7_mip_filter m_filter;
+	bool m_srgb;
+	bool m_succeeded;
+};
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+// The names of the filters.
+static char const* const Filter_names[ BC7_MIP_FILTER_COUNT ] = {
+
+	"box",
+	"kaiser"
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// The modified Bessel function of the first kind of order 0, for the Kaiser window.
+//
+// x:	The value.
+//
+// returns: I0(x).
+//
+static float bc7_mip_bessel_i0(float x)
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	float const half_x = 0.5f * x;
+	for (uint32_t k = 1; k < 20; k++) {
+
+		float const factor = half_x / k;
+		term *= factor * factor;
+		sum += term;
+
+	} // end for
+
+	return sum;
+}
+
+// Get the weight of a source pixel.
+//
+// offset:	The distance from the center of the destination pixel to the source pixel, in source pixels.
+// scale:	The number of source pixels per destination pixel.
+// filter:	The filter.
+//
+// returns: The weight before it's normalized.
+//
+static float bc7_mip_get_weight(float offset, float scale, bc7_mip_filter filter)
+{
+	if (filter == BC7_MIP_FILTER_BOX) {
+
+		// How much of the source pixel the destination pixel covers.
+		float const half_scale = 0.5f * scale;
+		float const start = (offset - 0.5f > -half_scale) ? (offset - 0.5f) : -half_scale;
+		float const end = (offset + 0.5f < half_scale) ? (offset + 0.5f) : half_scale;
+		return (end > start) ? (end - start) : 0.0f;
+	}
+
+	// A windowed sinc in destination pixels.
+	float const t = offset / scale;
+	if (fabsf(t) >= BC7_MIP_KAISER_WIDTH) {
+
+		return 0.0f;
+	}
+
+	float const sinc = (t == 0.0f) ? 1.0f : (sinf(BC7_MIP_PI * t) / (BC7_MIP_PI * t));
+	float const r = t / BC7_MIP_KAISER_WIDTH;
+	return sinc * bc7_mip_bessel_i0(BC7_MIP_KAISER_ALPHA * sqrtf(1.0f - r * r)) / bc7_mip_bessel_i0(BC7_MIP_KAISER_ALPHA);
+}
+
+// Work out the source pixels that go in to each destination pixel along one axis. Pixels past the
+// edges repeat the edge pixel.
+//
+// taps:						(output) The taps.
+// destination_size:		The number of destination pixels.
+// source_size:			The number of source pixels.
+// filter:					The filter.
+//
+static void bc7_mip_get_taps(bc7_mip_taps& taps, size_t destination_size, size_t source_size, bc7_mip_filter filter)
+{
+	float const scale = static_cast< float >(source_size) / destination_size;
+	float const radius = (filter == BC7_MIP_FILTER_BOX) ? (0.5f * scale + 0.5f) : (BC7_MIP_KAISER_WIDTH * scale);
+
+	taps.m_first_taps.resize(destination_size + 1);
+	taps.m_taps.clear();
+	for (size_t destination_iter = 0; destination_iter < destination_size; destination_iter++) {
+
+		taps.m_first_taps[ destination_iter ] = taps.m_taps.size();
+
+		float const center = (destination_iter + 0.5f) * scale - 0.5f;
+		int64_t const first = static_cast< int64_t >(ceilf(center - radius));
+		int64_t const last = static_cast< int64_t >(floorf(center + radius));
+
+		float total_weight = 0.0f;
+		for (int64_t source_iter = first; source_iter <= last; source_iter++) {
+
+			float const weight = bc7_mip_get_weight(source_iter - center, scale, filter);
+			if (weight == 0.0f) {
+
+				continue;
+			}
+
+			bc7_mip_tap tap;
+			tap.m_index = static_cast< size_t >((source_iter < 0) ? 0 : ((source_iter >= static_cast< int64_t >(source_size)) ? (source_size - 1) : source_iter));
+			tap.m_weight = weight;
+			taps.m_taps.push_back(tap);
+
+			total_weight += weight;
+
+		} // end for
+
+		// The weights add up to 1.
+		for (size_t tap_iter = taps.m_first_taps[ destination_iter ]; tap_iter < taps.m_taps.size(); tap_iter++) {
+
+			taps.m_taps[ tap_iter ].m_weight /= total_weight;
+
+		} // end for
+
+	} // end for
+
+	taps.m_first_taps[ destination_size ] = taps.m_taps.size();
+}
+
+// Turn an sRGB value in to a linear one.
+//
+// value:	The sRGB value from 0 to 1.
+//
+// returns: The linear value.
+//
+static float bc7_mip_srgb_to_linear(float value)
+{
+	return (value <= 0.04045f) ? (value / 12.92f) : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+// Turn a linear value in to an sRGB one.
+//
+// value:	The linear value from 0 to 1.
+//
+// returns: The sRGB value.
+//
+static float bc7_mip_linear_to_srgb(float value)
+{
+	return (value <= 0.0031308f) ? (value * 12.92f) : (1.055f * powf(value, 1.0f / 2.4f) - 0.055f);
+}
+
+// Turn 32-bit RGBA pixels in to linear RGBA float.
+//
+// p_destination:	(output) The linear pixels.
+// p_source:		The 32-bit RGBA pixels.
+// num_pixels:		The number of pixels.
+// srgb:				True if the colors are sRGB.
+//
+static void bc7_mip_decode_pixels(float* p_destination, uint8_t const* p_source, size_t num_pixels, bool srgb)
+{
+	float table[256];
+	for (uint32_t value_iter = 0; value_iter < 256; value_iter++) {
+
+		float const value = value_iter / 255.0f;
+		table[ value_iter ] = srgb ? bc7_mip_srgb_to_linear(value) : value;
+
+	} // end for
+
+	for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		p_destination[0] = table[ p_source[0] ];
+		p_destination[1] = table[ p_source[1] ];
+		p_destination[2] = table[ p_source[2] ];
+		p_destination[3] = p_source[3] / 255.0f;
+
+		p_destination += 4;
+		p_source += 4;
+
+	} // end for
+}
+
+// Turn a linear value in to a byte.
+//
+// value:	The value from 0 to 1, it's clamped since the Kaiser filter can overshoot.
+//
+// returns: The byte.
+//
+static uint8_t bc7_mip_encode_value(float value)
+{
+	value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+	return static_cast< uint8_t >(value * 255.0f + 0.5f);
+}
+
+// Turn the linear pixels of a level in to 32-bit RGBA padded to a multiple of 4 for the compressor.
+//
+// level:	(input/output) The level.
+// srgb:		True if the colors are sRGB.
+//
+static void bc7_mip_encode_pixels(bc7_mip_level& level, bool srgb)
+{
+	level.m_padded_width = (level.m_width + 3) & ~static_cast< size_t >(3);
+	level.m_padded_height = (level.m_height + 3) & ~static_cast< size_t >(3);
+	level.m_pixels.resize(level.m_padded_width * level.m_padded_height * 4);
+
+	for (size_t y = 0; y < level.m_padded_height; y++) {
+
+		// The padding repeats the last row and column.
+		size_t const source_y = (y < level.m_height) ? y : (level.m_height - 1);
+		float const* p_row = &level.m_linear_pixels[ source_y * level.m_width * 4 ];
+		uint8_t* p_destination = &level.m_pixels[ y * level.m_padded_width * 4 ];
+
+		for (size_t x = 0; x < level.m_padded_width; x++) {
+
+			float const* p_pixel = p_row + ((x < level.m_width) ? x : (level.m_width - 1)) * 4;
+			for (uint32_t channel_iter = 0; channel_iter < 3; channel_iter++) {
+
+				float const value = p_pixel[ channel_iter ];
+				p_destination[ channel_iter ] = bc7_mip_encode_value(srgb ? bc7_mip_linear_to_srgb(value) : value);
+
+			} // end for
+
+			p_destination[3] = bc7_mip_encode_value(p_pixel[3]);
+			p_destination += 4;
+
+		} // end for
+
+	} // end for
+}
+
+// Filter the next level of a chain, this runs on its own thread while the level before it is
+// compressed.
+//
+// p_job:	(input/output) The job.
+//
+static void bc7_mip_make_level(bc7_mip_job* p_job)
+{
+	bc7_mip_level const& source_level = *p_job->m_p_source_level;
+	bc7_mip_level& level = *p_job->m_p_level;
+
+	level.m_width = (source_level.m_width > 1) ? (source_level.m_width / 2) : 1;
+	level.m_height = (source_level.m_height > 1) ? (source_level.m_height / 2) : 1;
+	level.m_linear_pixels.resize(level.m_width * level.m_height * 4);
+
+	p_job->m_succeeded = p_job->m_downsample(p_job->m_p_context, &level.m_linear_pixels[0], level.m_width, level.m_height,
+														  &source_level.m_linear_pixels[0], source_level.m_width, source_level.m_height,
+														  p_job->m_filter);
+	if (p_job->m_succeeded) {
+
+		bc7_mip_encode_pixels(level, p_job->m_srgb);
+	}
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Find a mip filter by name.
+//
+// p_filter:	(output) The filter.
+// p_name:		The name, "box" or "kaiser".
+//
+// returns: True if there is a filter with the name.
+//
+bool bc7_find_mip_filter(bc7_mip_filter* p_filter, char const* p_name)
+{
+	for (uint32_t filter_iter = 0; filter_iter < BC7_MIP_FILTER_COUNT; filter_iter++) {
+
+		if (strcmp(p_name, Filter_names[ filter_iter ]) == 0) {
+
+			*p_filter = static_cast< bc7_mip_filter >(filter_iter);
+			return true;
+		}
+
+	} // end for
+
+	return false;
+}
+
+// Get the number of levels in a full mip chain, down to 1x1.
+//
+// width:	The width of the biggest level in pixels.
+// height:	The height of the biggest level in pixels.
+//
+// returns: The number of levels.
+//
+uint32_t bc7_get_num_mip_levels(size_t width, size_t height)
+{
+	size_t size = (width > height) ? width : height;
+	uint32_t num_levels = 1;
+	while ((size > 1)
+	&&     (num_levels < BC7_MIP_MAX_LEVELS)) {
+
+		size /= 2;
+		num_levels++;
+	}
+
+	return num_levels;
+}
+
+// Filter a level of linear RGBA float pixels to make a smaller one on the CPU. The filter is applied
+// across the rows and then down the columns.
+//
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_mip_downsample(float* p_destination, size_t destination_width, size_t destination_height,
+								float const* p_source, size_t source_width, size_t source_height,
+								bc7_mip_filter filter)
+{
+	bc7_mip_taps x_taps;
+	bc7_mip_taps y_taps;
+	bc7_mip_get_taps(x_taps, destination_width, source_width, filter);
+	bc7_mip_get_taps(y_taps, destination_height, source_height, filter);
+
+	// Filter the rows, the image is the destination width and the source height after this.
+	std::vector< float > row_filtered(destination_width * source_height * 4);
+	for (size_t y = 0; y < source_height; y++) {
+
+		float const* p_row = p_source + y * source_width * 4;
+		float* p_filtered = &row_filtered[ y * destination_width * 4 ];
+
+		for (size_t x = 0; x < destination_width; x++) {
+
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (size_t tap_iter = x_taps.m_first_taps[x]; tap_iter < x_taps.m_first_taps[x + 1]; tap_iter++) {
+
+				bc7_mip_tap const& tap = x_taps.m_taps[ tap_iter ];
+				float const* p_pixel = p_row + tap.m_index * 4;
+				sum[0] += p_pixel[0] * tap.m_weight;
+				sum[1] += p_pixel[1] * tap.m_weight;
+				sum[2] += p_pixel[2] * tap.m_weight;
+				sum[3] += p_pixel[3] * tap.m_weight;
+
+			} // end for
+
+			memcpy(p_filtered + x * 4, sum, sizeof(sum));
+
+		} // end for
+
+	} // end for
+
+	// Filter the columns.
+	size_t const row_size = destination_width * 4;
+	for (size_t y = 0; y < destination_height; y++) {
+
+		float* p_row = p_destination + y * row_size;
+		memset(p_row, 0, row_size * sizeof(float));
+
+		for (size_t tap_iter = y_taps.m_first_taps[y]; tap_iter < y_taps.m_first_taps[y + 1]; tap_iter++) {
+
+			bc7_mip_tap const& tap = y_taps.m_taps[ tap_iter ];
+			float const* p_filtered = &row_filtered[ tap.m_index * row_size ];
+			for (size_t value_iter = 0; value_iter < row_size; value_iter++) {
+
+				p_row[ value_iter ] += p_filtered[ value_iter ] * tap.m_weight;
+
+			} // end for
+
+		} // end for
+
+	} // end for
+
+	return true;
+}
+
+// Make and compress a full mip chain in one call. Each level is compressed while the next one is
+// being filtered on another thread.
+//
+// compress:			The compressor.
+// p_context:			The encoder context, it's passed to the compressor and the filter.
+// downsample:			The filter.
+// p_source:			The biggest level. The width and height must be multiples of 4.
+// filter:				How the levels are filtered.
+// srgb:					True if the colors are sRGB so they're averaged in linear space.
+// level_function:	Called with the compressed blocks of each level.
+// p_user_data:		Passed to the level function.
+// p_params:			The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_mip_compress_chain(bc7_compress_function compress, bc7_downsample_function downsample,
+									 bc7_encoder_context* p_context, bc7_source const* p_source,
+									 bc7_mip_filter filter, bool srgb,
+									 bc7_mip_level_function level_function, void* p_user_data,
+									 bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_mip_compress_chain");
+
+	size_t const width = p_source->m_width;
+	size_t const height = p_source->m_height;
+
+	if ((width == 0)
+	||  (height == 0)
+	||  (width & 0x3)
+	||  (height & 0x3)) {
+
+		printf("The width and height of the image must be multiples of 4!\n");
+		return false;
+	}
+
+	uint32_t const num_levels = bc7_get_num_mip_levels(width, height);
+	printf("Making %u mip levels with the %s filter%s\n", num_levels, Filter_names[ filter ], srgb ? " in linear space" : "");
+
+	// The biggest level is compressed straight from the source, it only needs to be in linear float
+	// to filter the next level. It's turned in to that a row at a time.
+	bc7_mip_level levels[2];
+	levels[0].m_width = width;
+	levels[0].m_height = height;
+	levels[0].m_linear_pixels.resize(width * height * 4);
+
+	std::vector< uint8_t > row_pixels(width * 4);
+	for (size_t y = 0; y < height; y++) {
+
+		bc7_source_get_row(&row_pixels[0], p_source, y);
+		bc7_mip_decode_pixels(&levels[0].m_linear_pixels[ y * width * 4 ], &row_pixels[0], width, srgb);
+
+	} // end for
+
+	std::vector< bc7_compressed_block > blocks;
+	for (uint32_t level_iter = 0; level_iter < num_levels; level_iter++) {
+
+		bc7_mip_level& level = levels[ level_iter & 1 ];
+		bc7_mip_level& next_level = levels[ (level_iter + 1) & 1 ];
+
+		// Filter the next level while this one is compressed.
+		bc7_mip_job job;
+		job.m_downsample = downsample;
+		job.m_p_context = p_context;
+		job.m_p_source_level = &level;
+		job.m_p_level = &next_level;
+		job.m_filter = filter;
+		job.m_srgb = srgb;
+		job.m_succeeded = true;
+
+		std::thread filter_thread;
+		if (level_iter + 1 < num_levels) {
+
+			filter_thread = std::thread(bc7_mip_make_level, &job);
+		}
+
+		bc7_source level_source;
+		if (level_iter > 0) {
+
+			bc7_source_init_rgba(&level_source, &level.m_pixels[0], level.m_padded_width, level.m_padded_height);
+		}
+
+		bc7_source const* p_level_source = (level_iter == 0) ? p_source : &level_source;
+		size_t const num_blocks = (p_level_source->m_width / 4) * (p_level_source->m_height / 4);
+
+		blocks.resize(num_blocks);
+		bool succeeded = compress(p_context, &blocks[0], p_level_source, p_params);
+		if (succeeded) {
+
+			succeeded = level_function(p_user_data, level_iter, level.m_width, level.m_height, &blocks[0], num_blocks);
+		}
+
+		if (filter_thread.joinable()) {
+
+			filter_thread.join();
+		}
+
+		if ((succeeded == false)
+		||  (job.m_succeeded == false)) {
+
+			return false;
+		}
+
+	} // end for
+
+	return true;
+}
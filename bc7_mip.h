@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_MIP_H
+#define __BC7_MIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bc7_block_dedup.h"
+#include "bc7_compressed_block.h"
+#include "bc7_encode_params.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The most levels a mip chain can have.
+#define BC7_MIP_MAX_LEVELS		32
+
+// The radius of the Kaiser filter in pixels of the smaller level and the alpha of the window. The
+// OpenCL kernel has its own copy of these.
+#define BC7_MIP_KAISER_WIDTH	3.0f
+#define BC7_MIP_KAISER_ALPHA	4.0f
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+// How the pixels of a level are filtered to make the next one.
+enum bc7_mip_filter {
+
+	// The average of the pixels each pixel covers.
+	BC7_MIP_FILTER_BOX = 0,
+
+	// A sinc with a Kaiser window, it keeps more detail than the box filter without much ringing.
+	BC7_MIP_FILTER_KAISER,
+
+	BC7_MIP_FILTER_COUNT
+};
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// Filter a level of linear RGBA float pixels to make a smaller one. bc7_encoder_context_downsample()
+// is one, it filters in OpenCL with the OpenCL version and with bc7_mip_downsample() otherwise.
+typedef bool (*bc7_downsample_function)(bc7_encoder_context* p_context, float* p_destination,
+													 size_t destination_width, size_t destination_height,
+													 float const* p_source, size_t source_width, size_t source_height,
+													 bc7_mip_filter filter);
+
+// Called with the compressed blocks of each level of a chain as soon as they're ready, from the
+// biggest level to the smallest. The blocks are only valid during the call.
+//
+// p_user_data:	The user data that was passed to bc7_mip_compress_chain().
+// level:			The level, 0 is the biggest.
+// width:			The width of the level in pixels.
+// height:			The height of the level in pixels.
+// p_blocks:		The compressed blocks a row at a time, levels that aren't a multiple of 4 are
+//						padded by repeating the last row and column of pixels.
+// num_blocks:		The number of blocks.
+//
+// returns: True to carry on with the next level.
+//
+typedef bool (*bc7_mip_level_function)(void* p_user_data, uint32_t level, size_t width, size_t height,
+													bc7_compressed_block const* p_blocks, size_t num_blocks);
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Find a mip filter by name.
+//
+// p_filter:	(output) The filter.
+// p_name:		The name, "box" or "kaiser".
+//
+// returns: True if there is a filter with the name.
+//
+bool bc7_find_mip_filter(bc7_mip_filter* p_filter, char const* p_name);
+
+// Get the number of levels in a full mip chain, down to 1x1.
+//
+// width:	The width of the biggest level in pixels.
+// height:	The height of the biggest level in pixels.
+//
+// returns: The number of levels.
+//
+uint32_t bc7_get_num_mip_levels(size_t width, size_t height);
+
+// Filter a level of linear RGBA float pixels to make a smaller one on the CPU.
+//
+// p_destination:			(output) The pixels of the smaller level.
+// destination_width:	The width of the smaller level in pixels.
+// destination_height:	The height of the smaller level in pixels.
+// p_source:				The pixels of the bigger level.
+// source_width:			The width of the bigger level in pixels.
+// source_height:			The height of the bigger level in pixels.
+// filter:					The filter.
+//
+// returns: True if successful.
+//
+bool bc7_mip_downsample(float* p_destination, size_t destination_width, size_t destination_height,
+								float const* p_source, size_t source_width, size_t source_height,
+								bc7_mip_filter filter);
+
+// Make and compress a full mip chain in one call. Each level is compressed while the next one is
+// being filtered on another thread, and is passed to the level function as soon as it's compressed.
+// The levels are filtered from the one before them in linear float so the rounding doesn't add up.
+//
+// compress:			The compressor.
+// p_context:			The encoder context, it's passed to the compressor and the filter.
+// downsample:			The filter.
+// p_source:			The biggest level. The width and height must be multiples of 4.
+// filter:				How the levels are filtered.
+// srgb:					True if the colors are sRGB so they're averaged in linear space, alpha is
+//							always linear.
+// level_function:	Called with the compressed blocks of each level.
+// p_user_data:		Passed to the level function.
+// p_params:			The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_mip_compress_chain(bc7_compress_function compress, bc7_downsample_function downsample,
+									 bc7_encoder_context* p_context, bc7_source const* p_source,
+									 bc7_mip_filter filter, bool srgb,
+									 bc7_mip_level_function level_function, void* p_user_data,
+									 bc7_encode_params const* p_params);
+
+#endif // __BC7_MIP_H
@@ -0,0 +1,217 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <string.h>
+
+#include "bc7_source.h"
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+// The number of bytes in a pixel of each format.
+static uint32_t const Bytes_per_pixel[ BC7_PIXEL_FORMAT_COUNT ] = {
+
+	3,
+	4,
+	4
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Turn some of the pixels of a row in to 32-bit RGBA.
+//
+// p_destination:	(output) The RGBA pixels.
+// p_source:		The source.
+// y:					The row, 0 is the top.
+// first_x:			The first pixel, 0 is the left.
+// num_pixels:		The number of pixels.
+//
+static void bc7_source_convert_pixels(uint8_t* p_destination, bc7_source const* p_source, size_t y,
+												  size_t first_x, size_t num_pixels)
+{
+	uint32_t const bytes_per_pixel = Bytes_per_pixel[ p_source->m_format ];
+	uint8_t const* p_row = p_source->m_p_top_row + static_cast< ptrdiff_t >(y) * p_source->m_row_stride;
+
+	// Rows stored from right to left are read backwards.
+	ptrdiff_t step = bytes_per_pixel;
+	uint8_t const* p_pixel = p_row + first_x * bytes_per_pixel;
+	if (p_source->m_right_to_left) {
+
+		step = -step;
+		p_pixel = p_row + (p_source->m_width - 1 - first_x) * bytes_per_pixel;
+	}
+
+	switch (p_source->m_format) {
+		case BC7_PIXEL_FORMAT_BGR8: {
+
+			for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+				p_destination[0] = p_pixel[2];
+				p_destination[1] = p_pixel[1];
+				p_destination[2] = p_pixel[0];
+				p_destination[3] = 255;
+
+				p_destination += 4;
+				p_pixel += step;
+
+			} // end for
+
+			break;
+		}
+		case BC7_PIXEL_FORMAT_BGRA8: {
+
+			for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+				p_destination[0] = p_pixel[2];
+				p_destination[1] = p_pixel[1];
+				p_destination[2] = p_pixel[0];
+				p_destination[3] = p_pixel[3];
+
+				p_destination += 4;
+				p_pixel += step;
+
+			} // end for
+
+			break;
+		}
+		default: {
+
+			if (p_source->m_right_to_left == false) {
+
+				memcpy(p_destination, p_pixel, num_pixels * 4);
+				break;
+			}
+
+			for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+				memcpy(p_destination, p_pixel, 4);
+
+				p_destination += 4;
+				p_pixel += step;
+
+			} // end for
+
+			break;
+		}
+	}
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Describe a source image.
+//
+// p_source:			(output) The source.
+// p_pixels:			The pixels as they're stored, starting with the first row in memory.
+// width:				Width of the image in pixels.
+// height:				Height of the image in pixels.
+// row_size:			The number of bytes from one row in memory to the next.
+// format:				The layout of the pixels.
+// bottom_up:			True if the first row in memory is the bottom of the image.
+// right_to_left:		True if the first pixel of a row in memory is on the right of the image.
+//
+void bc7_source_init(bc7_source* p_source, uint8_t const* p_pixels, size_t width, size_t height, size_t row_size,
+							bc7_pixel_format format, bool bottom_up, bool right_to_left)
+{
+	// Images stored from the bottom up are read from the last row in memory backwards.
+	p_source->m_p_top_row = p_pixels;
+	p_source->m_row_stride = static_cast< ptrdiff_t >(row_size);
+	if (bottom_up && (height > 0)) {
+
+		p_source->m_p_top_row = p_pixels + (height - 1) * row_size;
+		p_source->m_row_stride = -p_source->m_row_stride;
+	}
+
+	p_source->m_width = width;
+	p_source->m_height = height;
+	p_source->m_format = format;
+	p_source->m_right_to_left = right_to_left;
+}
+
+// Describe a 32-bit RGBA image stored from the top down, what the compressors take.
+//
+// p_source:	(output) The source.
+// p_pixels:	The 32-bit RGBA pixels.
+// width:		Width of the image in pixels.
+// height:		Height of the image in pixels.
+//
+void bc7_source_init_rgba(bc7_source* p_source, uint8_t const* p_pixels, size_t width, size_t height)
+{
+	bc7_source_init(p_source, p_pixels, width, height, width * 4, BC7_PIXEL_FORMAT_RGBA8, false, false);
+}
+
+// Check if a source is 32-bit RGBA stored from the top down with no gaps between the rows so its
+// pixels can be passed to the compressors as is.
+//
+// p_source:	The source.
+//
+// returns: True if the source is in the layout the compressors take.
+//
+bool bc7_source_is_rgba(bc7_source const* p_source)
+{
+	return (p_source->m_format == BC7_PIXEL_FORMAT_RGBA8)
+		 && (p_source->m_row_stride == static_cast< ptrdiff_t >(p_source->m_width * 4))
+		 && (p_source->m_right_to_left == false);
+}
+
+// Get a row of pixels as 32-bit RGBA.
+//
+// p_destination:	(output) The RGBA pixels, the width of the image.
+// p_source:		The source.
+// y:					The row, 0 is the top.
+//
+void bc7_source_get_row(uint8_t* p_destination, bc7_source const* p_source, size_t y)
+{
+	bc7_source_convert_pixels(p_destination, p_source, y, 0, p_source->m_width);
+}
+
+// Get a rectangle of pixels as 32-bit RGBA.
+//
+// p_destination:	(output) The RGBA pixels a row at a time, with no gaps between the rows.
+// p_source:		The source.
+// x:					The left of the rectangle, 0 is the left of the image.
+// y:					The top of the rectangle, 0 is the top of the image.
+// width:			The width of the rectangle in pixels.
+// height:			The height of the rectangle in pixels.
+//
+void bc7_source_get_pixels(uint8_t* p_destination, bc7_source const* p_source, size_t x, size_t y,
+									size_t width, size_t height)
+{
+	for (size_t row_iter = 0; row_iter < height; row_iter++) {
+
+		bc7_source_convert_pixels(p_destination + row_iter * width * 4, p_source, y + row_iter, x, width);
+
+	} // end for
+}
+
+// Get the pixels of a 4x4 block as 32-bit RGBA. The pixels are swizzled as they're gathered so
+// the image never has to be converted as a whole.
+//
+// pixels:			(output) The pixels of the block, a row at a time.
+// p_source:		The source, its width must be a multiple of 4.
+// block_index:	The index of the block, counting across the rows of blocks.
+//
+void bc7_source_get_block_pixels(uint8_t pixels[64], bc7_source const* p_source, size_t block_index)
+{
+	size_t const width_in_blocks = p_source->m_width / 4;
+	size_t const block_x = block_index % width_in_blocks;
+	size_t const block_y = block_index / width_in_blocks;
+
+	for (uint32_t row_iter = 0; row_iter < 4; row_iter++) {
+
+		bc7_source_convert_pixels(pixels + row_iter * 16, p_source, block_y * 4 + row_iter, block_x * 4, 4);
+
+	} // end for
+}
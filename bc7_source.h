@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_SOURCE_H
+#define __BC7_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+// The layouts of the source pixels.
+enum bc7_pixel_format {
+
+	// 24-bit blue, green, red like a 24-bit TGA, alpha is 255.
+	BC7_PIXEL_FORMAT_BGR8 = 0,
+
+	// 32-bit blue, green, red, alpha like a 32-bit TGA.
+	BC7_PIXEL_FORMAT_BGRA8,
+
+	// 32-bit red, green, blue, alpha, what the compressors take.
+	BC7_PIXEL_FORMAT_RGBA8,
+
+	BC7_PIXEL_FORMAT_COUNT
+};
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// Where the pixels of a source image are and how they're laid out, so they can be read straight
+// out of a loaded or memory-mapped file and turned in to 32-bit RGBA a block at a time instead of
+// the whole image being converted first.
+struct bc7_source {
+
+	// The first pixel in memory of the top row and the number of bytes from one row to the next,
+	// this is negative for images that are stored from the bottom up.
+	uint8_t const* m_p_top_row;
+	ptrdiff_t m_row_stride;
+
+	// Width and height of the image in pixels.
+	size_t m_width;
+	size_t m_height;
+
+	bc7_pixel_format m_format;
+
+	// True if the rows are stored from right to left.
+	bool m_right_to_left;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Describe a source image.
+//
+// p_source:			(output) The source.
+// p_pixels:			The pixels as they're stored, starting with the first row in memory.
+// width:				Width of the image in pixels.
+// height:				Height of the image in pixels.
+// row_size:			The number of bytes from one row in memory to the next.
+// format:				The layout of the pixels.
+// bottom_up:			True if the first row in memory is the bottom of the image.
+// right_to_left:		True if the first pixel of a row in memory is on the right of the image.
+//
+void bc7_source_init(bc7_source* p_source, uint8_t const* p_pixels, size_t width, size_t height, size_t row_size,
+							bc7_pixel_format format, bool bottom_up, bool right_to_left);
+
+// Describe a 32-bit RGBA image stored from the top down, what the compressors take.
+//
+// p_source:	(output) The source.
+// p_pixels:	The 32-bit RGBA pixels.
+// width:		Width of the image in pixels.
+// height:		Height of the image in pixels.
+//
+void bc7_source_init_rgba(bc7_source* p_source, uint8_t const* p_pixels, size_t width, size_t height);
+
+// Check if a source is 32-bit RGBA stored from the top down with no gaps between the rows so its
+// pixels can be passed to the compressors as is.
+//
+// p_source:	The source.
+//
+// returns: True if the source is in the layout the compressors take.
+//
+bool bc7_source_is_rgba(bc7_source const* p_source);
+
+// Get a row of pixels as 32-bit RGBA.
+//
+// p_destination:	(output) The RGBA pixels, the width of the image.
+// p_source:		The source.
+// y:					The row, 0 is the top.
+//
+void bc7_source_get_row(uint8_t* p_destination, bc7_source const* p_source, size_t y);
+
+// Get a rectangle of pixels as 32-bit RGBA, a band of rows or a tile of blocks can be gathered in one
+// go.
+//
+// p_destination:	(output) The RGBA pixels a row at a time, with no gaps between the rows.
+// p_source:		The source.
+// x:					The left of the rectangle, 0 is the left of the image.
+// y:					The top of the rectangle, 0 is the top of the image.
+// width:			The width of the rectangle in pixels.
+// height:			The height of the rectangle in pixels.
+//
+void bc7_source_get_pixels(uint8_t* p_destination, bc7_source const* p_source, size_t x, size_t y,
+									size_t width, size_t height);
+
+// Get the pixels of a 4x4 block as 32-bit RGBA.
+//
+// pixels:			(output) The pixels of the block, a row at a time.
+// p_source:		The source, its width must be a multiple of 4.
+// block_index:	The index of the block, counting across the rows of blocks.
+//
+void bc7_source_get_block_pixels(uint8_t pixels[64], bc7_source const* p_source, size_t block_index);
+
+#endif // __BC7_SOURCE_H
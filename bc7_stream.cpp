@@ -0,0 +1,190 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "bc7_stream.h"
+#include "portable.h"
+#include "scoped_timer.h"
+#include "tga/tga.h"
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Compress a TGA to the BC7 format a band of block rows at a time so the image is never in memory
+// as a whole.
+//
+// compress:					The compressor.
+// p_context:					The encoder context, it's passed to the compressor.
+// p_cache:						The block cache or NULL to not use one.
+// p_input_filename:			The TGA to compress.
+// p_output_filename:		The file to write the compressed blocks to.
+// band_height_in_blocks:	The number of rows of blocks in a band, 0 picks the most that fit in
+//									BC7_STREAM_DEFAULT_BAND_SIZE.
+// p_params:					The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_stream_compress(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_block_cache* p_cache,
+								 char const* p_input_filename, char const* p_output_filename,
+								 uint32_t band_height_in_blocks, bc7_encode_params const* p_params)
+{
+	SCOPED_TIMER("bc7_stream_compress");
+
+	tga_header image_header;
+	FILE* p_infile = tga_open(image_header, p_input_filename);
+	if (p_infile == NULL) {
+
+		return false;
+	}
+
+	// Everything that depends on the size of the image is 64-bit, only a band has to fit in memory.
+	uint64_t const width = image_header.get_width();
+	uint64_t const height = image_header.get_height();
+	uint32_t const bytes_per_pixel = image_header.get_bits_per_pixel() / 8;
+	bool const has_alpha = (bytes_per_pixel == 4);
+
+	// The origin says which corner the first pixel in the file is, 0 is the bottom left, 1 the bottom
+	// right, 2 the top left and 3 the top right. The bands are always compressed from the top.
+	uint8_t const origin = image_header.get_origin();
+	bool const bottom_up = ((origin & 0x2) == 0);
+	bool const right_to_left = ((origin & 0x1) != 0);
+	bc7_pixel_format const format = has_alpha ? BC7_PIXEL_FORMAT_BGRA8 : BC7_PIXEL_FORMAT_BGR8;
+
+	// The bands are read from where their rows are in the file.
+	int64_t const pixels_offset = _ftelli64(p_infile);
+	if (pixels_offset < 0) {
+
+		printf("Failed to read the image data \"%s\"!\n", p_input_filename);
+
+		fclose(p_infile);
+		return false;
+	}
+
+	if ((width == 0)
+	||  (height == 0)
+	||  (width & 0x3)
+	||  (height & 0x3)) {
+
+		printf("The width and height of the image must be multiples of 4!\n");
+
+		fclose(p_infile);
+		return false;
+	}
+
+	uint64_t const width_in_blocks = width / 4;
+	uint64_t const height_in_blocks = height / 4;
+	uint64_t const block_row_size = width * 4 * 4;
+	uint64_t const file_row_size = width * bytes_per_pixel;
+
+	// Use as many rows as fit in the default band size if the height isn't given, a band is never
+	// taller than the image or shorter than a row.
+	uint64_t band_height = band_height_in_blocks;
+	if (band_height == 0) {
+
+		band_height = BC7_STREAM_DEFAULT_BAND_SIZE / block_row_size;
+	}
+
+	if (band_height > height_in_blocks) {
+
+		band_height = height_in_blocks;
+	}
+
+	band_height_in_blocks = static_cast< uint32_t >((band_height > 0) ? band_height : 1);
+
+	FILE* p_outfile;
+	errno_t result = fopen_s(&p_outfile, p_output_filename, "wb");
+	if (result != 0) {
+
+		printf("Failed to open \"%s\"!\n", p_output_filename);
+
+		fclose(p_infile);
+		return false;
+	}
+
+	printf("Streaming '%s' %llu x %llu in bands of %u block rows...\n", p_input_filename,
+			 static_cast< unsigned long long >(width), static_cast< unsigned long long >(height), band_height_in_blocks);
+
+	// The buffers are the size of a full band and are reused for every band. The pixels are swizzled
+	// as the blocks are gathered.
+	size_t const band_pixels = static_cast< size_t >(width * band_height_in_blocks * 4);
+	std::vector< uint8_t > file_pixels(band_pixels * bytes_per_pixel);
+	std::vector< bc7_compressed_block > compressed_blocks(static_cast< size_t >(width_in_blocks * band_height_in_blocks));
+
+	bool succeeded = true;
+	uint64_t num_bands = 0;
+	uint64_t bytes_written = 0;
+	for (uint64_t band_y = 0; band_y < height_in_blocks; band_y += band_height_in_blocks) {
+
+		// The last band can be shorter.
+		uint64_t const rows_left = height_in_blocks - band_y;
+		size_t const num_block_rows = static_cast< size_t >((rows_left < band_height_in_blocks) ? rows_left : band_height_in_blocks);
+		size_t const num_pixels = static_cast< size_t >(width * num_block_rows * 4);
+		size_t const num_blocks = static_cast< size_t >(width_in_blocks * num_block_rows);
+
+		// The rows of a band are next to each other in the file either way, the bands of an image
+		// that is stored from the bottom up are read from the end of the file backwards.
+		uint64_t const num_rows = num_block_rows * 4;
+		uint64_t const top_row = band_y * 4;
+		uint64_t const first_file_row = bottom_up ? (height - top_row - num_rows) : top_row;
+		if ((_fseeki64(p_infile, pixels_offset + static_cast< int64_t >(first_file_row * file_row_size), SEEK_SET) != 0)
+		||  (fread(&file_pixels[0], num_pixels * bytes_per_pixel, 1, p_infile) != 1)) {
+
+			printf("Failed to read the image data \"%s\"!\n", p_input_filename);
+			succeeded = false;
+			break;
+		}
+
+		bc7_source band_source;
+		bc7_source_init(&band_source, &file_pixels[0], static_cast< size_t >(width), static_cast< size_t >(num_rows),
+							 static_cast< size_t >(file_row_size), format, bottom_up, right_to_left);
+
+		bool compressed;
+		if (p_cache != NULL) {
+
+			compressed = bc7_block_cache_compress(p_cache, compress, p_context, &compressed_blocks[0], &band_source, p_params);
+
+		} else {
+
+			compressed = bc7_dedup_compress_source(compress, p_context, &compressed_blocks[0], &band_source, p_params);
+		}
+
+		if (!compressed) {
+
+			succeeded = false;
+			break;
+		}
+
+		// The band's rows go straight after the rows of the band before it.
+		if (fwrite(&compressed_blocks[0], num_blocks * sizeof(bc7_compressed_block), 1, p_outfile) != 1) {
+
+			printf("Failed to write \"%s\"!\n", p_output_filename);
+			succeeded = false;
+			break;
+		}
+
+		bytes_written += static_cast< uint64_t >(num_blocks) * sizeof(bc7_compressed_block);
+		num_bands++;
+
+	} // end for
+
+	fclose(p_outfile);
+	fclose(p_infile);
+
+	if (succeeded) {
+
+		printf("Wrote %llu bytes in %llu bands, %llu bytes of source pixels per band\n",
+				 static_cast< unsigned long long >(bytes_written), static_cast< unsigned long long >(num_bands),
+				 static_cast< unsigned long long >(band_pixels * 4));
+	}
+
+	return succeeded;
+}
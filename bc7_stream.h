@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_STREAM_H
+#define __BC7_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bc7_block_cache.h"
+#include "bc7_block_dedup.h"
+#include "bc7_encode_params.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The most bytes of 32-bit RGBA source pixels in a band when the band height isn't given.
+#define BC7_STREAM_DEFAULT_BAND_SIZE	(64 * 1024 * 1024)
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Compress a TGA to the BC7 format a band of block rows at a time so the image is never in memory
+// as a whole. Each band is read from the file, compressed and its blocks are written out before
+// the next band is read, so the memory that is used only depends on the width of the image and
+// the band height. The output is the compressed blocks a row at a time with no header. The bands go
+// from the top of the image down whatever corner the TGA starts in, the bands of a TGA that is stored
+// from the bottom up are read from the end of the file backwards.
+//
+// compress:					The compressor.
+// p_context:					The encoder context, it's passed to the compressor.
+// p_cache:						The block cache or NULL to not use one.
+// p_input_filename:			The TGA to compress.
+// p_output_filename:		The file to write the compressed blocks to.
+// band_height_in_blocks:	The number of rows of blocks in a band, 0 picks the most that fit in
+//									BC7_STREAM_DEFAULT_BAND_SIZE.
+// p_params:					The encoding parameters.
+//
+// returns: True if successful.
+//
+bool bc7_stream_compress(bc7_compress_function compress, bc7_encoder_context* p_context, bc7_block_cache* p_cache,
+								 char const* p_input_filename, char const* p_output_filename,
+								 uint32_t band_height_in_blocks, bc7_encode_params const* p_params);
+
+#endif // __BC7_STREAM_H
@@ -0,0 +1,448 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bc7_texture_file.h"
+#include "portable.h"
+#include "scoped_timer.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// "DDS " and the DX10 pixel format.
+#define BC7_DDS_MAGIC							0x20534444
+#define BC7_DDS_FOURCC_DX10					0x30315844
+
+// The DDS header flags.
+#define BC7_DDSD_CAPS							0x1
+#define BC7_DDSD_HEIGHT							0x2
+#define BC7_DDSD_WIDTH							0x4
+#define BC7_DDSD_PIXELFORMAT					0x1000
+#define BC7_DDSD_MIPMAPCOUNT					0x20000
+#define BC7_DDSD_LINEARSIZE					0x80000
+#define BC7_DDPF_FOURCC							0x4
+#define BC7_DDSCAPS_COMPLEX					0x8
+#define BC7_DDSCAPS_TEXTURE					0x1000
+#define BC7_DDSCAPS_MIPMAP						0x400000
+
+// The DXGI formats and the D3D10_RESOURCE_DIMENSION of a 2D texture.
+#define BC7_DXGI_FORMAT_BC7_UNORM			98
+#define BC7_DXGI_FORMAT_BC7_UNORM_SRGB		99
+#define BC7_D3D10_RESOURCE_DIMENSION_2D	3
+
+// The Vulkan formats.
+#define BC7_VK_FORMAT_BC7_UNORM_BLOCK		145
+#define BC7_VK_FORMAT_BC7_SRGB_BLOCK		146
+
+// The parts of the KTX2 data format descriptor for BC7, from the Khronos Data Format Specification.
+#define BC7_KHR_DF_VERSION					2
+#define BC7_KHR_DF_MODEL_BC7					134
+#define BC7_KHR_DF_PRIMARIES_BT709			1
+#define BC7_KHR_DF_TRANSFER_LINEAR			1
+#define BC7_KHR_DF_TRANSFER_SRGB				2
+#define BC7_KHR_DF_NUM_WORDS					11
+
+// The levels of a KTX2 start on a multiple of the block size.
+#define BC7_KTX2_LEVEL_ALIGNMENT				16
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// The pixel format of a DDS.
+struct bc7_dds_pixel_format {
+
+	uint32_t m_size;
+	uint32_t m_flags;
+	uint32_t m_four_cc;
+	uint32_t m_rgb_bit_count;
+	uint32_t m_red_mask;
+	uint32_t m_green_mask;
+	uint32_t m_blue_mask;
+	uint32_t m_alpha_mask;
+};
+
+// The start of a DDS, the magic number, the header and the DX10 header.
+struct bc7_dds_header {
+
+	uint32_t m_magic;
+
+	uint32_t m_size;
+	uint32_t m_flags;
+	uint32_t m_height;
+	uint32_t m_width;
+	uint32_t m_pitch_or_linear_size;
+	uint32_t m_depth;
+	uint32_t m_mip_map_count;
+	uint32_t m_reserved1[11];
+	bc7_dds_pixel_format m_pixel_format;
+	uint32_t m_caps;
+	uint32_t m_caps2;
+	uint32_t m_caps3;
+	uint32_t m_caps4;
+	uint32_t m_reserved2;
+
+	uint32_t m_dxgi_format;
+	uint32_t m_resource_dimension;
+	uint32_t m_misc_flag;
+	uint32_t m_array_size;
+	uint32_t m_misc_flags2;
+};
+
+// The start of a KTX2, the identifier, the header and the index.
+struct bc7_ktx2_header {
+
+	uint8_t m_identifier[12];
+
+	uint32_t m_vk_format;
+	uint32_t m_type_size;
+	uint32_t m_pixel_width;
+	uint32_t m_pixel_height;
+	uint32_t m_pixel_depth;
+	uint32_t m_layer_count;
+	uint32_t m_face_count;
+	uint32_t m_level_count;
+	uint32_t m_supercompression_scheme;
+
+	uint32_t m_dfd_byte_offset;
+	uint32_t m_dfd_byte_length;
+	uint32_t m_kvd_byte_offset;
+	uint32_t m_kvd_byte_length;
+	uint64_t m_sgd_byte_offset;
+	uint64_t m_sgd_byte_length;
+};
+
+// Where a level of a KTX2 is, it follows the header.
+struct bc7_ktx2_level {
+
+	uint64_t m_byte_offset;
+	uint64_t m_byte_length;
+	uint64_t m_uncompressed_byte_length;
+};
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+// The extensions of the file formats.
+static char const* const Format_extensions[ BC7_TEXTURE_FILE_FORMAT_COUNT ] = {
+
+	".dds",
+	".ktx2"
+};
+
+// The start of every KTX2, "«KTX 20»\r\n\x1A\n".
+static uint8_t const Ktx2_identifier[12] = {
+
+	0xab, 0x4b, 0x54, 0x58, 0x20, 0x32, 0x30, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Get the size of the compressed blocks of a level.
+//
+// width:	The width of the biggest level in pixels.
+// height:	The height of the biggest level in pixels.
+// level:	The level.
+//
+// returns: The size in bytes.
+//
+static uint64_t bc7_texture_file_get_level_size(size_t width, size_t height, uint32_t level)
+{
+	uint64_t const level_width = ((width >> level) > 0) ? (width >> level) : 1;
+	uint64_t const level_height = ((height >> level) > 0) ? (height >> level) : 1;
+	return ((level_width + 3) / 4) * ((level_height + 3) / 4) * sizeof(bc7_compressed_block);
+}
+
+// Write the header of a DDS and work out where the levels go, they follow the header from the
+// biggest to the smallest.
+//
+// p_texture_file:	(input/output) The texture file.
+// srgb:					True if the colors are sRGB.
+//
+// returns: True if successful.
+//
+static bool bc7_texture_file_write_dds_header(bc7_texture_file* p_texture_file, bool srgb)
+{
+	bc7_dds_header header;
+	memset(&header, 0, sizeof(header));
+
+	header.m_magic = BC7_DDS_MAGIC;
+
+	// The size doesn't count the magic number or the DX10 header.
+	header.m_size = sizeof(header) - sizeof(header.m_magic) - 5 * sizeof(uint32_t);
+
+	header.m_flags = BC7_DDSD_CAPS | BC7_DDSD_HEIGHT | BC7_DDSD_WIDTH | BC7_DDSD_PIXELFORMAT | BC7_DDSD_LINEARSIZE;
+	header.m_height = static_cast< uint32_t >(p_texture_file->m_height);
+	header.m_width = static_cast< uint32_t >(p_texture_file->m_width);
+	header.m_pitch_or_linear_size = static_cast< uint32_t >(bc7_texture_file_get_level_size(p_texture_file->m_width, p_texture_file->m_height, 0));
+	header.m_mip_map_count = p_texture_file->m_num_levels;
+	header.m_pixel_format.m_size = sizeof(header.m_pixel_format);
+	header.m_pixel_format.m_flags = BC7_DDPF_FOURCC;
+	header.m_pixel_format.m_four_cc = BC7_DDS_FOURCC_DX10;
+	header.m_caps = BC7_DDSCAPS_TEXTURE;
+
+	if (p_texture_file->m_num_levels > 1) {
+
+		header.m_flags |= BC7_DDSD_MIPMAPCOUNT;
+		header.m_caps |= BC7_DDSCAPS_COMPLEX | BC7_DDSCAPS_MIPMAP;
+	}
+
+	header.m_dxgi_format = srgb ? BC7_DXGI_FORMAT_BC7_UNORM_SRGB : BC7_DXGI_FORMAT_BC7_UNORM;
+	header.m_resource_dimension = BC7_D3D10_RESOURCE_DIMENSION_2D;
+	header.m_array_size = 1;
+
+	uint64_t offset = sizeof(header);
+	for (uint32_t level_iter = 0; level_iter < p_texture_file->m_num_levels; level_iter++) {
+
+		p_texture_file->m_level_offsets[ level_iter ] = offset;
+		offset += bc7_texture_file_get_level_size(p_texture_file->m_width, p_texture_file->m_height, level_iter);
+
+	} // end for
+
+	return (fwrite(&header, sizeof(header), 1, p_texture_file->m_p_file) == 1);
+}
+
+// Write the header, the level index and the data format descriptor of a KTX2 and work out where the
+// levels go. They follow the data format descriptor from the smallest to the biggest, each one
+// starting on a multiple of the block size.
+//
+// p_texture_file:	(input/output) The texture file.
+// srgb:					True if the colors are sRGB.
+//
+// returns: True if successful.
+//
+static bool bc7_texture_file_write_ktx2_header(bc7_texture_file* p_texture_file, bool srgb)
+{
+	uint32_t const num_levels = p_texture_file->m_num_levels;
+	uint32_t const dfd_offset = static_cast< uint32_t >(sizeof(bc7_ktx2_header) + num_levels * sizeof(bc7_ktx2_level));
+
+	bc7_ktx2_header header;
+	memset(&header, 0, sizeof(header));
+
+	memcpy(header.m_identifier, Ktx2_identifier, sizeof(header.m_identifier));
+	header.m_vk_format = srgb ? BC7_VK_FORMAT_BC7_SRGB_BLOCK : BC7_VK_FORMAT_BC7_UNORM_BLOCK;
+	header.m_type_size = 1;
+	header.m_pixel_width = static_cast< uint32_t >(p_texture_file->m_width);
+	header.m_pixel_height = static_cast< uint32_t >(p_texture_file->m_height);
+	header.m_face_count = 1;
+	header.m_level_count = num_levels;
+	header.m_dfd_byte_offset = dfd_offset;
+	header.m_dfd_byte_length = BC7_KHR_DF_NUM_WORDS * sizeof(uint32_t);
+
+	// The basic data format descriptor of BC7: 4x4 blocks of 16 bytes with a single 128-bit sample.
+	uint32_t const transfer_function = srgb ? BC7_KHR_DF_TRANSFER_SRGB : BC7_KHR_DF_TRANSFER_LINEAR;
+	uint32_t const dfd[ BC7_KHR_DF_NUM_WORDS ] = {
+
+		BC7_KHR_DF_NUM_WORDS * sizeof(uint32_t),
+		0,
+		BC7_KHR_DF_VERSION | ((BC7_KHR_DF_NUM_WORDS - 1) * sizeof(uint32_t) << 16),
+		BC7_KHR_DF_MODEL_BC7 | (BC7_KHR_DF_PRIMARIES_BT709 << 8) | (transfer_function << 16),
+		3 | (3 << 8),
+		sizeof(bc7_compressed_block),
+		0,
+		(127 << 16),
+		0,
+		0,
+		0xffffffff
+	};
+
+	// The smallest level goes first.
+	bc7_ktx2_level levels[ BC7_MIP_MAX_LEVELS ];
+	uint64_t offset = dfd_offset + sizeof(dfd);
+	for (uint32_t level_iter = num_levels; level_iter-- > 0; ) {
+
+		offset = (offset + BC7_KTX2_LEVEL_ALIGNMENT - 1) & ~static_cast< uint64_t >(BC7_KTX2_LEVEL_ALIGNMENT - 1);
+
+		bc7_ktx2_level& level = levels[ level_iter ];
+		level.m_byte_offset = offset;
+		level.m_byte_length = bc7_texture_file_get_level_size(p_texture_file->m_width, p_texture_file->m_height, level_iter);
+		level.m_uncompressed_byte_length = level.m_byte_length;
+
+		p_texture_file->m_level_offsets[ level_iter ] = offset;
+		offset += level.m_byte_length;
+
+	} // end for
+
+	return (fwrite(&header, sizeof(header), 1, p_texture_file->m_p_file) == 1)
+		 && (fwrite(levels, num_levels * sizeof(bc7_ktx2_level), 1, p_texture_file->m_p_file) == 1)
+		 && (fwrite(dfd, sizeof(dfd), 1, p_texture_file->m_p_file) == 1);
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Find the file format from the extension of a filename, ".dds" or ".ktx2".
+//
+// p_format:		(output) The file format.
+// p_filename:	The filename.
+//
+// returns: True if the extension is one of the formats.
+//
+bool bc7_find_texture_file_format(bc7_texture_file_format* p_format, char const* p_filename)
+{
+	char const* p_extension = strrchr(p_filename, '.');
+	if (p_extension == NULL) {
+
+		return false;
+	}
+
+	for (uint32_t format_iter = 0; format_iter < BC7_TEXTURE_FILE_FORMAT_COUNT; format_iter++) {
+
+		if (_stricmp(p_extension, Format_extensions[ format_iter ]) == 0) {
+
+			*p_format = static_cast< bc7_texture_file_format >(format_iter);
+			return true;
+		}
+
+	} // end for
+
+	return false;
+}
+
+// Create a texture file and write its header and level index.
+//
+// p_texture_file:	(output) The texture file.
+// p_filename:			The name of the file.
+// format:				The file format.
+// width:				The width of the biggest level in pixels.
+// height:				The height of the biggest level in pixels.
+// num_levels:			The number of levels, 1 for just the biggest level.
+// srgb:					True if the colors are sRGB.
+//
+// returns: True if successful.
+//
+bool bc7_texture_file_open(bc7_texture_file* p_texture_file, char const* p_filename, bc7_texture_file_format format,
+									size_t width, size_t height, uint32_t num_levels, bool srgb)
+{
+	p_texture_file->m_p_file = NULL;
+
+	if ((width == 0)
+	||  (height == 0)
+	||  (static_cast< uint64_t >(width) > UINT32_MAX)
+	||  (static_cast< uint64_t >(height) > UINT32_MAX)) {
+
+		printf("The texture file \"%s\" can't be %llu x %llu!\n", p_filename, static_cast< unsigned long long >(width),
+				 static_cast< unsigned long long >(height));
+		return false;
+	}
+
+	if ((num_levels == 0)
+	||  (num_levels > bc7_get_num_mip_levels(width, height))) {
+
+		printf("The texture file \"%s\" can't have %u levels!\n", p_filename, num_levels);
+		return false;
+	}
+
+	errno_t result = fopen_s(&p_texture_file->m_p_file, p_filename, "wb");
+	if (result != 0) {
+
+		printf("Failed to open \"%s\"!\n", p_filename);
+
+		p_texture_file->m_p_file = NULL;
+		return false;
+	}
+
+	p_texture_file->m_format = format;
+	p_texture_file->m_width = width;
+	p_texture_file->m_height = height;
+	p_texture_file->m_num_levels = num_levels;
+	p_texture_file->m_written_levels = 0;
+
+	bool const written = (format == BC7_TEXTURE_FILE_FORMAT_DDS) ? bc7_texture_file_write_dds_header(p_texture_file, srgb) :
+																					   bc7_texture_file_write_ktx2_header(p_texture_file, srgb);
+	if (written == false) {
+
+		printf("Failed to write the header of \"%s\"!\n", p_filename);
+
+		fclose(p_texture_file->m_p_file);
+		p_texture_file->m_p_file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// Write the compressed blocks of a level. The levels can be written in any order, each one goes
+// straight to its place in the file.
+//
+// p_texture_file:	(input/output) The texture file.
+// level:				The level, 0 is the biggest.
+// p_blocks:			The compressed blocks a row at a time.
+// num_blocks:			The number of blocks, this has to match the size of the level.
+//
+// returns: True if successful.
+//
+bool bc7_texture_file_write_level(bc7_texture_file* p_texture_file, uint32_t level,
+											 bc7_compressed_block const* p_blocks, size_t num_blocks)
+{
+	if (level >= p_texture_file->m_num_levels) {
+
+		printf("The texture file only has %u levels!\n", p_texture_file->m_num_levels);
+		return false;
+	}
+
+	uint64_t const level_size = bc7_texture_file_get_level_size(p_texture_file->m_width, p_texture_file->m_height, level);
+	if (static_cast< uint64_t >(num_blocks) * sizeof(bc7_compressed_block) != level_size) {
+
+		printf("Level %u of the texture file has the wrong number of blocks!\n", level);
+		return false;
+	}
+
+	// Levels that are written in order don't have to seek, a seek flushes what's buffered.
+	int64_t const level_offset = static_cast< int64_t >(p_texture_file->m_level_offsets[ level ]);
+	if (((_ftelli64(p_texture_file->m_p_file) != level_offset)
+	&&   (_fseeki64(p_texture_file->m_p_file, level_offset, SEEK_SET) != 0))
+	||  (fwrite(p_blocks, static_cast< size_t >(level_size), 1, p_texture_file->m_p_file) != 1)) {
+
+		printf("Failed to write level %u of the texture file!\n", level);
+		return false;
+	}
+
+	p_texture_file->m_written_levels |= (static_cast< uint64_t >(1) << level);
+	return true;
+}
+
+// Close a texture file.
+//
+// p_texture_file:	(input/output) The texture file.
+//
+// returns: True if every level was written and the file was closed without an error.
+//
+bool bc7_texture_file_close(bc7_texture_file* p_texture_file)
+{
+	if (p_texture_file->m_p_file == NULL) {
+
+		return false;
+	}
+
+	bool succeeded = (fclose(p_texture_file->m_p_file) == 0);
+	p_texture_file->m_p_file = NULL;
+
+	uint64_t const all_levels = (static_cast< uint64_t >(1) << p_texture_file->m_num_levels) - 1;
+	if (p_texture_file->m_written_levels != all_levels) {
+
+		printf("Not every level of the texture file was written!\n");
+		succeeded = false;
+	}
+
+	return succeeded;
+}
@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_TEXTURE_FILE_H
+#define __BC7_TEXTURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bc7_compressed_block.h"
+#include "bc7_mip.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+// The file formats the compressed blocks can be written in.
+enum bc7_texture_file_format {
+
+	// A DDS with the DX10 header, the format is DXGI_FORMAT_BC7_UNORM or DXGI_FORMAT_BC7_UNORM_SRGB.
+	BC7_TEXTURE_FILE_FORMAT_DDS = 0,
+
+	// A KTX2, the format is VK_FORMAT_BC7_UNORM_BLOCK or VK_FORMAT_BC7_SRGB_BLOCK.
+	BC7_TEXTURE_FILE_FORMAT_KTX2,
+
+	BC7_TEXTURE_FILE_FORMAT_COUNT
+};
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// A DDS or KTX2 that the levels of a mip chain are written to as soon as they're compressed. The
+// sizes of all the levels are known up front so the header and the level index are written when
+// the file is opened and each level goes straight to its place in the file.
+struct bc7_texture_file {
+
+	FILE* m_p_file;
+	bc7_texture_file_format m_format;
+
+	// The size of the biggest level in pixels and the number of levels.
+	size_t m_width;
+	size_t m_height;
+	uint32_t m_num_levels;
+
+	// Where the blocks of each level go in the file.
+	uint64_t m_level_offsets[ BC7_MIP_MAX_LEVELS ];
+
+	// The levels that have been written, a bit per level.
+	uint64_t m_written_levels;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Find the file format from the extension of a filename, ".dds" or ".ktx2".
+//
+// p_format:		(output) The file format.
+// p_filename:	The filename.
+//
+// returns: True if the extension is one of the formats.
+//
+bool bc7_find_texture_file_format(bc7_texture_file_format* p_format, char const* p_filename);
+
+// Create a texture file and write its header and level index.
+//
+// p_texture_file:	(output) The texture file.
+// p_filename:			The name of the file.
+// format:				The file format.
+// width:				The width of the biggest level in pixels.
+// height:				The height of the biggest level in pixels.
+// num_levels:			The number of levels, 1 for just the biggest level.
+// srgb:					True if the colors are sRGB.
+//
+// returns: True if successful.
+//
+bool bc7_texture_file_open(bc7_texture_file* p_texture_file, char const* p_filename, bc7_texture_file_format format,
+									size_t width, size_t height, uint32_t num_levels, bool srgb);
+
+// Write the compressed blocks of a level. The levels can be written in any order, each one goes
+// straight to its place in the file.
+//
+// p_texture_file:	(input/output) The texture file.
+// level:				The level, 0 is the biggest.
+// p_blocks:			The compressed blocks a row at a time.
+// num_blocks:			The number of blocks, this has to match the size of the level.
+//
+// returns: True if successful.
+//
+bool bc7_texture_file_write_level(bc7_texture_file* p_texture_file, uint32_t level,
+											 bc7_compressed_block const* p_blocks, size_t num_blocks);
+
+// Close a texture file.
+//
+// p_texture_file:	(input/output) The texture file.
+//
+// returns: True if every level was written and the file was closed without an error.
+//
+bool bc7_texture_file_close(bc7_texture_file* p_texture_file);
+
+#endif // __BC7_TEXTURE_FILE_H
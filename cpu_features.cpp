@@ -0,0 +1,247 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_features.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+
+	#define CPU_FEATURES_X86
+
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif // #if defined(_MSC_VER)
+
+#endif // #if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// cpuid leaf 1, ecx.
+#define CPUID_1_ECX_SSE41		(1 << 19)
+#define CPUID_1_ECX_FMA			(1 << 12)
+#define CPUID_1_ECX_OSXSAVE	(1 << 27)
+#define CPUID_1_ECX_AVX			(1 << 28)
+
+// cpuid leaf 1, edx.
+#define CPUID_1_EDX_SSE2		(1 << 26)
+
+// cpuid leaf 7, ebx.
+#define CPUID_7_EBX_AVX2		(1 << 5)
+#define CPUID_7_EBX_AVX512F	(1 << 16)
+#define CPUID_7_EBX_AVX512BW	(1 << 30)
+
+// The register state the OS has to save for AVX (XMM, YMM) and AVX-512 (XMM, YMM, opmask, ZMM).
+#define XCR0_AVX_STATE			0x06
+#define XCR0_AVX512_STATE		0xe6
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+// The names of the instruction sets.
+static char const* const Instruction_set_names[ CPU_INSTRUCTION_SET_COUNT ] = {
+
+	"scalar",
+	"sse2",
+	"sse4.1",
+	"avx2",
+	"avx512"
+};
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+#if defined(CPU_FEATURES_X86)
+
+// Run cpuid.
+//
+// registers:	(output) eax, ebx, ecx and edx.
+// leaf:			The leaf (eax).
+// sub_leaf:	The sub leaf (ecx).
+//
+static void cpu_cpuid(uint32_t registers[4], uint32_t leaf, uint32_t sub_leaf)
+{
+#if defined(_MSC_VER)
+
+	int values[4];
+	__cpuidex(values, static_cast< int >(leaf), static_cast< int >(sub_leaf));
+
+	for (uint32_t register_iter = 0; register_iter < 4; register_iter++) {
+
+		registers[ register_iter ] = static_cast< uint32_t >(values[ register_iter ]);
+	}
+
+#else
+
+	__cpuid_count(leaf, sub_leaf, registers[0], registers[1], registers[2], registers[3]);
+
+#endif // #if defined(_MSC_VER)
+}
+
+// Read the extended control register that tells which register state the OS saves.
+//
+// returns: The low 32 bits of XCR0.
+//
+static uint32_t cpu_get_xcr0()
+{
+#if defined(_MSC_VER)
+
+	return static_cast< uint32_t >(_xgetbv(0));
+
+#else
+
+	uint32_t eax;
+	uint32_t edx;
+	__asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+
+	return eax;
+
+#endif // #if defined(_MSC_VER)
+}
+
+#endif // #if defined(CPU_FEATURES_X86)
+
+// Ask the CPU which instruction sets it supports.
+//
+// returns: The best supported instruction set.
+//
+static cpu_instruction_set cpu_detect_instruction_set()
+{
+#if defined(CPU_FEATURES_X86)
+
+	uint32_t registers[4];
+	cpu_cpuid(registers, 0, 0);
+
+	uint32_t const max_leaf = registers[0];
+	if (max_leaf < 1) {
+
+		return CPU_INSTRUCTION_SET_SCALAR;
+	}
+
+	cpu_cpuid(registers, 1, 0);
+	uint32_t const leaf_1_ecx = registers[2];
+	uint32_t const leaf_1_edx = registers[3];
+
+	if ((leaf_1_edx & CPUID_1_EDX_SSE2) == 0) {
+
+		return CPU_INSTRUCTION_SET_SCALAR;
+	}
+
+	if ((leaf_1_ecx & CPUID_1_ECX_SSE41) == 0) {
+
+		return CPU_INSTRUCTION_SET_SSE2;
+	}
+
+	// AVX needs the OS to save the YMM registers on a context switch.
+	uint32_t const avx_bits = CPUID_1_ECX_OSXSAVE | CPUID_1_ECX_AVX | CPUID_1_ECX_FMA;
+	if (((leaf_1_ecx & avx_bits) != avx_bits)
+	||  (max_leaf < 7)) {
+
+		return CPU_INSTRUCTION_SET_SSE41;
+	}
+
+	uint32_t const xcr0 = cpu_get_xcr0();
+	if ((xcr0 & XCR0_AVX_STATE) != XCR0_AVX_STATE) {
+
+		return CPU_INSTRUCTION_SET_SSE41;
+	}
+
+	cpu_cpuid(registers, 7, 0);
+	uint32_t const leaf_7_ebx = registers[1];
+
+	if ((leaf_7_ebx & CPUID_7_EBX_AVX2) == 0) {
+
+		return CPU_INSTRUCTION_SET_SSE41;
+	}
+
+	// AVX-512 also needs the OS to save the ZMM and opmask registers.
+	uint32_t const avx512_bits = CPUID_7_EBX_AVX512F | CPUID_7_EBX_AVX512BW;
+	if (((leaf_7_ebx & avx512_bits) != avx512_bits)
+	||  ((xcr0 & XCR0_AVX512_STATE) != XCR0_AVX512_STATE)) {
+
+		return CPU_INSTRUCTION_SET_AVX2;
+	}
+
+	return CPU_INSTRUCTION_SET_AVX512;
+
+#else
+
+	return CPU_INSTRUCTION_SET_SCALAR;
+
+#endif // #if defined(CPU_FEATURES_X86)
+}
+
+// Pick the instruction set, taking the BC7_INSTRUCTION_SET environment variable in to account.
+//
+// returns: The instruction set to use.
+//
+static cpu_instruction_set cpu_choose_instruction_set()
+{
+	cpu_instruction_set instruction_set = cpu_detect_instruction_set();
+
+	char const* p_limit = getenv("BC7_INSTRUCTION_SET");
+	if (p_limit != NULL) {
+
+		for (uint32_t set_iter = 0; set_iter < CPU_INSTRUCTION_SET_COUNT; set_iter++) {
+
+			if ((strcmp(p_limit, Instruction_set_names[ set_iter ]) == 0)
+			&&  (set_iter < static_cast< uint32_t >(instruction_set))) {
+
+				instruction_set = static_cast< cpu_instruction_set >(set_iter);
+				break;
+			}
+
+		} // end for
+	}
+
+	return instruction_set;
+}
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Get the best instruction set the CPU and OS support.
+//
+// returns: The best supported instruction set.
+//
+cpu_instruction_set cpu_get_instruction_set()
+{
+	static cpu_instruction_set const instruction_set = cpu_choose_instruction_set();
+
+	return instruction_set;
+}
+
+// Get the name of an instruction set.
+//
+// instruction_set:	The instruction set.
+//
+// returns: The name.
+//
+char const* cpu_get_instruction_set_name(cpu_instruction_set instruction_set)
+{
+	if (instruction_set >= CPU_INSTRUCTION_SET_COUNT) {
+
+		return "unknown";
+	}
+
+	return Instruction_set_names[ instruction_set ];
+}
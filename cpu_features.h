@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __CPU_FEATURES_H
+#define __CPU_FEATURES_H
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// Put in front of a function that uses a wider instruction set than the rest of the file is built
+// for, it's only called once cpu_get_instruction_set() says the CPU has it. Visual Studio lets any
+// function use any instruction set, GCC has to be told which functions use the wider ones.
+#if defined(__GNUC__)
+	#define CPU_TARGET(instruction_sets) __attribute__((target(instruction_sets)))
+#else
+	#define CPU_TARGET(instruction_sets)
+#endif // #if defined(__GNUC__)
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+// The instruction sets that there are versions of the CPU code for. Each one
+// includes the ones before it.
+enum cpu_instruction_set {
+
+	CPU_INSTRUCTION_SET_SCALAR = 0,
+	CPU_INSTRUCTION_SET_SSE2,
+	CPU_INSTRUCTION_SET_SSE41,
+
+	// AVX2 and FMA.
+	CPU_INSTRUCTION_SET_AVX2,
+
+	// AVX-512 F and BW.
+	CPU_INSTRUCTION_SET_AVX512,
+
+	CPU_INSTRUCTION_SET_COUNT
+};
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Get the best instruction set the CPU and OS support. This uses cpuid the first time it is
+// called. Setting the BC7_INSTRUCTION_SET environment variable to one of the names below
+// limits it to that instruction set.
+//
+// returns: The best supported instruction set.
+//
+cpu_instruction_set cpu_get_instruction_set();
+
+// Get the name of an instruction set ("scalar", "sse2", "sse4.1", "avx2" or "avx512").
+//
+// instruction_set:	The instruction set.
+//
+// returns: The name.
+//
+char const* cpu_get_instruction_set_name(cpu_instruction_set instruction_set);
+
+#endif // __CPU_FEATURES_H
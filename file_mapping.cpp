@@ -0,0 +1,319 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/file.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif // #if defined(_WIN32)
+
+#include "file_mapping.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The byte of a shared file that is locked while it's sized. It's past the end of any file that is
+// mapped so locking it doesn't keep other processes from reading the start of the file on Windows.
+#define FILE_MAPPING_LOCK_OFFSET	0x7fffffff00000000ULL
+
+// --------------------
+//
+// Enumerated Types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+
+// --------------------
+//
+// Global Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Local Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+
+// --------------------
+//
+// External Functions
+//
+// --------------------
+
+// Map a file in to memory to read. All of the file is expected to be read so the OS is told to
+// start reading it in straight away.
+//
+// p_mapping:	(output) The mapping.
+// p_filename:	The name of the file.
+//
+// returns: True if the file is mapped.
+//
+bool file_mapping_open_read(file_mapping* p_mapping, char const* p_filename)
+{
+	memset(p_mapping, 0, sizeof(*p_mapping));
+
+#if defined(_WIN32)
+
+	HANDLE file = CreateFileA(p_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+									  FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+
+		printf("Failed to open \"%s\"!\n", p_filename);
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if ((!GetFileSizeEx(file, &file_size))
+	||  (file_size.QuadPart == 0)
+	||  (static_cast< uint64_t >(file_size.QuadPart) != static_cast< size_t >(file_size.QuadPart))) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		CloseHandle(file);
+		return false;
+	}
+
+	p_mapping->m_p_data = reinterpret_cast< uint8_t* >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (p_mapping->m_p_data == NULL) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	p_mapping->m_size = static_cast< size_t >(file_size.QuadPart);
+	p_mapping->m_file = reinterpret_cast< intptr_t >(file);
+	p_mapping->m_mapping = reinterpret_cast< intptr_t >(mapping);
+
+#else
+
+	int file = open(p_filename, O_RDONLY);
+	if (file < 0) {
+
+		printf("Failed to open \"%s\"!\n", p_filename);
+		return false;
+	}
+
+	struct stat file_status;
+	if ((fstat(file, &file_status) != 0)
+	||  (file_status.st_size == 0)) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		close(file);
+		return false;
+	}
+
+	void* p_data = mmap(NULL, static_cast< size_t >(file_status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	if (p_data == MAP_FAILED) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		close(file);
+		return false;
+	}
+
+	madvise(p_data, static_cast< size_t >(file_status.st_size), MADV_WILLNEED);
+
+	p_mapping->m_p_data = reinterpret_cast< uint8_t* >(p_data);
+	p_mapping->m_size = static_cast< size_t >(file_status.st_size);
+	p_mapping->m_file = file;
+	p_mapping->m_mapping = 0;
+
+#endif // #if defined(_WIN32)
+
+	return true;
+}
+
+// Map a file in to memory to read and write, changes are seen by every process that has it mapped.
+// The file is created if it doesn't exist. An empty file is made new_size bytes under a lock, so
+// processes that open it at the same time see it either empty or with its whole size, never one
+// that is still being resized.
+//
+// p_mapping:	(output) The mapping, its size is the size of the file.
+// p_filename:	The name of the file.
+// new_size:	The size of the file if it's empty.
+//
+// returns: True if the file is mapped.
+//
+bool file_mapping_open_shared(file_mapping* p_mapping, char const* p_filename, size_t new_size)
+{
+	memset(p_mapping, 0, sizeof(*p_mapping));
+
+#if defined(_WIN32)
+
+	HANDLE file = CreateFileA(p_filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+									  NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+
+		printf("Failed to open \"%s\"!\n", p_filename);
+		return false;
+	}
+
+	OVERLAPPED lock_overlapped = {};
+	lock_overlapped.Offset = static_cast< DWORD >(FILE_MAPPING_LOCK_OFFSET);
+	lock_overlapped.OffsetHigh = static_cast< DWORD >(FILE_MAPPING_LOCK_OFFSET >> 32);
+	if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &lock_overlapped)) {
+
+		printf("Failed to lock \"%s\"!\n", p_filename);
+		CloseHandle(file);
+		return false;
+	}
+
+	// Closing the file drops the lock.
+	LARGE_INTEGER file_size;
+	if ((!GetFileSizeEx(file, &file_size))
+	||  (static_cast< uint64_t >(file_size.QuadPart) != static_cast< size_t >(file_size.QuadPart))) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		CloseHandle(file);
+		return false;
+	}
+
+	size_t const size = (file_size.QuadPart != 0) ? static_cast< size_t >(file_size.QuadPart) : new_size;
+
+	// The mapping makes the file as big as it is if it was empty.
+	uint64_t const mapping_size = size;
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, static_cast< DWORD >(mapping_size >> 32),
+												  static_cast< DWORD >(mapping_size), NULL);
+	UnlockFileEx(file, 0, 1, 0, &lock_overlapped);
+	if (mapping == NULL) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		CloseHandle(file);
+		return false;
+	}
+
+	p_mapping->m_p_data = reinterpret_cast< uint8_t* >(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if (p_mapping->m_p_data == NULL) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	p_mapping->m_size = size;
+	p_mapping->m_file = reinterpret_cast< intptr_t >(file);
+	p_mapping->m_mapping = reinterpret_cast< intptr_t >(mapping);
+
+#else
+
+	int file = open(p_filename, O_RDWR | O_CREAT, 0666);
+	if (file < 0) {
+
+		printf("Failed to open \"%s\"!\n", p_filename);
+		return false;
+	}
+
+	if (flock(file, LOCK_EX) != 0) {
+
+		printf("Failed to lock \"%s\"!\n", p_filename);
+		close(file);
+		return false;
+	}
+
+	// Closing the file drops the lock.
+	struct stat file_status;
+	if (fstat(file, &file_status) != 0) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		close(file);
+		return false;
+	}
+
+	size_t size = static_cast< size_t >(file_status.st_size);
+	if (size == 0) {
+
+		size = new_size;
+		if (ftruncate(file, size) != 0) {
+
+			printf("Failed to resize \"%s\"!\n", p_filename);
+			close(file);
+			return false;
+		}
+	}
+
+	flock(file, LOCK_UN);
+
+	void* p_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (p_data == MAP_FAILED) {
+
+		printf("Failed to map \"%s\"!\n", p_filename);
+		close(file);
+		return false;
+	}
+
+	p_mapping->m_p_data = reinterpret_cast< uint8_t* >(p_data);
+	p_mapping->m_size = size;
+	p_mapping->m_file = file;
+	p_mapping->m_mapping = 0;
+
+#endif // #if defined(_WIN32)
+
+	return true;
+}
+
+// Unmap a file and close it.
+//
+// p_mapping:	(input/output) The mapping, nothing is done if it isn't mapped.
+//
+void file_mapping_close(file_mapping* p_mapping)
+{
+	if (p_mapping->m_p_data == NULL) {
+
+		return;
+	}
+
+#if defined(_WIN32)
+
+	UnmapViewOfFile(p_mapping->m_p_data);
+	CloseHandle(reinterpret_cast< HANDLE >(p_mapping->m_mapping));
+	CloseHandle(reinterpret_cast< HANDLE >(p_mapping->m_file));
+
+#else
+
+	munmap(p_mapping->m_p_data, p_mapping->m_size);
+	close(static_cast< int >(p_mapping->m_file));
+
+#endif // #if defined(_WIN32)
+
+	p_mapping->m_p_data = NULL;
+	p_mapping->m_size = 0;
+}
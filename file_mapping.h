@@ -0,0 +1,88 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __FILE_MAPPING_H
+#define __FILE_MAPPING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+
+// --------------------
+//
+// Enumerated types
+//
+// --------------------
+
+
+// --------------------
+//
+// Structures/Classes
+//
+// --------------------
+
+// A file that is mapped in to memory, with mmap() or with CreateFileMapping() on Windows.
+struct file_mapping {
+
+	// The mapped file.
+	uint8_t* m_p_data;
+	size_t m_size;
+
+	// The handles of the file and the mapping, the mapping is only used on Windows.
+	intptr_t m_file;
+	intptr_t m_mapping;
+};
+
+// --------------------
+//
+// Variables
+//
+// --------------------
+
+
+// --------------------
+//
+// Prototypes
+//
+// --------------------
+
+// Map a file in to memory to read. All of the file is expected to be read so the OS is told to
+// start reading it in straight away.
+//
+// p_mapping:	(output) The mapping.
+// p_filename:	The name of the file.
+//
+// returns: True if the file is mapped.
+//
+bool file_mapping_open_read(file_mapping* p_mapping, char const* p_filename);
+
+// Map a file in to memory to read and write, changes are seen by every process that has it mapped.
+// The file is created if it doesn't exist. An empty file is made new_size bytes under a lock, so
+// processes that open it at the same time see it either empty or with its whole size, never one
+// that is still being resized.
+//
+// p_mapping:	(output) The mapping, its size is the size of the file.
+// p_filename:	The name of the file.
+// new_size:	The size of the file if it's empty.
+//
+// returns: True if the file is mapped.
+//
+bool file_mapping_open_shared(file_mapping* p_mapping, char const* p_filename, size_t new_size);
+
+// Unmap a file and close it.
+//
+// p_mapping:	(input/output) The mapping, nothing is done if it isn't mapped.
+//
+void file_mapping_close(file_mapping* p_mapping);
+
+#endif // __FILE_MAPPING_H
@@ -5,10 +5,20 @@
 
 #include "stdafx.h"
 
+#include <limits.h>
 #include <math.h>
+#include <stdlib.h>
 
+#include "bc7_block_cache.h"
+#include "bc7_block_dedup.h"
 #include "bc7_compressed_block.h"
 #include "bc7_decompress.h"
+#include "bc7_encode_params.h"
+#include "bc7_encoder_context.h"
+#include "bc7_mip.h"
+#include "bc7_stream.h"
+#include "bc7_texture_file.h"
+#include "CPU/bc7_cpu.h"
 #include "CUDA/bc7_cuda.h"
 #include "OpenCL/bc7_opencl.h"
 #include "scoped_timer.h"
@@ -16,77 +26,399 @@
 
 // Compare the original TGA with the one that was compressed with BC7.
 //
-// p_original:				Original TGA image.
-// p_bc7_image:			The uncompressed image.
-// num_pixels:				Number of pixels in the images.
-// original_has_alpha:	Whether or not the original has an alpha channel.
+// p_original:		Original TGA image.
+// p_bc7_image:	The uncompressed image.
 //
-static void bc7_compare_images(uint8_t const* p_original, uint8_t const* p_bc7_image, 
-										 size_t num_pixels, bool original_has_alpha)
+static void bc7_compare_images(bc7_source const* p_original, uint8_t const* p_bc7_image)
 {
 	uint64_t absolute_error = 0;
 
 	// Mean-squared error.
 	double mse = 0.0;	
 
-	for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+	// The original is turned in to RGBA a row at a time.
+	size_t const width = p_original->m_width;
+	size_t const height = p_original->m_height;
+	uint8_t* p_row = reinterpret_cast< uint8_t* >(malloc(4 * width));
 
-		// TGAs are BGRA.
-		uint8_t const original_blue	= *p_original++;		
-		uint8_t const original_green	= *p_original++;
-		uint8_t const original_red		= *p_original++;		
+	for (size_t y = 0; y < height; y++) {
 
-		uint8_t original_alpha = 255;
-		if (original_has_alpha == true) {
+		bc7_source_get_row(p_row, p_original, y);
 
-			original_alpha = *p_original++;
-		}
+		uint8_t const* p_original_pixel = p_row;
+		for (size_t x = 0; x < width; x++) {
+
+			uint8_t const original_red		= *p_original_pixel++;
+			uint8_t const original_green	= *p_original_pixel++;
+			uint8_t const original_blue	= *p_original_pixel++;
+			uint8_t const original_alpha	= *p_original_pixel++;
+
+			uint8_t const bc7_red	= *p_bc7_image++;
+			uint8_t const bc7_green = *p_bc7_image++;
+			uint8_t const bc7_blue	= *p_bc7_image++;
+			uint8_t const bc7_alpha = *p_bc7_image++;
 
-		uint8_t const bc7_red	= *p_bc7_image++;
-		uint8_t const bc7_green = *p_bc7_image++;
-		uint8_t const bc7_blue	= *p_bc7_image++;
-		uint8_t const bc7_alpha = *p_bc7_image++;
+			int32_t diff_red		= original_red - bc7_red;
+			int32_t diff_green	= original_green - bc7_green;
+			int32_t diff_blue		= original_blue - bc7_blue;
+			int32_t diff_alpha	= original_alpha - bc7_alpha;
 
-		int32_t diff_red		= original_red - bc7_red;
-		int32_t diff_green	= original_green - bc7_green;
-		int32_t diff_blue		= original_blue - bc7_blue;
-		int32_t diff_alpha	= original_alpha - bc7_alpha;
+			diff_red		= (diff_red < 0) ? -diff_red : diff_red;
+			diff_green	= (diff_green < 0) ? -diff_green : diff_green;
+			diff_blue	= (diff_blue < 0) ? -diff_blue : diff_blue;
+			diff_alpha	= (diff_alpha < 0) ? -diff_alpha : diff_alpha;
 
-		diff_red		= (diff_red < 0) ? -diff_red : diff_red;
-		diff_green	= (diff_green < 0) ? -diff_green : diff_green;
-		diff_blue	= (diff_blue < 0) ? -diff_blue : diff_blue;
-		diff_alpha	= (diff_alpha < 0) ? -diff_alpha : diff_alpha;
+			absolute_error += diff_red + diff_green + diff_blue + diff_alpha;
 
-		absolute_error += diff_red + diff_green + diff_blue + diff_alpha;
+			mse += diff_red * diff_red + diff_green * diff_green + 
+					 diff_blue * diff_blue + diff_alpha * diff_alpha;
 
-		mse += diff_red * diff_red + diff_green * diff_green + 
-				 diff_blue * diff_blue + diff_alpha * diff_alpha;
+		} // end for
 
 	} // end for
 
-	printf("RGBA absolute error: %I64u\n", absolute_error);
+	free(p_row);
 
-	mse = mse / (4.0 * num_pixels);
+	printf("RGBA absolute error: %llu\n", static_cast< unsigned long long >(absolute_error));
+
+	mse = mse / (4.0 * width * height);
 	printf("RGBA mean-squared error: %f\n", mse);
 
 	double rmse = sqrt(mse);
 	printf("RGBA root-mean-squared error: %f\n", rmse);
 }
 
+// What the level function of a mip chain keeps track of.
+struct bc7_mip_chain_output {
+
+	// The compressed blocks of the biggest level are copied here so it can be compared.
+	bc7_compressed_block* m_p_compressed;
+
+	// The number of blocks in all of the levels.
+	size_t m_num_blocks;
+
+	// The DDS or KTX2 each level is written to as soon as it's compressed, or NULL.
+	bc7_texture_file* m_p_texture_file;
+};
+
+// Called with the compressed blocks of each level of the mip chain.
+//
+// p_user_data:	The bc7_mip_chain_output.
+// level:			The level, 0 is the biggest.
+// width:			The width of the level in pixels.
+// height:			The height of the level in pixels.
+// p_blocks:		The compressed blocks.
+// num_blocks:		The number of blocks.
+//
+// returns: True to carry on with the next level.
+//
+static bool bc7_mip_chain_level(void* p_user_data, uint32_t level, size_t width, size_t height,
+										  bc7_compressed_block const* p_blocks, size_t num_blocks)
+{
+	bc7_mip_chain_output* p_output = static_cast< bc7_mip_chain_output* >(p_user_data);
+
+	printf("Mip level %u: %llu x %llu, %llu blocks\n", level, static_cast< unsigned long long >(width),
+			 static_cast< unsigned long long >(height), static_cast< unsigned long long >(num_blocks));
+
+	if (level == 0) {
+
+		memcpy(p_output->m_p_compressed, p_blocks, num_blocks * sizeof(bc7_compressed_block));
+	}
+
+	p_output->m_num_blocks += num_blocks;
+
+	if (p_output->m_p_texture_file != NULL) {
+
+		return bc7_texture_file_write_level(p_output->m_p_texture_file, level, p_blocks, num_blocks);
+	}
+
+	return true;
+}
+
 int _tmain(int argc, _TCHAR* argv[])
 {
 	scoped_timer::initialize();
 
-	if ((argc != 2) && (argc != 3)) {
+	// Pick out the options, the rest of the arguments are the filenames.
+	bc7_encode_preset preset = BC7_ENCODE_PRESET_NORMAL;
+	bc7_endpoint_optimizer endpoint_optimizer = BC7_ENDPOINT_OPTIMIZER_COUNT;
+	unsigned long error_threshold = 0;
+	char const* p_cache_filename = NULL;
+	char const* p_stream_filename = NULL;
+	unsigned long band_rows = 0;
+	unsigned long dispatch_latency = 0;
+	bool mips = false;
+	bc7_mip_filter mip_filter = BC7_MIP_FILTER_BOX;
+	bool srgb = true;
+	char const* p_texture_filename = NULL;
+	bc7_texture_file_format texture_file_format = BC7_TEXTURE_FILE_FORMAT_DDS;
+	bool rle = false;
+#if defined(__BC7_CPU)
+	bool cpu_report = false;
+#endif
+	char const* p_filenames[2] = { NULL, NULL };
+	int num_filenames = 0;
+	bool valid_arguments = true;
+	for (int arg_iter = 1; arg_iter < argc; arg_iter++) {
+
+		if (strcmp(argv[ arg_iter ], "-preset") == 0) {
+
+			if ((arg_iter + 1 == argc)
+			||  (bc7_find_encode_preset(&preset, argv[ arg_iter + 1 ]) == false)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-optimizer") == 0) {
+
+			if ((arg_iter + 1 == argc)
+			||  (bc7_find_endpoint_optimizer(&endpoint_optimizer, argv[ arg_iter + 1 ]) == false)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-error_threshold") == 0) {
+
+			if (arg_iter + 1 == argc) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			// The search starts with an error of UINT_MAX so the threshold has to be less.
+			char* p_end = NULL;
+			error_threshold = strtoul(argv[ arg_iter + 1 ], &p_end, 10);
+			if ((*p_end != '\0')
+			||  (error_threshold >= UINT_MAX)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-cache") == 0) {
+
+			if (arg_iter + 1 == argc) {
+
+				valid_arguments = false;
+				break;
+			}
 
-		printf("usage: bc7_gpu image.tga [output.tga]");
+			p_cache_filename = argv[ arg_iter + 1 ];
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-stream") == 0) {
+
+			if (arg_iter + 1 == argc) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			p_stream_filename = argv[ arg_iter + 1 ];
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-band_rows") == 0) {
+
+			if (arg_iter + 1 == argc) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			char* p_end = NULL;
+			band_rows = strtoul(argv[ arg_iter + 1 ], &p_end, 10);
+			if ((*p_end != '\0')
+			||  (band_rows > UINT_MAX)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-dispatch_ms") == 0) {
+
+			if (arg_iter + 1 == argc) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			char* p_end = NULL;
+			dispatch_latency = strtoul(argv[ arg_iter + 1 ], &p_end, 10);
+			if ((*p_end != '\0')
+			||  (dispatch_latency == 0)
+			||  (dispatch_latency > UINT_MAX)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-mips") == 0) {
+
+			mips = true;
+
+		} else if (strcmp(argv[ arg_iter ], "-mip_filter") == 0) {
+
+			if ((arg_iter + 1 == argc)
+			||  (bc7_find_mip_filter(&mip_filter, argv[ arg_iter + 1 ]) == false)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-linear") == 0) {
+
+			srgb = false;
+
+		} else if (strcmp(argv[ arg_iter ], "-texture") == 0) {
+
+			if ((arg_iter + 1 == argc)
+			||  (bc7_find_texture_file_format(&texture_file_format, argv[ arg_iter + 1 ]) == false)) {
+
+				valid_arguments = false;
+				break;
+			}
+
+			p_texture_filename = argv[ arg_iter + 1 ];
+			arg_iter++;
+
+		} else if (strcmp(argv[ arg_iter ], "-rle") == 0) {
+
+			rle = true;
+
+#if defined(__BC7_CPU)
+		} else if (strcmp(argv[ arg_iter ], "-cpu_report") == 0) {
+
+			cpu_report = true;
+
+#endif
+		} else if (num_filenames < 2) {
+
+			p_filenames[ num_filenames++ ] = argv[ arg_iter ];
+
+		} else {
+
+			valid_arguments = false;
+			break;
+		}
+
+	} // end for
+
+	if ((valid_arguments == false)
+	||  (num_filenames == 0)) {
+
+		printf("usage: bc7_gpu [-preset ultrafast|fast|normal|slow|exhaustive] [-optimizer gradient_descent|least_squares|both] [-error_threshold error] [-cache blocks.cache] [-stream output.bc7 [-band_rows rows]] [-dispatch_ms milliseconds] [-mips [-mip_filter box|kaiser]] [-linear] [-texture output.dds|output.ktx2] [-rle] [-cpu_report] image.tga [output.tga]");
+		return -1;
+	}
+
+	char const* p_input_filename = p_filenames[0];
+	char const* p_output_filename = p_filenames[1];
+
+	bc7_encode_params params;
+	bc7_get_encode_params(&params, preset);
+
+	// The endpoint optimizer overrides the one the preset uses.
+	if (endpoint_optimizer != BC7_ENDPOINT_OPTIMIZER_COUNT) {
+
+		params.m_endpoint_optimizer = endpoint_optimizer;
+	}
+
+	params.m_error_threshold = static_cast< uint32_t >(error_threshold);
+
+#if defined(__BC7_OPENCL)
+
+	if (dispatch_latency != 0) {
+
+		bc7_opencl_set_dispatch_latency(static_cast< uint32_t >(dispatch_latency));
+	}
+
+#elif defined(__BC7_CPU)
+
+	bc7_cpu_set_report(cpu_report);
+
+#endif
+
+	// The levels of a chain are compressed as they're made, they don't go through the cache.
+	if ((mips == true)
+	&&  ((p_stream_filename != NULL)
+	||   (p_cache_filename != NULL))) {
+
+		printf("Mip chains can't be streamed or cached!\n");
 		return -1;
 	}
 
-	// Load the TGA.
+	if ((p_texture_filename != NULL)
+	&&  (p_stream_filename != NULL)) {
+
+		printf("Streaming doesn't write a DDS or KTX2!\n");
+		return -1;
+	}
+
+	// Only the blocks that aren't in the cache from earlier runs are compressed.
+	bc7_block_cache cache;
+	bc7_block_cache* p_cache = NULL;
+	if (p_cache_filename != NULL) {
+
+		if (bc7_block_cache_open(&cache, p_cache_filename, BC7_BLOCK_CACHE_DEFAULT_SLOTS) == false) {
+
+			return -1;
+		}
+
+		p_cache = &cache;
+	}
+
+	// One encoder context compresses and filters everything, setting it up is the slow part so the
+	// bands, levels and blocks all share it.
+	bc7_encoder_context* p_context = bc7_encoder_context_create();
+	if (p_context == NULL) {
+
+		printf("Failed to create the encoder context!\n");
+		return -1;
+	}
+
+	bc7_compress_function const compress = bc7_encoder_context_compress_source;
+	bc7_downsample_function const downsample = bc7_encoder_context_downsample;
+
+	// Streaming never has the whole image in memory so it can't be compared or written out.
+	if (p_stream_filename != NULL) {
+
+		if (p_output_filename != NULL) {
+
+			printf("The decompressed image can't be written out when streaming!\n");
+			return -1;
+		}
+
+		bool const streamed = bc7_stream_compress(compress, p_context, p_cache, p_input_filename, p_stream_filename,
+																static_cast< uint32_t >(band_rows), &params);
+		bc7_encoder_context_destroy(p_context);
+
+		if (p_cache != NULL) {
+
+			bc7_block_cache_report(p_cache);
+			bc7_block_cache_close(p_cache);
+		}
+
+		return streamed ? 0 : -1;
+	}
+
+	// Map the TGA, its pixels are read straight out of the file.
 	tga_header image_header;
-	uint8_t* p_tga_source = tga_load(image_header, argv[1]);
-	if (p_tga_source == NULL) {
+	tga_mapping mapping;
+	uint8_t const* p_tga_pixels = tga_map(image_header, &mapping, p_input_filename);
+	if (p_tga_pixels == NULL) {
 
 		return -1;
 	}
@@ -107,35 +439,17 @@ int _tmain(int argc, _TCHAR* argv[])
 		return -1;
 	}
 
-	// Allocate and fill in a 32-bit RGBA source buffer.
-	size_t const num_pixels = source_width * source_height;
-	uint8_t* p_source = reinterpret_cast< uint8_t* >(malloc(4 * num_pixels));
-	{
-		size_t dest_index = 0;
-		size_t source_index = 0;
-		for (size_t i = 0; i < num_pixels; i++) {		
-
-			// TGAs are BGR so swap to RGB.
-			p_source[ dest_index ]		= p_tga_source[ source_index + 2 ];
-			p_source[ dest_index + 1 ] = p_tga_source[ source_index + 1 ];
-			p_source[ dest_index + 2 ] = p_tga_source[ source_index ];
+	// The origin says which corner the first pixel in the file is, 0 is the bottom left, 1 the bottom
+	// right, 2 the top left and 3 the top right. The blocks are always compressed from the top left.
+	uint8_t const origin = image_header.get_origin();
+	bc7_source tga_source;
+	bc7_source_init(&tga_source, p_tga_pixels, source_width, source_height, static_cast< size_t >(source_width) * (has_alpha ? 4 : 3),
+						 has_alpha ? BC7_PIXEL_FORMAT_BGRA8 : BC7_PIXEL_FORMAT_BGR8, (origin & 0x2) == 0, (origin & 0x1) != 0);
 
-			if (has_alpha == true) {
-
-				p_source[ dest_index + 3 ] = p_tga_source[ source_index + 3 ];
-
-			} else {
-
-				p_source[ dest_index + 3 ] = 255;
-			}
-
-			source_index += has_alpha ? 4 : 3;
-			dest_index += 4;
-		}
-	}
+	size_t const num_pixels = static_cast< size_t >(source_width) * source_height;
 
 	// Allocate memory for the destination buffer.
-	size_t const num_blocks = image_header.get_width() * image_header.get_height() / 16;
+	size_t const num_blocks = num_pixels / 16;
 	size_t const compressed_size = num_blocks * sizeof(bc7_compressed_block);
 	bc7_compressed_block* p_compressed = reinterpret_cast< bc7_compressed_block* >(malloc(compressed_size));
 	if (p_compressed == NULL) {
@@ -144,27 +458,88 @@ int _tmain(int argc, _TCHAR* argv[])
 		return -1;
 	}
 
-	printf("Compressing '%s' %u x %u...\n", argv[1], source_width, source_height);
+	printf("Compressing '%s' %u x %u with the %s preset and %s...\n", p_input_filename, source_width, source_height,
+			 bc7_get_encode_preset_name(preset),
+			 bc7_get_endpoint_optimizer_name(static_cast< bc7_endpoint_optimizer >(params.m_endpoint_optimizer)));
+
+	// The header and the level index are written before anything is compressed so each level can
+	// go straight to the file.
+	bc7_texture_file texture_file;
+	bc7_texture_file* p_texture_file = NULL;
+	if (p_texture_filename != NULL) {
+
+		uint32_t const num_levels = mips ? bc7_get_num_mip_levels(source_width, source_height) : 1;
+		if (bc7_texture_file_open(&texture_file, p_texture_filename, texture_file_format, source_width, source_height,
+										  num_levels, srgb) == false) {
+
+			return -1;
+		}
+
+		p_texture_file = &texture_file;
+	}
 
 	// Compress the image.
-#if defined(__BC7_OPENCL)
+	double const start_time = scoped_timer::get_time();
+
+	size_t num_compressed_blocks = num_blocks;
+	if (mips == true) {
+
+		bc7_mip_chain_output output;
+		output.m_p_compressed = p_compressed;
+		output.m_num_blocks = 0;
+		output.m_p_texture_file = p_texture_file;
 
-	if (bc7_opencl_compress(p_compressed, p_source, source_width, source_height) == false) {
+		if (bc7_mip_compress_chain(compress, downsample, p_context, &tga_source, mip_filter, srgb,
+											bc7_mip_chain_level, &output, &params) == false) {
+
+			return -1;
+		}
+
+		num_compressed_blocks = output.m_num_blocks;
+
+	} else if (p_cache != NULL) {
+
+		bool const compressed = bc7_block_cache_compress(p_cache, compress, p_context, p_compressed, &tga_source, &params);
+
+		bc7_block_cache_report(p_cache);
+		bc7_block_cache_close(p_cache);
+
+		if (compressed == false) {
+
+			return -1;
+		}
+
+	} else if (bc7_dedup_compress_source(compress, p_context, p_compressed, &tga_source, &params) == false) {
 
 		return -1;
 	}
 
-#elif defined(__BC7_CUDA)
+	bc7_encoder_context_destroy(p_context);
+
+	if (p_texture_file != NULL) {
+
+		// The levels of a chain have already been written.
+		if ((mips == false)
+		&&  (bc7_texture_file_write_level(p_texture_file, 0, p_compressed, num_blocks) == false)) {
+
+			return -1;
+		}
 
-	if (bc7_cuda_compress(p_compressed, p_source, source_width, source_height) == false) {
+		if (bc7_texture_file_close(p_texture_file) == false) {
 
-		return -1;	
+			return -1;
+		}
+
+		printf("Wrote \"%s\"\n", p_texture_filename);
 	}
 
-#endif
+	// Report the throughput so error thresholds can be compared.
+	double const compress_time = scoped_timer::get_time() - start_time;
+	printf("Error threshold %u : %.0f blocks/second\n", params.m_error_threshold,
+			 (compress_time > 0.0) ? (num_compressed_blocks / compress_time) : 0.0);
 
 	// Allocate memory for the decompressed image (it's 32-bits per pixel).
-	size_t const decompressed_size = source_width * source_height * 4;
+	size_t const decompressed_size = num_pixels * 4;
 	uint8_t* p_decompressed = reinterpret_cast< uint8_t* >(malloc(decompressed_size));
 	if (p_decompressed == NULL) {
 
@@ -179,19 +554,23 @@ int _tmain(int argc, _TCHAR* argv[])
 	}
 
 	// Compare the images.	
-	bc7_compare_images(p_tga_source, p_decompressed, source_width * source_height, has_alpha);
+	bc7_compare_images(&tga_source, p_decompressed);
 
 	// Write out the decompressed image.
-	if (argc == 3) {
+	if (p_output_filename != NULL) {
 
-		if (strcmp(argv[1], argv[2]) == 0) {
+		if (strcmp(p_input_filename, p_output_filename) == 0) {
 
 			printf("The input and output filenames are the same!\n");
 			return -1;
 		}
 
+		// The decompressed image is from the top down.
 		image_header.set_bits_per_pixel(32);
-		if (tga_write(image_header, argv[2], p_decompressed, decompressed_size) == false) {
+		image_header.set_origin(2);
+		bool const written = rle ? tga_write_rle(image_header, p_output_filename, p_decompressed, decompressed_size)
+										 : tga_write(image_header, p_output_filename, p_decompressed, decompressed_size);
+		if (written == false) {
 
 			return -1;
 		}
@@ -203,11 +582,8 @@ int _tmain(int argc, _TCHAR* argv[])
 	// Free the compressed data.
 	free(p_compressed);
 
-	// Free the source data.
-	free(p_source);
-
-	// Free the TGA buffer.
-	tga_destroy(&p_tga_source);
+	// Unmap the TGA.
+	tga_unmap(&mapping);
 
 	return 0;
 }
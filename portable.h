@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __PORTABLE_H
+#define __PORTABLE_H
+
+// The code is written against the Visual Studio C runtime. Everywhere else the few secure and 64
+// bit functions it uses are mapped onto the standard ones here, so the same code builds with GCC
+// and Clang.
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+	#include <tchar.h>
+#else
+	#include <errno.h>
+	#include <stdarg.h>
+	#include <strings.h>
+	#include <sys/types.h>
+#endif // #if defined(_WIN32)
+
+#if !defined(_WIN32)
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// Truncate a string that doesn't fit rather than failing.
+#define _TRUNCATE		static_cast< size_t >(-1)
+
+// The entry point takes narrow strings.
+#define _tmain			main
+
+// 64 bit file offsets, off_t is 64 bits with _FILE_OFFSET_BITS=64 or on 64 bit systems.
+#define _fseeki64		fseeko
+#define _ftelli64		ftello
+
+// A case insensitive string compare.
+#define _stricmp		strcasecmp
+
+// --------------------
+//
+// Types
+//
+// --------------------
+
+typedef char _TCHAR;
+typedef int errno_t;
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+// Open a file.
+//
+// pp_file:		(output) The file, NULL if it couldn't be opened.
+// p_filename:	The name of the file.
+// p_mode:		The fopen() mode.
+//
+// returns: 0 if successful, otherwise the error.
+//
+static inline errno_t fopen_s(FILE** pp_file, char const* p_filename, char const* p_mode)
+{
+	*pp_file = fopen(p_filename, p_mode);
+	return (*pp_file != NULL) ? 0 : errno;
+}
+
+// Print to a string. Only _TRUNCATE is supported for the count.
+//
+// p_buffer:		(output) The string.
+// buffer_size:	The size of the buffer.
+// count:			_TRUNCATE.
+// p_format:		The printf() format.
+//
+// returns: The length of the string, or -1 if it was truncated.
+//
+static inline int _snprintf_s(char* p_buffer, size_t buffer_size, size_t count, char const* p_format, ...)
+{
+	(void)count;
+
+	va_list args;
+	va_start(args, p_format);
+	int const length = vsnprintf(p_buffer, buffer_size, p_format, args);
+	va_end(args);
+
+	return ((length < 0) || (static_cast< size_t >(length) >= buffer_size)) ? -1 : length;
+}
+
+// Append to a string. Only _TRUNCATE is supported for the count.
+//
+// p_destination:		(output) The string that's appended to.
+// destination_size:	The size of the destination buffer.
+// p_source:			The string to append.
+// count:				_TRUNCATE.
+//
+// returns: 0 if successful, ERANGE if the string was truncated.
+//
+static inline errno_t strncat_s(char* p_destination, size_t destination_size, char const* p_source, size_t count)
+{
+	(void)count;
+
+	size_t const length = strlen(p_destination);
+	if (length >= destination_size) {
+
+		return EINVAL;
+	}
+
+	size_t const source_length = strlen(p_source);
+	size_t const copy_length = (source_length < destination_size - length - 1) ? source_length : destination_size - length - 1;
+	memcpy(p_destination + length, p_source, copy_length);
+	p_destination[ length + copy_length ] = '\0';
+
+	return (copy_length < source_length) ? ERANGE : 0;
+}
+
+#endif // #if !defined(_WIN32)
+
+#endif // __PORTABLE_H
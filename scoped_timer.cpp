@@ -11,5 +11,9 @@
 //
 // --------------------
 
+#if defined(_WIN32)
+
 // Allocate the static member.
 LARGE_INTEGER scoped_timer::m_frequency;
+
+#endif // #if defined(_WIN32)
@@ -8,7 +8,12 @@
 #ifndef __SCOPED_TIMER_H
 #define __SCOPED_TIMER_H
 
-#include <windows.h>
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif // #if defined(_WIN32)
+
 #include <stdio.h>
 
 // --------------------
@@ -32,32 +37,58 @@ struct scoped_timer {
 	// Initialize the scoped_timer system.
 	static void initialize()
 	{			
+	#if defined(_WIN32)
 		QueryPerformanceFrequency(&m_frequency);
+	#endif // #if defined(_WIN32)
 	}
 
 	// Constructor.
 	scoped_timer(char const* p_label)
 		: m_label(p_label)
 	{ 
-		QueryPerformanceCounter(&m_start);
+		m_start = get_time();
 	}
 
 	// Destructor.
 	~scoped_timer()
 	{
-		LARGE_INTEGER end;
-		QueryPerformanceCounter(&end);
-
-		double elapsed_time = (end.QuadPart - m_start.QuadPart) / static_cast< double >(m_frequency.QuadPart);
+		double elapsed_time = get_time() - m_start;
 
 		printf("%s : %.3f seconds\n", m_label, elapsed_time);
 	}
 
+	// Get the current time.
+	//
+	// returns: The current time in seconds.
+	//
+	static double get_time()
+	{
+	#if defined(_WIN32)
+
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+
+		return counter.QuadPart / static_cast< double >(m_frequency.QuadPart);
+
+	#else
+
+		timespec counter;
+		clock_gettime(CLOCK_MONOTONIC, &counter);
+
+		return counter.tv_sec + counter.tv_nsec * 1.0e-9;
+
+	#endif // #if defined(_WIN32)
+	}
+
+#if defined(_WIN32)
+
 	// The frequency of the timer.
 	static LARGE_INTEGER m_frequency;
 
-	// The starting time.
-	LARGE_INTEGER m_start;
+#endif // #if defined(_WIN32)
+
+	// The starting time in seconds.
+	double m_start;
 
 	// The label for the timed scope.
 	char const* m_label;		
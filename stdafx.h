@@ -10,10 +10,13 @@
 
 #pragma once
 
-#include "targetver.h"
+#if defined(_WIN32)
+	#include "targetver.h"
+#endif // #if defined(_WIN32)
 
 #include <stdio.h>
-#include <tchar.h>
+
+#include "portable.h"
 
 
 
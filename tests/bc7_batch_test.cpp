@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// Compresses textures of different sizes as a batch and checks that each one comes back exactly as
+// it does when it's compressed on its own.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "bc7_batch.h"
+#include "bc7_encoder_context.h"
+#include "bc7_test.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The number of textures in the batch.
+#define BC7_BATCH_TEST_NUM_JOBS	6
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Compress the batch and check each texture against the texture compressed on its own.
+//
+// p_context:	The encoder context.
+//
+// returns: True if the test passed.
+//
+static bool bc7_batch_test_jobs(bc7_encoder_context* p_context)
+{
+	// The textures are wider and narrower than the packed image, one is empty and the last row of the
+	// packed image isn't full.
+	size_t const sizes[ BC7_BATCH_TEST_NUM_JOBS ][2] = {
+		{ 64, 64 }, { 4, 4 }, { 1032, 8 }, { 0, 0 }, { 128, 36 }, { 256, 256 }
+	};
+
+	bc7_encode_params params;
+	bc7_get_encode_params(&params, BC7_ENCODE_PRESET_ULTRAFAST);
+
+	std::vector< uint8_t > images[ BC7_BATCH_TEST_NUM_JOBS ];
+	std::vector< bc7_compressed_block > batched[ BC7_BATCH_TEST_NUM_JOBS ];
+	bc7_batch_job jobs[ BC7_BATCH_TEST_NUM_JOBS ];
+	for (size_t job_iter = 0; job_iter < BC7_BATCH_TEST_NUM_JOBS; job_iter++) {
+
+		size_t const width = sizes[ job_iter ][0];
+		size_t const height = sizes[ job_iter ][1];
+		images[ job_iter ] = bc7_test_make_image(width, height, static_cast< uint32_t >(job_iter));
+		batched[ job_iter ].resize((width / 4) * (height / 4) + 1);
+
+		jobs[ job_iter ].m_p_source = images[ job_iter ].empty() ? NULL : &images[ job_iter ][0];
+		jobs[ job_iter ].m_width = width;
+		jobs[ job_iter ].m_height = height;
+		jobs[ job_iter ].m_p_destination = &batched[ job_iter ][0];
+
+	} // end for
+
+	BC7_TEST_CHECK(bc7_batch_compress(bc7_encoder_context_compress_source, p_context, jobs, BC7_BATCH_TEST_NUM_JOBS, &params));
+
+	for (size_t job_iter = 0; job_iter < BC7_BATCH_TEST_NUM_JOBS; job_iter++) {
+
+		size_t const num_blocks = batched[ job_iter ].size() - 1;
+		if (num_blocks == 0) {
+
+			continue;
+		}
+
+		std::vector< bc7_compressed_block > single(num_blocks);
+		BC7_TEST_CHECK(bc7_encoder_context_compress(p_context, &single[0], &images[ job_iter ][0], jobs[ job_iter ].m_width,
+																  jobs[ job_iter ].m_height, &params));
+		BC7_TEST_CHECK(memcmp(&batched[ job_iter ][0], &single[0], num_blocks * sizeof(bc7_compressed_block)) == 0);
+
+	} // end for
+
+	// The padding at the end of the packed image mustn't be copied past the end of any texture.
+	bc7_compressed_block const zero_block = {};
+	for (size_t job_iter = 0; job_iter < BC7_BATCH_TEST_NUM_JOBS; job_iter++) {
+
+		BC7_TEST_CHECK(memcmp(&batched[ job_iter ].back(), &zero_block, sizeof(bc7_compressed_block)) == 0);
+
+	} // end for
+
+	return true;
+}
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+int main()
+{
+	bc7_encoder_context* p_context = bc7_encoder_context_create();
+	if (p_context == NULL) {
+
+		printf("Failed to create the encoder context!\n");
+		return 1;
+	}
+
+	bool const passed = bc7_batch_test_jobs(p_context);
+
+	bc7_encoder_context_destroy(p_context);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// Checks the fused multiply-add that SSE2 and SSE4.1 do in double precision against fmaf(). The
+// sums are made to land halfway between two floats, where rounding the double sum to float on its
+// own gives the wrong answer, and on exact sums that look halfway.
+
+#if defined(__GNUC__)
+	#pragma GCC target("sse4.1")
+	#pragma GCC optimize("fp-contract=off")
+#endif // #if defined(__GNUC__)
+
+#include <math.h>
+#include <stdio.h>
+
+#include "bc7_test.h"
+#include "cpu_features.h"
+#include "CPU/bc7_cpu_lanes_sse2.h"
+#include "CPU/bc7_cpu_lanes_sse41.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// The number of times 4 lanes are checked.
+#define BC7_CPU_FMA_TEST_ITERATIONS	250000
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Get the next random number.
+//
+// p_random:	(input/output) The state.
+//
+// returns: The random number.
+//
+static uint32_t bc7_cpu_fma_test_random(uint32_t* p_random)
+{
+	*p_random = *p_random * 1664525u + 1013904223u;
+	return *p_random >> 8;
+}
+
+// Make the operands of a multiply-add. The product of an odd 13-bit and an odd 12-bit number has
+// 24 or 25 bits, with 25 it's halfway between two floats. Adding a float that is too small to show
+// up in the double sum makes it round the wrong way, adding 0 or a float that lines up with the
+// product makes an exact sum.
+//
+// p_random:	(input/output) The random number state.
+// p_a:			(output) The first factor.
+// p_b:			(output) The second factor.
+// p_c:			(output) What's added to the product.
+//
+static void bc7_cpu_fma_test_operands(uint32_t* p_random, float* p_a, float* p_b, float* p_c)
+{
+	uint32_t const kind = bc7_cpu_fma_test_random(p_random) & 3;
+	float const sign = (bc7_cpu_fma_test_random(p_random) & 1) ? 1.0f : -1.0f;
+
+	*p_a = sign * ldexpf(static_cast< float >((bc7_cpu_fma_test_random(p_random) & 0xfff) | 0x1001),
+								static_cast< int >(bc7_cpu_fma_test_random(p_random) % 40) - 20);
+	*p_b = ldexpf(static_cast< float >((bc7_cpu_fma_test_random(p_random) & 0x7ff) | 0x801),
+					  static_cast< int >(bc7_cpu_fma_test_random(p_random) % 40) - 20);
+
+	int exponent;
+	frexp(static_cast< double >(*p_a) * *p_b, &exponent);
+
+	float const c_sign = (bc7_cpu_fma_test_random(p_random) & 1) ? 1.0f : -1.0f;
+	float const c_mantissa = static_cast< float >(bc7_cpu_fma_test_random(p_random) & 0xffffff);
+	if (kind == 0) {
+
+		*p_c = 0.0f;
+
+	} else if (kind == 1) {
+
+		*p_c = c_sign * ldexpf(c_mantissa, exponent - 48);
+
+	} else {
+
+		*p_c = c_sign * ldexpf(c_mantissa, exponent - 54 - static_cast< int >(bc7_cpu_fma_test_random(p_random) % 40));
+	}
+}
+
+// Check the SSE2 version.
+//
+// returns: True if the test passed.
+//
+static bool bc7_cpu_fma_test_sse2()
+{
+	uint32_t random = 1;
+	for (uint32_t iter = 0; iter < BC7_CPU_FMA_TEST_ITERATIONS; iter++) {
+
+		float a[4], b[4], c[4];
+		for (uint32_t lane_iter = 0; lane_iter < 4; lane_iter++) {
+
+			bc7_cpu_fma_test_operands(&random, &a[ lane_iter ], &b[ lane_iter ], &c[ lane_iter ]);
+		}
+
+		float result[4];
+		bc7_cpu::sse2::lane_float const fused = bc7_cpu::sse2::lane_fma(bc7_cpu::sse2::lane_float(_mm_loadu_ps(a)),
+																							 bc7_cpu::sse2::lane_float(_mm_loadu_ps(b)),
+																							 bc7_cpu::sse2::lane_float(_mm_loadu_ps(c)));
+		_mm_storeu_ps(result, fused.m_value);
+
+		for (uint32_t lane_iter = 0; lane_iter < 4; lane_iter++) {
+
+			BC7_TEST_CHECK(result[ lane_iter ] == fmaf(a[ lane_iter ], b[ lane_iter ], c[ lane_iter ]));
+		}
+
+	} // end for
+
+	return true;
+}
+
+// Check the SSE4.1 version.
+//
+// returns: True if the test passed.
+//
+static bool bc7_cpu_fma_test_sse41()
+{
+	uint32_t random = 2;
+	for (uint32_t iter = 0; iter < BC7_CPU_FMA_TEST_ITERATIONS; iter++) {
+
+		float a[4], b[4], c[4];
+		for (uint32_t lane_iter = 0; lane_iter < 4; lane_iter++) {
+
+			bc7_cpu_fma_test_operands(&random, &a[ lane_iter ], &b[ lane_iter ], &c[ lane_iter ]);
+		}
+
+		float result[4];
+		bc7_cpu::sse41::lane_float const fused = bc7_cpu::sse41::lane_fma(bc7_cpu::sse41::lane_float(_mm_loadu_ps(a)),
+																							  bc7_cpu::sse41::lane_float(_mm_loadu_ps(b)),
+																							  bc7_cpu::sse41::lane_float(_mm_loadu_ps(c)));
+		_mm_storeu_ps(result, fused.m_value);
+
+		for (uint32_t lane_iter = 0; lane_iter < 4; lane_iter++) {
+
+			BC7_TEST_CHECK(result[ lane_iter ] == fmaf(a[ lane_iter ], b[ lane_iter ], c[ lane_iter ]));
+		}
+
+	} // end for
+
+	return true;
+}
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+int main()
+{
+	bool passed = bc7_cpu_fma_test_sse2();
+
+	// SSE4.1 is only checked where the CPU has it.
+	if (cpu_get_instruction_set() >= CPU_INSTRUCTION_SET_SSE41) {
+
+		passed &= bc7_cpu_fma_test_sse41();
+	}
+
+	return passed ? 0 : 1;
+}
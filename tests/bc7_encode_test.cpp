@@ -0,0 +1,166 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// Compresses a test image with every preset and checks that it decompresses to something close to
+// the original, and that each preset is at least as good as the one before it. Also checks that
+// solid blocks stay out of mode 5 when it isn't enabled.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "bc7_decompress.h"
+#include "bc7_encoder_context.h"
+#include "bc7_test.h"
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Compress the test image with a preset and check the error.
+//
+// p_context:	The encoder context.
+// preset:		The preset.
+// p_mse:		(output) The mean-squared error.
+//
+// returns: True if the test passed.
+//
+static bool bc7_encode_test_preset(bc7_encoder_context* p_context, bc7_encode_preset preset, double* p_mse)
+{
+	size_t const width = 64;
+	size_t const height = 48;
+	std::vector< uint8_t > const image = bc7_test_make_image(width, height, 1);
+
+	bc7_encode_params params;
+	bc7_get_encode_params(&params, preset);
+
+	std::vector< bc7_compressed_block > blocks((width / 4) * (height / 4));
+	BC7_TEST_CHECK(bc7_encoder_context_compress(p_context, &blocks[0], &image[0], width, height, &params));
+
+	std::vector< uint8_t > decompressed(width * height * 4);
+	BC7_TEST_CHECK(bc7_decompress(&decompressed[0], &blocks[0], width, height));
+
+	// Solid blocks are exact, the rest are lossy.
+	for (size_t y = 0; y < height; y++) {
+
+		for (size_t x = 0; x < width; x++) {
+
+			if (((x / 4) + (y / 4) * 3) % 5 == 0) {
+
+				BC7_TEST_CHECK(memcmp(&image[ (y * width + x) * 4 ], &decompressed[ (y * width + x) * 4 ], 4) == 0);
+			}
+
+		} // end for
+
+	} // end for
+
+	*p_mse = bc7_test_get_mse(&image[0], &decompressed[0], width, height);
+	printf("%s: MSE %f\n", bc7_get_encode_preset_name(preset), *p_mse);
+	BC7_TEST_CHECK(*p_mse < 16.0);
+
+	return true;
+}
+
+// Compress a solid image with and without mode 5, which solid blocks are normally encoded in, and
+// check the modes the blocks end up in.
+//
+// p_context:	The encoder context.
+//
+// returns: True if the test passed.
+//
+static bool bc7_encode_test_solid_mode_mask(bc7_encoder_context* p_context)
+{
+	size_t const width = 16;
+	size_t const height = 16;
+	size_t const num_blocks = (width / 4) * (height / 4);
+
+	std::vector< uint8_t > image(width * height * 4);
+	for (size_t pixel_iter = 0; pixel_iter < width * height; pixel_iter++) {
+
+		image[ pixel_iter * 4 + 0 ] = 13;
+		image[ pixel_iter * 4 + 1 ] = 130;
+		image[ pixel_iter * 4 + 2 ] = 201;
+		image[ pixel_iter * 4 + 3 ] = 77;
+
+	} // end for
+
+	bc7_encode_params params;
+	bc7_get_encode_params(&params, BC7_ENCODE_PRESET_ULTRAFAST);
+
+	for (uint32_t mask_iter = 0; mask_iter < 2; mask_iter++) {
+
+		bool const is_mode_5_enabled = (mask_iter == 0);
+		if (!is_mode_5_enabled) {
+
+			params.m_mode_mask &= ~(1 << 5);
+		}
+
+		std::vector< bc7_compressed_block > blocks(num_blocks);
+		BC7_TEST_CHECK(bc7_encoder_context_compress(p_context, &blocks[0], &image[0], width, height, &params));
+
+		// The mode is the number of zero bits before the first bit that is set.
+		for (size_t block_iter = 0; block_iter < num_blocks; block_iter++) {
+
+			bool const is_mode_5 = ((blocks[ block_iter ].m_data[0] & 0x3f) == 0x20);
+			BC7_TEST_CHECK(is_mode_5 == is_mode_5_enabled);
+
+		} // end for
+
+		std::vector< uint8_t > decompressed(width * height * 4);
+		BC7_TEST_CHECK(bc7_decompress(&decompressed[0], &blocks[0], width, height));
+
+		double const mse = bc7_test_get_mse(&image[0], &decompressed[0], width, height);
+		BC7_TEST_CHECK(is_mode_5_enabled ? (mse == 0.0) : (mse < 4.0));
+
+	} // end for
+
+	return true;
+}
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+int main()
+{
+	bc7_encoder_context* p_context = bc7_encoder_context_create();
+	if (p_context == NULL) {
+
+		printf("Failed to create the encoder context!\n");
+		return 1;
+	}
+
+	bool passed = true;
+	double mses[ BC7_ENCODE_PRESET_COUNT ] = {};
+	for (uint32_t preset_iter = 0; preset_iter < BC7_ENCODE_PRESET_COUNT; preset_iter++) {
+
+		passed &= bc7_encode_test_preset(p_context, static_cast< bc7_encode_preset >(preset_iter), &mses[ preset_iter ]);
+
+		if ((preset_iter > 0) && (mses[ preset_iter ] > mses[ preset_iter - 1 ])) {
+
+			printf("%s has a higher error than %s!\n", bc7_get_encode_preset_name(static_cast< bc7_encode_preset >(preset_iter)),
+					 bc7_get_encode_preset_name(static_cast< bc7_encode_preset >(preset_iter - 1)));
+			passed = false;
+		}
+
+	} // end for
+
+	// Exhaustive searches more than slow does, it has to find something better.
+	if (!(mses[ BC7_ENCODE_PRESET_EXHAUSTIVE ] < mses[ BC7_ENCODE_PRESET_SLOW ])) {
+
+		printf("exhaustive isn't better than slow!\n");
+		passed = false;
+	}
+
+	passed &= bc7_encode_test_solid_mode_mask(p_context);
+
+	bc7_encoder_context_destroy(p_context);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// Compresses an image that is split in to a lot of chunks with the OpenCL version and checks that
+// the chunks come back in the right place, by compressing each band of block rows on its own and
+// comparing, and checks that mip levels filtered in OpenCL match the ones filtered on the CPU. Run it
+// against a CPU OpenCL runtime when there isn't a GPU, it's skipped if there's no OpenCL platform at
+// all.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <CL/opencl.h>
+
+#include "bc7_test.h"
+#include "OpenCL/bc7_opencl.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// What CTest takes as a skipped test.
+#define BC7_OPENCL_TEST_SKIPPED	77
+
+// The first chunk on each of the 3 queues is 16K blocks, that's 128 block rows at this width. The
+// last quarter of the image is split in to a lot of small chunks once the kernel has been timed.
+#define BC7_OPENCL_TEST_WIDTH		512
+#define BC7_OPENCL_TEST_HEIGHT	2048
+
+// The block rows in each band that is compressed on its own, a band is always a single chunk.
+#define BC7_OPENCL_TEST_BAND_ROWS	8
+
+// The number of level sizes the filters are checked with.
+#define BC7_OPENCL_TEST_NUM_LEVELS	6
+
+// How far a filtered value can be from the CPU one, the kernel adds up the taps in a different order.
+#define BC7_OPENCL_TEST_MAX_FILTER_ERROR	1.0e-4f
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Compress the test image in chunks and check it against the bands compressed on their own, then
+// compress it again to check that the buffers and events that are kept between textures work.
+//
+// p_context:	The context.
+//
+// returns: True if the test passed.
+//
+static bool bc7_opencl_test_chunks(bc7_opencl_context* p_context)
+{
+	size_t const width = BC7_OPENCL_TEST_WIDTH;
+	size_t const height = BC7_OPENCL_TEST_HEIGHT;
+	size_t const width_in_blocks = width / 4;
+	size_t const height_in_blocks = height / 4;
+	std::vector< uint8_t > const image = bc7_test_make_image(width, height, 3);
+
+	bc7_encode_params params;
+	bc7_get_encode_params(&params, BC7_ENCODE_PRESET_ULTRAFAST);
+
+	// The shortest dispatch latency shrinks the chunks as soon as the first kernel is timed.
+	bc7_opencl_set_dispatch_latency(1);
+
+	std::vector< bc7_compressed_block > chunked(width_in_blocks * height_in_blocks);
+	BC7_TEST_CHECK(bc7_opencl_context_compress(p_context, &chunked[0], &image[0], width, height, &params));
+
+	std::vector< bc7_compressed_block > bands(chunked.size());
+	for (size_t block_row = 0; block_row < height_in_blocks; block_row += BC7_OPENCL_TEST_BAND_ROWS) {
+
+		size_t const first_block = block_row * width_in_blocks;
+		BC7_TEST_CHECK(bc7_opencl_context_compress(p_context, &bands[ first_block ], &image[ first_block * 64 ],
+																 width, BC7_OPENCL_TEST_BAND_ROWS * 4, &params));
+
+	} // end for
+
+	BC7_TEST_CHECK(memcmp(&chunked[0], &bands[0], chunked.size() * sizeof(bc7_compressed_block)) == 0);
+
+	std::vector< bc7_compressed_block > again(chunked.size());
+	BC7_TEST_CHECK(bc7_opencl_context_compress(p_context, &again[0], &image[0], width, height, &params));
+	BC7_TEST_CHECK(memcmp(&chunked[0], &again[0], chunked.size() * sizeof(bc7_compressed_block)) == 0);
+
+	return true;
+}
+
+// Filter levels of different sizes with both filters and check them against bc7_mip_downsample().
+//
+// p_context:	The context.
+//
+// returns: True if the test passed.
+//
+static bool bc7_opencl_test_downsample(bc7_opencl_context* p_context)
+{
+	// Source and destination sizes, halving odd sizes, a level that's a single row or column and one
+	// that isn't a multiple of the 8x8 work groups.
+	size_t const sizes[ BC7_OPENCL_TEST_NUM_LEVELS ][4] = {
+		{ 64, 48, 32, 24 }, { 37, 13, 18, 6 }, { 5, 3, 2, 1 }, { 1, 7, 1, 3 }, { 8, 1, 4, 1 }, { 300, 202, 150, 101 }
+	};
+
+	for (uint32_t filter_iter = 0; filter_iter < BC7_MIP_FILTER_COUNT; filter_iter++) {
+
+		bc7_mip_filter const filter = static_cast< bc7_mip_filter >(filter_iter);
+		for (size_t size_iter = 0; size_iter < BC7_OPENCL_TEST_NUM_LEVELS; size_iter++) {
+
+			size_t const source_width = sizes[ size_iter ][0];
+			size_t const source_height = sizes[ size_iter ][1];
+			size_t const destination_width = sizes[ size_iter ][2];
+			size_t const destination_height = sizes[ size_iter ][3];
+
+			std::vector< uint8_t > const image = bc7_test_make_image(source_width, source_height, static_cast< uint32_t >(size_iter));
+			std::vector< float > source(image.size());
+			for (size_t value_iter = 0; value_iter < image.size(); value_iter++) {
+
+				source[ value_iter ] = image[ value_iter ] / 255.0f;
+
+			} // end for
+
+			std::vector< float > expected(destination_width * destination_height * 4);
+			BC7_TEST_CHECK(bc7_mip_downsample(&expected[0], destination_width, destination_height,
+														 &source[0], source_width, source_height, filter));
+
+			std::vector< float > filtered(expected.size());
+			BC7_TEST_CHECK(bc7_opencl_context_downsample(p_context, &filtered[0], destination_width, destination_height,
+																		&source[0], source_width, source_height, filter));
+
+			float max_error = 0.0f;
+			for (size_t value_iter = 0; value_iter < expected.size(); value_iter++) {
+
+				float const error = fabsf(filtered[ value_iter ] - expected[ value_iter ]);
+				max_error = (error > max_error) ? error : max_error;
+
+			} // end for
+
+			printf("%s %llux%llu to %llux%llu: max error %g\n", (filter == BC7_MIP_FILTER_BOX) ? "box" : "kaiser",
+					 static_cast< unsigned long long >(source_width), static_cast< unsigned long long >(source_height),
+					 static_cast< unsigned long long >(destination_width), static_cast< unsigned long long >(destination_height),
+					 max_error);
+			BC7_TEST_CHECK(max_error <= BC7_OPENCL_TEST_MAX_FILTER_ERROR);
+
+		} // end for
+
+	} // end for
+
+	return true;
+}
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+int main()
+{
+	cl_uint num_platforms = 0;
+	if ((clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS)
+	||  (num_platforms == 0)) {
+
+		printf("There's no OpenCL platform, skipping.\n");
+		return BC7_OPENCL_TEST_SKIPPED;
+	}
+
+	bc7_opencl_context* p_context = bc7_opencl_context_create();
+	if (p_context == NULL) {
+
+		printf("Failed to create the OpenCL context!\n");
+		return 1;
+	}
+
+	bool passed = bc7_opencl_test_chunks(p_context);
+	passed &= bc7_opencl_test_downsample(p_context);
+
+	bc7_opencl_context_destroy(p_context);
+
+	return passed ? 0 : 1;
+}
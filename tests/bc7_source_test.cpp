@@ -0,0 +1,164 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+// Compresses a test image stored the way a TGA can be, 24-bit BGR or 32-bit BGRA from any corner, and
+// checks that it comes out exactly as the same image in 32-bit RGBA does. It's compressed straight
+// from the source and through the deduplication, with and without repeated blocks.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "bc7_block_dedup.h"
+#include "bc7_encoder_context.h"
+#include "bc7_test.h"
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// Big enough for several tiles and chunks, and not a multiple of the tile size.
+#define BC7_SOURCE_TEST_WIDTH		72
+#define BC7_SOURCE_TEST_HEIGHT	44
+
+// --------------------
+//
+// Internal Functions
+//
+// --------------------
+
+// Store a 32-bit RGBA image the way a TGA with a given origin and format stores it.
+//
+// stored:		(output) The stored pixels.
+// image:		The 32-bit RGBA image.
+// width:		Width of the image in pixels.
+// height:		Height of the image in pixels.
+// has_alpha:	True for 32-bit BGRA, false for 24-bit BGR.
+// origin:		The corner of the first pixel, 0 is the bottom left, 1 the bottom right, 2 the top left
+//					and 3 the top right.
+//
+static void bc7_source_test_store(std::vector< uint8_t >& stored, std::vector< uint8_t > const& image, size_t width,
+											 size_t height, bool has_alpha, uint32_t origin)
+{
+	size_t const bytes_per_pixel = has_alpha ? 4 : 3;
+	stored.resize(width * height * bytes_per_pixel);
+
+	for (size_t y = 0; y < height; y++) {
+
+		size_t const stored_y = (origin & 0x2) ? y : (height - 1 - y);
+		for (size_t x = 0; x < width; x++) {
+
+			size_t const stored_x = (origin & 0x1) ? (width - 1 - x) : x;
+			uint8_t const* p_pixel = &image[ (y * width + x) * 4 ];
+			uint8_t* p_stored = &stored[ (stored_y * width + stored_x) * bytes_per_pixel ];
+
+			p_stored[0] = p_pixel[2];
+			p_stored[1] = p_pixel[1];
+			p_stored[2] = p_pixel[0];
+			if (has_alpha) {
+
+				p_stored[3] = p_pixel[3];
+			}
+
+		} // end for
+
+	} // end for
+}
+
+// Compress an image in every format and origin and check it against the image in 32-bit RGBA.
+//
+// p_context:	The encoder context.
+// image:		The 32-bit RGBA image, the 24-bit versions are checked against it with alpha at 255.
+//
+// returns: True if the test passed.
+//
+static bool bc7_source_test_image(bc7_encoder_context* p_context, std::vector< uint8_t > const& image)
+{
+	size_t const width = BC7_SOURCE_TEST_WIDTH;
+	size_t const height = BC7_SOURCE_TEST_HEIGHT;
+	size_t const num_blocks = (width / 4) * (height / 4);
+
+	bc7_encode_params params;
+	bc7_get_encode_params(&params, BC7_ENCODE_PRESET_ULTRAFAST);
+
+	for (uint32_t alpha_iter = 0; alpha_iter < 2; alpha_iter++) {
+
+		bool const has_alpha = (alpha_iter == 1);
+
+		std::vector< uint8_t > rgba = image;
+		for (size_t pixel_iter = 0; (has_alpha == false) && (pixel_iter < width * height); pixel_iter++) {
+
+			rgba[ pixel_iter * 4 + 3 ] = 255;
+
+		} // end for
+
+		std::vector< bc7_compressed_block > expected(num_blocks);
+		BC7_TEST_CHECK(bc7_encoder_context_compress(p_context, &expected[0], &rgba[0], width, height, &params));
+
+		for (uint32_t origin_iter = 0; origin_iter < 4; origin_iter++) {
+
+			std::vector< uint8_t > stored;
+			bc7_source_test_store(stored, rgba, width, height, has_alpha, origin_iter);
+
+			bc7_source source;
+			bc7_source_init(&source, &stored[0], width, height, width * (has_alpha ? 4 : 3),
+								 has_alpha ? BC7_PIXEL_FORMAT_BGRA8 : BC7_PIXEL_FORMAT_BGR8, (origin_iter & 0x2) == 0,
+								 (origin_iter & 0x1) != 0);
+
+			std::vector< bc7_compressed_block > blocks(num_blocks);
+			BC7_TEST_CHECK(bc7_encoder_context_compress_source(p_context, &blocks[0], &source, &params));
+			BC7_TEST_CHECK(memcmp(&blocks[0], &expected[0], num_blocks * sizeof(bc7_compressed_block)) == 0);
+
+			std::vector< bc7_compressed_block > deduplicated(num_blocks);
+			BC7_TEST_CHECK(bc7_dedup_compress_source(bc7_encoder_context_compress_source, p_context, &deduplicated[0],
+																  &source, &params));
+			BC7_TEST_CHECK(memcmp(&deduplicated[0], &expected[0], num_blocks * sizeof(bc7_compressed_block)) == 0);
+
+		} // end for
+
+	} // end for
+
+	return true;
+}
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+int main()
+{
+	bc7_encoder_context* p_context = bc7_encoder_context_create();
+	if (p_context == NULL) {
+
+		printf("Failed to create the encoder context!\n");
+		return 1;
+	}
+
+	size_t const width = BC7_SOURCE_TEST_WIDTH;
+	size_t const height = BC7_SOURCE_TEST_HEIGHT;
+
+	// The test image has repeated blocks, the noise image doesn't so it's passed to the compressor as is.
+	std::vector< uint8_t > const image = bc7_test_make_image(width, height, 1);
+
+	std::vector< uint8_t > noise(width * height * 4);
+	uint32_t random = 12345;
+	for (size_t value_iter = 0; value_iter < noise.size(); value_iter++) {
+
+		random = random * 1664525u + 1013904223u;
+		noise[ value_iter ] = static_cast< uint8_t >(random >> 24);
+
+	} // end for
+
+	bool passed = bc7_source_test_image(p_context, image);
+	passed &= bc7_source_test_image(p_context, noise);
+
+	bc7_encoder_context_destroy(p_context);
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2012 THQ Inc.
+// All rights reserved.
+//
+
+#pragma once		// Include this file only once
+
+#ifndef __BC7_TEST_H
+#define __BC7_TEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+// --------------------
+//
+// Defines/Macros
+//
+// --------------------
+
+// Fail the test that this is in if the condition is false.
+#define BC7_TEST_CHECK(condition)																		\
+	if (!(condition)) {																						\
+																												\
+		printf("%s(%d): Check failed: %s\n", __FILE__, __LINE__, #condition);				\
+		return false;																							\
+	}
+
+// --------------------
+//
+// Functions
+//
+// --------------------
+
+// Make a 32-bit RGBA test image. It has smooth gradients, noise, solid blocks, blocks that repeat
+// and varying alpha, so every kind of block the encoder handles differently is in it.
+//
+// width:	Width of the image in pixels.
+// height:	Height of the image in pixels.
+// seed:		Changes the noise.
+//
+// returns: The image.
+//
+static inline std::vector< uint8_t > bc7_test_make_image(size_t width, size_t height, uint32_t seed)
+{
+	std::vector< uint8_t > image(width * height * 4);
+
+	uint32_t random = seed * 2654435761u + 1;
+	for (size_t y = 0; y < height; y++) {
+
+		for (size_t x = 0; x < width; x++) {
+
+			random = random * 1664525u + 1013904223u;
+			uint32_t const noise = random >> 24;
+
+			uint8_t* p_pixel = &image[ (y * width + x) * 4 ];
+			size_t const block_x = x / 4;
+			size_t const block_y = y / 4;
+			switch ((block_x + block_y * 3) % 5) {
+
+				// Solid.
+				case 0:
+					p_pixel[0] = static_cast< uint8_t >(block_x * 37);
+					p_pixel[1] = static_cast< uint8_t >(block_y * 91);
+					p_pixel[2] = 200;
+					p_pixel[3] = 255;
+					break;
+
+				// The same block over and over.
+				case 1:
+					p_pixel[0] = static_cast< uint8_t >((x & 3) * 60 + (y & 3) * 5);
+					p_pixel[1] = static_cast< uint8_t >((x & 3) * 40 + 20);
+					p_pixel[2] = static_cast< uint8_t >(200 - (x & 3) * 50);
+					p_pixel[3] = 255;
+					break;
+
+				// Gradients with a little noise.
+				case 2:
+					p_pixel[0] = static_cast< uint8_t >(x * 255 / width);
+					p_pixel[1] = static_cast< uint8_t >(y * 255 / height);
+					p_pixel[2] = static_cast< uint8_t >((x + y) * 127 / (width + height) + (noise & 7));
+					p_pixel[3] = 255;
+					break;
+
+				// Gradients with alpha.
+				case 3:
+					p_pixel[0] = static_cast< uint8_t >(255 - x * 255 / width);
+					p_pixel[1] = static_cast< uint8_t >(noise & 0x3f);
+					p_pixel[2] = static_cast< uint8_t >(y * 255 / height);
+					p_pixel[3] = static_cast< uint8_t >((x & 3) * 85);
+					break;
+
+				// Noise on a color.
+				default:
+					p_pixel[0] = static_cast< uint8_t >(64 + (noise & 0x3f));
+					p_pixel[1] = static_cast< uint8_t >(128 + ((noise >> 2) & 0x1f));
+					p_pixel[2] = static_cast< uint8_t >(32 + ((noise * 13) & 0x3f));
+					p_pixel[3] = static_cast< uint8_t >(192 + (noise & 0x3f));
+					break;
+
+			} // end switch
+
+		} // end for
+
+	} // end for
+
+	return image;
+}
+
+// Get the mean-squared error of an image against the original, over all the channels.
+//
+// p_original:	The original 32-bit RGBA image.
+// p_image:		The image to compare.
+// width:		Width of the images in pixels.
+// height:		Height of the images in pixels.
+//
+// returns: The mean-squared error.
+//
+static inline double bc7_test_get_mse(uint8_t const* p_original, uint8_t const* p_image, size_t width, size_t height)
+{
+	double error = 0.0;
+	for (size_t channel_iter = 0; channel_iter < width * height * 4; channel_iter++) {
+
+		double const diff = static_cast< double >(p_original[ channel_iter ]) - static_cast< double >(p_image[ channel_iter ]);
+		error += diff * diff;
+
+	} // end for
+
+	return error / static_cast< double >(width * height * 4);
+}
+
+#endif // __BC7_TEST_H
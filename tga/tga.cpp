@@ -3,18 +3,36 @@
 // All rights reserved.
 //
 
-#include <malloc.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <vector>
+
+#include "cpu_features.h"
+#include "portable.h"
 #include "tga.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+
+	#define TGA_X86
+
+	#include <immintrin.h>
+
+#endif // #if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+
 // --------------------
 //
 // Defines/Macros
 //
 // --------------------
 
+// The number of pixels swizzled and written out at a time.
+#define TGA_WRITE_CHUNK_PIXELS (64 * 1024)
+
+// The most pixels a run-length packet can hold.
+#define TGA_RLE_MAX_PACKET_PIXELS 128
 
 // --------------------
 //
@@ -29,6 +47,8 @@
 //
 // --------------------
 
+// Turns 32-bit RGBA pixels in to the BGRA that TGAs store.
+typedef void (*tga_swizzle_function)(uint8_t* p_destination, uint8_t const* p_source, size_t num_pixels);
 
 // --------------------
 //
@@ -50,6 +70,313 @@
 //
 // --------------------
 
+// Check that a TGA is one that can be loaded.
+//
+// header:		The TGA header.
+// p_filename:	The filename of the TGA.
+//
+// returns: True if it's an uncompressed 24 or 32 bit true-color image.
+//
+static bool tga_check_header(tga_header const& header, char const* p_filename)
+{
+	if (header.m_image_type != 2) {
+
+		printf("Failed to load \"%s\". Only uncompressed true-color images are supported.\n", p_filename);
+		return false;
+	}
+
+	uint8_t const bits_per_pixel = header.get_bits_per_pixel();
+
+	if ((bits_per_pixel != 24) && (bits_per_pixel != 32)) {
+
+		printf("Failed to load \"%s\".Only 24 and 32 bit images are supported!\n", p_filename);
+		return false;
+	}
+
+	return true;
+}
+
+
+
+// Turn 32-bit RGBA pixels in to BGRA, a pixel at a time.
+//
+// p_destination:	(output) The BGRA pixels.
+// p_source:		The RGBA pixels.
+// num_pixels:		The number of pixels.
+//
+static void tga_swizzle_scalar(uint8_t* p_destination, uint8_t const* p_source, size_t num_pixels)
+{
+	for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
+
+		p_destination[0] = p_source[2];
+		p_destination[1] = p_source[1];
+		p_destination[2] = p_source[0];
+		p_destination[3] = p_source[3];
+
+		p_destination += 4;
+		p_source += 4;
+
+	} // end for
+}
+
+#if defined(TGA_X86)
+
+// Turn 32-bit RGBA pixels in to BGRA, 4 at a time. Green and alpha stay where they are and red
+// and blue trade places by shifting each pixel.
+//
+// p_destination:	(output) The BGRA pixels.
+// p_source:		The RGBA pixels.
+// num_pixels:		The number of pixels.
+//
+CPU_TARGET("sse2")
+static void tga_swizzle_sse2(uint8_t* p_destination, uint8_t const* p_source, size_t num_pixels)
+{
+	__m128i const green_alpha_mask = _mm_set1_epi32(static_cast< int >(0xff00ff00));
+
+	size_t pixel_iter = 0;
+	for (; pixel_iter + 4 <= num_pixels; pixel_iter += 4) {
+
+		__m128i const pixels = _mm_loadu_si128(reinterpret_cast< __m128i const* >(p_source + pixel_iter * 4));
+		__m128i const red_blue = _mm_andnot_si128(green_alpha_mask, pixels);
+		__m128i const swapped = _mm_or_si128(_mm_slli_epi32(red_blue, 16), _mm_srli_epi32(red_blue, 16));
+
+		_mm_storeu_si128(reinterpret_cast< __m128i* >(p_destination + pixel_iter * 4),
+							  _mm_or_si128(_mm_and_si128(pixels, green_alpha_mask), swapped));
+
+	} // end for
+
+	tga_swizzle_scalar(p_destination + pixel_iter * 4, p_source + pixel_iter * 4, num_pixels - pixel_iter);
+}
+
+// Turn 32-bit RGBA pixels in to BGRA, 8 at a time with a byte shuffle.
+//
+// p_destination:	(output) The BGRA pixels.
+// p_source:		The RGBA pixels.
+// num_pixels:		The number of pixels.
+//
+CPU_TARGET("avx2")
+static void tga_swizzle_avx2(uint8_t* p_destination, uint8_t const* p_source, size_t num_pixels)
+{
+	__m256i const shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+														  2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	size_t pixel_iter = 0;
+	for (; pixel_iter + 8 <= num_pixels; pixel_iter += 8) {
+
+		__m256i const pixels = _mm256_loadu_si256(reinterpret_cast< __m256i const* >(p_source + pixel_iter * 4));
+
+		_mm256_storeu_si256(reinterpret_cast< __m256i* >(p_destination + pixel_iter * 4),
+								  _mm256_shuffle_epi8(pixels, shuffle));
+
+	} // end for
+
+	tga_swizzle_scalar(p_destination + pixel_iter * 4, p_source + pixel_iter * 4, num_pixels - pixel_iter);
+}
+
+#endif // #if defined(TGA_X86)
+
+// Pick the version of the swizzle for this CPU.
+//
+// returns: The swizzle function.
+//
+static tga_swizzle_function tga_get_swizzle_function()
+{
+#if defined(TGA_X86)
+
+	switch (cpu_get_instruction_set()) {
+
+		case CPU_INSTRUCTION_SET_AVX512:
+		case CPU_INSTRUCTION_SET_AVX2:
+		{
+			return tga_swizzle_avx2;
+		}
+
+		case CPU_INSTRUCTION_SET_SSE41:
+		case CPU_INSTRUCTION_SET_SSE2:
+		{
+			return tga_swizzle_sse2;
+		}
+
+		default:
+		{
+			break;
+		}
+
+	} // end switch
+
+#endif // #if defined(TGA_X86)
+
+	return tga_swizzle_scalar;
+}
+
+// Check if two 32-bit pixels are the same.
+//
+// p_pixel_0:	The first pixel.
+// p_pixel_1:	The second pixel.
+//
+// returns: True if they match.
+//
+static bool tga_pixels_match(uint8_t const* p_pixel_0, uint8_t const* p_pixel_1)
+{
+	return memcmp(p_pixel_0, p_pixel_1, 4) == 0;
+}
+
+// Run-length encode a row of 32-bit pixels. Runs of 2 or more of the same pixel become run-length
+// packets and everything in between goes in to raw packets, no packet crosses the end of the row.
+//
+// p_destination:	(output) The packets, this needs room for the row plus a byte per 128 pixels.
+// p_row:			The pixels of the row.
+// width:			The number of pixels in the row.
+//
+// returns: The number of bytes written to p_destination.
+//
+static size_t tga_rle_encode_row(uint8_t* p_destination, uint8_t const* p_row, size_t width)
+{
+	uint8_t* p_packet = p_destination;
+
+	size_t x = 0;
+	while (x < width) {
+
+		uint8_t const* p_pixel = p_row + x * 4;
+
+		size_t run_length = 1;
+		while ((x + run_length < width) && (run_length < TGA_RLE_MAX_PACKET_PIXELS)
+			 && tga_pixels_match(p_pixel, p_pixel + run_length * 4)) {
+
+			run_length++;
+
+		} // end while
+
+		if (run_length >= 2) {
+
+			*p_packet++ = static_cast< uint8_t >(0x80 | (run_length - 1));
+			memcpy(p_packet, p_pixel, 4);
+			p_packet += 4;
+
+			x += run_length;
+			continue;
+		}
+
+		// Take pixels until the next run starts.
+		size_t raw_length = 1;
+		while ((x + raw_length < width) && (raw_length < TGA_RLE_MAX_PACKET_PIXELS)
+			 && (((x + raw_length + 1) < width)
+				  && tga_pixels_match(p_pixel + raw_length * 4, p_pixel + (raw_length + 1) * 4)) == false) {
+
+			raw_length++;
+
+		} // end while
+
+		*p_packet++ = static_cast< uint8_t >(raw_length - 1);
+		memcpy(p_packet, p_pixel, raw_length * 4);
+		p_packet += raw_length * 4;
+
+		x += raw_length;
+
+	} // end while
+
+	return p_packet - p_destination;
+}
+
+// Write out a TGA image. The pixels are swizzled in to a buffer a chunk of rows at a time and
+// each chunk goes out in one write.
+//
+// header:		The TGA header.
+// p_filename:	The filename of the TGA to write out.
+// p_data:		The 32-bit RGBA image data.
+// data_size:	The size of the image data in bytes.
+// rle:			True to run-length encode the image.
+//
+// returns: True if successful.
+//
+static bool tga_write_image(tga_header const& header, char const* p_filename,
+									 uint8_t const* p_data, size_t data_size, bool rle)
+{
+	if (data_size & 0x3) {
+
+		printf("Expecting 32 bits for the source image!\n");
+		return false;
+	}
+
+	if (header.get_bits_per_pixel() != 32) {
+
+		printf("Expecting 32 bits for the output image!\n");
+		return false;
+	}
+
+	size_t const width = header.get_width();
+	size_t const height = header.get_height();
+	if (data_size != width * height * 4) {
+
+		printf("The image data doesn't match the size in the header!\n");
+		return false;
+	}
+
+	FILE* p_outfile;
+	errno_t result = fopen_s(&p_outfile, p_filename, "wb");
+	if (result != 0) {
+
+		printf("Failed to open \"%s\"!\n", p_filename);
+		return false;
+	}
+
+	// The image ID isn't written out so the pixels follow the header.
+	tga_header output_header = header;
+	output_header.m_id_length = 0;
+	output_header.m_image_type = rle ? 10 : 2;
+
+	bool written = fwrite(&output_header, sizeof(output_header), 1, p_outfile) == 1;
+
+	// Write out the image data a chunk of whole rows at a time.
+	if (width > 0) {
+
+		tga_swizzle_function const swizzle = tga_get_swizzle_function();
+
+		size_t const rows_per_chunk = (width < TGA_WRITE_CHUNK_PIXELS) ? TGA_WRITE_CHUNK_PIXELS / width : 1;
+		size_t const row_size = width * 4;
+
+		std::vector< uint8_t > swizzled(rows_per_chunk * row_size);
+
+		std::vector< uint8_t > encoded;
+		if (rle) {
+
+			encoded.resize(rows_per_chunk * (row_size + (width + TGA_RLE_MAX_PACKET_PIXELS - 1) / TGA_RLE_MAX_PACKET_PIXELS));
+		}
+
+		for (size_t y = 0; written && (y < height); y += rows_per_chunk) {
+
+			size_t const num_rows = (height - y < rows_per_chunk) ? height - y : rows_per_chunk;
+
+			// TGAs are BGRA.
+			swizzle(&swizzled[0], p_data + y * row_size, num_rows * width);
+
+			if (rle) {
+
+				size_t encoded_size = 0;
+				for (size_t row_iter = 0; row_iter < num_rows; row_iter++) {
+
+					encoded_size += tga_rle_encode_row(&encoded[ encoded_size ], &swizzled[ row_iter * row_size ], width);
+
+				} // end for
+
+				written = fwrite(&encoded[0], encoded_size, 1, p_outfile) == 1;
+
+			} else {
+
+				written = fwrite(&swizzled[0], num_rows * row_size, 1, p_outfile) == 1;
+			}
+
+		} // end for
+	}
+
+	if ((fclose(p_outfile) != 0) || (written == false)) {
+
+		printf("Failed to write \"%s\"!\n", p_filename);
+		return false;
+	}
+
+	return true;
+}
 
 // --------------------
 //
@@ -57,14 +384,15 @@
 //
 // --------------------
 
-// Load a TGA image.
+// Open a TGA image and read its header, the file is left at the start of the image data so it can
+// be read a few rows at a time.
 //
 // header:		(output) The TGA header.
-// p_filename:	The filename of the TGA to load.
+// p_filename:	The filename of the TGA to open.
 //
-// returns: A pointer to the image buffer.
+// returns: The file or NULL if it isn't a TGA that can be loaded.
 //
-uint8_t* tga_load(tga_header& header, char const* p_filename)
+FILE* tga_open(tga_header& header, char const* p_filename)
 {
 	FILE* p_infile;
 	errno_t result = fopen_s(&p_infile, p_filename, "rb");
@@ -83,39 +411,63 @@ uint8_t* tga_load(tga_header& header, char const* p_filename)
 		return NULL;
 	}
 
-	if (header.m_image_type != 2) {
+	if (tga_check_header(header, p_filename) == false) {
 
-		printf("Failed to load \"%s\". Only uncompressed true-color images are supported.\n", p_filename);
+		fclose(p_infile);
+		return NULL;
+	}
+
+	// Skip the image ID.
+	if (fseek(p_infile, header.m_id_length, SEEK_CUR) != 0) {
+
+		printf("Failed to read the header for \"%s\"!\n", p_filename);
 
 		fclose(p_infile);
 		return NULL;
 	}
 
-	uint16_t const width = header.get_width();
-	uint16_t const height = header.get_height();
-	uint8_t const bits_per_pixel = header.get_bits_per_pixel();
+	return p_infile;
+}
 
-	if ((bits_per_pixel != 24) && (bits_per_pixel != 32)) {
+// Load a TGA image.
+//
+// header:		(output) The TGA header.
+// p_filename:	The filename of the TGA to load.
+//
+// returns: A pointer to the image buffer.
+//
+uint8_t* tga_load(tga_header& header, char const* p_filename)
+{
+	FILE* p_infile = tga_open(header, p_filename);
+	if (p_infile == NULL) {
 
-		printf("Failed to load \"%s\".Only 24 and 32 bit images are supported!\n", p_filename);
+		return NULL;
+	}
+
+	uint64_t const data_size = static_cast< uint64_t >(header.get_width()) * header.get_height() * (header.get_bits_per_pixel() / 8);
+	if (data_size != static_cast< size_t >(data_size)) {
+
+		printf("The image \"%s\" is too big to load!\n", p_filename);
 
 		fclose(p_infile);
 		return NULL;
 	}
 
-	size_t const data_size = width * height * bits_per_pixel / 8;
-	uint8_t* p_image_data = reinterpret_cast< uint8_t* >(malloc(data_size));
+	uint8_t* p_image_data = reinterpret_cast< uint8_t* >(malloc(static_cast< size_t >(data_size)));
 	if (p_image_data == NULL) {
 
-		printf("Failed to allocate %u bytes for the image \"%s\"!\n", data_size, p_filename);
+		printf("Failed to allocate %llu bytes for the image \"%s\"!\n", static_cast< unsigned long long >(data_size), p_filename);
+
+		fclose(p_infile);
 		return NULL;
 	}
 
-	num_read = fread(p_image_data, data_size, 1, p_infile);
+	size_t const num_read = fread(p_image_data, static_cast< size_t >(data_size), 1, p_infile);
 	if (num_read != 1) {
 
 		printf("Failed to read the image data \"%s\"!\n", p_filename);
 
+		free(p_image_data);
 		fclose(p_infile);
 		return NULL;
 	}
@@ -125,6 +477,59 @@ uint8_t* tga_load(tga_header& header, char const* p_filename)
 	return p_image_data;
 }
 
+// Map a TGA image in to memory instead of reading it so the pixels can be used where they are.
+//
+// header:		(output) The TGA header.
+// p_mapping:	(output) The mapping.
+// p_filename:	The filename of the TGA to map.
+//
+// returns: A pointer to the image data in the file or NULL if it isn't a TGA that can be loaded.
+//
+uint8_t const* tga_map(tga_header& header, tga_mapping* p_mapping, char const* p_filename)
+{
+	if (file_mapping_open_read(p_mapping, p_filename) == false) {
+
+		return NULL;
+	}
+
+	if (p_mapping->m_size < sizeof(header)) {
+
+		printf("Failed to read the header for \"%s\"!\n", p_filename);
+
+		tga_unmap(p_mapping);
+		return NULL;
+	}
+
+	memcpy(&header, p_mapping->m_p_data, sizeof(header));
+	if (tga_check_header(header, p_filename) == false) {
+
+		tga_unmap(p_mapping);
+		return NULL;
+	}
+
+	// The image data follows the header and the image ID.
+	uint64_t const data_offset = sizeof(header) + header.m_id_length;
+	uint64_t const data_size = static_cast< uint64_t >(header.get_width()) * header.get_height() * (header.get_bits_per_pixel() / 8);
+	if (data_offset + data_size > p_mapping->m_size) {
+
+		printf("Failed to read the image data \"%s\"!\n", p_filename);
+
+		tga_unmap(p_mapping);
+		return NULL;
+	}
+
+	return p_mapping->m_p_data + data_offset;
+}
+
+// Unmap a TGA image.
+//
+// p_mapping:	(input/output) The mapping.
+//
+void tga_unmap(tga_mapping* p_mapping)
+{
+	file_mapping_close(p_mapping);
+}
+
 // Free the TGA image.
 //
 // p_buffer: (input/output) A pointer to the buffer. This is set to NULL.
@@ -148,49 +553,23 @@ void tga_destroy(uint8_t** p_buffer)
 bool tga_write(tga_header const& header, char const* p_filename,
 					uint8_t const* p_data, size_t data_size)
 {
-	if (data_size & 0x3) {
-
-		printf("Expecting 32 bits for the source image!\n");
-		return false;
-	}
-
-	if (header.get_bits_per_pixel() != 32) {
-
-		printf("Expecting 32 bits for the output image!\n");
-		return false;
-	}
-
-	FILE* p_outfile;
-	errno_t result = fopen_s(&p_outfile, p_filename, "wb");
-	if (result != 0) {
-
-		printf("Failed to open \"%s\"!\n", p_filename);
-		return NULL;
-	}
-
-	// Write out the header.
-	fwrite(&header, sizeof(header), 1, p_outfile);
-
-	// Write out the image data.
-	size_t const num_pixels = data_size / 4;
-	for (size_t pixel_iter = 0; pixel_iter < num_pixels; pixel_iter++) {
-
-		uint8_t const red		= *p_data++;
-		uint8_t const green	= *p_data++;
-		uint8_t const blue	= *p_data++;
-		uint8_t const alpha	= *p_data++;
-
-		// TGAs are BGRA.
-		fwrite(&blue, sizeof(blue), 1, p_outfile);
-		fwrite(&green, sizeof(green), 1, p_outfile);
-		fwrite(&red, sizeof(red), 1, p_outfile);
-		fwrite(&alpha, sizeof(alpha), 1, p_outfile);
-
-	} // end for
-
-	fclose(p_outfile);
+	return tga_write_image(header, p_filename, p_data, data_size, false);
+}
 
-	return true;
+// Write out a run-length encoded TGA image.
+// Note: This expects a 32-bit RGBA source and 32-bit target.
+//
+// header:		The TGA header.
+// p_filename:	The filename of the TGA to write out.
+// p_data:		The 32-bit RGBA image data.
+// data_size:	The size of the image data in bytes.
+//
+// returns: True if successful.
+//
+bool tga_write_rle(tga_header const& header, char const* p_filename,
+						 uint8_t const* p_data, size_t data_size)
+{
+	return tga_write_image(header, p_filename, p_data, data_size, true);
 }
 
 // Get a pixel from the image.
@@ -8,6 +8,8 @@
 #ifndef __TGA_H
 #define __TGA_H
 
+#include "file_mapping.h"
+
 // --------------------
 //
 // Defines/Macros
@@ -76,12 +78,20 @@ struct tga_header {
 		return (descriptor >> 4) & 0x3;
 	}
 
+	void set_origin(uint8_t origin)
+	{
+		m_image_specification[9] = (m_image_specification[9] & ~0x30) | ((origin & 0x3) << 4);
+	}
+
 private:
 
 	uint8_t m_color_map_specification[5];
 	uint8_t m_image_specification[10];
 };
 
+// A TGA that is mapped in to memory.
+typedef file_mapping tga_mapping;
+
 // --------------------
 //
 // Variables
@@ -95,6 +105,16 @@ private:
 //
 // --------------------
 
+// Open a TGA image and read its header, the file is left at the start of the image data so it can
+// be read a few rows at a time.
+//
+// header:		(output) The TGA header.
+// p_filename:	The filename of the TGA to open.
+//
+// returns: The file or NULL if it isn't a TGA that can be loaded.
+//
+FILE* tga_open(tga_header& header, char const* p_filename);
+
 // Load a TGA image.
 //
 // header:		(output) The TGA header.
@@ -104,6 +124,22 @@ private:
 //
 uint8_t* tga_load(tga_header& header, char const* p_filename);
 
+// Map a TGA image in to memory instead of reading it so the pixels can be used where they are.
+//
+// header:		(output) The TGA header.
+// p_mapping:	(output) The mapping.
+// p_filename:	The filename of the TGA to map.
+//
+// returns: A pointer to the image data in the file or NULL if it isn't a TGA that can be loaded.
+//
+uint8_t const* tga_map(tga_header& header, tga_mapping* p_mapping, char const* p_filename);
+
+// Unmap a TGA image.
+//
+// p_mapping:	(input/output) The mapping.
+//
+void tga_unmap(tga_mapping* p_mapping);
+
 // Free the TGA image.
 //
 // p_buffer: (input/output) A pointer to the buffer. This is set to NULL.
@@ -123,6 +159,19 @@ void tga_destroy(uint8_t** p_buffer);
 bool tga_write(tga_header const& header, char const* p_filename,
 					uint8_t const* p_data, size_t data_size);
 
+// Write out a run-length encoded TGA image.
+// Note: This expects a 32-bit RGBA source and 32-bit target.
+//
+// header:		The TGA header.
+// p_filename:	The filename of the TGA to write out.
+// p_data:		The 32-bit RGBA image data.
+// data_size:	The size of the image data in bytes.
+//
+// returns: True if successful.
+//
+bool tga_write_rle(tga_header const& header, char const* p_filename,
+						 uint8_t const* p_data, size_t data_size);
+
 // Get a pixel from the image.
 //
 // red:				(output) The red channel.